@@ -25,6 +25,8 @@
 #include <gio/gfiledescriptorbased.h>
 #include <gio/gunixoutputstream.h>
 #include <glib-unix.h>
+#include <sys/file.h>
+#include <sys/ioctl.h>
 #include <sys/xattr.h>
 
 #include "ostree-core-private.h"
@@ -32,6 +34,11 @@
 #include "ostree-repo-private.h"
 #include "ostree-sepolicy-private.h"
 
+/* The standardized version of BTRFS_IOC_CLONE */
+#ifndef FICLONE
+#define FICLONE _IOW (0x94, 9, int)
+#endif
+
 #define WHITEOUT_PREFIX ".wh."
 #define OPAQUE_WHITEOUT_NAME ".wh..wh..opq"
 
@@ -43,12 +50,30 @@
 // on checkout.
 #define OSTREE_QUOTED_OVERLAYFS_WHITEOUT_PREFIX ".ostree-wh."
 
+/* Number of files of a directory handed to a worker thread at once */
+#define CHECKOUT_FILES_PER_JOB 64
+
+/* Shared state of a checkout using worker threads for files */
+typedef struct
+{
+  OstreeRepo *repo;
+  OstreeRepoCheckoutAtOptions *options;
+  GCancellable *cancellable;
+  GThreadPool *pool;
+  GMutex lock; /* protects error, the devino cache and pending file counts */
+  GCond cond;
+  gint failed; /* atomic */
+  GError *error;
+} CheckoutParallel;
+
 /* Per-checkout call state/caching */
 typedef struct
 {
   GString *path_buf;         /* buffer for real path if filtering enabled */
   GString *selabel_path_buf; /* buffer for selinux path if labeling enabled; this may be
                                 the same buffer as path_buf */
+  CheckoutParallel *parallel;   /* set if files are checked out by worker threads */
+  GHashTable *layered_dirtrees; /* generated dirtrees of a layered checkout */
 } CheckoutState;
 
 static void
@@ -61,6 +86,22 @@ checkout_state_clear (CheckoutState *state)
 }
 G_DEFINE_AUTO_CLEANUP_CLEAR_FUNC (CheckoutState, checkout_state_clear)
 
+static gboolean
+ensure_uncompressed_objects_dir (OstreeRepo *self, GCancellable *cancellable, GError **error)
+{
+  if (self->uncompressed_objects_dir_fd != -1)
+    return TRUE;
+
+  if (!glnx_shutil_mkdir_p_at (self->repo_dir_fd, "uncompressed-objects-cache",
+                               DEFAULT_DIRECTORY_MODE, cancellable, error))
+    return FALSE;
+  if (!glnx_opendirat (self->repo_dir_fd, "uncompressed-objects-cache", TRUE,
+                       &self->uncompressed_objects_dir_fd, error))
+    return FALSE;
+
+  return TRUE;
+}
+
 static gboolean
 checkout_object_for_uncompressed_cache (OstreeRepo *self, const char *loose_path,
                                         GFileInfo *src_info, GInputStream *content,
@@ -95,15 +136,8 @@ checkout_object_for_uncompressed_cache (OstreeRepo *self, const char *loose_path
   if (!glnx_fchmod (tmpf.fd, file_mode, error))
     return FALSE;
 
-  if (self->uncompressed_objects_dir_fd == -1)
-    {
-      if (!glnx_shutil_mkdir_p_at (self->repo_dir_fd, "uncompressed-objects-cache",
-                                   DEFAULT_DIRECTORY_MODE, cancellable, error))
-        return FALSE;
-      if (!glnx_opendirat (self->repo_dir_fd, "uncompressed-objects-cache", TRUE,
-                           &self->uncompressed_objects_dir_fd, error))
-        return FALSE;
-    }
+  if (!ensure_uncompressed_objects_dir (self, cancellable, error))
+    return FALSE;
 
   if (!_ostree_repo_ensure_loose_objdir_at (self->uncompressed_objects_dir_fd, loose_path,
                                             cancellable, error))
@@ -116,6 +150,401 @@ checkout_object_for_uncompressed_cache (OstreeRepo *self, const char *loose_path
   return TRUE;
 }
 
+/* When core.uncompressed-cache-max-size is set, we keep an index of the
+ * objects in the uncompressed cache.  Each entry records the object size,
+ * the last time a checkout used it, whether it was hardlinked into a
+ * checkout when we last looked, and when that was.  The index is persisted
+ * as a text file, oldest first, with one "checksum size atime linked checked"
+ * line per object; it's advisory, so entries for objects which are already
+ * gone are fine.
+ *
+ * Only objects which aren't hardlinked into a checkout count towards the
+ * budget, since evicting the others wouldn't free any space.  We work out
+ * the unused size from the index, and only stat the least recently used
+ * objects we are about to evict, plus a few of the linked ones to notice
+ * checkouts being deleted; ostree_repo_checkout_gc() rechecks all of them.
+ *
+ * Checkouts only collect the objects they used in memory, and merge those
+ * into the index file at the end with its lock held, so that concurrent
+ * checkouts don't lose each other's entries.  Checkouts without a maximum
+ * size add objects without indexing them, so they remove the index to have
+ * it rebuilt from the cache contents.
+ */
+#define UNCOMPRESSED_CACHE_INDEX "index"
+#define UNCOMPRESSED_CACHE_INDEX_LOCK "index.lock"
+/* How many linked objects to recheck after each checkout */
+#define UNCOMPRESSED_CACHE_RECHECK 64
+
+typedef struct
+{
+  char checksum[OSTREE_SHA256_STRING_LEN + 1];
+  guint64 size;
+  gint64 atime;    /* Microseconds since the epoch */
+  gboolean linked; /* Whether a checkout had it hardlinked at @checked */
+  gint64 checked;  /* Microseconds since the epoch */
+} UncompressedCacheEntry;
+
+static GHashTable *
+uncompressed_cache_index_new (void)
+{
+  return g_hash_table_new_full (g_str_hash, g_str_equal, NULL, g_free);
+}
+
+static UncompressedCacheEntry *
+uncompressed_cache_index_add (GHashTable *index, const char *checksum, guint64 size, gint64 atime)
+{
+  UncompressedCacheEntry *entry = g_hash_table_lookup (index, checksum);
+  if (entry == NULL)
+    {
+      entry = g_new0 (UncompressedCacheEntry, 1);
+      memcpy (entry->checksum, checksum, OSTREE_SHA256_STRING_LEN + 1);
+      entry->size = size;
+      g_hash_table_replace (index, entry->checksum, entry);
+    }
+  entry->atime = MAX (entry->atime, atime);
+  return entry;
+}
+
+static gboolean
+uncompressed_cache_index_load (int dfd, GHashTable *index, gboolean *out_found,
+                               GCancellable *cancellable, GError **error)
+{
+  glnx_autofd int fd = -1;
+  if (!ot_openat_ignore_enoent (dfd, UNCOMPRESSED_CACHE_INDEX, &fd, error))
+    return FALSE;
+  *out_found = (fd != -1);
+  if (fd == -1)
+    return TRUE;
+
+  g_autofree char *contents = glnx_fd_readall_utf8 (fd, NULL, cancellable, error);
+  if (!contents)
+    return glnx_prefix_error (error, "Reading uncompressed cache index");
+
+  g_auto (GStrv) lines = g_strsplit (contents, "\n", -1);
+  for (char **iter = lines; *iter; iter++)
+    {
+      g_auto (GStrv) fields = g_strsplit (*iter, " ", -1);
+      /* Skip anything we don't understand */
+      if (g_strv_length (fields) != 5 || !ostree_validate_checksum_string (fields[0], NULL))
+        continue;
+
+      UncompressedCacheEntry *entry
+          = uncompressed_cache_index_add (index, fields[0], g_ascii_strtoull (fields[1], NULL, 10),
+                                          g_ascii_strtoll (fields[2], NULL, 10));
+      entry->linked = g_ascii_strtoull (fields[3], NULL, 10) != 0;
+      entry->checked = g_ascii_strtoll (fields[4], NULL, 10);
+    }
+
+  return TRUE;
+}
+
+/* Build the index from the cache contents, if the cache predates setting a
+ * maximum size or was added to without one.
+ */
+static gboolean
+uncompressed_cache_index_scan (int dfd, GHashTable *index, GCancellable *cancellable,
+                               GError **error)
+{
+  const gint64 now = g_get_real_time ();
+
+  for (guint i = 0; i < 256; i++)
+    {
+      char objdir_name[3];
+      g_snprintf (objdir_name, sizeof (objdir_name), "%02x", i);
+      g_auto (GLnxDirFdIterator) dfd_iter = {
+        0,
+      };
+      gboolean exists;
+      if (!ot_dfd_iter_init_allow_noent (dfd, objdir_name, &dfd_iter, &exists, error))
+        return FALSE;
+      if (!exists)
+        continue;
+
+      while (TRUE)
+        {
+          struct dirent *dent;
+          struct stat stbuf;
+
+          if (!glnx_dirfd_iterator_next_dent (&dfd_iter, &dent, cancellable, error))
+            return FALSE;
+          if (dent == NULL)
+            break;
+
+          const char *dot = strrchr (dent->d_name, '.');
+          if (!dot || !g_str_equal (dot, ".file"))
+            continue;
+
+          g_autofree char *checksum
+              = g_strdup_printf ("%s%.*s", objdir_name, (int)(dot - dent->d_name), dent->d_name);
+          if (!ostree_validate_checksum_string (checksum, NULL))
+            continue;
+
+          if (!glnx_fstatat_allow_noent (dfd_iter.fd, dent->d_name, &stbuf, AT_SYMLINK_NOFOLLOW,
+                                         error))
+            return FALSE;
+          if (errno == ENOENT)
+            continue;
+
+          UncompressedCacheEntry *entry = uncompressed_cache_index_add (
+              index, checksum, stbuf.st_size,
+              stbuf.st_atim.tv_sec * G_USEC_PER_SEC + stbuf.st_atim.tv_nsec / 1000);
+          entry->linked = stbuf.st_nlink > 1;
+          entry->checked = now;
+        }
+    }
+
+  return TRUE;
+}
+
+/* Note that a checkout used @checksum from the uncompressed cache; @hit is
+ * FALSE if it first had to be added to the cache.
+ */
+static void
+uncompressed_cache_record (OstreeRepo *self, const char *checksum, guint64 size, gboolean hit)
+{
+  g_mutex_lock (&self->cache_lock);
+  if (hit)
+    self->uncompressed_cache_hits++;
+  else
+    self->uncompressed_cache_misses++;
+  if (self->uncompressed_cache_max_size > 0)
+    {
+      if (self->uncompressed_cache_pending == NULL)
+        self->uncompressed_cache_pending = uncompressed_cache_index_new ();
+      uncompressed_cache_index_add (self->uncompressed_cache_pending, checksum, size,
+                                    g_get_real_time ());
+    }
+  g_mutex_unlock (&self->cache_lock);
+}
+
+/* Update the size and link state of @entry, setting @out_exists to FALSE if
+ * the object is gone from the cache.
+ */
+static gboolean
+uncompressed_cache_entry_check (int dfd, UncompressedCacheEntry *entry, gint64 now,
+                                gboolean *out_exists, GError **error)
+{
+  char loose_path[_OSTREE_LOOSE_PATH_MAX];
+  struct stat stbuf;
+
+  _ostree_loose_path (loose_path, entry->checksum, OSTREE_OBJECT_TYPE_FILE, OSTREE_REPO_MODE_BARE);
+  if (!glnx_fstatat_allow_noent (dfd, loose_path, &stbuf, AT_SYMLINK_NOFOLLOW, error))
+    return FALSE;
+  *out_exists = (errno != ENOENT);
+  if (*out_exists)
+    {
+      entry->size = stbuf.st_size;
+      entry->linked = stbuf.st_nlink > 1;
+      entry->checked = now;
+    }
+  return TRUE;
+}
+
+static gint
+compare_uncompressed_cache_entries (gconstpointer a, gconstpointer b)
+{
+  const UncompressedCacheEntry *entry_a = *(UncompressedCacheEntry **)a;
+  const UncompressedCacheEntry *entry_b = *(UncompressedCacheEntry **)b;
+
+  if (entry_a->atime < entry_b->atime)
+    return -1;
+  else if (entry_a->atime > entry_b->atime)
+    return 1;
+  return strcmp (entry_a->checksum, entry_b->checksum);
+}
+
+static gint
+compare_uncompressed_cache_checks (gconstpointer a, gconstpointer b)
+{
+  const UncompressedCacheEntry *entry_a = *(UncompressedCacheEntry **)a;
+  const UncompressedCacheEntry *entry_b = *(UncompressedCacheEntry **)b;
+
+  if (entry_a->checked < entry_b->checked)
+    return -1;
+  else if (entry_a->checked > entry_b->checked)
+    return 1;
+  return compare_uncompressed_cache_entries (a, b);
+}
+
+/* Merge the objects used by checkouts into the index, and evict the least
+ * recently used objects until the ones which no checkout uses fit in
+ * core.uncompressed-cache-max-size.  If @recheck_all is set, the link state
+ * of all the objects a checkout had hardlinked is refreshed, otherwise only
+ * that of the UNCOMPRESSED_CACHE_RECHECK checked longest ago.
+ *
+ * The cache_lock is only held to take the pending objects and to update the
+ * counters; the index lock file serializes the rest.
+ */
+static gboolean
+uncompressed_cache_evict (OstreeRepo *self, gboolean recheck_all, GCancellable *cancellable,
+                          GError **error)
+{
+  g_autoptr (GHashTable) pending = NULL;
+  guint64 max_size;
+  int dfd;
+  int errsv = 0;
+
+  g_mutex_lock (&self->cache_lock);
+  if (self->uncompressed_objects_dir_fd == -1)
+    {
+      self->uncompressed_objects_dir_fd
+          = glnx_opendirat_with_errno (self->repo_dir_fd, "uncompressed-objects-cache", TRUE);
+      errsv = errno;
+    }
+  dfd = self->uncompressed_objects_dir_fd;
+  pending = g_steal_pointer (&self->uncompressed_cache_pending);
+  max_size = self->uncompressed_cache_max_size;
+  g_mutex_unlock (&self->cache_lock);
+
+  if (dfd < 0)
+    {
+      if (errsv != ENOENT)
+        {
+          errno = errsv;
+          return glnx_throw_errno_prefix (error, "opendir(uncompressed-objects-cache)");
+        }
+      return TRUE;
+    }
+
+  g_auto (GLnxLockFile) lock = {
+    0,
+  };
+  if (!glnx_make_lock_file (dfd, UNCOMPRESSED_CACHE_INDEX_LOCK, LOCK_EX, &lock, error))
+    return FALSE;
+
+  g_autoptr (GHashTable) index = uncompressed_cache_index_new ();
+  gboolean found;
+  if (!uncompressed_cache_index_load (dfd, index, &found, cancellable, error))
+    return FALSE;
+  if (!found && !uncompressed_cache_index_scan (dfd, index, cancellable, error))
+    return FALSE;
+  gboolean dirty = !found;
+
+  /* The checkouts hardlinked the objects they used */
+  const gint64 now = g_get_real_time ();
+  if (pending != NULL)
+    {
+      GLNX_HASH_TABLE_FOREACH_V (pending, UncompressedCacheEntry *, pending_entry)
+        {
+          UncompressedCacheEntry *entry = uncompressed_cache_index_add (
+              index, pending_entry->checksum, pending_entry->size, pending_entry->atime);
+          entry->linked = TRUE;
+          entry->checked = now;
+        }
+      dirty = dirty || g_hash_table_size (pending) > 0;
+    }
+
+  /* Notice objects whose checkouts have since been deleted */
+  g_autoptr (GPtrArray) linked = g_ptr_array_new ();
+  GLNX_HASH_TABLE_FOREACH_V (index, UncompressedCacheEntry *, entry)
+    {
+      if (entry->linked && entry->checked < now)
+        g_ptr_array_add (linked, entry);
+    }
+  g_ptr_array_sort (linked, compare_uncompressed_cache_checks);
+  for (guint i = 0; i < linked->len && (recheck_all || i < UNCOMPRESSED_CACHE_RECHECK); i++)
+    {
+      UncompressedCacheEntry *entry = linked->pdata[i];
+      gboolean exists;
+      if (!uncompressed_cache_entry_check (dfd, entry, now, &exists, error))
+        return FALSE;
+      if (!exists)
+        g_hash_table_remove (index, entry->checksum);
+      dirty = TRUE;
+    }
+
+  g_autoptr (GPtrArray) entries = g_ptr_array_sized_new (g_hash_table_size (index));
+  guint64 unused_size = 0;
+  GLNX_HASH_TABLE_FOREACH_V (index, UncompressedCacheEntry *, entry)
+    {
+      g_ptr_array_add (entries, entry);
+      if (!entry->linked)
+        unused_size += entry->size;
+    }
+  g_ptr_array_sort (entries, compare_uncompressed_cache_entries);
+
+  guint n_evicted = 0;
+  for (guint i = 0; i < entries->len && unused_size > max_size; i++)
+    {
+      UncompressedCacheEntry *entry = entries->pdata[i];
+      if (entry->linked)
+        continue;
+
+      /* Only stat the objects we're about to evict */
+      unused_size -= entry->size;
+      gboolean exists;
+      if (!uncompressed_cache_entry_check (dfd, entry, now, &exists, error))
+        return FALSE;
+      dirty = TRUE;
+      if (exists && entry->linked)
+        continue;
+
+      if (exists)
+        {
+          char loose_path[_OSTREE_LOOSE_PATH_MAX];
+
+          _ostree_loose_path (loose_path, entry->checksum, OSTREE_OBJECT_TYPE_FILE,
+                              OSTREE_REPO_MODE_BARE);
+          if (!ot_ensure_unlinked_at (dfd, loose_path, error))
+            return FALSE;
+          n_evicted++;
+        }
+      g_hash_table_remove (index, entry->checksum);
+      entries->pdata[i] = NULL;
+    }
+
+  if (n_evicted > 0)
+    g_debug ("Evicted %u objects from uncompressed cache, now %" G_GUINT64_FORMAT " unused bytes",
+             n_evicted, unused_size);
+
+  if (dirty)
+    {
+      g_autoptr (GString) buf = g_string_new ("");
+      for (guint i = 0; i < entries->len; i++)
+        {
+          UncompressedCacheEntry *entry = entries->pdata[i];
+          if (entry == NULL)
+            continue;
+          g_string_append_printf (buf,
+                                  "%s %" G_GUINT64_FORMAT " %" G_GINT64_FORMAT " %u %" G_GINT64_FORMAT
+                                  "\n",
+                                  entry->checksum, entry->size, entry->atime, entry->linked ? 1 : 0,
+                                  entry->checked);
+        }
+
+      /* The cache can always be regenerated, so don't bother syncing */
+      if (!glnx_file_replace_contents_at (dfd, UNCOMPRESSED_CACHE_INDEX, (guint8 *)buf->str,
+                                          buf->len, GLNX_FILE_REPLACE_NODATASYNC, cancellable,
+                                          error))
+        return glnx_prefix_error (error, "Writing uncompressed cache index");
+    }
+
+  g_mutex_lock (&self->cache_lock);
+  self->uncompressed_cache_evictions += n_evicted;
+  self->uncompressed_cache_size = unused_size;
+  g_mutex_unlock (&self->cache_lock);
+
+  return TRUE;
+}
+
+/* Checkouts without a maximum cache size don't index the objects they add
+ * to the cache, so remove any index for it to be rebuilt.
+ */
+static gboolean
+uncompressed_cache_index_invalidate (OstreeRepo *self, GError **error)
+{
+  g_mutex_lock (&self->cache_lock);
+  const int dfd = self->uncompressed_objects_dir_fd;
+  const gboolean updated = self->updated_uncompressed_dirs != NULL
+                           && g_hash_table_size (self->updated_uncompressed_dirs) > 0;
+  g_mutex_unlock (&self->cache_lock);
+
+  if (dfd == -1 || !updated)
+    return TRUE;
+
+  return ot_ensure_unlinked_at (dfd, UNCOMPRESSED_CACHE_INDEX, error);
+}
+
 static gboolean
 fsync_is_enabled (OstreeRepo *self, OstreeRepoCheckoutAtOptions *options)
 {
@@ -135,8 +564,15 @@ write_regular_file_content (OstreeRepo *self, OstreeRepoCheckoutAtOptions *optio
       int infd = g_file_descriptor_based_get_fd ((GFileDescriptorBased *)input);
       guint64 len = g_file_info_get_size (file_info);
 
-      if (glnx_regfile_copy_bytes (infd, outfd, (off_t)len) < 0)
+      /* Try to share the data with the object via a reflink first; this
+       * fails for e.g. a checkout onto a different filesystem, in which
+       * case we copy.
+       */
+      gboolean did_clone = (ioctl (outfd, FICLONE, infd) == 0);
+      if (!did_clone && glnx_regfile_copy_bytes (infd, outfd, (off_t)len) < 0)
         return glnx_throw_errno_prefix (error, "regfile copy");
+
+      g_atomic_int_inc (did_clone ? &self->checkout_files_cloned : &self->checkout_files_copied);
     }
   else
     {
@@ -146,6 +582,8 @@ write_regular_file_content (OstreeRepo *self, OstreeRepoCheckoutAtOptions *optio
 
       if (!g_output_stream_flush (outstream, cancellable, error))
         return FALSE;
+
+      g_atomic_int_inc (&self->checkout_files_copied);
     }
 
   if (mode != OSTREE_REPO_CHECKOUT_MODE_USER)
@@ -436,6 +874,123 @@ hardlink_add_tmp_name (OstreeRepo *self, int srcfd, const char *loose_path, char
   return TRUE;
 }
 
+/* Objects which are hardlinked into many checkouts can hit the
+ * filesystem's limit on links (65000 on ext4).  Rather than copying them
+ * from then on, we link to "link anchors": copies of the object kept in
+ * `link-anchors/` with the same layout as the object directory.
+ */
+#define LINK_ANCHORS_DIR "link-anchors"
+#define LINK_ANCHOR_MAX 64
+
+static gboolean
+ensure_link_anchors_dir (OstreeRepo *self, int *out_dfd, GError **error)
+{
+  g_autoptr (GMutexLocker) locker = g_mutex_locker_new (&self->cache_lock);
+
+  if (self->link_anchors_dir_fd == -1)
+    {
+      if (!glnx_shutil_mkdir_p_at (self->repo_dir_fd, LINK_ANCHORS_DIR, DEFAULT_DIRECTORY_MODE,
+                                   NULL, error))
+        return FALSE;
+      if (!glnx_opendirat (self->repo_dir_fd, LINK_ANCHORS_DIR, TRUE, &self->link_anchors_dir_fd,
+                           error))
+        return FALSE;
+    }
+
+  *out_dfd = self->link_anchors_dir_fd;
+  return TRUE;
+}
+
+/* Called after hardlinking @loose_path failed with EMLINK; link to the
+ * first link anchor for the object which isn't full yet, creating one if
+ * needed.  Like linkat(), returns 0 or -1 with errno set; EMLINK means we
+ * should fall back to a copy.  If linking to an anchor failed for any other
+ * reason, @srcfd and @loose_path are updated to refer to that anchor so the
+ * caller can handle the error as it would for the object itself.
+ */
+static int
+link_anchor_linkat (OstreeRepo *self, int *srcfd, const char **loose_path, char **out_anchor_path,
+                    int destination_dfd, const char *destination_name, GCancellable *cancellable)
+{
+  g_autoptr (GError) local_error = NULL;
+  int anchors_dfd;
+  if (!ensure_link_anchors_dir (self, &anchors_dfd, &local_error))
+    {
+      g_debug ("Failed to open %s: %s", LINK_ANCHORS_DIR, local_error->message);
+      errno = EMLINK;
+      return -1;
+    }
+
+  const GLnxFileCopyFlags copyflags = self->disable_fsync ? 0 : GLNX_FILE_COPY_DATASYNC;
+  for (guint i = 0; i < LINK_ANCHOR_MAX; i++)
+    {
+      char anchor_path[_OSTREE_LOOSE_PATH_MAX + 8];
+      g_snprintf (anchor_path, sizeof (anchor_path), "%s.%u", *loose_path, i);
+
+      int r = linkat (anchors_dfd, anchor_path, destination_dfd, destination_name, 0);
+      if (r < 0 && errno == ENOENT)
+        {
+          /* Losing a race to create the anchor with another thread is fine */
+          if (!_ostree_repo_ensure_loose_objdir_at (anchors_dfd, anchor_path, cancellable,
+                                                    &local_error)
+              || !glnx_file_copy_at (*srcfd, *loose_path, NULL, anchors_dfd, anchor_path,
+                                     copyflags, cancellable, &local_error))
+            {
+              if (!g_error_matches (local_error, G_IO_ERROR, G_IO_ERROR_EXISTS))
+                {
+                  g_debug ("Failed to create link anchor %s: %s", anchor_path,
+                           local_error->message);
+                  errno = EMLINK;
+                  return -1;
+                }
+              g_clear_error (&local_error);
+            }
+          else
+            g_atomic_int_inc (&self->checkout_anchors_created);
+
+          r = linkat (anchors_dfd, anchor_path, destination_dfd, destination_name, 0);
+          if (r < 0 && errno == ENOENT)
+            {
+              /* Raced with ostree_repo_checkout_gc() */
+              errno = EMLINK;
+              return -1;
+            }
+        }
+
+      if (r == 0)
+        {
+          g_atomic_int_inc (&self->checkout_anchor_links);
+          return 0;
+        }
+      else if (errno != EMLINK)
+        {
+          int saved_errno = errno;
+          *srcfd = anchors_dfd;
+          *loose_path = *out_anchor_path = g_strdup (anchor_path);
+          errno = saved_errno;
+          return -1;
+        }
+    }
+
+  errno = EMLINK;
+  return -1;
+}
+
+/* Hardlink an object into a checkout; the EMLINK test error pretends
+ * every object is at the link limit, so that link anchors are used.
+ */
+static int
+object_linkat (OstreeRepo *self, int srcfd, const char *loose_path, int destination_dfd,
+               const char *destination_name)
+{
+  if ((self->test_error_flags & OSTREE_REPO_TEST_ERROR_EMLINK) > 0)
+    {
+      errno = EMLINK;
+      return -1;
+    }
+  return linkat (srcfd, loose_path, destination_dfd, destination_name, 0);
+}
+
 static gboolean
 checkout_file_hardlink (OstreeRepo *self, const char *checksum,
                         OstreeRepoCheckoutAtOptions *options, const char *loose_path,
@@ -445,12 +1000,17 @@ checkout_file_hardlink (OstreeRepo *self, const char *checksum,
   HardlinkResult ret_result = HARDLINK_RESULT_NOT_SUPPORTED;
   int srcfd = _ostree_repo_mode_is_bare (self->mode) ? self->objects_dir_fd
                                                      : self->uncompressed_objects_dir_fd;
+  g_autofree char *anchor_path = NULL;
 
   if (srcfd == -1)
     {
       /* Fall through; we don't have an uncompressed object cache */
     }
-  else if (linkat (srcfd, loose_path, destination_dfd, destination_name, 0) == 0)
+  else if (object_linkat (self, srcfd, loose_path, destination_dfd, destination_name) == 0
+           || (errno == EMLINK
+               && link_anchor_linkat (self, &srcfd, &loose_path, &anchor_path, destination_dfd,
+                                      destination_name, cancellable)
+                      == 0))
     ret_result = HARDLINK_RESULT_LINKED;
   else if (!options->no_copy_fallback && (errno == EMLINK || errno == EXDEV || errno == EPERM))
     {
@@ -829,9 +1389,17 @@ checkout_one_file_at (OstreeRepo *repo, OstreeRepoCheckoutAtOptions *options, Ch
                   key->ino = stbuf.st_ino;
                   memcpy (key->checksum, checksum, OSTREE_SHA256_STRING_LEN + 1);
 
+                  if (state->parallel)
+                    g_mutex_lock (&state->parallel->lock);
                   g_hash_table_add ((GHashTable *)options->devino_to_csum_cache, key);
+                  if (state->parallel)
+                    g_mutex_unlock (&state->parallel->lock);
                 }
 
+              if (is_archive_z2_with_cache && hardlink_res != HARDLINK_RESULT_NOT_SUPPORTED)
+                uncompressed_cache_record (current_repo, checksum,
+                                           g_file_info_get_size (source_info), TRUE);
+
               if (hardlink_res != HARDLINK_RESULT_NOT_SUPPORTED)
                 break;
             }
@@ -870,6 +1438,8 @@ checkout_one_file_at (OstreeRepo *repo, OstreeRepoCheckoutAtOptions *options, Ch
 
       g_clear_object (&input);
 
+      uncompressed_cache_record (repo, checksum, g_file_info_get_size (source_info), FALSE);
+
       /* Store the 2-byte objdir prefix (e.g. e3) in a set.  The basic
        * idea here is that if we had to unpack an object, it's very
        * likely we're replacing some other object, so we may need a GC.
@@ -969,38 +1539,230 @@ pop_path_element (OstreeRepoCheckoutAtOptions *options, CheckoutState *state, co
     g_string_truncate (state->selabel_path_buf, state->selabel_path_buf->len - n);
 }
 
-/*
- * checkout_tree_at:
- * @self: Repo
- * @mode: Options controlling all files
- * @state: Any state we're carrying through
- * @overwrite_mode: Whether or not to overwrite files
- * @destination_parent_fd: Place tree here
- * @destination_name: Use this name for tree
- * @source: Source tree
- * @source_info: Source info
- * @cancellable: Cancellable
- * @error: Error
- *
- * Like ostree_repo_checkout_tree(), but check out @source into the
- * relative @destination_name, located by @destination_parent_fd.
+/* The files of one directory being checked out by worker threads; the
+ * directory's metadata can only be finalized once n_pending drops to zero.
  */
-static gboolean
-checkout_tree_at_recurse (OstreeRepo *self, OstreeRepoCheckoutAtOptions *options,
-                          CheckoutState *state, int destination_parent_fd,
-                          const char *destination_name, const char *dirtree_checksum,
-                          const char *dirmeta_checksum, GCancellable *cancellable, GError **error)
+typedef struct
 {
-  gboolean did_exist = FALSE;
-  gboolean is_opaque_whiteout = FALSE;
-  const gboolean sepolicy_enabled = options->sepolicy && !self->disable_xattrs;
+  CheckoutParallel *parallel;
+  guint n_pending; /* protected by parallel->lock */
+} CheckoutFilesBatch;
+
+typedef struct
+{
+  CheckoutFilesBatch *batch;
+  GVariant *files;
+  guint start;
+  guint end;
+  int destination_dfd; /* owned by the directory waiting on the batch */
+} CheckoutFilesJob;
+
+static void
+checkout_files_job_free (CheckoutFilesJob *job)
+{
+  g_variant_unref (job->files);
+  g_free (job);
+}
+
+static void
+checkout_files_job_thread (gpointer data, gpointer user_data)
+{
+  CheckoutFilesJob *job = data;
+  CheckoutParallel *parallel = user_data;
+  g_autoptr (GError) local_error = NULL;
+
+  /* Once one file failed, don't bother with the remaining ones */
+  if (!g_atomic_int_get (&parallel->failed))
+    {
+      g_auto (CheckoutState) state = {
+        0,
+      };
+      state.parallel = parallel;
+
+      for (guint i = job->start; i < job->end; i++)
+        {
+          const char *fname;
+          g_autoptr (GVariant) contents_csum_v = NULL;
+          g_variant_get_child (job->files, i, "(&s@ay)", &fname, &contents_csum_v);
+
+          char tmp_checksum[OSTREE_SHA256_STRING_LEN + 1];
+          _ostree_checksum_inplace_from_bytes_v (contents_csum_v, tmp_checksum);
+
+          if (!checkout_one_file_at (parallel->repo, parallel->options, &state, tmp_checksum,
+                                     job->destination_dfd, fname, parallel->cancellable,
+                                     &local_error))
+            break;
+        }
+    }
+
+  g_mutex_lock (&parallel->lock);
+  if (local_error != NULL)
+    {
+      if (parallel->error == NULL)
+        parallel->error = g_steal_pointer (&local_error);
+      g_atomic_int_set (&parallel->failed, TRUE);
+    }
+  job->batch->n_pending--;
+  g_cond_broadcast (&parallel->cond);
+  g_mutex_unlock (&parallel->lock);
+
+  checkout_files_job_free (job);
+}
+
+static void
+checkout_files_batch_wait (CheckoutFilesBatch *batch)
+{
+  if (batch->parallel == NULL)
+    return;
+
+  g_mutex_lock (&batch->parallel->lock);
+  while (batch->n_pending > 0)
+    g_cond_wait (&batch->parallel->cond, &batch->parallel->lock);
+  g_mutex_unlock (&batch->parallel->lock);
+}
+G_DEFINE_AUTO_CLEANUP_CLEAR_FUNC (CheckoutFilesBatch, checkout_files_batch_wait)
+
+static gboolean
+checkout_parallel_throw (CheckoutParallel *parallel, GError **error)
+{
+  g_mutex_lock (&parallel->lock);
+  g_assert (parallel->error != NULL);
+  g_propagate_error (error, g_error_copy (parallel->error));
+  g_mutex_unlock (&parallel->lock);
+  return FALSE;
+}
+
+/* Hand the files of a directory to the worker threads */
+static gboolean
+checkout_files_batch_push (CheckoutFilesBatch *batch, GVariant *files, int destination_dfd,
+                           GError **error)
+{
+  CheckoutParallel *parallel = batch->parallel;
+
+  if (g_atomic_int_get (&parallel->failed))
+    return checkout_parallel_throw (parallel, error);
+
+  const guint n = g_variant_n_children (files);
+  for (guint start = 0; start < n; start += CHECKOUT_FILES_PER_JOB)
+    {
+      CheckoutFilesJob *job = g_new0 (CheckoutFilesJob, 1);
+      job->batch = batch;
+      job->files = g_variant_ref (files);
+      job->start = start;
+      job->end = MIN (start + CHECKOUT_FILES_PER_JOB, n);
+      job->destination_dfd = destination_dfd;
+
+      g_mutex_lock (&parallel->lock);
+      batch->n_pending++;
+      g_mutex_unlock (&parallel->lock);
+
+      if (!g_thread_pool_push (parallel->pool, job, error))
+        {
+          g_mutex_lock (&parallel->lock);
+          batch->n_pending--;
+          g_mutex_unlock (&parallel->lock);
+          checkout_files_job_free (job);
+          return FALSE;
+        }
+    }
+
+  return TRUE;
+}
+
+static gboolean
+checkout_files_batch_finish (CheckoutFilesBatch *batch, GError **error)
+{
+  if (batch->parallel == NULL)
+    return TRUE;
+
+  checkout_files_batch_wait (batch);
+  if (g_atomic_int_get (&batch->parallel->failed))
+    return checkout_parallel_throw (batch->parallel, error);
+
+  return TRUE;
+}
+
+/*
+ * Set the final mode, ownership and mtime of a checked out directory; this
+ * must be done after creating all of its children.
+ */
+static gboolean
+checkout_finalize_dir (OstreeRepo *self, OstreeRepoCheckoutAtOptions *options, int dfd,
+                       guint32 uid, guint32 gid, guint32 mode, GError **error)
+{
+  guint32 canonical_mode;
+  /* Silently ignore world-writable directories (plus sticky, suid bits,
+   * etc.) when doing a checkout for bare-user-only repos, or if requested explicitly.
+   * This is related to the logic in ostree-repo-commit.c for files.
+   * See also: https://github.com/ostreedev/ostree/pull/909 i.e.
+   * 0c4b3a2b6da950fd78e63f9afec602f6188f1ab0
+   */
+  if (self->mode == OSTREE_REPO_MODE_BARE_USER_ONLY || options->bareuseronly_dirs)
+    canonical_mode = (mode & 0775) | S_IFDIR;
+  else
+    canonical_mode = mode;
+  if (TEMP_FAILURE_RETRY (fchmod (dfd, canonical_mode)) < 0)
+    return glnx_throw_errno_prefix (error, "fchmod");
+
+  if (options->mode != OSTREE_REPO_CHECKOUT_MODE_USER)
+    {
+      if (TEMP_FAILURE_RETRY (fchown (dfd, uid, gid)) < 0)
+        return glnx_throw_errno (error);
+    }
+
+  /* Set directory mtime to OSTREE_TIMESTAMP, so that it is constant for all checkouts.
+   * We skip it if doing copying checkouts, which is mostly for /etc.
+   */
+  if (!options->force_copy)
+    {
+      const struct timespec times[2]
+          = { { OSTREE_TIMESTAMP, UTIME_OMIT }, { OSTREE_TIMESTAMP, 0 } };
+      if (TEMP_FAILURE_RETRY (futimens (dfd, times)) < 0)
+        return glnx_throw_errno (error);
+    }
+
+  return TRUE;
+}
+
+/*
+ * checkout_tree_at:
+ * @self: Repo
+ * @mode: Options controlling all files
+ * @state: Any state we're carrying through
+ * @overwrite_mode: Whether or not to overwrite files
+ * @destination_parent_fd: Place tree here
+ * @destination_name: Use this name for tree
+ * @source: Source tree
+ * @source_info: Source info
+ * @cancellable: Cancellable
+ * @error: Error
+ *
+ * Like ostree_repo_checkout_tree(), but check out @source into the
+ * relative @destination_name, located by @destination_parent_fd.
+ */
+static gboolean
+checkout_tree_at_recurse (OstreeRepo *self, OstreeRepoCheckoutAtOptions *options,
+                          CheckoutState *state, int destination_parent_fd,
+                          const char *destination_name, const char *dirtree_checksum,
+                          const char *dirmeta_checksum, GCancellable *cancellable, GError **error)
+{
+  gboolean did_exist = FALSE;
+  gboolean is_opaque_whiteout = FALSE;
+  const gboolean sepolicy_enabled = options->sepolicy && !self->disable_xattrs;
   g_autoptr (GVariant) dirtree = NULL;
   g_autoptr (GVariant) dirmeta = NULL;
   g_autoptr (GVariant) xattrs = NULL;
   g_autoptr (GVariant) modified_xattrs = NULL;
 
-  if (!ostree_repo_load_variant (self, OSTREE_OBJECT_TYPE_DIR_TREE, dirtree_checksum, &dirtree,
-                                 error))
+  if (state->layered_dirtrees)
+    {
+      GVariant *layered_dirtree = g_hash_table_lookup (state->layered_dirtrees, dirtree_checksum);
+      if (layered_dirtree)
+        dirtree = g_variant_ref (layered_dirtree);
+    }
+  if (!dirtree
+      && !ostree_repo_load_variant (self, OSTREE_OBJECT_TYPE_DIR_TREE, dirtree_checksum, &dirtree,
+                                    error))
     return FALSE;
   if (!ostree_repo_load_variant (self, OSTREE_OBJECT_TYPE_DIR_META, dirmeta_checksum, &dirmeta,
                                  error))
@@ -1133,27 +1895,41 @@ checkout_tree_at_recurse (OstreeRepo *self, OstreeRepoCheckoutAtOptions *options
         return glnx_prefix_error (error, "Processing dirmeta %s", dirmeta_checksum);
     }
 
-  /* Process files in this subdir */
+  /* Process files in this subdir, possibly on worker threads; those are
+   * waited for on the way out, as they use destination_dfd.
+   */
+  g_auto (CheckoutFilesBatch) files_batch = {
+    0,
+  };
+  files_batch.parallel = state->parallel;
   {
     g_autoptr (GVariant) dir_file_contents = g_variant_get_child_value (dirtree, 0);
-    GVariantIter viter;
-    g_variant_iter_init (&viter, dir_file_contents);
-    const char *fname;
-    g_autoptr (GVariant) contents_csum_v = NULL;
-    while (g_variant_iter_loop (&viter, "(&s@ay)", &fname, &contents_csum_v))
+    if (state->parallel)
+      {
+        if (!checkout_files_batch_push (&files_batch, dir_file_contents, destination_dfd, error))
+          return FALSE;
+      }
+    else
       {
-        push_path_element (options, state, fname, FALSE);
+        GVariantIter viter;
+        g_variant_iter_init (&viter, dir_file_contents);
+        const char *fname;
+        g_autoptr (GVariant) contents_csum_v = NULL;
+        while (g_variant_iter_loop (&viter, "(&s@ay)", &fname, &contents_csum_v))
+          {
+            push_path_element (options, state, fname, FALSE);
 
-        char tmp_checksum[OSTREE_SHA256_STRING_LEN + 1];
-        _ostree_checksum_inplace_from_bytes_v (contents_csum_v, tmp_checksum);
+            char tmp_checksum[OSTREE_SHA256_STRING_LEN + 1];
+            _ostree_checksum_inplace_from_bytes_v (contents_csum_v, tmp_checksum);
 
-        if (!checkout_one_file_at (self, options, state, tmp_checksum, destination_dfd, fname,
-                                   cancellable, error))
-          return FALSE;
+            if (!checkout_one_file_at (self, options, state, tmp_checksum, destination_dfd, fname,
+                                       cancellable, error))
+              return FALSE;
 
-        pop_path_element (options, state, fname, FALSE);
+            pop_path_element (options, state, fname, FALSE);
+          }
+        contents_csum_v = NULL; /* iter_loop freed it */
       }
-    contents_csum_v = NULL; /* iter_loop freed it */
   }
 
   /* Process subdirectories */
@@ -1191,45 +1967,251 @@ checkout_tree_at_recurse (OstreeRepo *self, OstreeRepoCheckoutAtOptions *options
       }
   }
 
+  if (!checkout_files_batch_finish (&files_batch, error))
+    return FALSE;
+
   /* We do fchmod/fchown last so that no one else could access the
    * partially created directory and change content we're laying out.
+   * Note we skip this for directories that already exist (under the
+   * theory we possibly don't own them).
    */
-  if (!did_exist)
-    {
-      guint32 canonical_mode;
-      /* Silently ignore world-writable directories (plus sticky, suid bits,
-       * etc.) when doing a checkout for bare-user-only repos, or if requested explicitly.
-       * This is related to the logic in ostree-repo-commit.c for files.
-       * See also: https://github.com/ostreedev/ostree/pull/909 i.e.
-       * 0c4b3a2b6da950fd78e63f9afec602f6188f1ab0
-       */
-      if (self->mode == OSTREE_REPO_MODE_BARE_USER_ONLY || options->bareuseronly_dirs)
-        canonical_mode = (mode & 0775) | S_IFDIR;
-      else
-        canonical_mode = mode;
-      if (TEMP_FAILURE_RETRY (fchmod (destination_dfd, canonical_mode)) < 0)
-        return glnx_throw_errno_prefix (error, "fchmod");
-    }
+  if (!did_exist
+      && !checkout_finalize_dir (self, options, destination_dfd, uid, gid, mode, error))
+    return FALSE;
 
-  if (!did_exist && options->mode != OSTREE_REPO_CHECKOUT_MODE_USER)
+  if (fsync_is_enabled (self, options))
     {
-      if (TEMP_FAILURE_RETRY (fchown (destination_dfd, uid, gid)) < 0)
+      if (fsync (destination_dfd) == -1)
         return glnx_throw_errno (error);
     }
 
-  /* Set directory mtime to OSTREE_TIMESTAMP, so that it is constant for all checkouts.
-   * Must be done after setting permissions and creating all children.  Note we skip doing
-   * this for directories that already exist (under the theory we possibly don't own them),
-   * and we also skip it if doing copying checkouts, which is mostly for /etc.
+  return TRUE;
+}
+
+/* Map the names of the entries in a dirtree's files or dirs array to their
+ * index + 1; @format is the entry format, with the name as "&s".
+ */
+static GHashTable *
+dirtree_entries_by_name (GVariant *entries, const char *format)
+{
+  GHashTable *ret = g_hash_table_new (g_str_hash, g_str_equal);
+  const guint n = g_variant_n_children (entries);
+  for (guint i = 0; i < n; i++)
+    {
+      const char *name;
+      g_variant_get_child (entries, i, format, &name, NULL, NULL);
+      g_hash_table_insert (ret, (char *)name, GUINT_TO_POINTER (i + 1));
+    }
+  return ret;
+}
+
+/* The name a file from a dirtree is checked out as */
+static const char *
+checkout_file_destination_name (OstreeRepoCheckoutAtOptions *options, const char *fname)
+{
+  if (options->process_passthrough_whiteouts
+      && g_str_has_prefix (fname, OSTREE_QUOTED_OVERLAYFS_WHITEOUT_PREFIX))
+    return fname + (sizeof (OSTREE_QUOTED_OVERLAYFS_WHITEOUT_PREFIX) - 1);
+  return fname;
+}
+
+/*
+ * checkout_tree_update_recurse:
+ *
+ * Update @destination_name, an existing checkout of the old dirtree/dirmeta
+ * pair, to the new one.  Only differing entries are touched, and identical
+ * subtrees aren't descended into at all.
+ */
+static gboolean
+checkout_tree_update_recurse (OstreeRepo *self, OstreeRepoCheckoutAtOptions *options,
+                              CheckoutState *state, int destination_parent_fd,
+                              const char *destination_name, const char *old_dirtree_checksum,
+                              const char *old_dirmeta_checksum, const char *dirtree_checksum,
+                              const char *dirmeta_checksum, GCancellable *cancellable,
+                              GError **error)
+{
+  if (g_str_equal (old_dirtree_checksum, dirtree_checksum)
+      && g_str_equal (old_dirmeta_checksum, dirmeta_checksum))
+    return TRUE;
+
+  const gboolean sepolicy_enabled = options->sepolicy && !self->disable_xattrs;
+  g_autoptr (GVariant) old_dirtree = NULL;
+  g_autoptr (GVariant) dirtree = NULL;
+  g_autoptr (GVariant) dirmeta = NULL;
+  g_autoptr (GVariant) xattrs = NULL;
+  g_autoptr (GVariant) modified_xattrs = NULL;
+
+  if (!ostree_repo_load_variant (self, OSTREE_OBJECT_TYPE_DIR_TREE, old_dirtree_checksum,
+                                 &old_dirtree, error))
+    return FALSE;
+  if (!ostree_repo_load_variant (self, OSTREE_OBJECT_TYPE_DIR_TREE, dirtree_checksum, &dirtree,
+                                 error))
+    return FALSE;
+  if (!ostree_repo_load_variant (self, OSTREE_OBJECT_TYPE_DIR_META, dirmeta_checksum, &dirmeta,
+                                 error))
+    return FALSE;
+
+  /* Parse OSTREE_OBJECT_TYPE_DIR_META */
+  guint32 uid, gid, mode;
+  g_variant_get (dirmeta, "(uuu@a(ayay))", &uid, &gid, &mode,
+                 options->mode != OSTREE_REPO_CHECKOUT_MODE_USER ? &xattrs : NULL);
+  uid = GUINT32_FROM_BE (uid);
+  gid = GUINT32_FROM_BE (gid);
+  mode = GUINT32_FROM_BE (mode);
+
+  if (options->filter)
+    {
+      struct stat stbuf = {
+        0,
+      };
+      stbuf.st_mode = mode;
+      stbuf.st_uid = uid;
+      stbuf.st_gid = gid;
+      if (options->filter (self, state->path_buf->str, &stbuf, options->filter_user_data)
+          == OSTREE_REPO_CHECKOUT_FILTER_SKIP)
+        return TRUE; /* Note early return */
+    }
+
+  glnx_autofd int destination_dfd = -1;
+  if (!glnx_opendirat (destination_parent_fd, destination_name, TRUE, &destination_dfd, error))
+    return FALSE;
+
+  /* Like a fresh checkout, work with mode 0700 until we're done */
+  if (TEMP_FAILURE_RETRY (fchmod (destination_dfd, 0700)) < 0)
+    return glnx_throw_errno_prefix (error, "fchmod");
+
+  if (!g_str_equal (old_dirmeta_checksum, dirmeta_checksum) && xattrs)
+    {
+      /* We don't relabel existing directories */
+      if (sepolicy_enabled && _ostree_sepolicy_host_enabled (options->sepolicy))
+        {
+          modified_xattrs = _ostree_filter_selinux_xattr (xattrs);
+          xattrs = modified_xattrs;
+        }
+
+      if (xattrs && !glnx_fd_set_all_xattrs (destination_dfd, xattrs, cancellable, error))
+        return glnx_prefix_error (error, "Processing dirmeta %s", dirmeta_checksum);
+    }
+
+  g_autoptr (GVariant) old_files = g_variant_get_child_value (old_dirtree, 0);
+  g_autoptr (GVariant) old_dirs = g_variant_get_child_value (old_dirtree, 1);
+  g_autoptr (GVariant) files = g_variant_get_child_value (dirtree, 0);
+  g_autoptr (GVariant) dirs = g_variant_get_child_value (dirtree, 1);
+  g_autoptr (GHashTable) old_files_by_name = dirtree_entries_by_name (old_files, "(&s@ay)");
+  g_autoptr (GHashTable) old_dirs_by_name = dirtree_entries_by_name (old_dirs, "(&s@ay@ay)");
+  g_autoptr (GHashTable) files_by_name = dirtree_entries_by_name (files, "(&s@ay)");
+  g_autoptr (GHashTable) dirs_by_name = dirtree_entries_by_name (dirs, "(&s@ay@ay)");
+
+  /* First remove what's gone; this also clears the way for entries which
+   * changed between being a file and a directory.
    */
-  if (!did_exist && !options->force_copy)
+  GLNX_HASH_TABLE_FOREACH (old_files_by_name, const char *, fname)
     {
-      const struct timespec times[2]
-          = { { OSTREE_TIMESTAMP, UTIME_OMIT }, { OSTREE_TIMESTAMP, 0 } };
-      if (TEMP_FAILURE_RETRY (futimens (destination_dfd, times)) < 0)
-        return glnx_throw_errno (error);
+      if (g_hash_table_contains (files_by_name, fname))
+        continue;
+      if (!ot_util_filename_validate (fname, error))
+        return FALSE;
+      if (!ot_ensure_unlinked_at (destination_dfd,
+                                  checkout_file_destination_name (options, fname), error))
+        return FALSE;
+    }
+  GLNX_HASH_TABLE_FOREACH (old_dirs_by_name, const char *, dname)
+    {
+      if (g_hash_table_contains (dirs_by_name, dname))
+        continue;
+      if (!ot_util_filename_validate (dname, error))
+        return FALSE;
+      if (!glnx_shutil_rm_rf_at (destination_dfd, dname, cancellable, error))
+        return FALSE;
     }
 
+  /* Replace changed files and add new ones */
+  const guint n_files = g_variant_n_children (files);
+  for (guint i = 0; i < n_files; i++)
+    {
+      const char *fname;
+      g_autoptr (GVariant) contents_csum_v = NULL;
+      g_variant_get_child (files, i, "(&s@ay)", &fname, &contents_csum_v);
+
+      const guint old_index = GPOINTER_TO_UINT (g_hash_table_lookup (old_files_by_name, fname));
+      if (old_index > 0)
+        {
+          g_autoptr (GVariant) old_contents_csum_v = NULL;
+          g_variant_get_child (old_files, old_index - 1, "(&s@ay)", NULL, &old_contents_csum_v);
+          if (g_variant_equal (old_contents_csum_v, contents_csum_v))
+            continue;
+        }
+
+      /* Validate this before unlinking anything */
+      if (!ot_util_filename_validate (fname, error))
+        return FALSE;
+      if (!ot_ensure_unlinked_at (destination_dfd,
+                                  checkout_file_destination_name (options, fname), error))
+        return FALSE;
+
+      push_path_element (options, state, fname, FALSE);
+
+      char tmp_checksum[OSTREE_SHA256_STRING_LEN + 1];
+      _ostree_checksum_inplace_from_bytes_v (contents_csum_v, tmp_checksum);
+
+      if (!checkout_one_file_at (self, options, state, tmp_checksum, destination_dfd, fname,
+                                 cancellable, error))
+        return FALSE;
+
+      pop_path_element (options, state, fname, FALSE);
+    }
+
+  /* Update existing subdirectories and check out new ones */
+  const guint n_dirs = g_variant_n_children (dirs);
+  for (guint i = 0; i < n_dirs; i++)
+    {
+      const char *dname;
+      g_autoptr (GVariant) subdirtree_csum_v = NULL;
+      g_autoptr (GVariant) subdirmeta_csum_v = NULL;
+      g_variant_get_child (dirs, i, "(&s@ay@ay)", &dname, &subdirtree_csum_v, &subdirmeta_csum_v);
+
+      if (!ot_util_filename_validate (dname, error))
+        return FALSE;
+
+      push_path_element (options, state, dname, TRUE);
+
+      char subdirtree_checksum[OSTREE_SHA256_STRING_LEN + 1];
+      _ostree_checksum_inplace_from_bytes_v (subdirtree_csum_v, subdirtree_checksum);
+      char subdirmeta_checksum[OSTREE_SHA256_STRING_LEN + 1];
+      _ostree_checksum_inplace_from_bytes_v (subdirmeta_csum_v, subdirmeta_checksum);
+
+      const guint old_index = GPOINTER_TO_UINT (g_hash_table_lookup (old_dirs_by_name, dname));
+      if (old_index > 0)
+        {
+          g_autoptr (GVariant) old_subdirtree_csum_v = NULL;
+          g_autoptr (GVariant) old_subdirmeta_csum_v = NULL;
+          g_variant_get_child (old_dirs, old_index - 1, "(&s@ay@ay)", NULL,
+                               &old_subdirtree_csum_v, &old_subdirmeta_csum_v);
+          char old_subdirtree_checksum[OSTREE_SHA256_STRING_LEN + 1];
+          _ostree_checksum_inplace_from_bytes_v (old_subdirtree_csum_v, old_subdirtree_checksum);
+          char old_subdirmeta_checksum[OSTREE_SHA256_STRING_LEN + 1];
+          _ostree_checksum_inplace_from_bytes_v (old_subdirmeta_csum_v, old_subdirmeta_checksum);
+
+          if (!checkout_tree_update_recurse (
+                  self, options, state, destination_dfd, dname, old_subdirtree_checksum,
+                  old_subdirmeta_checksum, subdirtree_checksum, subdirmeta_checksum, cancellable,
+                  error))
+            return FALSE;
+        }
+      else
+        {
+          if (!checkout_tree_at_recurse (self, options, state, destination_dfd, dname,
+                                         subdirtree_checksum, subdirmeta_checksum, cancellable,
+                                         error))
+            return FALSE;
+        }
+
+      pop_path_element (options, state, dname, TRUE);
+    }
+
+  if (!checkout_finalize_dir (self, options, destination_dfd, uid, gid, mode, error))
+    return FALSE;
+
   if (fsync_is_enabled (self, options))
     {
       if (fsync (destination_dfd) == -1)
@@ -1239,6 +2221,225 @@ checkout_tree_at_recurse (OstreeRepo *self, OstreeRepoCheckoutAtOptions *options
   return TRUE;
 }
 
+/* A directory of a layered checkout; see ostree_repo_checkout_layers_at() */
+typedef struct LayeredDir LayeredDir;
+struct LayeredDir
+{
+  char *dirmeta_checksum;
+  /* Set while the directory's contents are exactly one dirtree */
+  char *dirtree_checksum;
+  /* Otherwise, the merged contents */
+  GHashTable *files;   /* name -> file checksum */
+  GHashTable *subdirs; /* name -> LayeredDir */
+};
+
+static void
+layered_dir_free (LayeredDir *dir)
+{
+  g_free (dir->dirmeta_checksum);
+  g_free (dir->dirtree_checksum);
+  g_clear_pointer (&dir->files, g_hash_table_unref);
+  g_clear_pointer (&dir->subdirs, g_hash_table_unref);
+  g_free (dir);
+}
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (LayeredDir, layered_dir_free)
+
+static LayeredDir *
+layered_dir_new (const char *dirtree_checksum, const char *dirmeta_checksum)
+{
+  LayeredDir *dir = g_new0 (LayeredDir, 1);
+  dir->dirtree_checksum = g_strdup (dirtree_checksum);
+  dir->dirmeta_checksum = g_strdup (dirmeta_checksum);
+  return dir;
+}
+
+static gboolean layered_dir_merge (OstreeRepo *self, OstreeRepoCheckoutAtOptions *options,
+                                   LayeredDir *dir, const char *dirtree_checksum,
+                                   const char *dirmeta_checksum, GError **error);
+
+/* Apply the entries of @dirtree on top of the merged contents of @dir */
+static gboolean
+layered_dir_apply (OstreeRepo *self, OstreeRepoCheckoutAtOptions *options, LayeredDir *dir,
+                   GVariant *dirtree, GError **error)
+{
+  g_autoptr (GVariant) files = g_variant_get_child_value (dirtree, 0);
+  g_autoptr (GVariant) dirs = g_variant_get_child_value (dirtree, 1);
+
+  const guint n_files = g_variant_n_children (files);
+  for (guint i = 0; i < n_files; i++)
+    {
+      const char *fname;
+      g_autoptr (GVariant) contents_csum_v = NULL;
+      g_variant_get_child (files, i, "(&s@ay)", &fname, &contents_csum_v);
+
+      if (!ot_util_filename_validate (fname, error))
+        return FALSE;
+
+      /* Whiteouts hide entries from lower layers; opaque whiteouts are
+       * handled by layered_dir_merge().
+       */
+      if (options->process_whiteouts && g_str_has_prefix (fname, WHITEOUT_PREFIX))
+        {
+          if (!g_str_equal (fname, OPAQUE_WHITEOUT_NAME))
+            {
+              const char *name = fname + (sizeof (WHITEOUT_PREFIX) - 1);
+              g_hash_table_remove (dir->files, name);
+              g_hash_table_remove (dir->subdirs, name);
+            }
+          continue;
+        }
+
+      char *checksum = g_malloc (OSTREE_SHA256_STRING_LEN + 1);
+      _ostree_checksum_inplace_from_bytes_v (contents_csum_v, checksum);
+      g_hash_table_remove (dir->subdirs, fname);
+      g_hash_table_replace (dir->files, g_strdup (fname), checksum);
+    }
+
+  const guint n_dirs = g_variant_n_children (dirs);
+  for (guint i = 0; i < n_dirs; i++)
+    {
+      const char *dname;
+      g_autoptr (GVariant) subdirtree_csum_v = NULL;
+      g_autoptr (GVariant) subdirmeta_csum_v = NULL;
+      g_variant_get_child (dirs, i, "(&s@ay@ay)", &dname, &subdirtree_csum_v, &subdirmeta_csum_v);
+
+      if (!ot_util_filename_validate (dname, error))
+        return FALSE;
+
+      char subdirtree_checksum[OSTREE_SHA256_STRING_LEN + 1];
+      _ostree_checksum_inplace_from_bytes_v (subdirtree_csum_v, subdirtree_checksum);
+      char subdirmeta_checksum[OSTREE_SHA256_STRING_LEN + 1];
+      _ostree_checksum_inplace_from_bytes_v (subdirmeta_csum_v, subdirmeta_checksum);
+
+      g_hash_table_remove (dir->files, dname);
+      LayeredDir *subdir = g_hash_table_lookup (dir->subdirs, dname);
+      if (subdir)
+        {
+          if (!layered_dir_merge (self, options, subdir, subdirtree_checksum, subdirmeta_checksum,
+                                  error))
+            return FALSE;
+        }
+      else
+        g_hash_table_insert (dir->subdirs, g_strdup (dname),
+                             layered_dir_new (subdirtree_checksum, subdirmeta_checksum));
+    }
+
+  return TRUE;
+}
+
+/* Merge the dirtree/dirmeta pair of an upper layer into @dir.  Subdirectories
+ * which only exist in one layer are never loaded.
+ */
+static gboolean
+layered_dir_merge (OstreeRepo *self, OstreeRepoCheckoutAtOptions *options, LayeredDir *dir,
+                   const char *dirtree_checksum, const char *dirmeta_checksum, GError **error)
+{
+  g_free (dir->dirmeta_checksum);
+  dir->dirmeta_checksum = g_strdup (dirmeta_checksum);
+
+  /* Layers commonly share directories */
+  if (dir->dirtree_checksum && g_str_equal (dir->dirtree_checksum, dirtree_checksum))
+    return TRUE;
+
+  g_autoptr (GVariant) dirtree = NULL;
+  if (!ostree_repo_load_variant (self, OSTREE_OBJECT_TYPE_DIR_TREE, dirtree_checksum, &dirtree,
+                                 error))
+    return FALSE;
+
+  if (options->process_whiteouts)
+    {
+      g_autoptr (GVariant) files = g_variant_get_child_value (dirtree, 0);
+      const guint n_files = g_variant_n_children (files);
+      for (guint i = 0; i < n_files; i++)
+        {
+          const char *fname;
+          g_variant_get_child (files, i, "(&s@ay)", &fname, NULL);
+          if (g_str_equal (fname, OPAQUE_WHITEOUT_NAME))
+            {
+              /* Nothing from the lower layers is visible */
+              g_clear_pointer (&dir->files, g_hash_table_unref);
+              g_clear_pointer (&dir->subdirs, g_hash_table_unref);
+              g_free (dir->dirtree_checksum);
+              dir->dirtree_checksum = g_strdup (dirtree_checksum);
+              return TRUE; /* Note early return */
+            }
+        }
+    }
+
+  /* Load the contents from the lower layer if we haven't yet */
+  if (dir->dirtree_checksum)
+    {
+      g_autoptr (GVariant) lower_dirtree = NULL;
+      if (!ostree_repo_load_variant (self, OSTREE_OBJECT_TYPE_DIR_TREE, dir->dirtree_checksum,
+                                     &lower_dirtree, error))
+        return FALSE;
+
+      dir->files = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+      dir->subdirs = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                            (GDestroyNotify)layered_dir_free);
+      g_clear_pointer (&dir->dirtree_checksum, g_free);
+      if (!layered_dir_apply (self, options, dir, lower_dirtree, error))
+        return FALSE;
+    }
+
+  return layered_dir_apply (self, options, dir, dirtree, error);
+}
+
+static int
+compare_names (gconstpointer a, gconstpointer b)
+{
+  return strcmp (*(const char **)a, *(const char **)b);
+}
+
+/* Generate dirtree objects for the merged directories in @dir, adding them
+ * to @dirtrees; returns the checksum of the dirtree for @dir.
+ */
+static const char *
+layered_dir_resolve (LayeredDir *dir, GHashTable *dirtrees)
+{
+  if (dir->dirtree_checksum)
+    return dir->dirtree_checksum;
+
+  /* Like commits, entries are sorted by name */
+  g_autoptr (GPtrArray) fnames = g_ptr_array_new ();
+  GLNX_HASH_TABLE_FOREACH (dir->files, const char *, fname)
+    g_ptr_array_add (fnames, (gpointer)fname);
+  g_ptr_array_sort (fnames, compare_names);
+  g_auto (GVariantBuilder) files_builder = OT_VARIANT_BUILDER_INITIALIZER;
+  g_variant_builder_init (&files_builder, G_VARIANT_TYPE ("a(say)"));
+  for (guint i = 0; i < fnames->len; i++)
+    {
+      const char *fname = fnames->pdata[i];
+      g_variant_builder_add (&files_builder, "(s@ay)", fname,
+                             ostree_checksum_to_bytes_v (g_hash_table_lookup (dir->files, fname)));
+    }
+
+  g_autoptr (GPtrArray) dnames = g_ptr_array_new ();
+  GLNX_HASH_TABLE_FOREACH (dir->subdirs, const char *, dname)
+    g_ptr_array_add (dnames, (gpointer)dname);
+  g_ptr_array_sort (dnames, compare_names);
+  g_auto (GVariantBuilder) dirs_builder = OT_VARIANT_BUILDER_INITIALIZER;
+  g_variant_builder_init (&dirs_builder, G_VARIANT_TYPE ("a(sayay)"));
+  for (guint i = 0; i < dnames->len; i++)
+    {
+      const char *dname = dnames->pdata[i];
+      LayeredDir *subdir = g_hash_table_lookup (dir->subdirs, dname);
+      const char *subdirtree_checksum = layered_dir_resolve (subdir, dirtrees);
+      g_variant_builder_add (&dirs_builder, "(s@ay@ay)", dname,
+                             ostree_checksum_to_bytes_v (subdirtree_checksum),
+                             ostree_checksum_to_bytes_v (subdir->dirmeta_checksum));
+    }
+
+  g_autoptr (GVariant) dirtree = g_variant_ref_sink (
+      g_variant_new ("(@a(say)@a(sayay))", g_variant_builder_end (&files_builder),
+                     g_variant_builder_end (&dirs_builder)));
+  dir->dirtree_checksum = g_compute_checksum_for_data (
+      G_CHECKSUM_SHA256, g_variant_get_data (dirtree), g_variant_get_size (dirtree));
+  g_hash_table_replace (dirtrees, g_strdup (dir->dirtree_checksum), g_steal_pointer (&dirtree));
+
+  return dir->dirtree_checksum;
+}
+
 #ifdef HAVE_COMPOSEFS
 static gboolean
 compare_verity_digests (GVariant *metadata_composefs, const guchar *fsverity_digest, GError **error)
@@ -1285,6 +2486,12 @@ compare_verity_digests (GVariant *metadata_composefs, const guchar *fsverity_dig
  *
  *  - verity: `u`: 0 = disabled, 1 = set if present on file, 2 = enabled; any other value is a fatal
  * error
+ *  - n-threads: `u`: Number of threads used to generate the image; the default of 0 uses one
+ * per CPU (Since: 2024.11)
+ *  - reuse-dirs: `b`: Copy the directories which are unchanged from the last image generated
+ * through @self with this option set, rather than loading them from the repository again.  A
+ * copy of that image is kept in memory for this, until a checkout without this option or the
+ * repository is finalized; it only helps a process generating several images. (Since: 2024.11)
  */
 gboolean
 ostree_repo_checkout_composefs (OstreeRepo *self, GVariant *options, int destination_dfd,
@@ -1293,6 +2500,8 @@ ostree_repo_checkout_composefs (OstreeRepo *self, GVariant *options, int destina
 {
 #ifdef HAVE_COMPOSEFS
   OtTristate verity = OT_TRISTATE_YES;
+  guint32 n_threads = 0;
+  gboolean reuse_dirs = FALSE;
 
   if (options != NULL)
     {
@@ -1316,6 +2525,8 @@ ostree_repo_checkout_composefs (OstreeRepo *self, GVariant *options, int destina
               g_assert_not_reached ();
             }
         }
+      g_variant_dict_lookup (&options_dict, "n-threads", "u", &n_threads);
+      g_variant_dict_lookup (&options_dict, "reuse-dirs", "b", &reuse_dirs);
     }
 
   g_auto (GLnxTmpfile) tmpf = {
@@ -1338,8 +2549,8 @@ ostree_repo_checkout_composefs (OstreeRepo *self, GVariant *options, int destina
 
   g_autoptr (OstreeComposefsTarget) target = ostree_composefs_target_new ();
 
-  if (!_ostree_repo_checkout_composefs (self, verity, target, (OstreeRepoFile *)commit_root,
-                                        cancellable, error))
+  if (!_ostree_repo_checkout_composefs (self, verity, n_threads, reuse_dirs, target,
+                                        (OstreeRepoFile *)commit_root, cancellable, error))
     return FALSE;
 
   g_autofree guchar *fsverity_digest = NULL;
@@ -1371,16 +2582,31 @@ ostree_repo_checkout_composefs (OstreeRepo *self, GVariant *options, int destina
 #endif
 }
 
-/* Begin a checkout process */
+/* The merged root of a layered checkout */
+typedef struct
+{
+  GHashTable *dirtrees; /* generated dirtrees, by checksum */
+  const char *dirtree_checksum;
+  const char *dirmeta_checksum;
+} CheckoutLayers;
+
+/* Begin a checkout process; if @update_from_source is set, the destination
+ * is an existing checkout of it to update.  If @layers is set, it replaces
+ * @source and @source_info.
+ */
 static gboolean
 checkout_tree_at (OstreeRepo *self, OstreeRepoCheckoutAtOptions *options, int destination_parent_fd,
                   const char *destination_name, OstreeRepoFile *source, GFileInfo *source_info,
+                  OstreeRepoFile *update_from_source, CheckoutLayers *layers,
                   GCancellable *cancellable, GError **error)
 {
   g_auto (CheckoutState) state = {
     0,
   };
 
+  if (layers)
+    state.layered_dirtrees = layers->dirtrees;
+
   if (options->filter)
     state.path_buf = g_string_new ("/");
 
@@ -1419,7 +2645,7 @@ checkout_tree_at (OstreeRepo *self, OstreeRepoCheckoutAtOptions *options, int de
     }
 
   /* Special case handling for subpath of a non-directory */
-  if (g_file_info_get_file_type (source_info) != G_FILE_TYPE_DIRECTORY)
+  if (!layers && g_file_info_get_file_type (source_info) != G_FILE_TYPE_DIRECTORY)
     {
       /* For backwards compat reasons, we do a mkdir() here. However, as a
        * special case to allow callers to directly check out files without an
@@ -1452,11 +2678,76 @@ checkout_tree_at (OstreeRepo *self, OstreeRepoCheckoutAtOptions *options, int de
   g_auto (OstreeRepoMemoryCacheRef) memcache_ref;
   _ostree_repo_memory_cache_ref_init (&memcache_ref, self);
 
-  g_assert_cmpint (g_file_info_get_file_type (source_info), ==, G_FILE_TYPE_DIRECTORY);
-  const char *dirtree_checksum = ostree_repo_file_tree_get_contents_checksum (source);
-  const char *dirmeta_checksum = ostree_repo_file_tree_get_metadata_checksum (source);
-  return checkout_tree_at_recurse (self, options, &state, destination_parent_fd, destination_name,
-                                   dirtree_checksum, dirmeta_checksum, cancellable, error);
+  /* Check out files on worker threads if requested.  The filter and
+   * SELinux labeling aren't required to be thread-safe, and whiteouts
+   * need to be processed in order, so those checkouts stay serial.
+   */
+  CheckoutParallel parallel = {
+    0,
+  };
+  if (options->n_threads > 1 && !options->filter && !options->sepolicy
+      && !options->process_whiteouts)
+    {
+      /* Set up the cache directory now rather than racing to do it later */
+      if (can_cache && !_ostree_repo_mode_is_bare (self->mode)
+          && options->mode == OSTREE_REPO_CHECKOUT_MODE_USER
+          && !ensure_uncompressed_objects_dir (self, cancellable, error))
+        return FALSE;
+
+      parallel.repo = self;
+      parallel.options = options;
+      parallel.cancellable = cancellable;
+      parallel.pool = g_thread_pool_new (checkout_files_job_thread, &parallel, options->n_threads,
+                                         TRUE, error);
+      if (parallel.pool == NULL)
+        return FALSE;
+      g_mutex_init (&parallel.lock);
+      g_cond_init (&parallel.cond);
+      state.parallel = &parallel;
+    }
+
+  const char *dirtree_checksum;
+  const char *dirmeta_checksum;
+  if (layers)
+    {
+      dirtree_checksum = layers->dirtree_checksum;
+      dirmeta_checksum = layers->dirmeta_checksum;
+    }
+  else
+    {
+      g_assert_cmpint (g_file_info_get_file_type (source_info), ==, G_FILE_TYPE_DIRECTORY);
+      dirtree_checksum = ostree_repo_file_tree_get_contents_checksum (source);
+      dirmeta_checksum = ostree_repo_file_tree_get_metadata_checksum (source);
+    }
+  gboolean ret;
+  if (update_from_source)
+    ret = checkout_tree_update_recurse (
+        self, options, &state, destination_parent_fd, destination_name,
+        ostree_repo_file_tree_get_contents_checksum (update_from_source),
+        ostree_repo_file_tree_get_metadata_checksum (update_from_source), dirtree_checksum,
+        dirmeta_checksum, cancellable, error);
+  else
+    ret = checkout_tree_at_recurse (self, options, &state, destination_parent_fd, destination_name,
+                                    dirtree_checksum, dirmeta_checksum, cancellable, error);
+
+  if (parallel.pool)
+    {
+      g_thread_pool_free (parallel.pool, FALSE, TRUE);
+      g_mutex_clear (&parallel.lock);
+      g_cond_clear (&parallel.cond);
+      g_clear_error (&parallel.error);
+    }
+
+  /* Keep the uncompressed cache within its budget */
+  if (ret && can_cache && !_ostree_repo_mode_is_bare (self->mode))
+    {
+      if (self->uncompressed_cache_max_size > 0)
+        ret = uncompressed_cache_evict (self, FALSE, cancellable, error);
+      else
+        ret = uncompressed_cache_index_invalidate (self, error);
+    }
+
+  return ret;
 }
 
 static void
@@ -1503,7 +2794,7 @@ ostree_repo_checkout_tree (OstreeRepo *self, OstreeRepoCheckoutMode mode,
   canonicalize_options (self, &options);
 
   return checkout_tree_at (self, &options, AT_FDCWD, gs_file_get_path_cached (destination), source,
-                           source_info, cancellable, error);
+                           source_info, NULL, NULL, cancellable, error);
 }
 
 /**
@@ -1598,6 +2889,7 @@ ostree_repo_checkout_at (OstreeRepo *self, OstreeRepoCheckoutAtOptions *options,
   g_return_val_if_fail (!(options->overwrite_mode == OSTREE_REPO_CHECKOUT_OVERWRITE_UNION_IDENTICAL
                           && !options->no_copy_fallback),
                         FALSE);
+  g_return_val_if_fail (!(options->update_from && options->process_whiteouts), FALSE);
 
   g_autoptr (GFile) commit_root = (GFile *)_ostree_repo_file_new_for_commit (self, commit, error);
   if (!commit_root)
@@ -1618,13 +2910,139 @@ ostree_repo_checkout_at (OstreeRepo *self, OstreeRepoCheckoutAtOptions *options,
   if (!target_info)
     return FALSE;
 
+  g_autoptr (GFile) update_from_dir = NULL;
+  if (options->update_from)
+    {
+      if (g_file_info_get_file_type (target_info) != G_FILE_TYPE_DIRECTORY)
+        return glnx_throw (error, "Updating a checkout requires a directory");
+
+      g_autoptr (GFile) update_from_root
+          = (GFile *)_ostree_repo_file_new_for_commit (self, options->update_from, error);
+      if (!update_from_root)
+        return FALSE;
+      if (!ostree_repo_file_ensure_resolved ((OstreeRepoFile *)update_from_root, error))
+        return FALSE;
+
+      if (strcmp (options->subpath, "/") != 0)
+        update_from_dir = g_file_resolve_relative_path (update_from_root, options->subpath);
+      else
+        update_from_dir = g_object_ref (update_from_root);
+      if (!ostree_repo_file_ensure_resolved ((OstreeRepoFile *)update_from_dir, error))
+        return FALSE;
+      if (g_file_query_file_type (update_from_dir, G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS, cancellable)
+          != G_FILE_TYPE_DIRECTORY)
+        return glnx_throw (error, "%s is not a directory in commit %s", options->subpath,
+                           options->update_from);
+    }
+
   if (!checkout_tree_at (self, options, destination_dfd, destination_path,
-                         (OstreeRepoFile *)target_dir, target_info, cancellable, error))
+                         (OstreeRepoFile *)target_dir, target_info,
+                         (OstreeRepoFile *)update_from_dir, NULL, cancellable, error))
     return FALSE;
 
   return TRUE;
 }
 
+/**
+ * ostree_repo_checkout_layers_at:
+ * @self: Repo
+ * @options: (allow-none): Options
+ * @destination_dfd: Directory FD for destination
+ * @destination_path: Directory for destination
+ * @commits: (array zero-terminated=1): Checksums of the commits to layer, lowest first
+ * @subpaths: (array zero-terminated=1) (allow-none): Directory to use from each commit
+ * @cancellable: Cancellable
+ * @error: Error
+ *
+ * Check out the union of the trees of @commits, where files from later
+ * commits replace those from earlier ones.  This gives the same result as
+ * checking out each commit in turn with
+ * %OSTREE_REPO_CHECKOUT_OVERWRITE_UNION_FILES, but the trees are merged
+ * in memory first, so shared directories are only created once and
+ * replaced files are never checked out.  If @options has
+ * `process_whiteouts` set, overlayfs-style whiteouts in a layer hide the
+ * corresponding entries of the layers below it.
+ *
+ * If @subpaths is set, it must have the same length as @commits, and
+ * gives the directory of each commit to use instead of its root.  The
+ * `subpath` and `update_from` members of @options must not be set.
+ *
+ * Since: 2024.11
+ */
+gboolean
+ostree_repo_checkout_layers_at (OstreeRepo *self, OstreeRepoCheckoutAtOptions *options,
+                                int destination_dfd, const char *destination_path,
+                                const char *const *commits, const char *const *subpaths,
+                                GCancellable *cancellable, GError **error)
+{
+  OstreeRepoCheckoutAtOptions default_options = {
+    0,
+  };
+  OstreeRepoCheckoutAtOptions real_options;
+
+  if (!options)
+    options = &default_options;
+
+  /* Make a copy so we can modify the options */
+  real_options = *options;
+  options = &real_options;
+  canonicalize_options (self, options);
+
+  g_return_val_if_fail (commits != NULL && commits[0] != NULL, FALSE);
+  g_return_val_if_fail (g_str_equal (options->subpath, "/"), FALSE);
+  g_return_val_if_fail (options->update_from == NULL, FALSE);
+  g_return_val_if_fail (!(options->force_copy && options->no_copy_fallback), FALSE);
+  g_return_val_if_fail (!options->sepolicy || options->force_copy, FALSE);
+  g_return_val_if_fail (!(options->overwrite_mode == OSTREE_REPO_CHECKOUT_OVERWRITE_UNION_IDENTICAL
+                          && !options->no_copy_fallback),
+                        FALSE);
+
+  g_autoptr (LayeredDir) root = NULL;
+  for (guint i = 0; commits[i] != NULL; i++)
+    {
+      const char *commit = commits[i];
+      const char *subpath = subpaths ? subpaths[i] : "/";
+      g_assert (subpath != NULL);
+
+      g_autoptr (GFile) commit_root
+          = (GFile *)_ostree_repo_file_new_for_commit (self, commit, error);
+      if (!commit_root)
+        return FALSE;
+      if (!ostree_repo_file_ensure_resolved ((OstreeRepoFile *)commit_root, error))
+        return FALSE;
+
+      g_autoptr (GFile) layer_dir = NULL;
+      if (strcmp (subpath, "/") != 0)
+        layer_dir = g_file_resolve_relative_path (commit_root, subpath);
+      else
+        layer_dir = g_object_ref (commit_root);
+      if (!ostree_repo_file_ensure_resolved ((OstreeRepoFile *)layer_dir, error))
+        return FALSE;
+      if (g_file_query_file_type (layer_dir, G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS, cancellable)
+          != G_FILE_TYPE_DIRECTORY)
+        return glnx_throw (error, "%s is not a directory in commit %s", subpath, commit);
+
+      const char *dirtree_checksum
+          = ostree_repo_file_tree_get_contents_checksum ((OstreeRepoFile *)layer_dir);
+      const char *dirmeta_checksum
+          = ostree_repo_file_tree_get_metadata_checksum ((OstreeRepoFile *)layer_dir);
+      if (root == NULL)
+        root = layered_dir_new (dirtree_checksum, dirmeta_checksum);
+      else if (!layered_dir_merge (self, options, root, dirtree_checksum, dirmeta_checksum, error))
+        return glnx_prefix_error (error, "Layering commit %s", commit);
+    }
+
+  g_autoptr (GHashTable) dirtrees = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                                           (GDestroyNotify)g_variant_unref);
+  CheckoutLayers layers = {
+    .dirtrees = dirtrees,
+    .dirtree_checksum = layered_dir_resolve (root, dirtrees),
+    .dirmeta_checksum = root->dirmeta_checksum,
+  };
+  return checkout_tree_at (self, options, destination_dfd, destination_path, NULL, NULL, NULL,
+                           &layers, cancellable, error);
+}
+
 /**
  * ostree_repo_checkout_at_options_set_devino:
  * @opts: Checkout options
@@ -1679,6 +3097,58 @@ ostree_repo_devino_cache_new (void)
   return (OstreeRepoDevInoCache *)g_hash_table_new_full (devino_hash, devino_equal, g_free, NULL);
 }
 
+/* Delete link anchors which are no longer used by any checkout */
+static gboolean
+link_anchors_gc (OstreeRepo *self, GCancellable *cancellable, GError **error)
+{
+  g_auto (GLnxDirFdIterator) dfd_iter = {
+    0,
+  };
+  gboolean exists;
+  if (!ot_dfd_iter_init_allow_noent (self->repo_dir_fd, LINK_ANCHORS_DIR, &dfd_iter, &exists,
+                                     error))
+    return FALSE;
+  if (!exists)
+    return TRUE;
+
+  while (TRUE)
+    {
+      struct dirent *dent;
+      if (!glnx_dirfd_iterator_next_dent_ensure_dtype (&dfd_iter, &dent, cancellable, error))
+        return FALSE;
+      if (dent == NULL)
+        break;
+      if (dent->d_type != DT_DIR)
+        continue;
+
+      g_auto (GLnxDirFdIterator) child_dfd_iter = {
+        0,
+      };
+      if (!glnx_dirfd_iterator_init_at (dfd_iter.fd, dent->d_name, FALSE, &child_dfd_iter, error))
+        return FALSE;
+
+      while (TRUE)
+        {
+          struct dirent *child_dent;
+          struct stat stbuf;
+
+          if (!glnx_dirfd_iterator_next_dent (&child_dfd_iter, &child_dent, cancellable, error))
+            return FALSE;
+          if (child_dent == NULL)
+            break;
+
+          if (!glnx_fstatat (child_dfd_iter.fd, child_dent->d_name, &stbuf, AT_SYMLINK_NOFOLLOW,
+                             error))
+            return FALSE;
+          if (stbuf.st_nlink == 1
+              && !glnx_unlinkat (child_dfd_iter.fd, child_dent->d_name, 0, error))
+            return FALSE;
+        }
+    }
+
+  return TRUE;
+}
+
 /**
  * ostree_repo_checkout_gc:
  * @self: Repo
@@ -1688,6 +3158,14 @@ ostree_repo_devino_cache_new (void)
  * Call this after finishing a succession of checkout operations; it
  * will delete any currently-unused uncompressed objects from the
  * cache.
+ *
+ * If the repository sets `core.uncompressed-cache-max-size`, the least
+ * recently used objects are instead evicted until the unused ones fit in
+ * that size.
+ *
+ * Link anchors, the extra copies of objects created when an object reached
+ * the filesystem's limit on hardlinks, are also deleted once no checkout
+ * uses them.
  */
 gboolean
 ostree_repo_checkout_gc (OstreeRepo *self, GCancellable *cancellable, GError **error)
@@ -1699,6 +3177,12 @@ ostree_repo_checkout_gc (OstreeRepo *self, GCancellable *cancellable, GError **e
   self->updated_uncompressed_dirs = g_hash_table_new (NULL, NULL);
   g_mutex_unlock (&self->cache_lock);
 
+  if (!link_anchors_gc (self, cancellable, error))
+    return FALSE;
+
+  if (self->uncompressed_cache_max_size > 0)
+    return uncompressed_cache_evict (self, TRUE, cancellable, error);
+
   if (!to_clean_dirs)
     return TRUE; /* Note early return */
 
@@ -1739,3 +3223,79 @@ ostree_repo_checkout_gc (OstreeRepo *self, GCancellable *cancellable, GError **e
 
   return TRUE;
 }
+
+/**
+ * ostree_repo_get_uncompressed_cache_stats:
+ * @self: Repo
+ *
+ * Get statistics about the uncompressed object cache used when checking
+ * out from an archive repository, as a dictionary with these keys, all of
+ * type `t`:
+ *
+ *   - hits: Number of files checked out from the cache
+ *   - misses: Number of files which had to be added to the cache
+ *   - evictions: Number of objects evicted from the cache
+ *   - size: Total size in bytes of the cached objects which no checkout
+ *     uses, as of the last eviction; only tracked if
+ *     `core.uncompressed-cache-max-size` is set
+ *   - max-size: Value of `core.uncompressed-cache-max-size` in bytes, or 0
+ *
+ * The counters cover operations done through @self.
+ *
+ * Returns: (transfer full): A #GVariant of type `a{sv}`
+ * Since: 2024.11
+ */
+GVariant *
+ostree_repo_get_uncompressed_cache_stats (OstreeRepo *self)
+{
+  g_auto (GVariantDict) dict;
+  g_variant_dict_init (&dict, NULL);
+
+  g_mutex_lock (&self->cache_lock);
+  g_variant_dict_insert (&dict, "hits", "t", self->uncompressed_cache_hits);
+  g_variant_dict_insert (&dict, "misses", "t", self->uncompressed_cache_misses);
+  g_variant_dict_insert (&dict, "evictions", "t", self->uncompressed_cache_evictions);
+  g_variant_dict_insert (&dict, "size", "t", self->uncompressed_cache_size);
+  g_mutex_unlock (&self->cache_lock);
+  g_variant_dict_insert (&dict, "max-size", "t", self->uncompressed_cache_max_size);
+
+  return g_variant_ref_sink (g_variant_dict_end (&dict));
+}
+
+/**
+ * ostree_repo_get_checkout_stats:
+ * @self: Repo
+ *
+ * Get statistics about how checkouts from @self created files which could
+ * not be hardlinked to the repository object, as a dictionary with these
+ * keys, all of type `t`:
+ *
+ *   - files-cloned: Number of regular files whose data was shared with the
+ *     repository object using a reflink
+ *   - files-copied: Number of regular files whose data was copied
+ *   - hardlinks-anchored: Number of files hardlinked to a link anchor because
+ *     the object itself reached the filesystem's limit on hardlinks
+ *   - link-anchors-created: Number of link anchors created
+ *
+ * The counters cover checkouts done through @self.
+ *
+ * Returns: (transfer full): A #GVariant of type `a{sv}`
+ * Since: 2024.11
+ */
+GVariant *
+ostree_repo_get_checkout_stats (OstreeRepo *self)
+{
+  g_auto (GVariantDict) dict;
+  g_variant_dict_init (&dict, NULL);
+
+  g_variant_dict_insert (&dict, "files-cloned", "t",
+                         (guint64)g_atomic_int_get (&self->checkout_files_cloned));
+  g_variant_dict_insert (&dict, "files-copied", "t",
+                         (guint64)g_atomic_int_get (&self->checkout_files_copied));
+  g_variant_dict_insert (&dict, "hardlinks-anchored", "t",
+                         (guint64)g_atomic_int_get (&self->checkout_anchor_links));
+  g_variant_dict_insert (&dict, "link-anchors-created", "t",
+                         (guint64)g_atomic_int_get (&self->checkout_anchors_created));
+
+  return g_variant_ref_sink (g_variant_dict_end (&dict));
+}
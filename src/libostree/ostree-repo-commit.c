@@ -30,6 +30,7 @@
 #include <glib/gprintf.h>
 #include <stdbool.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
 #include <sys/statvfs.h>
 #include <sys/xattr.h>
 
@@ -187,7 +188,11 @@ _ostree_repo_commit_tmpf_final (OstreeRepo *self, const char *checksum, OstreeOb
   if (!_ostree_repo_ensure_loose_objdir_at (dest_dfd, tmpbuf, cancellable, error))
     return FALSE;
 
-  if (!_ostree_tmpf_fsverity (self, tmpf, NULL, error))
+  /* Objects staged in a transaction only need fs-verity once they're moved
+   * into place, so leave that to worker threads.
+   */
+  const gboolean defer_fsverity = self->in_transaction && dest_dfd == self->commit_stagedir.fd;
+  if (!defer_fsverity && !_ostree_tmpf_fsverity (self, tmpf, NULL, error))
     return FALSE;
 
   if (!glnx_link_tmpfile_at (tmpf, GLNX_LINK_TMPFILE_NOREPLACE_IGNORE_EXIST, dest_dfd, tmpbuf,
@@ -195,6 +200,11 @@ _ostree_repo_commit_tmpf_final (OstreeRepo *self, const char *checksum, OstreeOb
     return FALSE;
   /* We're done with the fd */
   glnx_tmpfile_clear (tmpf);
+  _ostree_repo_object_index_note_added (self, dest_dfd, tmpbuf);
+
+  if (defer_fsverity && !_ostree_repo_fsverity_defer (self, dest_dfd, tmpbuf, error))
+    return FALSE;
+
   return TRUE;
 }
 
@@ -224,6 +234,7 @@ commit_path_final (OstreeRepo *self, const char *checksum, OstreeObjectType objt
       /* The tmp path was consumed */
       ot_cleanup_unlinkat_clear (tmp_path);
     }
+  _ostree_repo_object_index_note_added (self, dest_dfd, tmpbuf);
 
   return TRUE;
 }
@@ -496,7 +507,8 @@ _ostree_repo_bare_content_open (OstreeRepo *self, const char *expected_checksum,
   g_assert (!real->initialized);
   real->initialized = TRUE;
   g_assert (S_ISREG (mode));
-  if (!glnx_open_tmpfile_linkable_at (commit_tmp_dfd (self), ".", O_WRONLY | O_CLOEXEC, &real->tmpf,
+  /* Opened read-write so that _ostree_repo_bare_content_map() can use it */
+  if (!glnx_open_tmpfile_linkable_at (commit_tmp_dfd (self), ".", O_RDWR | O_CLOEXEC, &real->tmpf,
                                       error))
     return FALSE;
   ot_checksum_init (&real->checksum);
@@ -529,6 +541,55 @@ _ostree_repo_bare_content_write (OstreeRepo *repo, OstreeRepoBareContent *barewr
   return TRUE;
 }
 
+/* Map the full content of @barewrite, for callers which generate it all at
+ * once (e.g. bspatch); they then write straight into the page cache instead
+ * of into a heap buffer which is then copied.  The blocks are allocated up
+ * front so that running out of space is an error here rather than a SIGBUS
+ * later.  If the filesystem can't do that, @out_buf is set to %NULL and the
+ * caller should use _ostree_repo_bare_content_write() instead.
+ *
+ * Must not be mixed with _ostree_repo_bare_content_write(), and must be
+ * followed by _ostree_repo_bare_content_unmap().
+ */
+gboolean
+_ostree_repo_bare_content_map (OstreeRepo *repo, OstreeRepoBareContent *barewrite,
+                               guint8 **out_buf, GError **error)
+{
+  OstreeRealRepoBareContent *real = (OstreeRealRepoBareContent *)barewrite;
+  g_assert (real->initialized);
+  g_assert (real->content_len > 0);
+
+  *out_buf = NULL;
+
+  if (fallocate (real->tmpf.fd, 0, 0, real->content_len) < 0)
+    {
+      if (G_IN_SET (errno, EOPNOTSUPP, ENOSYS))
+        return TRUE;
+      return glnx_throw_errno_prefix (error, "fallocate");
+    }
+
+  void *buf = mmap (NULL, real->content_len, PROT_READ | PROT_WRITE, MAP_SHARED, real->tmpf.fd, 0);
+  if (buf == MAP_FAILED)
+    return glnx_throw_errno_prefix (error, "mmap");
+
+  *out_buf = buf;
+  return TRUE;
+}
+
+/* Finish writing the content mapped by _ostree_repo_bare_content_map() */
+gboolean
+_ostree_repo_bare_content_unmap (OstreeRepo *repo, OstreeRepoBareContent *barewrite, guint8 *buf,
+                                 GError **error)
+{
+  OstreeRealRepoBareContent *real = (OstreeRealRepoBareContent *)barewrite;
+  g_assert (real->initialized);
+
+  ot_checksum_update (&real->checksum, buf, real->content_len);
+  if (munmap (buf, real->content_len) < 0)
+    return glnx_throw_errno_prefix (error, "munmap");
+  return TRUE;
+}
+
 gboolean
 _ostree_repo_bare_content_commit (OstreeRepo *self, OstreeRepoBareContent *barewrite,
                                   char *checksum_buf, size_t buflen, GCancellable *cancellable,
@@ -835,6 +896,8 @@ _try_clone_from_payload_link (OstreeRepo *self, OstreeRepo *dest_repo, const cha
            * just unlink it.  */
           if (!glnx_unlinkat (dfd, loose_path_buf, 0, error))
             return FALSE;
+          _ostree_repo_object_index_note_removed (self, dfd, payload_checksum,
+                                                  OSTREE_OBJECT_TYPE_PAYLOAD_LINK);
         }
       else
         {
@@ -1291,6 +1354,7 @@ adopt_and_commit_regfile (OstreeRepo *self, int dfd, const char *name, GFileInfo
       if (!glnx_unlinkat (dfd, name, 0, error))
         return FALSE;
     }
+  _ostree_repo_object_index_note_added (self, dest_dfd, loose_path);
 
   return TRUE;
 }
@@ -1801,6 +1865,7 @@ rename_pending_loose_objects (OstreeRepo *self, GCancellable *cancellable, GErro
           if (!glnx_renameat (child_dfd_iter.fd, loose_objpath + 3, self->objects_dir_fd,
                               loose_objpath, error))
             return FALSE;
+          _ostree_repo_object_index_note_added (self, self->objects_dir_fd, loose_objpath);
         }
     }
 
@@ -2224,6 +2289,9 @@ ostree_repo_commit_transaction (OstreeRepo *self, OstreeRepoTransactionStats *ou
   if ((self->test_error_flags & OSTREE_REPO_TEST_ERROR_PRE_COMMIT) > 0)
     return glnx_throw (error, "OSTREE_REPO_TEST_ERROR_PRE_COMMIT specified");
 
+  if (!_ostree_repo_fsverity_wait (self, error))
+    return FALSE;
+
   /* FIXME: Added OSTREE_SUPPRESS_SYNCFS since valgrind in el7 doesn't know
    * about `syncfs`...we should delete this later.
    */
@@ -2239,6 +2307,9 @@ ostree_repo_commit_transaction (OstreeRepo *self, OstreeRepoTransactionStats *ou
   if (!fsync_object_dirs (self, cancellable, error))
     return FALSE;
 
+  /* Now that the objects are in place, record them in the index */
+  _ostree_repo_object_index_flush (self);
+
   g_debug ("txn commit %s", glnx_basename (self->commit_stagedir.path));
   if (!glnx_tmpdir_delete (&self->commit_stagedir, cancellable, error))
     return FALSE;
@@ -2318,6 +2389,9 @@ ostree_repo_abort_transaction (OstreeRepo *self, GCancellable *cancellable, GErr
 
   g_debug ("Aborting transaction in repository %p", self);
 
+  /* The fs-verity workers use the staging directory */
+  (void)_ostree_repo_fsverity_wait (self, NULL);
+
   if (self->loose_object_devino_hash)
     g_hash_table_remove_all (self->loose_object_devino_hash);
 
@@ -3073,6 +3147,7 @@ ostree_repo_write_commit_detached_metadata (OstreeRepo *self, const char *checks
       g_prefix_error (error, "Unable to write detached metadata: ");
       return FALSE;
     }
+  _ostree_repo_object_index_note_added (self, dest_dfd, pathbuf);
 
   return TRUE;
 }
@@ -4344,6 +4419,8 @@ import_one_object_direct (OstreeRepo *dest_repo, OstreeRepo *src_repo, const cha
       else
         did_hardlink = TRUE;
     }
+  if (did_hardlink)
+    _ostree_repo_object_index_note_added (dest_repo, dest_dfd, loose_path_buf);
 
   /* If we weren't able to hardlink, fall back to a copy (which might be
    * reflinked).
@@ -365,15 +365,138 @@ checkout_one_composefs_file_at (OstreeRepo *repo, OtTristate verity, const char
   return TRUE;
 }
 
+/* With the reuse-dirs option, the directories of the last image generated
+ * are remembered by dirtree and dirmeta checksum, so that generating the
+ * next image in the same process only needs to load the directories which
+ * changed; the others are copied from the previous image.  The cache is
+ * only kept in memory, and dropped by the next checkout without the option.
+ */
+typedef struct
+{
+  char *path; /* relative to the root directory of the image */
+  char **subdir_names;
+  char **subdir_keys;
+} ComposefsCachedDir;
+
+static void
+composefs_cached_dir_free (ComposefsCachedDir *dir)
+{
+  g_free (dir->path);
+  g_strfreev (dir->subdir_names);
+  g_strfreev (dir->subdir_keys);
+  g_free (dir);
+}
+
+/* Writing an image modifies its nodes, so @root is a copy of the root
+ * directory taken before that; it is never modified.
+ */
+struct _OstreeComposefsDirCache
+{
+  struct lcfs_node_s *root;
+  GHashTable *dirs; /* key → ComposefsCachedDir */
+};
+
+void
+_ostree_composefs_dir_cache_free (_OstreeComposefsDirCache *cache)
+{
+  lcfs_node_unref (cache->root);
+  g_hash_table_unref (cache->dirs);
+  g_free (cache);
+}
+
+static struct lcfs_node_s *
+composefs_dir_cache_lookup_node (_OstreeComposefsDirCache *cache, const char *path)
+{
+  g_auto (GStrv) components = g_strsplit (path, "/", -1);
+  struct lcfs_node_s *node = cache->root;
+  for (char **iter = components; node != NULL && *iter != NULL; iter++)
+    node = lcfs_node_lookup_child (node, *iter);
+  return node;
+}
+
+/* A directory to copy from the previous image */
+typedef struct
+{
+  struct lcfs_node_s *parent;
+  char *name;
+  char *key;
+  char *path;
+} ComposefsReusedDir;
+
+static void
+composefs_reused_dir_free (ComposefsReusedDir *reused)
+{
+  g_free (reused->name);
+  g_free (reused->key);
+  g_free (reused->path);
+  g_free (reused);
+}
+
+/* State of generating a composefs image.  Each directory is filled in by
+ * a job on the worker threads; subdirectories are added to their parent
+ * before their job is queued, so a node is only modified by one job.  The
+ * nodes are owned by the tree, which outlives the jobs, so the jobs don't
+ * take references to them.
+ */
+typedef struct
+{
+  OstreeRepo *repo;
+  OtTristate verity;
+  GCancellable *cancellable;
+  GThreadPool *pool;              /* NULL if generating the image serially */
+  _OstreeComposefsDirCache *prev; /* NULL unless reusing directories; read-only */
+  GMutex lock;                    /* protects the fields below */
+  GCond cond;
+  GHashTable *dirs;  /* directories of this image, for the next one, or NULL */
+  GPtrArray *reused; /* ComposefsReusedDir, copied once the jobs are done */
+  guint n_pending;
+  gint failed; /* atomic */
+  GError *error;
+} ComposefsCheckout;
+
+typedef struct
+{
+  char *key;
+  char *path;
+  char dirtree_checksum[OSTREE_SHA256_STRING_LEN + 1];
+  char dirmeta_checksum[OSTREE_SHA256_STRING_LEN + 1];
+  struct lcfs_node_s *directory;
+} ComposefsDirJob;
+
+static void
+composefs_dir_job_free (ComposefsDirJob *job)
+{
+  g_free (job->key);
+  g_free (job->path);
+  g_free (job);
+}
+
+static char *
+composefs_dir_key (ComposefsCheckout *cfs, const char *dirtree_checksum,
+                   const char *dirmeta_checksum)
+{
+  /* The digests stored for files depend on the verity mode */
+  return g_strdup_printf ("%s.%s.%d", dirtree_checksum, dirmeta_checksum, (int)cfs->verity);
+}
+
+static gboolean checkout_composefs_subdir (ComposefsCheckout *cfs, const char *key,
+                                           const char *path, const char *dirtree_checksum,
+                                           const char *dirmeta_checksum,
+                                           struct lcfs_node_s *parent, const char *name,
+                                           GError **error);
+
+/* Fill in @directory from the given dirtree and dirmeta, and remember it
+ * as @key at @path unless @key is %NULL.
+ */
 static gboolean
-checkout_composefs_recurse (OstreeRepo *self, OtTristate verity, const char *dirtree_checksum,
-                            const char *dirmeta_checksum, struct lcfs_node_s *parent,
-                            const char *name, GCancellable *cancellable, GError **error)
+checkout_composefs_dir (ComposefsCheckout *cfs, const char *key, const char *path,
+                        const char *dirtree_checksum, const char *dirmeta_checksum,
+                        struct lcfs_node_s *directory, GError **error)
 {
+  OstreeRepo *self = cfs->repo;
   g_autoptr (GVariant) dirtree = NULL;
   g_autoptr (GVariant) dirmeta = NULL;
   g_autoptr (GVariant) xattrs = NULL;
-  struct lcfs_node_s *directory;
 
   if (!ostree_repo_load_variant (self, OSTREE_OBJECT_TYPE_DIR_TREE, dirtree_checksum, &dirtree,
                                  error))
@@ -389,31 +512,12 @@ checkout_composefs_recurse (OstreeRepo *self, OtTristate verity, const char *dir
   gid = GUINT32_FROM_BE (gid);
   mode = GUINT32_FROM_BE (mode);
 
-  directory = lcfs_node_lookup_child (parent, name);
-  if (directory != NULL && lcfs_node_get_mode (directory) != 0)
-    {
-      return glnx_throw (error, "Target checkout directory already exist");
-    }
-  else
-    {
-      directory = lcfs_node_new ();
-      if (directory == NULL)
-        return glnx_throw (error, "Out of memory");
-
-      /* Takes ownership on success */
-      if (lcfs_node_add_child (parent, directory, name) != 0)
-        {
-          lcfs_node_unref (directory);
-          return glnx_throw_errno_prefix (error, "lcfs_node_add_child");
-        }
-    }
-
   lcfs_node_set_mode (directory, mode);
   lcfs_node_set_uid (directory, uid);
   lcfs_node_set_gid (directory, gid);
 
   /* Set the xattrs if we created the dir */
-  if (xattrs && !_ostree_composefs_set_xattrs (directory, xattrs, cancellable, error))
+  if (xattrs && !_ostree_composefs_set_xattrs (directory, xattrs, cfs->cancellable, error))
     return FALSE;
 
   /* Process files in this subdir */
@@ -428,14 +532,16 @@ checkout_composefs_recurse (OstreeRepo *self, OtTristate verity, const char *dir
         char tmp_checksum[OSTREE_SHA256_STRING_LEN + 1];
         _ostree_checksum_inplace_from_bytes_v (contents_csum_v, tmp_checksum);
 
-        if (!checkout_one_composefs_file_at (self, verity, tmp_checksum, directory, fname,
-                                             cancellable, error))
+        if (!checkout_one_composefs_file_at (self, cfs->verity, tmp_checksum, directory, fname,
+                                             cfs->cancellable, error))
           return glnx_prefix_error (error, "Processing %s", tmp_checksum);
       }
     contents_csum_v = NULL; /* iter_loop freed it */
   }
 
   /* Process subdirectories */
+  g_autoptr (GPtrArray) subdir_names = g_ptr_array_new_with_free_func (g_free);
+  g_autoptr (GPtrArray) subdir_keys = g_ptr_array_new_with_free_func (g_free);
   {
     g_autoptr (GVariant) dir_subdirs = g_variant_get_child_value (dirtree, 1);
     const char *dname;
@@ -459,8 +565,17 @@ checkout_composefs_recurse (OstreeRepo *self, OtTristate verity, const char *dir
         _ostree_checksum_inplace_from_bytes_v (subdirtree_csum_v, subdirtree_checksum);
         char subdirmeta_checksum[OSTREE_SHA256_STRING_LEN + 1];
         _ostree_checksum_inplace_from_bytes_v (subdirmeta_csum_v, subdirmeta_checksum);
-        if (!checkout_composefs_recurse (self, verity, subdirtree_checksum, subdirmeta_checksum,
-                                         directory, dname, cancellable, error))
+        g_autofree char *subdir_key = NULL;
+        g_autofree char *subdir_path = NULL;
+        if (cfs->dirs != NULL)
+          {
+            subdir_key = composefs_dir_key (cfs, subdirtree_checksum, subdirmeta_checksum);
+            subdir_path = *path ? g_strconcat (path, "/", dname, NULL) : g_strdup (dname);
+            g_ptr_array_add (subdir_names, g_strdup (dname));
+            g_ptr_array_add (subdir_keys, g_strdup (subdir_key));
+          }
+        if (!checkout_composefs_subdir (cfs, subdir_key, subdir_path, subdirtree_checksum,
+                                        subdirmeta_checksum, directory, dname, error))
           return FALSE;
       }
     /* Freed by iter-loop */
@@ -468,14 +583,237 @@ checkout_composefs_recurse (OstreeRepo *self, OtTristate verity, const char *dir
     subdirmeta_csum_v = NULL;
   }
 
+  if (key != NULL)
+    {
+      g_mutex_lock (&cfs->lock);
+      if (!g_hash_table_contains (cfs->dirs, key))
+        {
+          ComposefsCachedDir *cached = g_new0 (ComposefsCachedDir, 1);
+          cached->path = g_strdup (path);
+          g_ptr_array_add (subdir_names, NULL);
+          cached->subdir_names = (char **)g_ptr_array_free (g_steal_pointer (&subdir_names), FALSE);
+          g_ptr_array_add (subdir_keys, NULL);
+          cached->subdir_keys = (char **)g_ptr_array_free (g_steal_pointer (&subdir_keys), FALSE);
+          g_hash_table_insert (cfs->dirs, g_strdup (key), cached);
+        }
+      g_mutex_unlock (&cfs->lock);
+    }
+
   return TRUE;
 }
 
+static void
+composefs_dir_job_thread (gpointer data, gpointer user_data)
+{
+  ComposefsDirJob *job = data;
+  ComposefsCheckout *cfs = user_data;
+  g_autoptr (GError) local_error = NULL;
+
+  /* Once one directory failed, don't bother with the remaining ones */
+  if (!g_atomic_int_get (&cfs->failed))
+    (void)checkout_composefs_dir (cfs, job->key, job->path, job->dirtree_checksum,
+                                  job->dirmeta_checksum, job->directory, &local_error);
+  composefs_dir_job_free (job);
+
+  g_mutex_lock (&cfs->lock);
+  if (local_error != NULL)
+    {
+      if (cfs->error == NULL)
+        cfs->error = g_steal_pointer (&local_error);
+      g_atomic_int_set (&cfs->failed, TRUE);
+    }
+  cfs->n_pending--;
+  g_cond_broadcast (&cfs->cond);
+  g_mutex_unlock (&cfs->lock);
+}
+
+/* Carry a directory of the previous image and its subdirectories over to
+ * this one as @path.
+ */
+static void
+composefs_dir_carry_over (ComposefsCheckout *cfs, const char *key, const char *path,
+                          ComposefsCachedDir *prev)
+{
+  if (g_hash_table_contains (cfs->dirs, key))
+    return;
+
+  ComposefsCachedDir *cached = g_new0 (ComposefsCachedDir, 1);
+  cached->path = g_strdup (path);
+  cached->subdir_names = g_strdupv (prev->subdir_names);
+  cached->subdir_keys = g_strdupv (prev->subdir_keys);
+  g_hash_table_insert (cfs->dirs, g_strdup (key), cached);
+
+  for (guint i = 0; prev->subdir_keys[i] != NULL; i++)
+    {
+      ComposefsCachedDir *prev_subdir = g_hash_table_lookup (cfs->prev->dirs, prev->subdir_keys[i]);
+      if (prev_subdir == NULL)
+        continue;
+
+      g_autofree char *subdir_path = g_strconcat (path, "/", prev->subdir_names[i], NULL);
+      composefs_dir_carry_over (cfs, prev->subdir_keys[i], subdir_path, prev_subdir);
+    }
+}
+
+/* Copy the directories found unchanged from the previous image.  This is
+ * only done once all jobs are done, so that the nodes of the previous image
+ * are only ever used by a single thread.
+ */
+static gboolean
+composefs_add_reused_dirs (ComposefsCheckout *cfs, GError **error)
+{
+  for (guint i = 0; i < cfs->reused->len; i++)
+    {
+      ComposefsReusedDir *reused = cfs->reused->pdata[i];
+      ComposefsCachedDir *prev = g_hash_table_lookup (cfs->prev->dirs, reused->key);
+      g_assert (prev != NULL);
+
+      struct lcfs_node_s *prev_node = composefs_dir_cache_lookup_node (cfs->prev, prev->path);
+      if (prev_node == NULL)
+        return glnx_throw (error, "Missing cached directory %s", prev->path);
+
+      struct lcfs_node_s *directory = lcfs_node_clone_deep (prev_node);
+      if (directory == NULL)
+        return glnx_throw (error, "Out of memory");
+
+      /* Takes ownership on success */
+      if (lcfs_node_add_child (reused->parent, directory, reused->name) != 0)
+        {
+          lcfs_node_unref (directory);
+          return glnx_throw_errno_prefix (error, "lcfs_node_add_child");
+        }
+
+      composefs_dir_carry_over (cfs, reused->key, reused->path, prev);
+    }
+
+  return TRUE;
+}
+
+/* Add the directory @name to @parent, copying it from the previous image
+ * if it's unchanged, and otherwise fill it in, possibly on a worker thread.
+ */
+static gboolean
+checkout_composefs_subdir (ComposefsCheckout *cfs, const char *key, const char *path,
+                           const char *dirtree_checksum, const char *dirmeta_checksum,
+                           struct lcfs_node_s *parent, const char *name, GError **error)
+{
+  struct lcfs_node_s *directory = lcfs_node_lookup_child (parent, name);
+  if (directory != NULL && lcfs_node_get_mode (directory) != 0)
+    return glnx_throw (error, "Target checkout directory already exist");
+
+  if (directory == NULL && cfs->prev != NULL && g_hash_table_contains (cfs->prev->dirs, key))
+    {
+      ComposefsReusedDir *reused = g_new0 (ComposefsReusedDir, 1);
+      reused->parent = parent;
+      reused->name = g_strdup (name);
+      reused->key = g_strdup (key);
+      reused->path = g_strdup (path);
+
+      g_mutex_lock (&cfs->lock);
+      g_ptr_array_add (cfs->reused, reused);
+      g_mutex_unlock (&cfs->lock);
+      return TRUE;
+    }
+
+  if (directory == NULL)
+    {
+      directory = lcfs_node_new ();
+      if (directory == NULL)
+        return glnx_throw (error, "Out of memory");
+
+      /* Takes ownership on success */
+      if (lcfs_node_add_child (parent, directory, name) != 0)
+        {
+          lcfs_node_unref (directory);
+          return glnx_throw_errno_prefix (error, "lcfs_node_add_child");
+        }
+    }
+
+  if (cfs->pool == NULL)
+    return checkout_composefs_dir (cfs, key, path, dirtree_checksum, dirmeta_checksum, directory,
+                                   error);
+
+  if (g_atomic_int_get (&cfs->failed))
+    return TRUE; /* The error is reported once all jobs are done */
+
+  ComposefsDirJob *job = g_new0 (ComposefsDirJob, 1);
+  job->key = g_strdup (key);
+  job->path = g_strdup (path);
+  memcpy (job->dirtree_checksum, dirtree_checksum, sizeof (job->dirtree_checksum));
+  memcpy (job->dirmeta_checksum, dirmeta_checksum, sizeof (job->dirmeta_checksum));
+  job->directory = directory;
+
+  g_mutex_lock (&cfs->lock);
+  cfs->n_pending++;
+  g_mutex_unlock (&cfs->lock);
+
+  if (!g_thread_pool_push (cfs->pool, job, error))
+    {
+      g_mutex_lock (&cfs->lock);
+      cfs->n_pending--;
+      g_mutex_unlock (&cfs->lock);
+      composefs_dir_job_free (job);
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+static gboolean
+checkout_composefs_recurse (ComposefsCheckout *cfs, const char *dirtree_checksum,
+                            const char *dirmeta_checksum, struct lcfs_node_s *parent,
+                            const char *name, struct lcfs_node_s **out_directory, GError **error)
+{
+  struct lcfs_node_s *directory;
+
+  directory = lcfs_node_lookup_child (parent, name);
+  if (directory != NULL && lcfs_node_get_mode (directory) != 0)
+    {
+      return glnx_throw (error, "Target checkout directory already exist");
+    }
+  else
+    {
+      directory = lcfs_node_new ();
+      if (directory == NULL)
+        return glnx_throw (error, "Out of memory");
+
+      /* Takes ownership on success */
+      if (lcfs_node_add_child (parent, directory, name) != 0)
+        {
+          lcfs_node_unref (directory);
+          return glnx_throw_errno_prefix (error, "lcfs_node_add_child");
+        }
+    }
+
+  /* The root directory isn't remembered, as more directories are added to
+   * it once the checkout is done.
+   */
+  gboolean ret = checkout_composefs_dir (cfs, NULL, "", dirtree_checksum, dirmeta_checksum,
+                                         directory, error);
+
+  /* Wait for the worker threads even if we failed, as they use @cfs */
+  g_mutex_lock (&cfs->lock);
+  while (cfs->n_pending > 0)
+    g_cond_wait (&cfs->cond, &cfs->lock);
+  if (ret && cfs->error != NULL)
+    {
+      g_propagate_error (error, g_steal_pointer (&cfs->error));
+      ret = FALSE;
+    }
+  g_mutex_unlock (&cfs->lock);
+
+  if (ret && cfs->reused != NULL && !composefs_add_reused_dirs (cfs, error))
+    ret = FALSE;
+
+  *out_directory = directory;
+  return ret;
+}
+
 /* Begin a checkout process */
 static gboolean
-checkout_composefs_tree (OstreeRepo *self, OtTristate verity, OstreeComposefsTarget *target,
-                         OstreeRepoFile *source, GFileInfo *source_info, GCancellable *cancellable,
-                         GError **error)
+checkout_composefs_tree (OstreeRepo *self, OtTristate verity, guint n_threads,
+                         gboolean reuse_dirs, OstreeComposefsTarget *target,
+                         OstreeRepoFile *source, GFileInfo *source_info,
+                         GCancellable *cancellable, GError **error)
 {
   if (g_file_info_get_file_type (source_info) != G_FILE_TYPE_DIRECTORY)
     return glnx_throw (error, "Root checkout of composefs must be directory");
@@ -488,10 +826,87 @@ checkout_composefs_tree (OstreeRepo *self, OtTristate verity, OstreeComposefsTar
 
   g_assert_cmpint (g_file_info_get_file_type (source_info), ==, G_FILE_TYPE_DIRECTORY);
 
+  ComposefsCheckout cfs = {
+    0,
+  };
+  cfs.repo = self;
+  cfs.verity = verity;
+  cfs.cancellable = cancellable;
+  g_mutex_init (&cfs.lock);
+  g_cond_init (&cfs.cond);
+
+  if (reuse_dirs)
+    {
+      cfs.dirs = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                        (GDestroyNotify)composefs_cached_dir_free);
+      cfs.reused = g_ptr_array_new_with_free_func ((GDestroyNotify)composefs_reused_dir_free);
+
+      /* Take the directories of the previous image; a concurrent checkout
+       * will just generate its image from scratch.
+       */
+      g_mutex_lock (&self->cache_lock);
+      cfs.prev = g_steal_pointer (&self->composefs_dir_cache);
+      g_mutex_unlock (&self->cache_lock);
+    }
+  else
+    {
+      /* Don't keep a previous image in memory if it's no longer wanted */
+      g_mutex_lock (&self->cache_lock);
+      _OstreeComposefsDirCache *unwanted = g_steal_pointer (&self->composefs_dir_cache);
+      g_mutex_unlock (&self->cache_lock);
+      g_clear_pointer (&unwanted, _ostree_composefs_dir_cache_free);
+    }
+
+  gboolean ret = TRUE;
+  if (n_threads > 1)
+    {
+      cfs.pool = g_thread_pool_new (composefs_dir_job_thread, &cfs, n_threads, TRUE, error);
+      if (cfs.pool == NULL)
+        ret = FALSE;
+    }
+
   const char *dirtree_checksum = ostree_repo_file_tree_get_contents_checksum (source);
   const char *dirmeta_checksum = ostree_repo_file_tree_get_metadata_checksum (source);
-  return checkout_composefs_recurse (self, verity, dirtree_checksum, dirmeta_checksum, target->dest,
-                                     "root", cancellable, error);
+  struct lcfs_node_s *directory = NULL;
+  if (ret)
+    ret = checkout_composefs_recurse (&cfs, dirtree_checksum, dirmeta_checksum, target->dest,
+                                      "root", &directory, error);
+
+  if (cfs.pool)
+    g_thread_pool_free (cfs.pool, FALSE, TRUE);
+  g_mutex_clear (&cfs.lock);
+  g_cond_clear (&cfs.cond);
+  g_clear_error (&cfs.error);
+  g_clear_pointer (&cfs.reused, g_ptr_array_unref);
+
+  /* Remember this image's directories for the next one */
+  _OstreeComposefsDirCache *cache = NULL;
+  if (ret && cfs.dirs != NULL)
+    {
+      struct lcfs_node_s *root = lcfs_node_clone_deep (directory);
+      if (root != NULL)
+        {
+          cache = g_new0 (_OstreeComposefsDirCache, 1);
+          cache->root = root;
+          cache->dirs = g_steal_pointer (&cfs.dirs);
+        }
+    }
+  if (cache != NULL || cfs.prev != NULL)
+    {
+      g_mutex_lock (&self->cache_lock);
+      if (cache != NULL)
+        {
+          g_clear_pointer (&self->composefs_dir_cache, _ostree_composefs_dir_cache_free);
+          self->composefs_dir_cache = g_steal_pointer (&cache);
+        }
+      else if (self->composefs_dir_cache == NULL)
+        self->composefs_dir_cache = g_steal_pointer (&cfs.prev);
+      g_mutex_unlock (&self->cache_lock);
+    }
+  g_clear_pointer (&cfs.dirs, g_hash_table_unref);
+  g_clear_pointer (&cfs.prev, _ostree_composefs_dir_cache_free);
+
+  return ret;
 }
 
 static struct lcfs_node_s *
@@ -521,8 +936,10 @@ ensure_lcfs_dir (struct lcfs_node_s *parent, const char *name, GError **error)
 /**
  * _ostree_repo_checkout_composefs:
  * @self: Repo
- * @target: A target for the checkout
  * @verity: Use fsverity
+ * @n_threads: Number of worker threads to use, or 0 for one per CPU
+ * @reuse_dirs: Copy unchanged directories from the last image generated with this set
+ * @target: A target for the checkout
  * @source: Source tree
  * @cancellable: Cancellable
  * @error: Error
@@ -538,8 +955,10 @@ ensure_lcfs_dir (struct lcfs_node_s *parent, const char *name, GError **error)
  * Returns: %TRUE on success, %FALSE on failure
  */
 gboolean
-_ostree_repo_checkout_composefs (OstreeRepo *self, OtTristate verity, OstreeComposefsTarget *target,
-                                 OstreeRepoFile *source, GCancellable *cancellable, GError **error)
+_ostree_repo_checkout_composefs (OstreeRepo *self, OtTristate verity, guint n_threads,
+                                 gboolean reuse_dirs, OstreeComposefsTarget *target,
+                                 OstreeRepoFile *source, GCancellable *cancellable,
+                                 GError **error)
 {
 #ifdef HAVE_COMPOSEFS
   GLNX_AUTO_PREFIX_ERROR ("Checking out composefs", error);
@@ -553,7 +972,11 @@ _ostree_repo_checkout_composefs (OstreeRepo *self, OtTristate verity, OstreeComp
   if (!target_info)
     return glnx_prefix_error (error, "Failed to query");
 
-  if (!checkout_composefs_tree (self, verity, target, source, target_info, cancellable, error))
+  if (n_threads == 0)
+    n_threads = g_get_num_processors ();
+
+  if (!checkout_composefs_tree (self, verity, n_threads, reuse_dirs, target, source, target_info,
+                                cancellable, error))
     return FALSE;
 
   /* We need a root dir */
@@ -604,8 +1027,8 @@ ostree_repo_commit_add_composefs_metadata (OstreeRepo *self, guint format_versio
   // We unconditionally add the expected verity digest. Note that for repositories
   // on filesystems without fsverity, this operation currently requires re-checksumming
   // all objects.
-  if (!_ostree_repo_checkout_composefs (self, OT_TRISTATE_YES, target, repo_root, cancellable,
-                                        error))
+  if (!_ostree_repo_checkout_composefs (self, OT_TRISTATE_YES, 0, FALSE, target, repo_root,
+                                        cancellable, error))
     return FALSE;
 
   g_autofree guchar *fsverity_digest = NULL;
@@ -0,0 +1,807 @@
+/*
+ * Copyright (C) Red Hat, Inc.
+ *
+ * SPDX-License-Identifier: LGPL-2.0+
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "ostree-core-private.h"
+#include "ostree-repo-private.h"
+#include "otutil.h"
+
+/* The object index (core.object-index) records the loose objects in objects/
+ * so that ostree_repo_has_object(), ostree_repo_list_objects() and
+ * ostree_repo_query_object_storage_size() don't need to stat() or readdir()
+ * a repository with millions of objects.  It is made of two files at the top
+ * of the repository:
+ *
+ *  - objects.index: a header followed by a fixed size record per object,
+ *    sorted by binary checksum and type, which is mmap()ed and binary searched.
+ *  - objects.journal: records appended at transaction commit and when objects
+ *    are deleted, replayed on top of objects.index when it's loaded.
+ *
+ * The index is only trusted for a fan-out directory (objects/XX) while its
+ * modification time matches the one recorded for it, and such times are only
+ * appended to the journal after the records for the changes leading up to
+ * them.  So a crash, or a writer which doesn't know about the index, just
+ * makes a directory fall back to the filesystem.  The index is also only
+ * consulted while the repository lock is held, since objects are only
+ * deleted with an exclusive lock, which means it can at worst miss an object
+ * added concurrently.  ostree_repo_prune() rewrites objects.index, rescanning
+ * the directories which fell back, and starts a new journal.
+ */
+
+#define OBJECT_INDEX_NAME "objects.index"
+#define OBJECT_INDEX_JOURNAL_NAME "objects.journal"
+#define OBJECT_INDEX_MAGIC "OSTOIDX1"
+
+/* Special values for the recorded modification time of a fan-out directory */
+#define PREFIX_MTIME_UNKNOWN 0
+#define PREFIX_MTIME_ABSENT G_MAXUINT64
+
+typedef enum
+{
+  RECORD_OP_NONE = 0, /* Also what a zeroed out journal block reads as */
+  RECORD_OP_ADD,
+  RECORD_OP_DELETE,
+  RECORD_OP_MTIME,      /* csum[0] is the fan-out directory */
+  RECORD_OP_GENERATION, /* First record of the journal */
+} ObjectIndexRecordOp;
+
+typedef struct
+{
+  guint8 csum[OSTREE_SHA256_DIGEST_LEN];
+  guint8 objtype;
+  guint8 op;
+  guint8 padding[6];
+  guint64 value; /* Little endian; storage size, time or generation */
+} ObjectIndexRecord;
+
+G_STATIC_ASSERT (sizeof (ObjectIndexRecord) == 48);
+
+/* Records are sorted and looked up by checksum and object type */
+#define RECORD_KEY_LEN (OSTREE_SHA256_DIGEST_LEN + 1)
+
+typedef struct
+{
+  char magic[8];
+  guint64 generation;
+  guint64 n_records;
+  guint64 prefix_mtimes[256];
+} ObjectIndexHeader;
+
+struct _OstreeObjectIndex
+{
+  GMutex lock;
+  gboolean loaded; /* Since the repository lock was taken */
+  GMappedFile *base;
+  const ObjectIndexRecord *records;
+  gsize n_records;
+  guint64 generation; /* 0 if there is no usable objects.index */
+  gboolean journal_valid;
+  /* Journal records and changes made by this process, per fan-out directory */
+  GHashTable *overlay[256];
+  guint64 recorded_mtimes[256];
+  gboolean clean[256];
+  /* Changes not yet appended to the journal */
+  GArray *pending;
+  gboolean touched[256];
+  guint64 noted_mtimes[256]; /* Sampled right after our last change */
+  gboolean uncertified[256];
+};
+
+static guint
+record_key_hash (gconstpointer v)
+{
+  const ObjectIndexRecord *rec = v;
+  guint32 hash;
+
+  /* All records in an overlay table share csum[0] */
+  memcpy (&hash, rec->csum + 1, sizeof (hash));
+  return hash ^ rec->objtype;
+}
+
+static gboolean
+record_key_equal (gconstpointer a, gconstpointer b)
+{
+  return memcmp (a, b, RECORD_KEY_LEN) == 0;
+}
+
+static int
+compare_records (gconstpointer a, gconstpointer b)
+{
+  return memcmp (a, b, RECORD_KEY_LEN);
+}
+
+static void
+record_init (ObjectIndexRecord *rec, const char *checksum, OstreeObjectType objtype,
+             ObjectIndexRecordOp op, guint64 value)
+{
+  memset (rec, 0, sizeof (*rec));
+  ostree_checksum_inplace_to_bytes (checksum, rec->csum);
+  rec->objtype = objtype;
+  rec->op = op;
+  rec->value = GUINT64_TO_LE (value);
+}
+
+/* Parse @name in the fan-out directory @prefix, the inverse of
+ * _ostree_loose_path().
+ */
+static gboolean
+parse_loose_name (OstreeRepo *self, const char *prefix, const char *name,
+                  ObjectIndexRecord *out_rec)
+{
+  const char *dot = strchr (name, '.');
+  if (dot == NULL || dot - name != OSTREE_SHA256_STRING_LEN - 2)
+    return FALSE;
+
+  char checksum[OSTREE_SHA256_STRING_LEN + 1];
+  snprintf (checksum, sizeof (checksum), "%.2s%.62s", prefix, name);
+  if (!ostree_validate_checksum_string (checksum, NULL))
+    return FALSE;
+
+  const char *suffix = dot + 1;
+  for (OstreeObjectType objtype = OSTREE_OBJECT_TYPE_FILE; objtype <= OSTREE_OBJECT_TYPE_LAST;
+       objtype++)
+    {
+      const char *objtype_str = ostree_object_type_to_string (objtype);
+      const size_t len = strlen (objtype_str);
+      const gboolean compressed
+          = !OSTREE_OBJECT_TYPE_IS_META (objtype) && self->mode == OSTREE_REPO_MODE_ARCHIVE;
+
+      if (strncmp (suffix, objtype_str, len) != 0
+          || strcmp (suffix + len, compressed ? "z" : "") != 0)
+        continue;
+
+      record_init (out_rec, checksum, objtype, RECORD_OP_ADD, 0);
+      return TRUE;
+    }
+
+  return FALSE;
+}
+
+static guint64
+prefix_mtime (OstreeRepo *self, guint prefix)
+{
+  char buf[3];
+  snprintf (buf, sizeof (buf), "%02x", prefix);
+
+  struct stat stbuf;
+  if (TEMP_FAILURE_RETRY (fstatat (self->objects_dir_fd, buf, &stbuf, 0)) < 0)
+    return errno == ENOENT ? PREFIX_MTIME_ABSENT : PREFIX_MTIME_UNKNOWN;
+
+  return (guint64)stbuf.st_mtim.tv_sec * G_GUINT64_CONSTANT (1000000000) + stbuf.st_mtim.tv_nsec;
+}
+
+static gboolean
+repo_lock_held (OstreeRepo *self, gboolean exclusive)
+{
+  g_autoptr (GMutexLocker) locker = g_mutex_locker_new (&self->lock.mutex);
+  if (exclusive)
+    return self->lock.exclusive > 0;
+  return self->lock.shared > 0 || self->lock.exclusive > 0;
+}
+
+_OstreeObjectIndex *
+_ostree_object_index_new (void)
+{
+  _OstreeObjectIndex *index = g_new0 (_OstreeObjectIndex, 1);
+  g_mutex_init (&index->lock);
+  index->pending = g_array_new (FALSE, FALSE, sizeof (ObjectIndexRecord));
+  return index;
+}
+
+static void
+object_index_clear (_OstreeObjectIndex *index)
+{
+  index->loaded = FALSE;
+  g_clear_pointer (&index->base, g_mapped_file_unref);
+  index->records = NULL;
+  index->n_records = 0;
+  index->generation = 0;
+  index->journal_valid = FALSE;
+  for (guint i = 0; i < G_N_ELEMENTS (index->overlay); i++)
+    g_clear_pointer (&index->overlay[i], g_hash_table_unref);
+  memset (index->recorded_mtimes, 0, sizeof (index->recorded_mtimes));
+  memset (index->clean, 0, sizeof (index->clean));
+}
+
+static void
+object_index_clear_pending (_OstreeObjectIndex *index)
+{
+  g_array_set_size (index->pending, 0);
+  memset (index->touched, 0, sizeof (index->touched));
+  memset (index->noted_mtimes, 0, sizeof (index->noted_mtimes));
+  memset (index->uncertified, 0, sizeof (index->uncertified));
+}
+
+void
+_ostree_object_index_free (_OstreeObjectIndex *index)
+{
+  object_index_clear (index);
+  g_array_unref (index->pending);
+  g_mutex_clear (&index->lock);
+  g_free (index);
+}
+
+static void
+overlay_apply (_OstreeObjectIndex *index, const ObjectIndexRecord *rec)
+{
+  GHashTable **overlay = &index->overlay[rec->csum[0]];
+  if (*overlay == NULL)
+    *overlay = g_hash_table_new_full (record_key_hash, record_key_equal, g_free, NULL);
+
+  ObjectIndexRecord *copy = g_new (ObjectIndexRecord, 1);
+  *copy = *rec;
+  g_hash_table_add (*overlay, copy);
+}
+
+static const ObjectIndexRecord *
+base_lookup (_OstreeObjectIndex *index, const ObjectIndexRecord *key)
+{
+  gsize lo = 0;
+  gsize hi = index->n_records;
+  while (lo < hi)
+    {
+      const gsize mid = lo + (hi - lo) / 2;
+      const int c = compare_records (&index->records[mid], key);
+      if (c == 0)
+        return &index->records[mid];
+      else if (c < 0)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+  return NULL;
+}
+
+/* Position of the first record in the fan-out directory @prefix */
+static gsize
+base_prefix_start (_OstreeObjectIndex *index, guint prefix)
+{
+  gsize lo = 0;
+  gsize hi = index->n_records;
+  while (lo < hi)
+    {
+      const gsize mid = lo + (hi - lo) / 2;
+      if (index->records[mid].csum[0] < prefix)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+  return lo;
+}
+
+static const ObjectIndexRecord *
+object_index_find (_OstreeObjectIndex *index, const ObjectIndexRecord *key)
+{
+  GHashTable *overlay = index->overlay[key->csum[0]];
+  const ObjectIndexRecord *rec = overlay ? g_hash_table_lookup (overlay, key) : NULL;
+  if (rec != NULL)
+    return rec->op == RECORD_OP_ADD ? rec : NULL;
+  return base_lookup (index, key);
+}
+
+/* Call @func for each object in the fan-out directory @prefix */
+static void
+object_index_foreach_record (_OstreeObjectIndex *index, guint prefix,
+                             void (*func) (const ObjectIndexRecord *rec, gpointer user_data),
+                             gpointer user_data)
+{
+  GHashTable *overlay = index->overlay[prefix];
+
+  for (gsize i = base_prefix_start (index, prefix);
+       i < index->n_records && index->records[i].csum[0] == prefix; i++)
+    {
+      const ObjectIndexRecord *rec = &index->records[i];
+      if (overlay == NULL || !g_hash_table_contains (overlay, rec))
+        func (rec, user_data);
+    }
+
+  if (overlay != NULL)
+    {
+      GLNX_HASH_TABLE_FOREACH (overlay, const ObjectIndexRecord *, rec)
+        {
+          if (rec->op == RECORD_OP_ADD)
+            func (rec, user_data);
+        }
+    }
+}
+
+static gboolean
+object_index_load_base (OstreeRepo *self, _OstreeObjectIndex *index, GError **error)
+{
+  glnx_autofd int fd = -1;
+  if (!ot_openat_ignore_enoent (self->repo_dir_fd, OBJECT_INDEX_NAME, &fd, error))
+    return FALSE;
+  /* Note early return; nothing is indexed until the first prune */
+  if (fd < 0)
+    return TRUE;
+
+  g_autoptr (GMappedFile) mfile = g_mapped_file_new_from_fd (fd, FALSE, error);
+  if (!mfile)
+    return glnx_prefix_error (error, "Mapping %s", OBJECT_INDEX_NAME);
+
+  const gsize len = g_mapped_file_get_length (mfile);
+  const ObjectIndexHeader *header = (const ObjectIndexHeader *)g_mapped_file_get_contents (mfile);
+  if (len < sizeof (*header) || memcmp (header->magic, OBJECT_INDEX_MAGIC, sizeof (header->magic)))
+    return glnx_throw (error, "Invalid %s", OBJECT_INDEX_NAME);
+
+  const guint64 n_records = GUINT64_FROM_LE (header->n_records);
+  if ((len - sizeof (*header)) % sizeof (ObjectIndexRecord) != 0
+      || (len - sizeof (*header)) / sizeof (ObjectIndexRecord) != n_records)
+    return glnx_throw (error, "Truncated %s", OBJECT_INDEX_NAME);
+
+  index->generation = GUINT64_FROM_LE (header->generation);
+  for (guint i = 0; i < G_N_ELEMENTS (index->recorded_mtimes); i++)
+    index->recorded_mtimes[i] = GUINT64_FROM_LE (header->prefix_mtimes[i]);
+  index->records = (const ObjectIndexRecord *)(header + 1);
+  index->n_records = n_records;
+  index->base = g_steal_pointer (&mfile);
+  return TRUE;
+}
+
+static gboolean
+object_index_replay_journal (OstreeRepo *self, _OstreeObjectIndex *index, GError **error)
+{
+  glnx_autofd int fd = -1;
+  if (!ot_openat_ignore_enoent (self->repo_dir_fd, OBJECT_INDEX_JOURNAL_NAME, &fd, error))
+    return FALSE;
+  if (fd < 0)
+    return TRUE;
+
+  g_autoptr (GBytes) contents = glnx_fd_readall_bytes (fd, NULL, error);
+  if (!contents)
+    return glnx_prefix_error (error, "Reading %s", OBJECT_INDEX_JOURNAL_NAME);
+
+  gsize len;
+  const ObjectIndexRecord *records = g_bytes_get_data (contents, &len);
+  const gsize n_records = len / sizeof (ObjectIndexRecord);
+
+  /* Left over from before the last rebuild */
+  if (n_records == 0 || records[0].op != RECORD_OP_GENERATION
+      || GUINT64_FROM_LE (records[0].value) != index->generation)
+    return TRUE;
+
+  for (gsize i = 1; i < n_records; i++)
+    {
+      const ObjectIndexRecord *rec = &records[i];
+      switch (rec->op)
+        {
+        case RECORD_OP_ADD:
+        case RECORD_OP_DELETE:
+          overlay_apply (index, rec);
+          break;
+        case RECORD_OP_MTIME:
+          index->recorded_mtimes[rec->csum[0]] = GUINT64_FROM_LE (rec->value);
+          break;
+        default:
+          /* A torn write; nothing after it can be trusted, and nothing more
+           * is appended until the next rebuild.
+           */
+          return TRUE;
+        }
+    }
+
+  index->journal_valid = (len % sizeof (ObjectIndexRecord)) == 0;
+  return TRUE;
+}
+
+static void
+object_index_load (OstreeRepo *self, _OstreeObjectIndex *index)
+{
+  g_autoptr (GError) local_error = NULL;
+
+  object_index_clear (index);
+  if (!object_index_load_base (self, index, &local_error)
+      || (index->generation != 0 && !object_index_replay_journal (self, index, &local_error)))
+    {
+      g_debug ("Ignoring object index: %s", local_error->message);
+      object_index_clear (index);
+    }
+  index->loaded = TRUE;
+
+  for (guint i = 0; i < index->pending->len; i++)
+    overlay_apply (index, &g_array_index (index->pending, ObjectIndexRecord, i));
+
+  for (guint prefix = 0; prefix < G_N_ELEMENTS (index->clean); prefix++)
+    {
+      const guint64 recorded = index->recorded_mtimes[prefix];
+      index->clean[prefix] = index->generation != 0 && !index->uncertified[prefix]
+                             && recorded != PREFIX_MTIME_UNKNOWN
+                             && recorded == prefix_mtime (self, prefix);
+    }
+}
+
+/* Returns the index with its lock held, or %NULL if it can't be used */
+static _OstreeObjectIndex *
+object_index_acquire (OstreeRepo *self)
+{
+  if (!self->enable_object_index || !repo_lock_held (self, FALSE))
+    return NULL;
+
+  _OstreeObjectIndex *index = self->object_index;
+  g_mutex_lock (&index->lock);
+  if (!index->loaded)
+    object_index_load (self, index);
+  if (index->generation == 0)
+    {
+      g_mutex_unlock (&index->lock);
+      return NULL;
+    }
+  return index;
+}
+
+/* Called when the repository lock is dropped, since anything could happen to
+ * objects/ after that.  Pending changes are dropped too; the directories they
+ * touched just fall back until the next rebuild.
+ */
+void
+_ostree_repo_object_index_invalidate (OstreeRepo *self)
+{
+  _OstreeObjectIndex *index = self->object_index;
+  g_autoptr (GMutexLocker) locker = g_mutex_locker_new (&index->lock);
+  object_index_clear (index);
+  object_index_clear_pending (index);
+}
+
+_OstreeObjectIndexResult
+_ostree_repo_object_index_lookup (OstreeRepo *self, const char *checksum, OstreeObjectType objtype,
+                                  guint64 *out_size)
+{
+  _OstreeObjectIndex *index = object_index_acquire (self);
+  if (index == NULL)
+    return _OSTREE_OBJECT_INDEX_UNKNOWN;
+
+  ObjectIndexRecord key;
+  record_init (&key, checksum, objtype, RECORD_OP_NONE, 0);
+
+  _OstreeObjectIndexResult result = _OSTREE_OBJECT_INDEX_UNKNOWN;
+  if (index->clean[key.csum[0]])
+    {
+      const ObjectIndexRecord *rec = object_index_find (index, &key);
+      if (rec != NULL)
+        {
+          result = _OSTREE_OBJECT_INDEX_PRESENT;
+          if (out_size)
+            *out_size = GUINT64_FROM_LE (rec->value);
+        }
+      else
+        result = _OSTREE_OBJECT_INDEX_ABSENT;
+    }
+
+  g_mutex_unlock (&index->lock);
+  return result;
+}
+
+typedef struct
+{
+  _OstreeObjectIndexFunc func;
+  gpointer user_data;
+} ForeachPrefixData;
+
+static void
+foreach_prefix_record (const ObjectIndexRecord *rec, gpointer user_data)
+{
+  ForeachPrefixData *data = user_data;
+  char checksum[OSTREE_SHA256_STRING_LEN + 1];
+
+  ostree_checksum_inplace_from_bytes (rec->csum, checksum);
+  data->func (checksum, rec->objtype, data->user_data);
+}
+
+/* Returns %FALSE if the fan-out directory @prefix needs to be read instead */
+gboolean
+_ostree_repo_object_index_foreach_prefix (OstreeRepo *self, guint prefix,
+                                          _OstreeObjectIndexFunc func, gpointer user_data)
+{
+  g_assert_cmpuint (prefix, <, 256);
+
+  _OstreeObjectIndex *index = object_index_acquire (self);
+  if (index == NULL)
+    return FALSE;
+
+  const gboolean clean = index->clean[prefix];
+  if (clean)
+    {
+      ForeachPrefixData data = { func, user_data };
+      object_index_foreach_record (index, prefix, foreach_prefix_record, &data);
+    }
+
+  g_mutex_unlock (&index->lock);
+  return clean;
+}
+
+/* @mtime is the time of the fan-out directory sampled right after the change */
+static void
+object_index_note (OstreeRepo *self, const ObjectIndexRecord *rec, guint64 mtime)
+{
+  /* Changes made without the repository lock can't be journaled safely; the
+   * directory time will make them fall back instead.
+   */
+  if (!repo_lock_held (self, FALSE))
+    return;
+
+  _OstreeObjectIndex *index = self->object_index;
+  g_autoptr (GMutexLocker) locker = g_mutex_locker_new (&index->lock);
+  const guint prefix = rec->csum[0];
+  if (index->loaded)
+    {
+      if (index->generation == 0)
+        return;
+      overlay_apply (index, rec);
+      index->touched[prefix] = TRUE;
+      index->noted_mtimes[prefix] = mtime;
+    }
+  else
+    index->uncertified[prefix] = TRUE;
+  g_array_append_val (index->pending, *rec);
+}
+
+static void
+object_index_mark_dirty (OstreeRepo *self, guint prefix)
+{
+  _OstreeObjectIndex *index = self->object_index;
+  g_autoptr (GMutexLocker) locker = g_mutex_locker_new (&index->lock);
+  index->uncertified[prefix] = TRUE;
+  index->clean[prefix] = FALSE;
+}
+
+/* Record that @loose_path was linked into @dfd, if that is objects/ */
+void
+_ostree_repo_object_index_note_added (OstreeRepo *self, int dfd, const char *loose_path)
+{
+  if (!self->enable_object_index || dfd != self->objects_dir_fd)
+    return;
+
+  ObjectIndexRecord rec;
+  if (strlen (loose_path) < 3 || loose_path[2] != '/'
+      || !parse_loose_name (self, loose_path, loose_path + 3, &rec))
+    return;
+
+  struct stat stbuf;
+  if (TEMP_FAILURE_RETRY (fstatat (dfd, loose_path, &stbuf, AT_SYMLINK_NOFOLLOW)) < 0)
+    {
+      object_index_mark_dirty (self, rec.csum[0]);
+      return;
+    }
+
+  rec.value = GUINT64_TO_LE (stbuf.st_size);
+  object_index_note (self, &rec, prefix_mtime (self, rec.csum[0]));
+}
+
+/* Record that an object was unlinked from @dfd, if that is objects/ */
+void
+_ostree_repo_object_index_note_removed (OstreeRepo *self, int dfd, const char *checksum,
+                                        OstreeObjectType objtype)
+{
+  if (!self->enable_object_index || dfd != self->objects_dir_fd)
+    return;
+
+  ObjectIndexRecord rec;
+  record_init (&rec, checksum, objtype, RECORD_OP_DELETE, 0);
+  object_index_note (self, &rec, prefix_mtime (self, rec.csum[0]));
+}
+
+static gboolean
+object_index_flush (OstreeRepo *self, _OstreeObjectIndex *index, GError **error)
+{
+  if (!index->loaded)
+    object_index_load (self, index);
+  /* Note early return; the changed directories fall back until the next rebuild */
+  if (index->generation == 0 || !index->journal_valid)
+    return TRUE;
+
+  glnx_autofd int fd = TEMP_FAILURE_RETRY (
+      openat (self->repo_dir_fd, OBJECT_INDEX_JOURNAL_NAME, O_WRONLY | O_APPEND | O_CLOEXEC));
+  if (fd < 0)
+    return glnx_throw_errno_prefix (error, "openat(%s)", OBJECT_INDEX_JOURNAL_NAME);
+
+  if (glnx_loop_write (fd, index->pending->data, index->pending->len * sizeof (ObjectIndexRecord))
+      < 0)
+    return glnx_throw_errno_prefix (error, "write(%s)", OBJECT_INDEX_JOURNAL_NAME);
+  if (!self->disable_fsync && fdatasync (fd) < 0)
+    return glnx_throw_errno_prefix (error, "fdatasync(%s)", OBJECT_INDEX_JOURNAL_NAME);
+
+  /* Only now can the changed directories be trusted again, and only if
+   * nothing but us changed them since our last change, which is when their
+   * times were noted.
+   */
+  g_autoptr (GArray) mtimes = g_array_new (FALSE, FALSE, sizeof (ObjectIndexRecord));
+  for (guint prefix = 0; prefix < G_N_ELEMENTS (index->touched); prefix++)
+    {
+      if (!index->touched[prefix] || index->uncertified[prefix] || !index->clean[prefix])
+        continue;
+
+      const guint64 mtime = index->noted_mtimes[prefix];
+      if (mtime == PREFIX_MTIME_UNKNOWN || mtime != prefix_mtime (self, prefix))
+        {
+          index->clean[prefix] = FALSE;
+          continue;
+        }
+
+      ObjectIndexRecord rec = {
+        0,
+      };
+      rec.csum[0] = prefix;
+      rec.op = RECORD_OP_MTIME;
+      rec.value = GUINT64_TO_LE (mtime);
+      g_array_append_val (mtimes, rec);
+      index->recorded_mtimes[prefix] = mtime;
+    }
+  if (mtimes->len > 0
+      && glnx_loop_write (fd, mtimes->data, mtimes->len * sizeof (ObjectIndexRecord)) < 0)
+    return glnx_throw_errno_prefix (error, "write(%s)", OBJECT_INDEX_JOURNAL_NAME);
+
+  return TRUE;
+}
+
+/* Append the changes made while holding the repository lock to the journal.
+ * Failing to do so isn't fatal, since the affected directories fall back.
+ */
+void
+_ostree_repo_object_index_flush (OstreeRepo *self)
+{
+  if (!self->enable_object_index || !repo_lock_held (self, FALSE))
+    return;
+
+  _OstreeObjectIndex *index = self->object_index;
+  g_autoptr (GMutexLocker) locker = g_mutex_locker_new (&index->lock);
+  if (index->pending->len == 0)
+    return;
+
+  g_autoptr (GError) local_error = NULL;
+  if (!object_index_flush (self, index, &local_error))
+    g_debug ("Failed to update object index: %s", local_error->message);
+  object_index_clear_pending (index);
+}
+
+static void
+collect_record (const ObjectIndexRecord *rec, gpointer user_data)
+{
+  GArray *records = user_data;
+  g_array_append_val (records, *rec);
+}
+
+static gboolean
+object_index_scan_prefix (OstreeRepo *self, guint prefix, GArray *records,
+                          GCancellable *cancellable, GError **error)
+{
+  char prefix_str[3];
+  snprintf (prefix_str, sizeof (prefix_str), "%02x", prefix);
+
+  g_auto (GLnxDirFdIterator) dfd_iter = {
+    0,
+  };
+  gboolean exists;
+  if (!ot_dfd_iter_init_allow_noent (self->objects_dir_fd, prefix_str, &dfd_iter, &exists, error))
+    return FALSE;
+  /* Note early return */
+  if (!exists)
+    return TRUE;
+
+  while (TRUE)
+    {
+      struct dirent *dent;
+      if (!glnx_dirfd_iterator_next_dent (&dfd_iter, &dent, cancellable, error))
+        return FALSE;
+      if (dent == NULL)
+        break;
+
+      ObjectIndexRecord rec;
+      if (!parse_loose_name (self, prefix_str, dent->d_name, &rec))
+        continue;
+
+      struct stat stbuf;
+      if (!glnx_fstatat_allow_noent (dfd_iter.fd, dent->d_name, &stbuf, AT_SYMLINK_NOFOLLOW,
+                                     error))
+        return FALSE;
+      if (errno == ENOENT)
+        continue;
+
+      rec.value = GUINT64_TO_LE (stbuf.st_size);
+      g_array_append_val (records, rec);
+    }
+
+  return TRUE;
+}
+
+/* Write a new objects.index from the current one, rescanning the directories
+ * which can't be trusted, and start a new journal.  This needs the exclusive
+ * repository lock, so that nothing is deleted while scanning.
+ */
+gboolean
+_ostree_repo_object_index_rebuild (OstreeRepo *self, GCancellable *cancellable, GError **error)
+{
+  if (!self->enable_object_index || !repo_lock_held (self, TRUE))
+    return TRUE;
+
+  GLNX_AUTO_PREFIX_ERROR ("Rebuilding object index", error);
+
+  _OstreeObjectIndex *index = self->object_index;
+  g_autoptr (GMutexLocker) locker = g_mutex_locker_new (&index->lock);
+  if (!index->loaded)
+    object_index_load (self, index);
+
+  ObjectIndexHeader header = {
+    0,
+  };
+  memcpy (header.magic, OBJECT_INDEX_MAGIC, sizeof (header.magic));
+  guint64 generation;
+  do
+    generation = ((guint64)g_random_int () << 32) | g_random_int ();
+  while (generation == 0);
+  header.generation = GUINT64_TO_LE (generation);
+
+  g_autoptr (GArray) records = g_array_new (FALSE, FALSE, sizeof (ObjectIndexRecord));
+  guint n_scanned = 0;
+  for (guint prefix = 0; prefix < G_N_ELEMENTS (header.prefix_mtimes); prefix++)
+    {
+      /* Taken before reading the directory, so that anything added meanwhile
+       * makes it fall back.
+       */
+      const guint64 mtime = prefix_mtime (self, prefix);
+      if (index->clean[prefix])
+        object_index_foreach_record (index, prefix, collect_record, records);
+      else
+        {
+          if (!object_index_scan_prefix (self, prefix, records, cancellable, error))
+            return FALSE;
+          n_scanned++;
+        }
+      header.prefix_mtimes[prefix] = GUINT64_TO_LE (mtime);
+    }
+  g_array_sort (records, compare_records);
+  header.n_records = GUINT64_TO_LE (records->len);
+  g_debug ("Writing object index of %u objects, rescanned %u directories", records->len,
+           n_scanned);
+
+  g_auto (GLnxTmpfile) tmpf = {
+    0,
+  };
+  if (!glnx_open_tmpfile_linkable_at (self->repo_dir_fd, ".", O_WRONLY | O_CLOEXEC, &tmpf, error))
+    return FALSE;
+  if (glnx_loop_write (tmpf.fd, &header, sizeof (header)) < 0
+      || glnx_loop_write (tmpf.fd, records->data, records->len * sizeof (ObjectIndexRecord)) < 0)
+    return glnx_throw_errno_prefix (error, "write");
+  if (fchmod (tmpf.fd, 0644) < 0)
+    return glnx_throw_errno_prefix (error, "fchmod");
+  if (!self->disable_fsync && fdatasync (tmpf.fd) < 0)
+    return glnx_throw_errno_prefix (error, "fdatasync");
+  if (!glnx_link_tmpfile_at (&tmpf, GLNX_LINK_TMPFILE_REPLACE, self->repo_dir_fd,
+                             OBJECT_INDEX_NAME, error))
+    return FALSE;
+
+  /* The old journal doesn't match the new generation, so it's ignored if
+   * we're interrupted here.
+   */
+  ObjectIndexRecord rec = {
+    0,
+  };
+  rec.op = RECORD_OP_GENERATION;
+  rec.value = header.generation;
+  if (!glnx_file_replace_contents_at (
+          self->repo_dir_fd, OBJECT_INDEX_JOURNAL_NAME, (guint8 *)&rec, sizeof (rec),
+          self->disable_fsync ? GLNX_FILE_REPLACE_NODATASYNC : GLNX_FILE_REPLACE_DATASYNC_NEW,
+          cancellable, error))
+    return FALSE;
+
+  /* Everything pending is in the new index; it's loaded again on next use */
+  object_index_clear (index);
+  object_index_clear_pending (index);
+  return TRUE;
+}
@@ -35,6 +35,12 @@ G_BEGIN_DECLS
 
 #define _OSTREE_MAX_OUTSTANDING_DELTAPART_REQUESTS 2
 
+/* Maximum number of static deltas the pull code will apply in sequence
+ * to get from a commit we have to the requested one; beyond that, it's
+ * unlikely to beat fetching objects directly.
+ */
+#define _OSTREE_MAX_STATIC_DELTA_CHAIN_LENGTH 8
+
 /* We want some parallelism with disk writes, but we also
  * want to avoid starting tens or hundreds of threads
  * (via GTask) all writing to disk.  Eventually we may
@@ -75,6 +81,7 @@ typedef enum
 {
   OSTREE_REPO_TEST_ERROR_PRE_COMMIT = (1 << 0),
   OSTREE_REPO_TEST_ERROR_INVALID_CACHE = (1 << 1),
+  OSTREE_REPO_TEST_ERROR_EMLINK = (1 << 2),
 } OstreeRepoTestErrorFlags;
 
 struct OstreeRepoCommitModifier
@@ -129,6 +136,28 @@ typedef enum
   _OSTREE_FEATURE_YES,
 } _OstreeFeatureSupport;
 
+/* Worker threads enabling fs-verity; see ostree-repo-verity.c */
+typedef struct _OstreeFsverityWorkers _OstreeFsverityWorkers;
+
+/* Persistent index of loose objects; see ostree-repo-object-index.c */
+typedef struct _OstreeObjectIndex _OstreeObjectIndex;
+
+/* Directories of a previous composefs image; see ostree-repo-composefs.c */
+typedef struct _OstreeComposefsDirCache _OstreeComposefsDirCache;
+
+/* Parsed contents of refs/packed-refs; see ostree-repo-refs.c */
+typedef struct _OstreePackedRefs _OstreePackedRefs;
+
+typedef enum
+{
+  _OSTREE_OBJECT_INDEX_UNKNOWN, /* Not indexed; look at the filesystem */
+  _OSTREE_OBJECT_INDEX_ABSENT,
+  _OSTREE_OBJECT_INDEX_PRESENT,
+} _OstreeObjectIndexResult;
+
+typedef void (*_OstreeObjectIndexFunc) (const char *checksum, OstreeObjectType objtype,
+                                        gpointer user_data);
+
 /* Possible values for the sysroot.bootloader configuration variable */
 typedef enum
 {
@@ -178,24 +207,32 @@ struct OstreeRepo
   char *cache_dir;
   int objects_dir_fd;
   int uncompressed_objects_dir_fd;
+  int link_anchors_dir_fd; /* Opened lazily under cache_lock */
   GFile *sysroot_dir;
   GWeakRef sysroot; /* Weak to avoid a circular ref; see also `is_system` */
   char *remotes_config_dir;
 
   OstreeRepoLock lock;
+  _OstreeObjectIndex *object_index; /* Only used while the lock is held */
 
   GMutex txn_lock;
   OstreeRepoTxn txn;
   gboolean txn_locked;
   _OstreeFeatureSupport fs_verity_wanted;
   _OstreeFeatureSupport fs_verity_supported;
+  _OstreeFsverityWorkers *fsverity_workers; /* Staged objects; protected by txn_lock */
   OtTristate composefs_wanted;
   gboolean composefs_supported;
 
   GMutex cache_lock;
-  guint dirmeta_cache_refcount;
-  /* char * checksum → GVariant * for dirmeta objects, used in the checkout path */
-  GHashTable *dirmeta_cache;
+  /* Directories of the last composefs image generated with reuse-dirs; see
+   * ostree-repo-composefs.c.  Protected by cache_lock.
+   */
+  _OstreeComposefsDirCache *composefs_dir_cache;
+  /* Last parsed refs/packed-refs, revalidated against its stat on each use.
+   * Protected by cache_lock.
+   */
+  _OstreePackedRefs *packed_refs;
 
   gboolean inited;
   gboolean writable;
@@ -209,6 +246,20 @@ struct OstreeRepo
   guint zlib_compression_level;
   GHashTable *loose_object_devino_hash;
   GHashTable *updated_uncompressed_dirs;
+  /* Objects used from uncompressed-objects-cache which are yet to be merged into its index,
+   * only if core.uncompressed-cache-max-size is set; see ostree-repo-checkout.c.  Protected
+   * by cache_lock, as are the counters.
+   */
+  GHashTable *uncompressed_cache_pending;
+  guint64 uncompressed_cache_size;
+  guint64 uncompressed_cache_hits;
+  guint64 uncompressed_cache_misses;
+  guint64 uncompressed_cache_evictions;
+  /* Checkout counters; see ostree_repo_get_checkout_stats().  Accessed atomically. */
+  gint checkout_files_cloned;
+  gint checkout_files_copied;
+  gint checkout_anchor_links;
+  gint checkout_anchors_created;
 
   /* FIXME: The object sizes hash table is really per-commit state, not repo
    * state. Using a single table for the repo means that commits cannot be
@@ -235,18 +286,22 @@ struct OstreeRepo
   GMutex remotes_lock;
   OstreeRepoMode mode;
   gboolean enable_uncompressed_cache;
+  guint64 uncompressed_cache_max_size; /* See the uncompressed-cache-max-size config option */
   gboolean generate_sizes;
   guint64 tmp_expiry_seconds;
   gchar *collection_id;
   gboolean add_remotes_config_dir; /* Add new remotes in remotes.d dir */
   gint lock_timeout_seconds;
   guint64 payload_link_threshold;
-  gint fs_support_reflink; /* The underlying filesystem has support for ioctl (FICLONE..) */
+  gboolean enable_object_index; /* See the object-index config option */
+  guint prune_full_interval;    /* See the prune-full-interval config option */
+  gint fs_support_reflink;      /* The underlying filesystem has support for ioctl (FICLONE..) */
   gchar **repo_finders;
   OstreeCfgSysrootBootloaderOpt bootloader; /* Configure which bootloader to use. */
   GHashTable
       *bls_append_values;     /* Parsed key-values from bls-append-except-default key in config. */
   gboolean enable_bootprefix; /* If true, prepend bootloader entries with /boot */
+  gboolean enable_boot_prefetch; /* If true, write a list of objects to read ahead at boot */
 
   OstreeRepo *parent_repo;
 };
@@ -258,10 +313,11 @@ typedef struct
   char checksum[OSTREE_SHA256_STRING_LEN + 1];
 } OstreeDevIno;
 
-/* A MemoryCacheRef is an in-memory cache of objects (currently just DIRMETA).  This can
- * be used when performing an operation that traverses a repository in someway.  Currently,
- * the primary use case is ostree_repo_checkout_at() avoiding lots of duplicate dirmeta
- * lookups.
+/* While a MemoryCacheRef is held, DIRMETA objects are kept in the process-wide
+ * metadata cache, even if ostree_repo_set_metadata_cache_max_size() wasn't called.
+ * This can be used when performing an operation that traverses a repository in
+ * someway.  Currently, the primary use case is ostree_repo_checkout_at() avoiding
+ * lots of duplicate dirmeta lookups.
  */
 typedef struct
 {
@@ -315,6 +371,8 @@ gboolean _ostree_repo_write_ref (OstreeRepo *self, const char *remote,
                                  const OstreeCollectionRef *ref, const char *rev, const char *alias,
                                  GCancellable *cancellable, GError **error);
 
+void _ostree_packed_refs_unref (_OstreePackedRefs *packed);
+
 OstreeRepoFile *_ostree_repo_file_new_for_commit (OstreeRepo *repo, const char *commit,
                                                   GError **error);
 
@@ -379,6 +437,12 @@ gboolean _ostree_repo_bare_content_write (OstreeRepo *repo, OstreeRepoBareConten
                                           const guint8 *buf, size_t len, GCancellable *cancellable,
                                           GError **error);
 
+gboolean _ostree_repo_bare_content_map (OstreeRepo *repo, OstreeRepoBareContent *barewrite,
+                                        guint8 **out_buf, GError **error);
+
+gboolean _ostree_repo_bare_content_unmap (OstreeRepo *repo, OstreeRepoBareContent *barewrite,
+                                          guint8 *buf, GError **error);
+
 gboolean _ostree_repo_bare_content_commit (OstreeRepo *self, OstreeRepoBareContent *barewrite,
                                            char *checksum_buf, size_t buflen,
                                            GCancellable *cancellable, GError **error);
@@ -415,6 +479,39 @@ gboolean _ostree_tmpf_fsverity (OstreeRepo *self, GLnxTmpfile *tmpf, GBytes *sig
 gboolean _ostree_ensure_fsverity (OstreeRepo *self, gboolean allow_enoent, int dirfd,
                                   const char *path, gboolean *supported, GError **error);
 
+_OstreeFsverityWorkers *_ostree_fsverity_workers_new (OstreeRepo *self, GError **error);
+gboolean _ostree_fsverity_workers_push (_OstreeFsverityWorkers *workers, int dirfd,
+                                        const char *path, GError **error);
+gboolean _ostree_fsverity_workers_finish (_OstreeFsverityWorkers *workers, GError **error);
+
+gboolean _ostree_repo_fsverity_defer (OstreeRepo *self, int dirfd, const char *path,
+                                      GError **error);
+gboolean _ostree_repo_fsverity_wait (OstreeRepo *self, GError **error);
+
+_OstreeObjectIndex *_ostree_object_index_new (void);
+void _ostree_object_index_free (_OstreeObjectIndex *index);
+void _ostree_repo_object_index_invalidate (OstreeRepo *self);
+_OstreeObjectIndexResult _ostree_repo_object_index_lookup (OstreeRepo *self, const char *checksum,
+                                                           OstreeObjectType objtype,
+                                                           guint64 *out_size);
+gboolean _ostree_repo_object_index_foreach_prefix (OstreeRepo *self, guint prefix,
+                                                   _OstreeObjectIndexFunc func,
+                                                   gpointer user_data);
+void _ostree_repo_object_index_note_added (OstreeRepo *self, int dfd, const char *loose_path);
+void _ostree_repo_object_index_note_removed (OstreeRepo *self, int dfd, const char *checksum,
+                                             OstreeObjectType objtype);
+void _ostree_repo_object_index_flush (OstreeRepo *self);
+gboolean _ostree_repo_object_index_rebuild (OstreeRepo *self, GCancellable *cancellable,
+                                            GError **error);
+
+/* Binary checksum followed by the object type */
+#define _OSTREE_REACHABLE_SET_ENTRY_SIZE (OSTREE_SHA256_DIGEST_LEN + 1)
+
+void _ostree_repo_reachable_set_serialize (OstreeRepoReachableSet *set, GByteArray *buf);
+gboolean _ostree_repo_reachable_set_add_serialized (OstreeRepoReachableSet *set,
+                                                    const guint8 *data, gsize len,
+                                                    GError **error);
+
 gboolean _ostree_repo_verify_bindings (const char *collection_id, const char *ref_name,
                                        GVariant *commit, GError **error);
 
@@ -473,9 +570,11 @@ gboolean ostree_composefs_target_write (OstreeComposefsTarget *target, int fd,
                                         guchar **out_fsverity_digest, GCancellable *cancellable,
                                         GError **error);
 
-gboolean _ostree_repo_checkout_composefs (OstreeRepo *self, OtTristate verity,
-                                          OstreeComposefsTarget *target, OstreeRepoFile *source,
-                                          GCancellable *cancellable, GError **error);
+gboolean _ostree_repo_checkout_composefs (OstreeRepo *self, OtTristate verity, guint n_threads,
+                                          gboolean reuse_dirs, OstreeComposefsTarget *target,
+                                          OstreeRepoFile *source, GCancellable *cancellable,
+                                          GError **error);
+void _ostree_composefs_dir_cache_free (_OstreeComposefsDirCache *cache);
 static inline gboolean
 composefs_not_supported (GError **error)
 {
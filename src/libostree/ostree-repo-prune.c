@@ -26,15 +26,19 @@
 #include "ostree-repo-private.h"
 #include "otutil.h"
 
+/* The objects of one objects/XX directory, and what pruning them found */
 typedef struct
 {
   OstreeRepo *repo;
-  GHashTable *reachable;
+  OstreeRepoReachableSet *reachable;
+  GPtrArray *objects;             /* Serialized object names */
+  GPtrArray *unreachable_commits; /* Checksums, deleted after the sweep */
   guint n_reachable_meta;
   guint n_reachable_content;
   guint n_unreachable_meta;
   guint n_unreachable_content;
   guint64 freed_bytes;
+  GError *error;
 } OtPruneData;
 
 static gboolean
@@ -51,7 +55,7 @@ maybe_prune_loose_object (OtPruneData *data, OstreeRepoPruneFlags flags, GVarian
   if (commit_only && (objtype != OSTREE_OBJECT_TYPE_COMMIT))
     goto exit;
 
-  if (g_hash_table_lookup_extended (data->reachable, key, NULL, NULL))
+  if (ostree_repo_reachable_set_contains (data->reachable, checksum, objtype))
     reachable = TRUE;
   else
     {
@@ -87,10 +91,8 @@ maybe_prune_loose_object (OtPruneData *data, OstreeRepoPruneFlags flags, GVarian
               sprintf (target_checksum, "%.2s%.62s", target_buf + _OSTREE_PAYLOAD_LINK_PREFIX_LEN,
                        target_buf + _OSTREE_PAYLOAD_LINK_PREFIX_LEN + 3);
 
-              g_autoptr (GVariant) target_key
-                  = ostree_object_name_serialize (target_checksum, OSTREE_OBJECT_TYPE_FILE);
-
-              if (g_hash_table_lookup_extended (data->reachable, target_key, NULL, NULL))
+              if (ostree_repo_reachable_set_contains (data->reachable, target_checksum,
+                                                      OSTREE_OBJECT_TYPE_FILE))
                 {
                   guint64 target_storage_size = 0;
                   if (!ostree_repo_query_object_storage_size (data->repo, OSTREE_OBJECT_TYPE_FILE,
@@ -103,13 +105,13 @@ maybe_prune_loose_object (OtPruneData *data, OstreeRepoPruneFlags flags, GVarian
                     goto exit;
                 }
             }
-          else if (objtype == OSTREE_OBJECT_TYPE_COMMIT)
-            {
-              if (!ostree_repo_mark_commit_partial (data->repo, checksum, FALSE, error))
-                return FALSE;
-            }
 
-          if (!ostree_repo_delete_object (data->repo, objtype, checksum, cancellable, error))
+          /* Deleting a commit involves more than its file, so that's done
+           * afterwards, see prune_commits().
+           */
+          if (objtype == OSTREE_OBJECT_TYPE_COMMIT)
+            g_ptr_array_add (data->unreachable_commits, g_strdup (checksum));
+          else if (!ostree_repo_delete_object (data->repo, objtype, checksum, cancellable, error))
             return FALSE;
         }
 
@@ -257,26 +259,173 @@ ostree_repo_prune_static_deltas (OstreeRepo *self, const char *commit, GCancella
   return TRUE;
 }
 
+/* The sweep is sharded by objects/XX directory, and the shards are pruned by
+ * a pool of workers, so that deletions in different directories (which on
+ * many filesystems serialize on the directory) run in parallel.  Each shard
+ * keeps its own counts, which are only summed up at the end.
+ */
+typedef struct
+{
+  OstreeRepoPruneFlags flags;
+  OtPruneData shards[256];
+  gint n_shards_done;
+  gint n_swept;
+  gint n_pruned;
+  gint failed;
+  GMainContext *main_context;
+  GCancellable *cancellable;
+} OtPruneSweep;
+
+/* Number of objects swept between progress updates */
+#define PRUNE_PROGRESS_BATCH 128
+
+static void
+prune_shard_thread (gpointer data, gpointer user_data)
+{
+  OtPruneData *shard = data;
+  OtPruneSweep *sweep = user_data;
+
+  for (guint i = 0; i < shard->objects->len; i++)
+    {
+      const guint n_unreachable = shard->n_unreachable_meta + shard->n_unreachable_content;
+
+      if (g_atomic_int_get (&sweep->failed))
+        break;
+      if (g_cancellable_set_error_if_cancelled (sweep->cancellable, &shard->error)
+          || !maybe_prune_loose_object (shard, sweep->flags, shard->objects->pdata[i],
+                                        sweep->cancellable, &shard->error))
+        {
+          g_atomic_int_set (&sweep->failed, 1);
+          break;
+        }
+
+      if (shard->n_unreachable_meta + shard->n_unreachable_content != n_unreachable)
+        g_atomic_int_inc (&sweep->n_pruned);
+      /* Wake up the progress loop every batch, rather than once per shard */
+      if (g_atomic_int_add (&sweep->n_swept, 1) % PRUNE_PROGRESS_BATCH == 0)
+        g_main_context_wakeup (sweep->main_context);
+    }
+
+  g_atomic_int_inc (&sweep->n_shards_done);
+  g_main_context_wakeup (sweep->main_context);
+}
+
+static void
+prune_sweep_update_progress (OtPruneSweep *sweep, OstreeAsyncProgress *progress, guint n_objects)
+{
+  ostree_async_progress_set (progress, "total-objects", "u", n_objects, "swept-objects", "u",
+                             (guint)g_atomic_int_get (&sweep->n_swept), "pruned-objects", "u",
+                             (guint)g_atomic_int_get (&sweep->n_pruned), NULL);
+}
+
+/* Delete the commits found unreachable by the sweep, along with their
+ * detached metadata and commitpartial marker, and adding a tombstone if
+ * those are enabled.
+ */
+static gboolean
+prune_commits (OstreeRepo *self, GPtrArray *commits, GCancellable *cancellable, GError **error)
+{
+  for (guint i = 0; i < commits->len; i++)
+    {
+      const char *checksum = commits->pdata[i];
+
+      if (!ostree_repo_mark_commit_partial (self, checksum, FALSE, error))
+        return FALSE;
+      if (!ostree_repo_delete_object (self, OSTREE_OBJECT_TYPE_COMMIT, checksum, cancellable,
+                                      error))
+        return FALSE;
+    }
+
+  return TRUE;
+}
+
 static gboolean
-repo_prune_internal (OstreeRepo *self, GHashTable *objects, OstreeRepoPruneOptions *options,
+repo_prune_internal (OstreeRepo *self, GHashTable *objects, OstreeRepoPruneFlags flags,
+                     OstreeRepoReachableSet *reachable, OstreeAsyncProgress *progress,
                      gint *out_objects_total, gint *out_objects_pruned,
                      guint64 *out_pruned_object_size_total, GCancellable *cancellable,
                      GError **error)
 {
+  g_autofree OtPruneSweep *sweep = g_new0 (OtPruneSweep, 1);
+  sweep->flags = flags;
+  sweep->cancellable = cancellable;
+  g_autoptr (GMainContext) main_context = g_main_context_ref_thread_default ();
+  sweep->main_context = main_context;
+
+  for (guint i = 0; i < G_N_ELEMENTS (sweep->shards); i++)
+    {
+      OtPruneData *shard = &sweep->shards[i];
+      shard->repo = self;
+      shard->reachable = reachable;
+      shard->objects = g_ptr_array_new ();
+      shard->unreachable_commits = g_ptr_array_new_with_free_func (g_free);
+    }
+
+  GLNX_HASH_TABLE_FOREACH (objects, GVariant *, serialized_key)
+    {
+      const char *checksum;
+      OstreeObjectType objtype;
+      ostree_object_name_deserialize (serialized_key, &checksum, &objtype);
+
+      const guint prefix
+          = (g_ascii_xdigit_value (checksum[0]) << 4) | g_ascii_xdigit_value (checksum[1]);
+      g_ptr_array_add (sweep->shards[prefix].objects, serialized_key);
+    }
+
+  const guint n_objects = g_hash_table_size (objects);
+  guint n_shards = 0;
+  GThreadPool *pool
+      = g_thread_pool_new (prune_shard_thread, sweep, g_get_num_processors (), FALSE, NULL);
+  for (guint i = 0; i < G_N_ELEMENTS (sweep->shards); i++)
+    {
+      if (sweep->shards[i].objects->len == 0)
+        continue;
+      g_thread_pool_push (pool, &sweep->shards[i], NULL);
+      n_shards++;
+    }
+
+  /* Like pulls, report progress through the thread-default main context */
+  if (progress != NULL)
+    {
+      while ((guint)g_atomic_int_get (&sweep->n_shards_done) < n_shards)
+        {
+          prune_sweep_update_progress (sweep, progress, n_objects);
+          g_main_context_iteration (main_context, TRUE);
+        }
+      prune_sweep_update_progress (sweep, progress, n_objects);
+    }
+  g_thread_pool_free (pool, FALSE, TRUE);
+
+  gboolean ret = TRUE;
+  g_autoptr (GPtrArray) unreachable_commits = g_ptr_array_new_with_free_func (g_free);
   OtPruneData data = {
     0,
   };
+  for (guint i = 0; i < G_N_ELEMENTS (sweep->shards); i++)
+    {
+      OtPruneData *shard = &sweep->shards[i];
 
-  data.repo = self;
-  /* We unref this when we're done */
-  g_autoptr (GHashTable) reachable_owned = g_hash_table_ref (options->reachable);
-  data.reachable = reachable_owned;
+      if (shard->error != NULL)
+        {
+          if (ret)
+            g_propagate_error (error, g_steal_pointer (&shard->error));
+          g_clear_error (&shard->error);
+          ret = FALSE;
+        }
 
-  GLNX_HASH_TABLE_FOREACH (objects, GVariant *, serialized_key)
-    {
-      if (!maybe_prune_loose_object (&data, options->flags, serialized_key, cancellable, error))
-        return FALSE;
+      data.n_reachable_meta += shard->n_reachable_meta;
+      data.n_reachable_content += shard->n_reachable_content;
+      data.n_unreachable_meta += shard->n_unreachable_meta;
+      data.n_unreachable_content += shard->n_unreachable_content;
+      data.freed_bytes += shard->freed_bytes;
+      g_ptr_array_extend_and_steal (unreachable_commits, shard->unreachable_commits);
+      g_ptr_array_unref (shard->objects);
     }
+  if (!ret)
+    return FALSE;
+
+  if (!prune_commits (self, unreachable_commits, cancellable, error))
+    return FALSE;
 
   if (!ostree_repo_prune_static_deltas (self, NULL, cancellable, error))
     return FALSE;
@@ -284,6 +433,11 @@ repo_prune_internal (OstreeRepo *self, GHashTable *objects, OstreeRepoPruneOptio
   if (!_ostree_repo_prune_tmp (self, cancellable, error))
     return FALSE;
 
+  /* With the exclusive lock held, this is the time to compact the object index */
+  if (!(flags & OSTREE_REPO_PRUNE_FLAGS_NO_PRUNE)
+      && !_ostree_repo_object_index_rebuild (self, cancellable, error))
+    return FALSE;
+
   *out_objects_total = (data.n_reachable_meta + data.n_unreachable_meta + data.n_reachable_content
                         + data.n_unreachable_content);
   *out_objects_pruned = (data.n_unreachable_meta + data.n_unreachable_content);
@@ -291,27 +445,180 @@ repo_prune_internal (OstreeRepo *self, GHashTable *objects, OstreeRepoPruneOptio
   return TRUE;
 }
 
+/* With %OSTREE_REPO_PRUNE_FLAGS_INCREMENTAL, ostree_repo_prune() saves the
+ * set of reachable objects it computed, and the next one starts from it.
+ * Since traversal stops at anything already in the set, only commits and
+ * trees added since are walked.  Objects which became unreachable in the
+ * meantime are kept until the next full prune; that happens after
+ * core.prune-full-interval incremental ones, or when the options change.
+ *
+ * The file is a header followed by _OSTREE_REACHABLE_SET_ENTRY_SIZE byte
+ * entries, see _ostree_repo_reachable_set_serialize().
+ */
+#define PRUNE_STATE_PATH "state/prune-reachable"
+#define PRUNE_STATE_MAGIC "OSTPRUN1"
+#define PRUNE_STATE_FLAGS (OSTREE_REPO_PRUNE_FLAGS_REFS_ONLY | OSTREE_REPO_PRUNE_FLAGS_COMMIT_ONLY)
+
+typedef struct
+{
+  char magic[8];
+  guint32 flags;         /* PRUNE_STATE_FLAGS of the prune, little endian */
+  gint32 depth;          /* Little endian */
+  guint32 n_incremental; /* Prunes since the last full one, little endian */
+  guint32 padding;
+  guint64 n_entries; /* Little endian */
+} PruneStateHeader;
+
+G_STATIC_ASSERT (sizeof (PruneStateHeader) == 32);
+
+/* Add the objects saved by the last incremental prune to @reachable, unless
+ * it used other options or a full prune is due.  @out_n_incremental is set to
+ * the number of incremental prunes since the last full one, or -1 if the set
+ * wasn't loaded.
+ */
 static gboolean
-traverse_reachable_internal (OstreeRepo *self, OstreeRepoCommitTraverseFlags flags, guint depth,
-                             GHashTable *reachable, GCancellable *cancellable, GError **error)
+prune_state_load (OstreeRepo *self, OstreeRepoPruneFlags flags, gint depth,
+                  OstreeRepoReachableSet *reachable, gint *out_n_incremental, GError **error)
 {
-  g_autoptr (OstreeRepoAutoLock) lock
-      = ostree_repo_auto_lock_push (self, OSTREE_REPO_LOCK_SHARED, cancellable, error);
-  if (!lock)
+  *out_n_incremental = -1;
+
+  glnx_autofd int fd = -1;
+  if (!ot_openat_ignore_enoent (self->repo_dir_fd, PRUNE_STATE_PATH, &fd, error))
     return FALSE;
+  if (fd == -1)
+    return TRUE;
+
+  g_autoptr (GBytes) bytes = ot_fd_readall_or_mmap (fd, 0, error);
+  if (!bytes)
+    return FALSE;
+
+  gsize len;
+  const guint8 *data = g_bytes_get_data (bytes, &len);
+  PruneStateHeader header = {
+    { 0 },
+  };
+  if (len >= sizeof (header))
+    memcpy (&header, data, sizeof (header));
+  if (memcmp (header.magic, PRUNE_STATE_MAGIC, sizeof (header.magic)) != 0
+      || len - sizeof (header)
+             != GUINT64_FROM_LE (header.n_entries) * _OSTREE_REACHABLE_SET_ENTRY_SIZE)
+    {
+      g_debug ("Ignoring invalid %s", PRUNE_STATE_PATH);
+      return TRUE;
+    }
+
+  const guint32 n_incremental = GUINT32_FROM_LE (header.n_incremental);
+  if (GUINT32_FROM_LE (header.flags) != (flags & PRUNE_STATE_FLAGS)
+      || (gint32)GUINT32_FROM_LE (header.depth) != depth)
+    {
+      g_debug ("Prune options changed, doing a full prune");
+      return TRUE;
+    }
+  if (n_incremental >= self->prune_full_interval)
+    {
+      g_debug ("Doing a full prune after %u incremental ones", n_incremental);
+      return TRUE;
+    }
+
+  if (!_ostree_repo_reachable_set_add_serialized (reachable, data + sizeof (header),
+                                                  len - sizeof (header), error))
+    return glnx_prefix_error (error, "Loading %s", PRUNE_STATE_PATH);
+
+  g_debug ("Loaded %u objects reachable at the last prune",
+           ostree_repo_reachable_set_get_size (reachable));
+  *out_n_incremental = n_incremental;
+  return TRUE;
+}
+
+static gboolean
+repo_has_partial_commits (OstreeRepo *self, gboolean *out_have_partial, GCancellable *cancellable,
+                          GError **error)
+{
+  g_auto (GLnxDirFdIterator) dfd_iter = {
+    0,
+  };
+  gboolean exists;
+  *out_have_partial = FALSE;
+  if (!ot_dfd_iter_init_allow_noent (self->repo_dir_fd, "state", &dfd_iter, &exists, error))
+    return FALSE;
+  /* Note early return */
+  if (!exists)
+    return TRUE;
+
+  while (TRUE)
+    {
+      struct dirent *dent;
+      if (!glnx_dirfd_iterator_next_dent (&dfd_iter, &dent, cancellable, error))
+        return FALSE;
+      if (dent == NULL)
+        break;
+
+      if (g_str_has_suffix (dent->d_name, ".commitpartial"))
+        {
+          *out_have_partial = TRUE;
+          break;
+        }
+    }
+
+  return TRUE;
+}
+
+static gboolean
+prune_state_save (OstreeRepo *self, OstreeRepoPruneFlags flags, gint depth,
+                  OstreeRepoReachableSet *reachable, guint n_incremental,
+                  GCancellable *cancellable, GError **error)
+{
+  /* The objects missing from a partial commit can be pulled later.  The
+   * saved set wouldn't have them, and the traversal wouldn't find them either
+   * since it stops at the commit, so the next prune must be a full one.
+   */
+  gboolean have_partial;
+  if (!repo_has_partial_commits (self, &have_partial, cancellable, error))
+    return FALSE;
+  if (have_partial)
+    {
+      g_debug ("Not saving reachable objects of a repository with partial commits");
+      return ot_ensure_unlinked_at (self->repo_dir_fd, PRUNE_STATE_PATH, error);
+    }
+
+  const guint n_entries = ostree_repo_reachable_set_get_size (reachable);
+  PruneStateHeader header = {
+    PRUNE_STATE_MAGIC,
+    GUINT32_TO_LE (flags & PRUNE_STATE_FLAGS),
+    GUINT32_TO_LE ((guint32)depth),
+    GUINT32_TO_LE (n_incremental),
+    0,
+    GUINT64_TO_LE (n_entries),
+  };
+  g_autoptr (GByteArray) buf
+      = g_byte_array_sized_new (sizeof (header) + n_entries * _OSTREE_REACHABLE_SET_ENTRY_SIZE);
+  g_byte_array_append (buf, (guint8 *)&header, sizeof (header));
+  _ostree_repo_reachable_set_serialize (reachable, buf);
+
+  if (!glnx_shutil_mkdir_p_at (self->repo_dir_fd, "state", 0777, cancellable, error))
+    return FALSE;
+  return glnx_file_replace_contents_at (self->repo_dir_fd, PRUNE_STATE_PATH, buf->data, buf->len,
+                                        0, cancellable, error);
+}
+
+/* Gather the commits of all refs, so that they can be traversed together and
+ * the trees they share are only walked once.
+ */
+static GPtrArray *
+list_ref_commits (OstreeRepo *self, GCancellable *cancellable, GError **error)
+{
+  g_autoptr (GPtrArray) commits = g_ptr_array_new_with_free_func (g_free);
 
   /* Ignoring collections. */
   g_autoptr (GHashTable) all_refs = NULL; /* (element-type utf8 utf8) */
 
   if (!ostree_repo_list_refs (self, NULL, &all_refs, cancellable, error))
-    return FALSE;
+    return NULL;
 
   GLNX_HASH_TABLE_FOREACH_V (all_refs, const char *, checksum)
     {
       g_debug ("Finding objects to keep for commit %s", checksum);
-      if (!ostree_repo_traverse_commit_with_flags (self, flags, checksum, depth, reachable, NULL,
-                                                   cancellable, error))
-        return FALSE;
+      g_ptr_array_add (commits, g_strdup (checksum));
     }
 
   /* Using collections. */
@@ -320,17 +627,34 @@ traverse_reachable_internal (OstreeRepo *self, OstreeRepoCommitTraverseFlags fla
   if (!ostree_repo_list_collection_refs (self, NULL, &all_collection_refs,
                                          OSTREE_REPO_LIST_REFS_EXT_EXCLUDE_REMOTES, cancellable,
                                          error))
-    return FALSE;
+    return NULL;
 
   GLNX_HASH_TABLE_FOREACH_V (all_collection_refs, const char *, checksum)
     {
       g_debug ("Finding objects to keep for commit %s", checksum);
-      if (!ostree_repo_traverse_commit_with_flags (self, flags, checksum, depth, reachable, NULL,
-                                                   cancellable, error))
-        return FALSE;
+      g_ptr_array_add (commits, g_strdup (checksum));
     }
 
-  return TRUE;
+  g_ptr_array_add (commits, NULL);
+  return g_steal_pointer (&commits);
+}
+
+static gboolean
+traverse_reachable_internal (OstreeRepo *self, OstreeRepoCommitTraverseFlags flags, guint depth,
+                             OstreeRepoReachableSet *reachable, GCancellable *cancellable,
+                             GError **error)
+{
+  g_autoptr (OstreeRepoAutoLock) lock
+      = ostree_repo_auto_lock_push (self, OSTREE_REPO_LOCK_SHARED, cancellable, error);
+  if (!lock)
+    return FALSE;
+
+  g_autoptr (GPtrArray) commits = list_ref_commits (self, cancellable, error);
+  if (!commits)
+    return FALSE;
+
+  return ostree_repo_traverse_commits_to_set (self, flags, (const char *const *)commits->pdata,
+                                              depth, reachable, cancellable, error);
 }
 
 /**
@@ -349,6 +673,39 @@ traverse_reachable_internal (OstreeRepo *self, OstreeRepoCommitTraverseFlags fla
 gboolean
 ostree_repo_traverse_reachable_refs (OstreeRepo *self, guint depth, GHashTable *reachable,
                                      GCancellable *cancellable, GError **error)
+{
+  g_autoptr (OstreeRepoAutoLock) lock
+      = ostree_repo_auto_lock_push (self, OSTREE_REPO_LOCK_SHARED, cancellable, error);
+  if (!lock)
+    return FALSE;
+
+  g_autoptr (GPtrArray) commits = list_ref_commits (self, cancellable, error);
+  if (!commits)
+    return FALSE;
+
+  return ostree_repo_traverse_commits_with_flags (
+      self, OSTREE_REPO_COMMIT_TRAVERSE_FLAG_NONE, (const char *const *)commits->pdata, depth,
+      reachable, NULL, cancellable, error);
+}
+
+/**
+ * ostree_repo_traverse_reachable_refs_to_set:
+ * @self: Repo
+ * @depth: Depth of traversal
+ * @reachable: Set of reachable objects (will be modified)
+ * @cancellable: Cancellable
+ * @error: Error
+ *
+ * Like ostree_repo_traverse_reachable_refs(), but adding to an
+ * #OstreeRepoReachableSet.
+ *
+ * Locking: shared
+ * Since: 2024.11
+ */
+gboolean
+ostree_repo_traverse_reachable_refs_to_set (OstreeRepo *self, guint depth,
+                                            OstreeRepoReachableSet *reachable,
+                                            GCancellable *cancellable, GError **error)
 {
   return traverse_reachable_internal (self, OSTREE_REPO_COMMIT_TRAVERSE_FLAG_NONE, depth, reachable,
                                       cancellable, error);
@@ -379,6 +736,13 @@ ostree_repo_traverse_reachable_refs (OstreeRepo *self, guint depth, GHashTable *
  * statistics on objects that would be deleted, without actually
  * deleting them.
  *
+ * With %OSTREE_REPO_PRUNE_FLAGS_INCREMENTAL, the objects found to be
+ * reachable are saved in the repository, and the next prune with that flag
+ * only traverses the commits added since.  Objects which became unreachable
+ * in the meantime are only deleted by a full prune, which is done after
+ * the number of incremental ones set by the `core.prune-full-interval`
+ * option, or when @depth or the other flags change.
+ *
  * Locking: exclusive
  */
 gboolean
@@ -394,8 +758,12 @@ ostree_repo_prune (OstreeRepo *self, OstreeRepoPruneFlags flags, gint depth,
   g_autoptr (GHashTable) objects = NULL;
   gboolean refs_only = flags & OSTREE_REPO_PRUNE_FLAGS_REFS_ONLY;
   gboolean commit_only = flags & OSTREE_REPO_PRUNE_FLAGS_COMMIT_ONLY;
+  gboolean incremental = flags & OSTREE_REPO_PRUNE_FLAGS_INCREMENTAL;
+  gint n_incremental = -1;
 
-  g_autoptr (GHashTable) reachable = ostree_repo_traverse_new_reachable ();
+  g_autoptr (OstreeRepoReachableSet) reachable = ostree_repo_reachable_set_new ();
+  if (incremental && !prune_state_load (self, flags, depth, reachable, &n_incremental, error))
+    return FALSE;
 
   /* This original prune API has fixed logic for traversing refs or all commits
    * combined with actually deleting content. The newer backend API just does
@@ -429,6 +797,8 @@ ostree_repo_prune (OstreeRepo *self, OstreeRepoPruneFlags flags, gint depth,
 
   if (!refs_only)
     {
+      g_autoptr (GPtrArray) commits = g_ptr_array_new ();
+
       GLNX_HASH_TABLE_FOREACH (objects, GVariant *, serialized_key)
         {
           const char *checksum;
@@ -440,17 +810,36 @@ ostree_repo_prune (OstreeRepo *self, OstreeRepoPruneFlags flags, gint depth,
             continue;
 
           g_debug ("Finding objects to keep for commit %s", checksum);
-          if (!ostree_repo_traverse_commit_with_flags (self, traverse_flags, checksum, depth,
-                                                       reachable, NULL, cancellable, error))
-            return FALSE;
+          g_ptr_array_add (commits, (char *)checksum);
         }
+
+      g_ptr_array_add (commits, NULL);
+      if (!ostree_repo_traverse_commits_to_set (self, traverse_flags,
+                                                (const char *const *)commits->pdata, depth,
+                                                reachable, cancellable, error))
+        return FALSE;
     }
 
-  {
-    OstreeRepoPruneOptions opts = { flags, reachable };
-    return repo_prune_internal (self, objects, &opts, out_objects_total, out_objects_pruned,
-                                out_pruned_object_size_total, cancellable, error);
-  }
+  if (!repo_prune_internal (self, objects, flags, reachable, NULL, out_objects_total,
+                            out_objects_pruned, out_pruned_object_size_total, cancellable, error))
+    return FALSE;
+
+  if (incremental && !(flags & OSTREE_REPO_PRUNE_FLAGS_NO_PRUNE)
+      && !prune_state_save (self, flags, depth, reachable, n_incremental + 1, cancellable, error))
+    return FALSE;
+
+  return TRUE;
+}
+
+static void
+add_to_reachable_set (gpointer key, gpointer value, gpointer user_data)
+{
+  OstreeRepoReachableSet *reachable = user_data;
+  const char *checksum;
+  OstreeObjectType objtype;
+
+  ostree_object_name_deserialize (key, &checksum, &objtype);
+  ostree_repo_reachable_set_add (reachable, checksum, objtype);
 }
 
 /**
@@ -472,6 +861,16 @@ ostree_repo_prune (OstreeRepo *self, OstreeRepoPruneFlags flags, gint depth,
  * retain all commits from a production branch, but just GC some history from
  * your dev branch.
  *
+ * The root set is taken from the `reachable_set` member of @options if it is
+ * set (since 2024.11), which takes much less memory for large repositories,
+ * and from `reachable` otherwise.
+ *
+ * If the `progress` member of @options is set (since 2024.11), the
+ * `total-objects`, `swept-objects` and `pruned-objects` keys are updated as
+ * objects are examined.  As with ostree_repo_pull_with_options(), the
+ * changes are signalled in the thread-default main context, which this
+ * function iterates while it waits.
+ *
  * The %OSTREE_REPO_PRUNE_FLAGS_NO_PRUNE flag may be specified to just determine
  * statistics on objects that would be deleted, without actually deleting them.
  *
@@ -507,6 +906,16 @@ ostree_repo_prune_from_reachable (OstreeRepo *self, OstreeRepoPruneOptions *opti
   if (!objects)
     return FALSE;
 
-  return repo_prune_internal (self, objects, options, out_objects_total, out_objects_pruned,
-                              out_pruned_object_size_total, cancellable, error);
+  g_autoptr (OstreeRepoReachableSet) reachable = NULL;
+  if (options->reachable_set != NULL)
+    reachable = ostree_repo_reachable_set_ref (options->reachable_set);
+  else
+    {
+      reachable = ostree_repo_reachable_set_new ();
+      g_hash_table_foreach (options->reachable, add_to_reachable_set, reachable);
+    }
+
+  return repo_prune_internal (self, objects, flags, reachable, options->progress,
+                              out_objects_total, out_objects_pruned, out_pruned_object_size_total,
+                              cancellable, error);
 }
@@ -93,7 +93,12 @@ typedef struct
                                            signapi verified */
   GHashTable *ref_keyring_map;          /* Maps OstreeCollectionRef to keyring remote name */
 
-  GHashTable *static_delta_targets; /* Set<checksum> of commits fetched via static delta */
+  GHashTable *static_delta_targets;    /* Set<checksum> of commits fetched via static delta */
+  GHashTable *delta_chain_commits;     /* Set<checksum> of intermediate commits of delta chains */
+  GPtrArray *pending_delta_chains;     /* Array<DeltaChain> waiting to apply their next hop */
+  GHashTable *estimated_objects;       /* Map<ObjectName,have> looked up for pull size estimates */
+  GHashTable *deferred_deltaparts;     /* Set<FetchStaticDeltaData> not yet needed by the scan */
+  GHashTable *deltapart_content_index; /* Map<checksum,FetchStaticDeltaData> for deferred parts */
 
   GHashTable *expected_commit_sizes;           /* Maps commit checksum to known size */
   GHashTable *commit_to_depth;                 /* Maps parent commit checksum maximum depth */
@@ -91,6 +91,8 @@ typedef struct
   char *to_revision;
   guint i;
   guint64 size;
+  guint64 usize;
+  GBytes *inline_part_bytes; /* (nullable) */
   guint n_retries_remaining;
 } FetchStaticDeltaData;
 
@@ -103,6 +105,37 @@ typedef struct
   OstreeCollectionRef *requested_ref; /* (nullable) */
 } ScanObjectQueueData;
 
+/* A sequence of static deltas going from a commit we already have to a
+ * target commit via one or more intermediate commits, e.g. A→B→C when the
+ * remote only carries deltas between consecutive releases.  All superblocks
+ * are fetched up front so the total size can be compared with a plain object
+ * pull; the hops are then applied one at a time, since a hop may use objects
+ * written by the previous one as sources.
+ */
+typedef struct
+{
+  gint refcount;
+  GPtrArray *revisions;               /* (element-type utf8): start, intermediates..., target */
+  GPtrArray *superblocks;             /* (element-type GVariant): one per hop, NULL until fetched */
+  OstreeCollectionRef *requested_ref; /* (nullable) */
+  guint n_superblocks_fetched;
+  guint next_hop;
+  gboolean abandoned; /* A superblock was missing; we fell back to an object pull */
+  gboolean use_scratch_delta; /* Fall back to the from-scratch delta rather than objects */
+} DeltaChain;
+
+/* State shared between the delta index fetches done while looking for
+ * a chain of deltas to @target_revision; see on_delta_index_fetched().
+ */
+typedef struct
+{
+  gint refcount;
+  char *target_revision;
+  GHashTable *requested; /* Set<checksum> of the delta indexes requested for this search */
+  guint n_outstanding;
+  gboolean done;
+} DeltaIndexSearch;
+
 typedef struct
 {
   OtPullData *pull_data;
@@ -110,6 +143,8 @@ typedef struct
   char *to_revision;
   OstreeCollectionRef *requested_ref; /* (nullable) */
   guint n_retries_remaining;
+  DeltaChain *chain; /* (nullable): set if this superblock is one hop of a chain */
+  guint chain_hop;
 } FetchDeltaSuperData;
 
 typedef struct
@@ -119,6 +154,8 @@ typedef struct
   char *to_revision;
   OstreeCollectionRef *requested_ref; /* (nullable) */
   guint n_retries_remaining;
+  DeltaIndexSearch *search;
+  guint chain_depth; /* Number of deltas between @to_revision and the search target */
 } FetchDeltaIndexData;
 
 static void
@@ -161,6 +198,16 @@ static void scan_object_queue_data_free (ScanObjectQueueData *scan_data);
 static gboolean initiate_delta_request (OtPullData *pull_data, const OstreeCollectionRef *ref,
                                         const char *to_revision, const char *delta_from_revision,
                                         GError **error);
+static gboolean delta_chain_apply_next_hop (OtPullData *pull_data, DeltaChain *chain,
+                                            GError **error);
+static void delta_chain_unref (DeltaChain *chain);
+static void enqueue_one_static_delta_superblock_request (OtPullData *pull_data,
+                                                         const char *from_revision,
+                                                         const char *to_revision,
+                                                         const OstreeCollectionRef *ref);
+static gboolean start_deferred_static_delta_part (OtPullData *pull_data, const char *checksum,
+                                                  gboolean *out_started,
+                                                  GCancellable *cancellable, GError **error);
 
 static gboolean
 update_progress (gpointer user_data)
@@ -228,9 +275,9 @@ update_progress (gpointer user_data)
   return TRUE;
 }
 
-/* The core logic function for whether we should continue the main loop */
+/* Whether there are no outstanding fetches, writes or scans */
 static gboolean
-pull_termination_condition (OtPullData *pull_data)
+pull_is_idle (OtPullData *pull_data)
 {
   gboolean current_fetch_idle = (pull_data->n_outstanding_metadata_fetches == 0
                                  && pull_data->n_outstanding_content_fetches == 0
@@ -239,7 +286,14 @@ pull_termination_condition (OtPullData *pull_data)
                                  && pull_data->n_outstanding_content_write_requests == 0
                                  && pull_data->n_outstanding_deltapart_write_requests == 0);
   gboolean current_scan_idle = g_queue_is_empty (&pull_data->scan_object_queue);
-  gboolean current_idle = current_fetch_idle && current_write_idle && current_scan_idle;
+  return current_fetch_idle && current_write_idle && current_scan_idle;
+}
+
+/* The core logic function for whether we should continue the main loop */
+static gboolean
+pull_termination_condition (OtPullData *pull_data)
+{
+  gboolean current_idle = pull_is_idle (pull_data);
 
   /* we only enter the main loop when we're fetching objects */
   g_assert (pull_data->phase == OSTREE_PULL_PHASE_FETCHING_OBJECTS);
@@ -290,6 +344,7 @@ check_outstanding_requests_handle_error (OtPullData *pull_data, GError **errorp)
       g_hash_table_remove_all (pull_data->pending_fetch_delta_superblocks);
       g_hash_table_remove_all (pull_data->pending_fetch_deltaparts);
       g_hash_table_remove_all (pull_data->pending_fetch_content);
+      g_ptr_array_set_size (pull_data->pending_delta_chains, 0);
     }
   else
     {
@@ -366,6 +421,27 @@ check_outstanding_requests_handle_error (OtPullData *pull_data, GError **errorp)
       /* Finally, if we still have capacity, scan more metadata objects */
       if (!g_queue_is_empty (&pull_data->scan_object_queue))
         ensure_idle_queued (pull_data);
+
+      /* Once everything else has settled, start the next hop of any delta
+       * chains; a hop may use objects written by the previous one (including
+       * its fallback objects) as sources, so we can't start it any earlier.
+       */
+      while (pull_data->pending_delta_chains->len > 0 && pull_is_idle (pull_data))
+        {
+          g_autoptr (GPtrArray) chains = g_steal_pointer (&pull_data->pending_delta_chains);
+          pull_data->pending_delta_chains
+              = g_ptr_array_new_with_free_func ((GDestroyNotify)delta_chain_unref);
+
+          for (guint i = 0; i < chains->len; i++)
+            {
+              g_autoptr (GError) local_error = NULL;
+              if (!delta_chain_apply_next_hop (pull_data, chains->pdata[i], &local_error))
+                {
+                  check_outstanding_requests_handle_error (pull_data, &local_error);
+                  return;
+                }
+            }
+        }
     }
 }
 
@@ -677,6 +753,14 @@ scan_dirtree_object (OtPullData *pull_data, const char *checksum, const char *pa
       if (g_hash_table_lookup (pull_data->requested_content, file_checksum))
         continue;
 
+      /* Is it contained in a static delta part we haven't fetched yet? */
+      gboolean started_deltapart;
+      if (!start_deferred_static_delta_part (pull_data, file_checksum, &started_deltapart,
+                                             cancellable, error))
+        return FALSE;
+      if (started_deltapart)
+        continue;
+
       /* Is this a local repo? */
       if (pull_data->remote_repo_local)
         {
@@ -1221,6 +1305,7 @@ fetch_static_delta_data_free (gpointer data)
   g_variant_unref (fetch_data->objects);
   g_free (fetch_data->from_revision);
   g_free (fetch_data->to_revision);
+  g_clear_pointer (&fetch_data->inline_part_bytes, g_bytes_unref);
   g_free (fetch_data);
 }
 
@@ -1616,9 +1701,12 @@ scan_commit_object (OtPullData *pull_data, const char *checksum, guint recursion
   /* We only recurse to looking whether we need dirtree/dirmeta
    * objects if the commit is partial, and we're not doing a
    * commit-only fetch nor is it the target of a static delta.
+   * Subdir pulls always recurse; static delta parts are only
+   * fetched as the scan finds content they contain.
    */
   if (is_partial && !pull_data->is_commit_only
-      && !g_hash_table_contains (pull_data->static_delta_targets, checksum))
+      && (pull_data->dirs != NULL
+          || !g_hash_table_contains (pull_data->static_delta_targets, checksum)))
     {
       g_autoptr (GVariant) tree_contents_csum = NULL;
       g_autoptr (GVariant) tree_meta_csum = NULL;
@@ -2062,6 +2150,117 @@ start_fetch_deltapart (OtPullData *pull_data, FetchStaticDeltaData *fetch)
                                       static_deltapart_fetch_on_complete, fetch);
 }
 
+static gboolean
+start_static_delta_part (OtPullData *pull_data, FetchStaticDeltaData *fetch_data,
+                         GCancellable *cancellable, GError **error)
+{
+  if (fetch_data->inline_part_bytes != NULL)
+    {
+      g_autoptr (GInputStream) memin
+          = g_memory_input_stream_new_from_bytes (fetch_data->inline_part_bytes);
+      g_autoptr (GVariant) inline_delta_part = NULL;
+
+      /* For inline parts we are relying on per-commit GPG, so don't bother checksumming. */
+      if (!_ostree_static_delta_part_open (memin, fetch_data->inline_part_bytes,
+                                           OSTREE_STATIC_DELTA_OPEN_FLAGS_SKIP_CHECKSUM, NULL,
+                                           &inline_delta_part, cancellable, error))
+        {
+          fetch_static_delta_data_free (fetch_data);
+          return FALSE;
+        }
+
+      _ostree_static_delta_part_execute_async (pull_data->repo, fetch_data->objects,
+                                               inline_delta_part, pull_data->cancellable,
+                                               on_static_delta_written, fetch_data);
+      pull_data->n_outstanding_deltapart_write_requests++;
+    }
+  else
+    {
+      enqueue_one_static_delta_part_request_s (pull_data, fetch_data);
+    }
+
+  return TRUE;
+}
+
+/* Takes ownership of @fetch_data, and records which part carries each
+ * of its content objects so that start_deferred_static_delta_part()
+ * can find it when scanning.
+ */
+static gboolean
+defer_static_delta_part (OtPullData *pull_data, FetchStaticDeltaData *fetch_data, GError **error)
+{
+  g_hash_table_add (pull_data->deferred_deltaparts, fetch_data);
+
+  guint8 *checksums_data;
+  guint n_checksums;
+  if (!_ostree_static_delta_parse_checksum_array (fetch_data->objects, &checksums_data,
+                                                  &n_checksums, error))
+    return FALSE;
+
+  for (guint i = 0; i < n_checksums; i++)
+    {
+      const guint8 *objtype_csum = checksums_data + (i * OSTREE_STATIC_DELTA_OBJTYPE_CSUM_LEN);
+      if ((OstreeObjectType)*objtype_csum != OSTREE_OBJECT_TYPE_FILE)
+        continue;
+
+      g_hash_table_insert (pull_data->deltapart_content_index,
+                           ostree_checksum_from_bytes (objtype_csum + 1), fetch_data);
+    }
+
+  return TRUE;
+}
+
+/* If the content object @checksum is in a deferred static delta part, start
+ * that part and mark everything else it contains as requested.
+ */
+static gboolean
+start_deferred_static_delta_part (OtPullData *pull_data, const char *checksum,
+                                  gboolean *out_started, GCancellable *cancellable, GError **error)
+{
+  *out_started = FALSE;
+
+  FetchStaticDeltaData *fetch_data
+      = g_hash_table_lookup (pull_data->deltapart_content_index, checksum);
+  if (fetch_data == NULL)
+    return TRUE;
+
+  gboolean was_deferred = g_hash_table_steal (pull_data->deferred_deltaparts, fetch_data);
+  g_assert (was_deferred);
+
+  guint8 *checksums_data;
+  guint n_checksums;
+  if (!_ostree_static_delta_parse_checksum_array (fetch_data->objects, &checksums_data,
+                                                  &n_checksums, error))
+    {
+      fetch_static_delta_data_free (fetch_data);
+      return FALSE;
+    }
+
+  for (guint i = 0; i < n_checksums; i++)
+    {
+      const guint8 *objtype_csum = checksums_data + (i * OSTREE_STATIC_DELTA_OBJTYPE_CSUM_LEN);
+      if ((OstreeObjectType)*objtype_csum != OSTREE_OBJECT_TYPE_FILE)
+        continue;
+
+      g_autofree char *part_checksum = ostree_checksum_from_bytes (objtype_csum + 1);
+      g_hash_table_remove (pull_data->deltapart_content_index, part_checksum);
+      g_hash_table_add (pull_data->requested_content, g_steal_pointer (&part_checksum));
+    }
+
+  g_debug ("starting deferred static delta %s-%s part %u for %s",
+           fetch_data->from_revision ?: "empty", fetch_data->to_revision, fetch_data->i, checksum);
+
+  pull_data->n_total_deltaparts++;
+  pull_data->total_deltapart_size += fetch_data->size;
+  pull_data->total_deltapart_usize += fetch_data->usize;
+
+  if (!start_static_delta_part (pull_data, fetch_data, cancellable, error))
+    return FALSE;
+
+  *out_started = TRUE;
+  return TRUE;
+}
+
 static gboolean
 process_one_static_delta (OtPullData *pull_data, const char *from_revision, const char *to_revision,
                           GVariant *delta_superblock, const OstreeCollectionRef *ref,
@@ -2079,8 +2278,15 @@ process_one_static_delta (OtPullData *pull_data, const char *from_revision, cons
   if (TEMP_FAILURE_RETRY (fstatvfs (pull_data->repo->repo_dir_fd, &stvfsbuf)) < 0)
     return glnx_throw_errno_prefix (error, "fstatvfs");
 
+  /* Pulls of only part of the commit skip the fallbacks, and only fetch the
+   * parts whose content the scan finds under the requested subdirectories.
+   * Commit-only pulls just need the commit from the superblock.
+   */
+  const gboolean defer_parts = pull_data->dirs != NULL;
+  const gboolean skip_parts = pull_data->is_commit_only;
+
   /* First process the fallbacks */
-  guint n = g_variant_n_children (fallback_objects);
+  guint n = (defer_parts || skip_parts) ? 0 : g_variant_n_children (fallback_objects);
   for (guint i = 0; i < n; i++)
     {
       g_autoptr (GVariant) fallback_object = g_variant_get_child_value (fallback_objects, i);
@@ -2137,10 +2343,19 @@ process_one_static_delta (OtPullData *pull_data, const char *from_revision, cons
                                             fetch_data);
           pull_data->n_outstanding_metadata_write_requests++;
         }
+      else if (defer_parts)
+        {
+          /* Nothing else will scan the commit, and the scan is what
+           * starts the parts we need.
+           */
+          queue_scan_one_metadata_object (pull_data, to_checksum, OSTREE_OBJECT_TYPE_COMMIT, NULL,
+                                          0, ref);
+        }
     }
 
-  n = g_variant_n_children (headers);
-  pull_data->n_total_deltaparts += n;
+  n = skip_parts ? 0 : g_variant_n_children (headers);
+  if (!defer_parts)
+    pull_data->n_total_deltaparts += n;
 
   for (guint i = 0; i < n; i++)
     {
@@ -2168,15 +2383,21 @@ process_one_static_delta (OtPullData *pull_data, const char *from_revision, cons
                                                             cancellable, error))
         return FALSE;
 
-      pull_data->total_deltapart_size += size;
-      pull_data->total_deltapart_usize += usize;
+      if (!defer_parts)
+        {
+          pull_data->total_deltapart_size += size;
+          pull_data->total_deltapart_usize += usize;
+        }
 
       if (have_all)
         {
           g_debug ("Have all objects from static delta %s-%s part %u", from_revision ?: "empty",
                    to_revision, i);
-          pull_data->fetched_deltapart_size += size;
-          pull_data->n_fetched_deltaparts++;
+          if (!defer_parts)
+            {
+              pull_data->fetched_deltapart_size += size;
+              pull_data->n_fetched_deltaparts++;
+            }
           continue;
         }
 
@@ -2201,32 +2422,18 @@ process_one_static_delta (OtPullData *pull_data, const char *from_revision, cons
       fetch_data->objects = g_variant_ref (objects);
       fetch_data->expected_checksum = ostree_checksum_from_bytes_v (csum_v);
       fetch_data->size = size;
+      fetch_data->usize = usize;
+      fetch_data->inline_part_bytes = g_steal_pointer (&inline_part_bytes);
       fetch_data->i = i;
       fetch_data->n_retries_remaining = pull_data->n_network_retries;
 
-      if (inline_part_bytes != NULL)
-        {
-          g_autoptr (GInputStream) memin = g_memory_input_stream_new_from_bytes (inline_part_bytes);
-          g_autoptr (GVariant) inline_delta_part = NULL;
-
-          /* For inline parts we are relying on per-commit GPG, so don't bother checksumming. */
-          if (!_ostree_static_delta_part_open (memin, inline_part_bytes,
-                                               OSTREE_STATIC_DELTA_OPEN_FLAGS_SKIP_CHECKSUM, NULL,
-                                               &inline_delta_part, cancellable, error))
-            {
-              fetch_static_delta_data_free (fetch_data);
-              return FALSE;
-            }
-
-          _ostree_static_delta_part_execute_async (pull_data->repo, fetch_data->objects,
-                                                   inline_delta_part, pull_data->cancellable,
-                                                   on_static_delta_written, fetch_data);
-          pull_data->n_outstanding_deltapart_write_requests++;
-        }
-      else
+      if (defer_parts)
         {
-          enqueue_one_static_delta_part_request_s (pull_data, g_steal_pointer (&fetch_data));
+          if (!defer_static_delta_part (pull_data, fetch_data, error))
+            return FALSE;
         }
+      else if (!start_static_delta_part (pull_data, fetch_data, cancellable, error))
+        return FALSE;
     }
 
   /* The free space check is here since at this point we've parsed the delta not
@@ -2261,6 +2468,12 @@ process_one_static_delta (OtPullData *pull_data, const char *from_revision, cons
  * DELTA_SEARCH_RESULT_SCRATCH:
  * There is a %NULL → @to_revision delta, also known as
  * a "from scratch" delta.
+ *
+ * DELTA_SEARCH_RESULT_CHAIN:
+ * There is no single delta from a commit we have, but there is a
+ * sequence of them; the revisions along the way (starting with one
+ * we have, ending with @to_revision) will be set in `chain`.  Whether
+ * there is also a from-scratch delta is set in `have_scratch`.
  */
 typedef struct
 {
@@ -2270,10 +2483,147 @@ typedef struct
     DELTA_SEARCH_RESULT_NO_MATCH,
     DELTA_SEARCH_RESULT_FROM,
     DELTA_SEARCH_RESULT_SCRATCH,
+    DELTA_SEARCH_RESULT_CHAIN,
   } result;
   char from_revision[OSTREE_SHA256_STRING_LEN + 1];
+  GPtrArray *chain;
+  gboolean have_scratch;
 } DeltaSearchResult;
 
+/* Check whether @revision is a commit we have completely, and hence can
+ * be used as the source of a static delta.  If so, its timestamp is
+ * returned in @out_timestamp.
+ */
+static gboolean
+get_delta_source_timestamp (OtPullData *pull_data, const char *revision, gboolean *out_usable,
+                            guint64 *out_timestamp, GError **error)
+{
+  g_autoptr (GVariant) commit = NULL;
+  OstreeRepoCommitState state;
+  gboolean have_commit;
+
+  *out_usable = FALSE;
+  *out_timestamp = 0;
+
+  /* Do we have this commit at all?  If not, skip it */
+  if (!ostree_repo_has_object (pull_data->repo, OSTREE_OBJECT_TYPE_COMMIT, revision, &have_commit,
+                               NULL, error))
+    return FALSE;
+  if (!have_commit)
+    return TRUE;
+
+  /* Load it */
+  if (!ostree_repo_load_commit (pull_data->repo, revision, &commit, &state, error))
+    return FALSE;
+
+  /* Ignore partial commits, we can't use them */
+  if (state & OSTREE_REPO_COMMIT_STATE_PARTIAL)
+    return TRUE;
+
+  *out_usable = TRUE;
+  *out_timestamp = ostree_commit_get_timestamp (commit);
+  return TRUE;
+}
+
+/* Breadth-first search backwards from @to_revision through the known
+ * "from" deltas, looking for the shortest sequence of deltas which starts
+ * at a commit we have.  Among sequences of equal length, the one starting
+ * from the newest commit wins.  If one is found, @out_chain is set to the
+ * revisions along it, starting with the one we have; otherwise %NULL.
+ */
+static gboolean
+find_static_delta_chain (OtPullData *pull_data, const char *to_revision, GPtrArray **out_chain,
+                         GError **error)
+{
+  /* Map<to-revision,Array<from-revision>> */
+  g_autoptr (GHashTable) deltas_to = g_hash_table_new_full (
+      g_str_hash, g_str_equal, (GDestroyNotify)g_free, (GDestroyNotify)g_ptr_array_unref);
+  /* Map<revision,revision> of the next hop towards @to_revision */
+  g_autoptr (GHashTable) next_hops
+      = g_hash_table_new_full (g_str_hash, g_str_equal, (GDestroyNotify)g_free, g_free);
+  g_autoptr (GPtrArray) level = g_ptr_array_new_with_free_func (g_free);
+
+  *out_chain = NULL;
+
+  GLNX_HASH_TABLE_FOREACH (pull_data->summary_deltas_checksums, const char *, delta_name)
+    {
+      g_autofree char *cur_from_rev = NULL;
+      g_autofree char *cur_to_rev = NULL;
+
+      /* Gracefully handle corrupted (or malicious) summary files */
+      if (!_ostree_parse_delta_name (delta_name, &cur_from_rev, &cur_to_rev, error))
+        return FALSE;
+
+      /* From-scratch deltas can't be part of a chain */
+      if (cur_from_rev == NULL)
+        continue;
+
+      GPtrArray *froms = g_hash_table_lookup (deltas_to, cur_to_rev);
+      if (froms == NULL)
+        {
+          froms = g_ptr_array_new_with_free_func (g_free);
+          g_hash_table_insert (deltas_to, g_steal_pointer (&cur_to_rev), froms);
+        }
+      g_ptr_array_add (froms, g_steal_pointer (&cur_from_rev));
+    }
+
+  g_hash_table_insert (next_hops, g_strdup (to_revision), NULL);
+  g_ptr_array_add (level, g_strdup (to_revision));
+
+  for (guint depth = 1; depth <= _OSTREE_MAX_STATIC_DELTA_CHAIN_LENGTH && level->len > 0; depth++)
+    {
+      g_autoptr (GPtrArray) next_level = g_ptr_array_new_with_free_func (g_free);
+      const char *newest_start = NULL;
+      guint64 newest_start_timestamp = 0;
+
+      for (guint i = 0; i < level->len; i++)
+        {
+          const char *revision = level->pdata[i];
+          GPtrArray *froms = g_hash_table_lookup (deltas_to, revision);
+
+          if (froms == NULL)
+            continue;
+
+          for (guint j = 0; j < froms->len; j++)
+            {
+              const char *from = froms->pdata[j];
+              gboolean usable;
+              guint64 timestamp;
+
+              /* Already reachable via a chain at least as short */
+              if (g_hash_table_contains (next_hops, from))
+                continue;
+
+              g_hash_table_insert (next_hops, g_strdup (from), g_strdup (revision));
+              g_ptr_array_add (next_level, g_strdup (from));
+
+              if (!get_delta_source_timestamp (pull_data, from, &usable, &timestamp, error))
+                return FALSE;
+              if (usable && (newest_start == NULL || timestamp > newest_start_timestamp))
+                {
+                  newest_start = from;
+                  newest_start_timestamp = timestamp;
+                }
+            }
+        }
+
+      if (newest_start != NULL)
+        {
+          g_autoptr (GPtrArray) chain = g_ptr_array_new_with_free_func (g_free);
+          for (const char *revision = newest_start; revision != NULL;
+               revision = g_hash_table_lookup (next_hops, revision))
+            g_ptr_array_add (chain, g_strdup (revision));
+          *out_chain = g_steal_pointer (&chain);
+          return TRUE;
+        }
+
+      g_clear_pointer (&level, g_ptr_array_unref);
+      level = g_steal_pointer (&next_level);
+    }
+
+  return TRUE;
+}
+
 /* Loop over the static delta data we got from the summary,
  * and find the a delta path (if available) that goes to @to_revision.
  * See the enum in `DeltaSearchResult` for available result types.
@@ -2283,15 +2633,12 @@ get_best_static_delta_start_for (OtPullData *pull_data, const char *to_revision,
                                  DeltaSearchResult *out_result, GCancellable *cancellable,
                                  GError **error)
 {
-  /* Array<char*> of possible from checksums */
-  g_autoptr (GPtrArray) candidates = g_ptr_array_new_with_free_func (g_free);
-  const char *newest_candidate = NULL;
-  guint64 newest_candidate_timestamp = 0;
-
   g_assert (pull_data->summary_deltas_checksums != NULL);
 
   out_result->result = DELTA_SEARCH_RESULT_NO_MATCH;
   out_result->from_revision[0] = '\0';
+  out_result->chain = NULL;
+  out_result->have_scratch = FALSE;
 
   /* First, do we already have this commit completely downloaded? */
   gboolean have_to_rev;
@@ -2311,8 +2658,7 @@ get_best_static_delta_start_for (OtPullData *pull_data, const char *to_revision,
         }
     }
 
-  /* Loop over all deltas known from the summary file,
-   * finding ones which go to to_revision */
+  /* Is there a from-scratch delta to to_revision? */
   GLNX_HASH_TABLE_FOREACH (pull_data->summary_deltas_checksums, const char *, delta_name)
     {
       g_autofree char *cur_from_rev = NULL;
@@ -2322,63 +2668,103 @@ get_best_static_delta_start_for (OtPullData *pull_data, const char *to_revision,
       if (!_ostree_parse_delta_name (delta_name, &cur_from_rev, &cur_to_rev, error))
         return FALSE;
 
-      /* Is this the checksum we want? */
-      if (strcmp (cur_to_rev, to_revision) != 0)
-        continue;
-
-      if (cur_from_rev)
-        {
-          g_ptr_array_add (candidates, g_steal_pointer (&cur_from_rev));
-        }
-      else
+      /* We note that we have a _SCRATCH delta here, but we'll prefer using
+       * "from" deltas (obviously, they'll be smaller) where possible if we
+       * find one below.
+       */
+      if (cur_from_rev == NULL && strcmp (cur_to_rev, to_revision) == 0)
         {
-          /* We note that we have a _SCRATCH delta here, but we'll prefer using
-           * "from" deltas (obviously, they'll be smaller) where possible if we
-           * find one below.
-           */
           out_result->result = DELTA_SEARCH_RESULT_SCRATCH;
+          out_result->have_scratch = TRUE;
+          break;
         }
     }
 
-  /* Loop over our candidates, find the newest one */
-  for (guint i = 0; i < candidates->len; i++)
+  /* Find the shortest sequence of deltas from a commit we have; in the
+   * common case that's a single delta from the newest such commit.
+   */
+  g_autoptr (GPtrArray) chain = NULL;
+  if (!find_static_delta_chain (pull_data, to_revision, &chain, error))
+    return FALSE;
+
+  if (chain != NULL && chain->len == 2)
     {
-      const char *candidate = candidates->pdata[i];
-      guint64 candidate_ts = 0;
-      g_autoptr (GVariant) commit = NULL;
-      OstreeRepoCommitState state;
-      gboolean have_candidate;
+      out_result->result = DELTA_SEARCH_RESULT_FROM;
+      memcpy (out_result->from_revision, chain->pdata[0], OSTREE_SHA256_STRING_LEN + 1);
+    }
+  /* Each hop of a chain needs the complete intermediate commit, so
+   * don't use chains when pulling only part of a commit.
+   */
+  else if (chain != NULL && pull_data->dirs == NULL && !pull_data->is_commit_only)
+    {
+      out_result->result = DELTA_SEARCH_RESULT_CHAIN;
+      out_result->chain = g_steal_pointer (&chain);
+    }
+  return TRUE;
+}
 
-      /* Do we have this commit at all?  If not, skip it */
-      if (!ostree_repo_has_object (pull_data->repo, OSTREE_OBJECT_TYPE_COMMIT, candidate,
-                                   &have_candidate, NULL, error))
-        return FALSE;
-      if (!have_candidate)
-        continue;
+static DeltaChain *
+delta_chain_new (GPtrArray *revisions, const OstreeCollectionRef *ref)
+{
+  DeltaChain *chain = g_new0 (DeltaChain, 1);
+  chain->refcount = 1;
+  chain->revisions = g_ptr_array_ref (revisions);
+  chain->superblocks = g_ptr_array_new_with_free_func (variant_or_null_unref);
+  g_ptr_array_set_size (chain->superblocks, revisions->len - 1);
+  chain->requested_ref = (ref != NULL) ? ostree_collection_ref_dup (ref) : NULL;
+  return chain;
+}
 
-      /* Load it */
-      if (!ostree_repo_load_commit (pull_data->repo, candidate, &commit, &state, error))
-        return FALSE;
+static DeltaChain *
+delta_chain_ref (DeltaChain *chain)
+{
+  g_atomic_int_inc (&chain->refcount);
+  return chain;
+}
 
-      /* Ignore partial commits, we can't use them */
-      if (state & OSTREE_REPO_COMMIT_STATE_PARTIAL)
-        continue;
+static void
+delta_chain_unref (DeltaChain *chain)
+{
+  if (!g_atomic_int_dec_and_test (&chain->refcount))
+    return;
+  g_ptr_array_unref (chain->revisions);
+  g_ptr_array_unref (chain->superblocks);
+  if (chain->requested_ref)
+    ostree_collection_ref_free (chain->requested_ref);
+  g_free (chain);
+}
 
-      /* Is it newer? */
-      candidate_ts = ostree_commit_get_timestamp (commit);
-      if (newest_candidate == NULL || candidate_ts > newest_candidate_timestamp)
-        {
-          newest_candidate = candidate;
-          newest_candidate_timestamp = candidate_ts;
-        }
-    }
+static const char *
+delta_chain_get_target (DeltaChain *chain)
+{
+  return chain->revisions->pdata[chain->revisions->len - 1];
+}
 
-  if (newest_candidate)
-    {
-      out_result->result = DELTA_SEARCH_RESULT_FROM;
-      memcpy (out_result->from_revision, newest_candidate, OSTREE_SHA256_STRING_LEN + 1);
-    }
-  return TRUE;
+static DeltaIndexSearch *
+delta_index_search_new (const char *target_revision)
+{
+  DeltaIndexSearch *search = g_new0 (DeltaIndexSearch, 1);
+  search->refcount = 1;
+  search->target_revision = g_strdup (target_revision);
+  search->requested = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  return search;
+}
+
+static DeltaIndexSearch *
+delta_index_search_ref (DeltaIndexSearch *search)
+{
+  g_atomic_int_inc (&search->refcount);
+  return search;
+}
+
+static void
+delta_index_search_unref (DeltaIndexSearch *search)
+{
+  if (!g_atomic_int_dec_and_test (&search->refcount))
+    return;
+  g_free (search->target_revision);
+  g_hash_table_unref (search->requested);
+  g_free (search);
 }
 
 static void
@@ -2388,6 +2774,7 @@ fetch_delta_super_data_free (FetchDeltaSuperData *fetch_data)
   g_free (fetch_data->to_revision);
   if (fetch_data->requested_ref)
     ostree_collection_ref_free (fetch_data->requested_ref);
+  g_clear_pointer (&fetch_data->chain, delta_chain_unref);
   g_free (fetch_data);
 }
 
@@ -2398,6 +2785,7 @@ fetch_delta_index_data_free (FetchDeltaIndexData *fetch_data)
   g_free (fetch_data->to_revision);
   if (fetch_data->requested_ref)
     ostree_collection_ref_free (fetch_data->requested_ref);
+  g_clear_pointer (&fetch_data->search, delta_index_search_unref);
   g_free (fetch_data);
 }
 
@@ -2408,6 +2796,220 @@ set_required_deltas_error (GError **error, const char *from_revision, const char
                "Static deltas required, but none found for %s to %s", from_revision, to_revision);
 }
 
+/* Sum up the size of everything we'd download for @delta_superblock,
+ * i.e. the compressed size of all its parts and fallback objects.
+ */
+static gboolean
+get_static_delta_download_size (GVariant *delta_superblock, guint64 *out_size, GError **error)
+{
+  gboolean delta_byteswap = _ostree_delta_needs_byteswap (delta_superblock);
+  g_autoptr (GVariant) headers = g_variant_get_child_value (delta_superblock, 6);
+  g_autoptr (GVariant) fallback_objects = g_variant_get_child_value (delta_superblock, 7);
+  guint64 total = 0;
+
+  const guint n_parts = g_variant_n_children (headers);
+  for (guint i = 0; i < n_parts; i++)
+    {
+      guint32 version;
+      guint64 size, usize;
+      g_variant_get_child (headers, i, "(u@aytt@ay)", &version, NULL, &size, &usize, NULL);
+      total += maybe_swap_endian_u64 (delta_byteswap, size);
+    }
+
+  const guint n_fallbacks = g_variant_n_children (fallback_objects);
+  for (guint i = 0; i < n_fallbacks; i++)
+    {
+      guint8 objtype;
+      guint64 compressed_size, uncompressed_size;
+      g_variant_get_child (fallback_objects, i, "(y@aytt)", &objtype, NULL, &compressed_size,
+                           &uncompressed_size);
+      total += maybe_swap_endian_u64 (delta_byteswap, compressed_size);
+    }
+
+  *out_size = total;
+  return TRUE;
+}
+
+/* Estimate how much we'd download by pulling the objects of @commit we
+ * don't have, using its "ostree.sizes" metadata.  If the commit doesn't
+ * have that metadata, @out_have_estimate is set to %FALSE.  Whether we have
+ * each object is only looked up once per pull, since the chains to several
+ * refs mostly list the same objects.
+ */
+static gboolean
+estimate_object_pull_size (OtPullData *pull_data, GVariant *commit, gboolean *out_have_estimate,
+                           guint64 *out_size, GCancellable *cancellable, GError **error)
+{
+  g_autoptr (GPtrArray) sizes = NULL;
+  g_autoptr (GError) local_error = NULL;
+  guint64 total = 0;
+
+  *out_have_estimate = FALSE;
+  *out_size = 0;
+
+  if (!ostree_commit_get_object_sizes (commit, &sizes, &local_error))
+    {
+      if (g_error_matches (local_error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND))
+        return TRUE;
+      g_propagate_error (error, g_steal_pointer (&local_error));
+      return FALSE;
+    }
+
+  for (guint i = 0; i < sizes->len; i++)
+    {
+      OstreeCommitSizesEntry *entry = sizes->pdata[i];
+      g_autoptr (GVariant) object = ostree_object_name_serialize (entry->checksum, entry->objtype);
+      gpointer value;
+      gboolean have_object;
+
+      if (g_hash_table_lookup_extended (pull_data->estimated_objects, object, NULL, &value))
+        have_object = GPOINTER_TO_INT (value);
+      else
+        {
+          if (!ostree_repo_has_object (pull_data->repo, entry->objtype, entry->checksum,
+                                       &have_object, cancellable, error))
+            return FALSE;
+          g_hash_table_insert (pull_data->estimated_objects, g_steal_pointer (&object),
+                               GINT_TO_POINTER (have_object));
+        }
+      if (!have_object)
+        total += entry->archived;
+    }
+
+  *out_have_estimate = TRUE;
+  *out_size = total;
+  return TRUE;
+}
+
+/* Start processing the next hop of @chain; called once all objects from
+ * the previous hop have been written.
+ */
+static gboolean
+delta_chain_apply_next_hop (OtPullData *pull_data, DeltaChain *chain, GError **error)
+{
+  const guint hop = chain->next_hop++;
+  const char *from_revision = chain->revisions->pdata[hop];
+  const char *to_revision = chain->revisions->pdata[hop + 1];
+  GVariant *delta_superblock = chain->superblocks->pdata[hop];
+
+  g_debug ("applying static delta %s-%s (hop %u of %u)", from_revision, to_revision, hop + 1,
+           chain->superblocks->len);
+
+  g_hash_table_add (pull_data->static_delta_targets, g_strdup (to_revision));
+  /* Intermediate commits will be complete once their hop is applied, so
+   * they can serve as delta sources in the future.
+   */
+  if (chain->next_hop < chain->superblocks->len)
+    g_hash_table_add (pull_data->delta_chain_commits, g_strdup (to_revision));
+
+  if (!process_one_static_delta (pull_data, from_revision, to_revision, delta_superblock,
+                                 chain->requested_ref, pull_data->cancellable, error))
+    return FALSE;
+
+  if (chain->next_hop < chain->superblocks->len && !pull_data->dry_run)
+    g_ptr_array_add (pull_data->pending_delta_chains, delta_chain_ref (chain));
+
+  return TRUE;
+}
+
+/* Pull the target of @chain the way we would have without it: through
+ * the from-scratch delta if that's what we'd have used, otherwise objects.
+ */
+static void
+delta_chain_fall_back (OtPullData *pull_data, DeltaChain *chain)
+{
+  const char *to_revision = delta_chain_get_target (chain);
+
+  if (chain->use_scratch_delta)
+    enqueue_one_static_delta_superblock_request (pull_data, NULL, to_revision,
+                                                 chain->requested_ref);
+  else
+    queue_scan_one_metadata_object (pull_data, to_revision, OSTREE_OBJECT_TYPE_COMMIT, NULL, 0,
+                                    chain->requested_ref);
+}
+
+/* Called once all superblocks of @chain have been fetched; decides
+ * whether the chain is worth using compared to fetching objects.
+ */
+static gboolean
+delta_chain_start (OtPullData *pull_data, DeltaChain *chain, GError **error)
+{
+  const char *to_revision = delta_chain_get_target (chain);
+  guint64 delta_size = 0;
+
+  for (guint i = 0; i < chain->superblocks->len; i++)
+    {
+      guint64 hop_size;
+      if (!get_static_delta_download_size (chain->superblocks->pdata[i], &hop_size, error))
+        return FALSE;
+      delta_size += hop_size;
+    }
+
+  if (!pull_data->require_static_deltas)
+    {
+      GVariant *last_superblock = chain->superblocks->pdata[chain->superblocks->len - 1];
+      g_autoptr (GVariant) to_commit = g_variant_get_child_value (last_superblock, 4);
+      gboolean have_estimate;
+      guint64 object_size;
+
+      if (!estimate_object_pull_size (pull_data, to_commit, &have_estimate, &object_size,
+                                      pull_data->cancellable, error))
+        return FALSE;
+
+      /* Without an estimate, do what we'd have done without the chain */
+      if (!have_estimate)
+        {
+          g_debug ("no size estimate for %s; not using a chain of static deltas", to_revision);
+          delta_chain_fall_back (pull_data, chain);
+          return TRUE;
+        }
+
+      if (object_size < delta_size)
+        {
+          g_debug ("chain of %u static deltas to %s needs %" G_GUINT64_FORMAT
+                   " bytes, objects only %" G_GUINT64_FORMAT "; pulling objects",
+                   chain->superblocks->len, to_revision, delta_size, object_size);
+          queue_scan_one_metadata_object (pull_data, to_revision, OSTREE_OBJECT_TYPE_COMMIT, NULL,
+                                          0, chain->requested_ref);
+          return TRUE;
+        }
+    }
+
+  g_debug ("using chain of %u static deltas (%" G_GUINT64_FORMAT " bytes) to %s",
+           chain->superblocks->len, delta_size, to_revision);
+
+  /* For dry runs nothing gets written, so just account for every hop now */
+  if (pull_data->dry_run)
+    {
+      while (chain->next_hop < chain->superblocks->len)
+        {
+          if (!delta_chain_apply_next_hop (pull_data, chain, error))
+            return FALSE;
+        }
+      return TRUE;
+    }
+
+  return delta_chain_apply_next_hop (pull_data, chain, error);
+}
+
+static gboolean
+delta_chain_superblock_fetched (OtPullData *pull_data, DeltaChain *chain, guint hop,
+                                GVariant *delta_superblock, GError **error)
+{
+  /* We already gave up on this chain */
+  if (chain->abandoned)
+    return TRUE;
+
+  g_assert (chain->superblocks->pdata[hop] == NULL);
+  chain->superblocks->pdata[hop] = g_variant_ref (delta_superblock);
+  chain->n_superblocks_fetched++;
+
+  if (chain->n_superblocks_fetched < chain->superblocks->len)
+    return TRUE;
+
+  return delta_chain_start (pull_data, chain, error);
+}
+
 static void
 on_superblock_fetched (GObject *src, GAsyncResult *res, gpointer data)
 
@@ -2427,6 +3029,29 @@ on_superblock_fetched (GObject *src, GAsyncResult *res, gpointer data)
         goto out;
       g_clear_error (&local_error);
 
+      if (fetch_data->chain != NULL)
+        {
+          DeltaChain *chain = fetch_data->chain;
+
+          /* If one hop of a chain is missing, the whole chain is unusable;
+           * fall back to what we'd have done without it, just once. */
+          if (chain->abandoned)
+            goto out;
+          chain->abandoned = TRUE;
+
+          /* Report the pull that was asked for rather than the missing hop */
+          if (pull_data->require_static_deltas && !chain->use_scratch_delta)
+            {
+              set_required_deltas_error (error, chain->revisions->pdata[0],
+                                         delta_chain_get_target (chain));
+              goto out;
+            }
+
+          g_debug ("static delta %s-%s of chain is missing", from_revision, to_revision);
+          delta_chain_fall_back (pull_data, chain);
+          goto out;
+        }
+
       if (pull_data->require_static_deltas)
         {
           set_required_deltas_error (error, from_revision, to_revision);
@@ -2473,10 +3098,20 @@ on_superblock_fetched (GObject *src, GAsyncResult *res, gpointer data)
       delta_superblock = g_variant_ref_sink (g_variant_new_from_bytes (
           (GVariantType *)OSTREE_STATIC_DELTA_SUPERBLOCK_FORMAT, delta_superblock_data, FALSE));
 
-      g_hash_table_add (pull_data->static_delta_targets, g_strdup (to_revision));
-      if (!process_one_static_delta (pull_data, from_revision, to_revision, delta_superblock,
-                                     fetch_data->requested_ref, pull_data->cancellable, error))
-        goto out;
+      if (fetch_data->chain != NULL)
+        {
+          if (!delta_chain_superblock_fetched (pull_data, fetch_data->chain, fetch_data->chain_hop,
+                                               delta_superblock, error))
+            goto out;
+        }
+      else
+        {
+          g_hash_table_add (pull_data->static_delta_targets, g_strdup (to_revision));
+          if (!process_one_static_delta (pull_data, from_revision, to_revision, delta_superblock,
+                                         fetch_data->requested_ref, pull_data->cancellable,
+                                         error))
+            goto out;
+        }
     }
 
 out:
@@ -2541,6 +3176,31 @@ enqueue_one_static_delta_superblock_request (OtPullData *pull_data, const char *
   enqueue_one_static_delta_superblock_request_s (pull_data, g_steal_pointer (&fdata));
 }
 
+/* Start requests for all superblocks along a chain of static deltas */
+static void
+enqueue_static_delta_chain_request (OtPullData *pull_data, GPtrArray *revisions,
+                                    const OstreeCollectionRef *ref, gboolean use_scratch_delta)
+{
+  DeltaChain *chain = delta_chain_new (revisions, ref);
+  chain->use_scratch_delta = use_scratch_delta;
+
+  for (guint i = 0; i + 1 < revisions->len; i++)
+    {
+      FetchDeltaSuperData *fdata = g_new0 (FetchDeltaSuperData, 1);
+      fdata->pull_data = pull_data;
+      fdata->from_revision = g_strdup (revisions->pdata[i]);
+      fdata->to_revision = g_strdup (revisions->pdata[i + 1]);
+      fdata->requested_ref = (ref != NULL) ? ostree_collection_ref_dup (ref) : NULL;
+      fdata->n_retries_remaining = pull_data->n_network_retries;
+      fdata->chain = delta_chain_ref (chain);
+      fdata->chain_hop = i;
+
+      enqueue_one_static_delta_superblock_request_s (pull_data, g_steal_pointer (&fdata));
+    }
+
+  delta_chain_unref (chain);
+}
+
 static gboolean
 validate_variant_is_csum (GVariant *csum, GError **error)
 {
@@ -2577,17 +3237,53 @@ collect_available_deltas_for_pull (OtPullData *pull_data, GVariant *deltas, GErr
   return TRUE;
 }
 
+static void
+enqueue_one_static_delta_index_request_full (OtPullData *pull_data, const char *to_revision,
+                                             const char *from_revision,
+                                             const OstreeCollectionRef *ref,
+                                             DeltaIndexSearch *search, guint chain_depth);
+
+/* Request the delta indexes of the "from" revisions of @deltas, so we can
+ * look for a chain of deltas via them.
+ */
+static void
+enqueue_delta_index_requests_for_sources (OtPullData *pull_data, FetchDeltaIndexData *fetch_data,
+                                          GVariant *deltas, GError **error)
+{
+  const gsize n = deltas ? g_variant_n_children (deltas) : 0;
+  for (gsize i = 0; i < n; i++)
+    {
+      const char *delta_name;
+      g_autofree char *cur_from_rev = NULL;
+      g_autofree char *cur_to_rev = NULL;
+
+      g_variant_get_child (deltas, i, "{&sv}", &delta_name, NULL);
+      if (!_ostree_parse_delta_name (delta_name, &cur_from_rev, &cur_to_rev, error))
+        return;
+
+      if (cur_from_rev == NULL || strcmp (cur_to_rev, fetch_data->to_revision) != 0)
+        continue;
+      if (g_hash_table_contains (fetch_data->search->requested, cur_from_rev))
+        continue;
+
+      enqueue_one_static_delta_index_request_full (
+          pull_data, cur_from_rev, fetch_data->from_revision, fetch_data->requested_ref,
+          fetch_data->search, fetch_data->chain_depth + 1);
+    }
+}
+
 static void
 on_delta_index_fetched (GObject *src, GAsyncResult *res, gpointer data)
 
 {
   FetchDeltaIndexData *fetch_data = data;
   OtPullData *pull_data = fetch_data->pull_data;
+  DeltaIndexSearch *search = fetch_data->search;
   g_autoptr (GError) local_error = NULL;
   GError **error = &local_error;
   g_autoptr (GBytes) delta_index_data = NULL;
+  g_autoptr (GVariant) deltas = NULL;
   const char *from_revision = fetch_data->from_revision;
-  const char *to_revision = fetch_data->to_revision;
 
   if (!_ostree_fetcher_request_to_membuf_finish ((OstreeFetcher *)src, res, &delta_index_data, NULL,
                                                  NULL, NULL, error))
@@ -2603,15 +3299,48 @@ on_delta_index_fetched (GObject *src, GAsyncResult *res, gpointer data)
     {
       g_autoptr (GVariant) delta_index = g_variant_ref_sink (
           g_variant_new_from_bytes (G_VARIANT_TYPE_VARDICT, delta_index_data, FALSE));
-      g_autoptr (GVariant) deltas = g_variant_lookup_value (
-          delta_index, OSTREE_SUMMARY_STATIC_DELTAS, G_VARIANT_TYPE ("a{sv}"));
+      deltas = g_variant_lookup_value (delta_index, OSTREE_SUMMARY_STATIC_DELTAS,
+                                       G_VARIANT_TYPE ("a{sv}"));
 
       if (!collect_available_deltas_for_pull (pull_data, deltas, error))
         goto out;
     }
 
-  if (!initiate_delta_request (pull_data, fetch_data->requested_ref, to_revision, from_revision,
-                               &local_error))
+  g_assert_cmpuint (search->n_outstanding, >, 0);
+  search->n_outstanding--;
+
+  /* Another index fetch already settled this search */
+  if (search->done)
+    goto out;
+
+  /* If we have an older version of the ref but no delta starts at anything
+   * we have, look one step further back through the indexes of the
+   * revisions deltas start from, in the hope of finding a chain of deltas.
+   */
+  if (from_revision != NULL && fetch_data->chain_depth + 1 < _OSTREE_MAX_STATIC_DELTA_CHAIN_LENGTH
+      && pull_data->dirs == NULL && !pull_data->is_commit_only)
+    {
+      DeltaSearchResult deltares;
+      if (!get_best_static_delta_start_for (pull_data, search->target_revision, &deltares,
+                                            pull_data->cancellable, error))
+        goto out;
+      g_clear_pointer (&deltares.chain, g_ptr_array_unref);
+
+      if (deltares.result == DELTA_SEARCH_RESULT_NO_MATCH
+          || deltares.result == DELTA_SEARCH_RESULT_SCRATCH)
+        {
+          enqueue_delta_index_requests_for_sources (pull_data, fetch_data, deltas, error);
+          if (local_error != NULL)
+            goto out;
+        }
+    }
+
+  if (search->n_outstanding > 0)
+    goto out;
+
+  search->done = TRUE;
+  if (!initiate_delta_request (pull_data, fetch_data->requested_ref, search->target_revision,
+                               from_revision, &local_error))
     goto out;
 
 out:
@@ -2658,10 +3387,11 @@ enqueue_one_static_delta_index_request_s (OtPullData *pull_data, FetchDeltaIndex
     }
 }
 
-/* Start a request for a static delta index */
 static void
-enqueue_one_static_delta_index_request (OtPullData *pull_data, const char *to_revision,
-                                        const char *from_revision, const OstreeCollectionRef *ref)
+enqueue_one_static_delta_index_request_full (OtPullData *pull_data, const char *to_revision,
+                                             const char *from_revision,
+                                             const OstreeCollectionRef *ref,
+                                             DeltaIndexSearch *search, guint chain_depth)
 {
   FetchDeltaIndexData *fdata = g_new0 (FetchDeltaIndexData, 1);
   fdata->pull_data = pull_data;
@@ -2669,10 +3399,26 @@ enqueue_one_static_delta_index_request (OtPullData *pull_data, const char *to_re
   fdata->to_revision = g_strdup (to_revision);
   fdata->requested_ref = (ref != NULL) ? ostree_collection_ref_dup (ref) : NULL;
   fdata->n_retries_remaining = pull_data->n_network_retries;
+  fdata->search = delta_index_search_ref (search);
+  fdata->chain_depth = chain_depth;
+
+  g_hash_table_add (search->requested, g_strdup (to_revision));
+  search->n_outstanding++;
 
   enqueue_one_static_delta_index_request_s (pull_data, g_steal_pointer (&fdata));
 }
 
+/* Start a request for a static delta index */
+static void
+enqueue_one_static_delta_index_request (OtPullData *pull_data, const char *to_revision,
+                                        const char *from_revision, const OstreeCollectionRef *ref)
+{
+  DeltaIndexSearch *search = delta_index_search_new (to_revision);
+  enqueue_one_static_delta_index_request_full (pull_data, to_revision, from_revision, ref, search,
+                                               0);
+  delta_index_search_unref (search);
+}
+
 static gboolean
 _ostree_repo_verify_summary (OstreeRepo *self, const char *name, gboolean gpg_verify_summary,
                              GPtrArray *signapi_summary_verifiers, GBytes *summary,
@@ -3272,6 +4018,14 @@ initiate_delta_request (OtPullData *pull_data, const OstreeCollectionRef *ref,
       enqueue_one_static_delta_superblock_request (pull_data, deltares.from_revision, to_revision,
                                                    ref);
       break;
+    case DELTA_SEARCH_RESULT_CHAIN:
+      {
+        g_autoptr (GPtrArray) chain = g_steal_pointer (&deltares.chain);
+        /* Same as DELTA_SEARCH_RESULT_SCRATCH below, should the chain not be worth it */
+        const gboolean use_scratch_delta = deltares.have_scratch && delta_from_revision == NULL;
+        enqueue_static_delta_chain_request (pull_data, chain, ref, use_scratch_delta);
+      }
+      break;
     case DELTA_SEARCH_RESULT_SCRATCH:
       {
         /* If a from-scratch delta is available, we don’t want to use it if
@@ -3727,6 +4481,16 @@ ostree_repo_pull_with_options (OstreeRepo *self, const char *remote_name_or_base
       = g_hash_table_new_full (NULL, NULL, (GDestroyNotify)fetch_delta_index_data_free, NULL);
   pull_data->pending_fetch_delta_superblocks
       = g_hash_table_new_full (NULL, NULL, (GDestroyNotify)fetch_delta_super_data_free, NULL);
+  pull_data->delta_chain_commits
+      = g_hash_table_new_full (g_str_hash, g_str_equal, (GDestroyNotify)g_free, NULL);
+  pull_data->pending_delta_chains
+      = g_ptr_array_new_with_free_func ((GDestroyNotify)delta_chain_unref);
+  pull_data->estimated_objects = g_hash_table_new_full (
+      ostree_hash_object_name, g_variant_equal, (GDestroyNotify)g_variant_unref, NULL);
+  pull_data->deferred_deltaparts
+      = g_hash_table_new_full (NULL, NULL, (GDestroyNotify)fetch_static_delta_data_free, NULL);
+  pull_data->deltapart_content_index
+      = g_hash_table_new_full (g_str_hash, g_str_equal, (GDestroyNotify)g_free, NULL);
   pull_data->pending_fetch_deltaparts
       = g_hash_table_new_full (NULL, NULL, (GDestroyNotify)fetch_static_delta_data_free, NULL);
 
@@ -3995,11 +4759,6 @@ ostree_repo_pull_with_options (OstreeRepo *self, const char *remote_name_or_base
       pull_data->disable_static_deltas = TRUE;
     }
 
-  /* It's not efficient to use static deltas if all we want is the commit
-   * metadata. */
-  if (pull_data->is_commit_only)
-    pull_data->disable_static_deltas = TRUE;
-
   /* Compute the set of collection-refs (and optional commit id) to fetch */
 
   if (pull_data->is_mirror && !refs_to_fetch && !opt_collection_refs_set && !configured_branches)
@@ -4912,6 +5671,13 @@ ostree_repo_pull_with_options (OstreeRepo *self, const char *remote_name_or_base
           if (!ostree_repo_mark_commit_partial (pull_data->repo, commit, FALSE, error))
             goto out;
         }
+
+      /* intermediate commits of delta chains are complete too */
+      GLNX_HASH_TABLE_FOREACH (pull_data->delta_chain_commits, const char *, commit)
+        {
+          if (!ostree_repo_mark_commit_partial (pull_data->repo, commit, FALSE, error))
+            goto out;
+        }
     }
 
   ret = TRUE;
@@ -4949,6 +5715,11 @@ out:
   g_clear_pointer (&pull_data->summary_sig_etag, g_free);
   g_clear_pointer (&pull_data->summary, g_variant_unref);
   g_clear_pointer (&pull_data->static_delta_targets, g_hash_table_unref);
+  g_clear_pointer (&pull_data->delta_chain_commits, g_hash_table_unref);
+  g_clear_pointer (&pull_data->pending_delta_chains, g_ptr_array_unref);
+  g_clear_pointer (&pull_data->estimated_objects, g_hash_table_unref);
+  g_clear_pointer (&pull_data->deltapart_content_index, g_hash_table_unref);
+  g_clear_pointer (&pull_data->deferred_deltaparts, g_hash_table_unref);
   g_clear_pointer (&pull_data->commit_to_depth, g_hash_table_unref);
   g_clear_pointer (&pull_data->expected_commit_sizes, g_hash_table_unref);
   g_clear_pointer (&pull_data->scanned_metadata, g_hash_table_unref);
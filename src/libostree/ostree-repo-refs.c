@@ -19,6 +19,8 @@
 
 #include "config.h"
 
+#include <sys/file.h>
+
 #include "ostree-core-private.h"
 #include "ostree-repo-private.h"
 #include "ot-fs-utils.h"
@@ -175,6 +177,360 @@ find_ref_in_remotes (OstreeRepo *self, const char *rev, int *out_fd, GError **er
   return TRUE;
 }
 
+/* Refs may also be stored together in refs/packed-refs, similar to git: a
+ * header comment followed by one `CHECKSUM PATH` line per ref, sorted by
+ * path, where PATH is relative to the repository (e.g. `refs/heads/foo`).
+ * Loose refs always take precedence over packed ones; writing a ref only
+ * writes the loose file, and deleting one removes it from both places.  The
+ * file is only ever replaced atomically, under PACKED_REFS_LOCK.
+ */
+#define PACKED_REFS "refs/packed-refs"
+#define PACKED_REFS_LOCK "refs/packed-refs.lock"
+#define PACKED_REFS_HEADER "# ostree packed-refs\n"
+
+typedef struct
+{
+  const char *path;
+  const char *checksum;
+} PackedRef;
+
+struct _OstreePackedRefs
+{
+  gint refcount;
+  dev_t dev;
+  ino_t ino;
+  off_t size;
+  struct timespec mtim;
+  char *contents;
+  GArray *refs; /* (element-type PackedRef), pointing into @contents */
+};
+
+static _OstreePackedRefs *
+packed_refs_ref (_OstreePackedRefs *packed)
+{
+  g_atomic_int_inc (&packed->refcount);
+  return packed;
+}
+
+void
+_ostree_packed_refs_unref (_OstreePackedRefs *packed)
+{
+  if (!g_atomic_int_dec_and_test (&packed->refcount))
+    return;
+  g_free (packed->contents);
+  g_array_unref (packed->refs);
+  g_free (packed);
+}
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (_OstreePackedRefs, _ostree_packed_refs_unref)
+
+static int
+packed_ref_cmp (gconstpointer a, gconstpointer b)
+{
+  return strcmp (((const PackedRef *)a)->path, ((const PackedRef *)b)->path);
+}
+
+/* Parses @contents in place into @refs */
+static gboolean
+parse_packed_refs (char *contents, GArray *refs, GError **error)
+{
+  gboolean sorted = TRUE;
+  guint lineno = 0;
+
+  for (char *line = contents, *next; *line != '\0'; line = next)
+    {
+      char *nl = strchr (line, '\n');
+      if (nl != NULL)
+        {
+          *nl = '\0';
+          next = nl + 1;
+        }
+      else
+        next = line + strlen (line);
+      lineno++;
+
+      if (*line == '\0' || *line == '#')
+        continue;
+
+      char *space = strchr (line, ' ');
+      if (space == NULL || space - line != OSTREE_SHA256_STRING_LEN)
+        return glnx_throw (error, "Invalid line %u", lineno);
+      *space = '\0';
+
+      PackedRef pref = { space + 1, line };
+      if (!ostree_validate_checksum_string (pref.checksum, error))
+        return glnx_prefix_error (error, "Line %u", lineno);
+      if (!g_str_has_prefix (pref.path, "refs/")
+          || !ostree_validate_rev (pref.path + strlen ("refs/"), NULL))
+        return glnx_throw (error, "Invalid ref '%s' on line %u", pref.path, lineno);
+
+      if (refs->len > 0
+          && strcmp (g_array_index (refs, PackedRef, refs->len - 1).path, pref.path) >= 0)
+        sorted = FALSE;
+      g_array_append_val (refs, pref);
+    }
+
+  if (!sorted)
+    g_array_sort (refs, packed_ref_cmp);
+  for (guint i = 1; i < refs->len; i++)
+    {
+      const char *path = g_array_index (refs, PackedRef, i).path;
+      if (strcmp (g_array_index (refs, PackedRef, i - 1).path, path) == 0)
+        return glnx_throw (error, "Duplicate ref '%s'", path);
+    }
+
+  return TRUE;
+}
+
+/* Sets @out_packed to the current contents of refs/packed-refs, or %NULL if
+ * there is none.  The parsed file is cached on @self as long as its stat
+ * doesn't change, so this is cheap to call on every lookup.
+ */
+static gboolean
+load_packed_refs (OstreeRepo *self, _OstreePackedRefs **out_packed, GError **error)
+{
+  glnx_autofd int fd = -1;
+  struct stat stbuf;
+
+  *out_packed = NULL;
+
+  if (!ot_openat_ignore_enoent (self->repo_dir_fd, PACKED_REFS, &fd, error))
+    return FALSE;
+  if (fd == -1)
+    return TRUE;
+  if (!glnx_fstat (fd, &stbuf, error))
+    return FALSE;
+
+  g_mutex_lock (&self->cache_lock);
+  _OstreePackedRefs *cached = self->packed_refs;
+  if (cached != NULL && cached->dev == stbuf.st_dev && cached->ino == stbuf.st_ino
+      && cached->size == stbuf.st_size && cached->mtim.tv_sec == stbuf.st_mtim.tv_sec
+      && cached->mtim.tv_nsec == stbuf.st_mtim.tv_nsec)
+    *out_packed = packed_refs_ref (cached);
+  g_mutex_unlock (&self->cache_lock);
+
+  if (*out_packed != NULL)
+    return TRUE;
+
+  g_autoptr (_OstreePackedRefs) packed = g_new0 (_OstreePackedRefs, 1);
+  packed->refcount = 1;
+  packed->dev = stbuf.st_dev;
+  packed->ino = stbuf.st_ino;
+  packed->size = stbuf.st_size;
+  packed->mtim = stbuf.st_mtim;
+  packed->refs = g_array_new (FALSE, FALSE, sizeof (PackedRef));
+
+  packed->contents = glnx_fd_readall_utf8 (fd, NULL, NULL, error);
+  if (packed->contents == NULL)
+    return glnx_prefix_error (error, "Reading %s", PACKED_REFS);
+  if (!parse_packed_refs (packed->contents, packed->refs, error))
+    return glnx_prefix_error (error, "Parsing %s", PACKED_REFS);
+
+  g_mutex_lock (&self->cache_lock);
+  g_clear_pointer (&self->packed_refs, _ostree_packed_refs_unref);
+  self->packed_refs = packed_refs_ref (packed);
+  g_mutex_unlock (&self->cache_lock);
+
+  *out_packed = g_steal_pointer (&packed);
+  return TRUE;
+}
+
+/* Returns the index of the first packed ref whose path is not less than @path */
+static guint
+packed_refs_lower_bound (_OstreePackedRefs *packed, const char *path)
+{
+  guint lo = 0;
+  guint hi = packed->refs->len;
+
+  while (lo < hi)
+    {
+      guint mid = lo + (hi - lo) / 2;
+      if (strcmp (g_array_index (packed->refs, PackedRef, mid).path, path) < 0)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+
+  return lo;
+}
+
+static const char *
+packed_refs_lookup (_OstreePackedRefs *packed, const char *path)
+{
+  if (packed == NULL)
+    return NULL;
+
+  guint i = packed_refs_lower_bound (packed, path);
+  if (i < packed->refs->len && strcmp (g_array_index (packed->refs, PackedRef, i).path, path) == 0)
+    return g_array_index (packed->refs, PackedRef, i).checksum;
+  return NULL;
+}
+
+/* Sets [@out_start, @out_end) to the range of packed refs whose path starts with @prefix */
+static void
+packed_refs_prefix_range (_OstreePackedRefs *packed, const char *prefix, guint *out_start,
+                          guint *out_end)
+{
+  guint start = 0;
+  guint end = 0;
+
+  if (packed != NULL)
+    {
+      start = end = packed_refs_lower_bound (packed, prefix);
+      while (end < packed->refs->len
+             && g_str_has_prefix (g_array_index (packed->refs, PackedRef, end).path, prefix))
+        end++;
+    }
+
+  *out_start = start;
+  *out_end = end;
+}
+
+/* The packed equivalent of find_ref_in_remotes() */
+static const char *
+packed_refs_find_in_remotes (_OstreePackedRefs *packed, const char *rev)
+{
+  guint start, end;
+
+  packed_refs_prefix_range (packed, "refs/remotes/", &start, &end);
+  for (guint i = start; i < end; i++)
+    {
+      const PackedRef *pref = &g_array_index (packed->refs, PackedRef, i);
+      const char *slash = strchr (pref->path + strlen ("refs/remotes/"), '/');
+      if (slash != NULL && strcmp (slash + 1, rev) == 0)
+        return pref->checksum;
+    }
+
+  return NULL;
+}
+
+/* A packed ref may not also be a directory of other refs, or vice versa */
+static gboolean
+check_packed_ref_conflicts (_OstreePackedRefs *packed, const char *path, GError **error)
+{
+  if (packed == NULL)
+    return TRUE;
+
+  g_autofree char *parent = g_strdup (path);
+  char *slash;
+  while ((slash = strrchr (parent, '/')) != NULL)
+    {
+      *slash = '\0';
+      if (packed_refs_lookup (packed, parent) != NULL)
+        return glnx_throw (error, "Conflict: %s exists when attempting write of %s", parent, path);
+    }
+
+  guint start, end;
+  packed_refs_prefix_range (packed, glnx_strjoina (path, "/"), &start, &end);
+  if (start < end)
+    return glnx_throw (error, "Conflict: %s exists under %s when attempting write",
+                       g_array_index (packed->refs, PackedRef, start).path, path);
+
+  return TRUE;
+}
+
+/* Atomically replaces refs/packed-refs with @refs, which must be sorted */
+static gboolean
+write_packed_refs (OstreeRepo *self, GArray *refs, GCancellable *cancellable, GError **error)
+{
+  if (refs->len == 0)
+    return ot_ensure_unlinked_at (self->repo_dir_fd, PACKED_REFS, error);
+
+  g_autoptr (GString) buf = g_string_new (PACKED_REFS_HEADER);
+  for (guint i = 0; i < refs->len; i++)
+    {
+      const PackedRef *pref = &g_array_index (refs, PackedRef, i);
+      g_string_append_printf (buf, "%s %s\n", pref->checksum, pref->path);
+    }
+
+  return _ostree_repo_file_replace_contents (self, self->repo_dir_fd, PACKED_REFS,
+                                             (guint8 *)buf->str, buf->len, cancellable, error);
+}
+
+static gboolean
+delete_packed_ref (OstreeRepo *self, const char *path, GCancellable *cancellable, GError **error)
+{
+  g_autoptr (_OstreePackedRefs) packed = NULL;
+
+  if (!load_packed_refs (self, &packed, error))
+    return FALSE;
+  if (packed_refs_lookup (packed, path) == NULL)
+    return TRUE;
+
+  g_auto (GLnxLockFile) lock = {
+    0,
+  };
+  if (!glnx_make_lock_file (self->repo_dir_fd, PACKED_REFS_LOCK, LOCK_EX, &lock, error))
+    return FALSE;
+
+  /* Reload now that we hold the lock, in case it was rewritten meanwhile */
+  g_clear_pointer (&packed, _ostree_packed_refs_unref);
+  if (!load_packed_refs (self, &packed, error))
+    return FALSE;
+  if (packed_refs_lookup (packed, path) == NULL)
+    return TRUE;
+
+  g_autoptr (GArray) refs = g_array_sized_new (FALSE, FALSE, sizeof (PackedRef), packed->refs->len);
+  for (guint i = 0; i < packed->refs->len; i++)
+    {
+      const PackedRef *pref = &g_array_index (packed->refs, PackedRef, i);
+      if (strcmp (pref->path, path) != 0)
+        g_array_append_val (refs, *pref);
+    }
+
+  return write_packed_refs (self, refs, cancellable, error);
+}
+
+/* Like add_ref_to_set(), but doesn't replace a loose ref already in @refs */
+static void
+add_packed_ref_to_set (const char *remote, const char *collection_id, const char *name,
+                       const char *checksum, GHashTable *refs)
+{
+  if (collection_id == NULL)
+    {
+      g_autofree char *refname
+          = remote != NULL ? g_strconcat (remote, ":", name, NULL) : g_strdup (name);
+      if (!g_hash_table_contains (refs, refname))
+        g_hash_table_insert (refs, g_steal_pointer (&refname), g_strdup (checksum));
+    }
+  else
+    {
+      const OstreeCollectionRef ref = { (gchar *)collection_id, (gchar *)name };
+      if (!g_hash_table_contains (refs, &ref))
+        g_hash_table_insert (refs, ostree_collection_ref_new (collection_id, name),
+                             g_strdup (checksum));
+    }
+}
+
+/* Adds each packed ref under @dir (e.g. `refs/heads/`) to @refs, keyed by the
+ * rest of its path; if @remote_dirs is set, the first component of that is
+ * the name of the remote instead.
+ */
+static void
+add_packed_refs_under (_OstreePackedRefs *packed, const char *dir, gboolean remote_dirs,
+                       const char *collection_id, GHashTable *refs)
+{
+  guint start, end;
+
+  packed_refs_prefix_range (packed, dir, &start, &end);
+  for (guint i = start; i < end; i++)
+    {
+      const PackedRef *pref = &g_array_index (packed->refs, PackedRef, i);
+      const char *name = pref->path + strlen (dir);
+
+      if (remote_dirs)
+        {
+          const char *slash = strchr (name, '/');
+          if (slash == NULL)
+            continue;
+          g_autofree char *remote = g_strndup (name, slash - name);
+          add_packed_ref_to_set (remote, collection_id, slash + 1, pref->checksum, refs);
+        }
+      else
+        add_packed_ref_to_set (NULL, collection_id, name, pref->checksum, refs);
+    }
+}
+
 static gboolean resolve_refspec (OstreeRepo *self, const char *remote, const char *ref,
                                  gboolean allow_noent, gboolean fallback_remote, char **out_rev,
                                  GError **error);
@@ -210,6 +566,8 @@ resolve_refspec (OstreeRepo *self, const char *remote, const char *ref, gboolean
   __attribute__ ((unused)) GCancellable *cancellable = NULL;
   g_autofree char *ret_rev = NULL;
   glnx_autofd int target_fd = -1;
+  g_autoptr (_OstreePackedRefs) packed = NULL;
+  const char *packed_rev = NULL;
 
   g_return_val_if_fail (ref != NULL, FALSE);
 
@@ -245,6 +603,13 @@ resolve_refspec (OstreeRepo *self, const char *remote, const char *ref, gboolean
 
       if (!ot_openat_ignore_enoent (self->repo_dir_fd, remote_ref, &target_fd, error))
         return FALSE;
+
+      if (target_fd == -1)
+        {
+          if (!load_packed_refs (self, &packed, error))
+            return FALSE;
+          packed_rev = packed_refs_lookup (packed, remote_ref);
+        }
     }
   else
     {
@@ -253,7 +618,14 @@ resolve_refspec (OstreeRepo *self, const char *remote, const char *ref, gboolean
       if (!ot_openat_ignore_enoent (self->repo_dir_fd, local_ref, &target_fd, error))
         return FALSE;
 
-      if (target_fd == -1 && fallback_remote)
+      if (target_fd == -1)
+        {
+          if (!load_packed_refs (self, &packed, error))
+            return FALSE;
+          packed_rev = packed_refs_lookup (packed, local_ref);
+        }
+
+      if (target_fd == -1 && packed_rev == NULL && fallback_remote)
         {
           local_ref = glnx_strjoina ("refs/remotes/", ref);
 
@@ -261,9 +633,15 @@ resolve_refspec (OstreeRepo *self, const char *remote, const char *ref, gboolean
             return FALSE;
 
           if (target_fd == -1)
+            packed_rev = packed_refs_lookup (packed, local_ref);
+
+          if (target_fd == -1 && packed_rev == NULL)
             {
               if (!find_ref_in_remotes (self, ref, &target_fd, error))
                 return FALSE;
+
+              if (target_fd == -1)
+                packed_rev = packed_refs_find_in_remotes (packed, ref);
             }
         }
     }
@@ -281,6 +659,10 @@ resolve_refspec (OstreeRepo *self, const char *remote, const char *ref, gboolean
       if (!ostree_validate_checksum_string (ret_rev, error))
         return FALSE;
     }
+  else if (packed_rev != NULL)
+    {
+      ret_rev = g_strdup (packed_rev);
+    }
   else
     {
       if (!resolve_refspec_fallback (self, remote, ref, allow_noent, fallback_remote, &ret_rev,
@@ -630,6 +1012,7 @@ _ostree_repo_list_refs_internal (OstreeRepo *self, gboolean cut_prefix,
 {
   GLNX_AUTO_PREFIX_ERROR ("Listing refs", error);
 
+  const gboolean aliases_only = (flags & OSTREE_REPO_LIST_REFS_EXT_ALIASES) > 0;
   g_autofree char *remote = NULL;
   g_autofree char *ref_prefix = NULL;
 
@@ -672,7 +1055,8 @@ _ostree_repo_list_refs_internal (OstreeRepo *self, gboolean cut_prefix,
 
       if (!glnx_fstatat_allow_noent (self->repo_dir_fd, path, &stbuf, 0, error))
         return FALSE;
-      if (errno == 0)
+      const gboolean loose_exists = (errno == 0);
+      if (loose_exists)
         {
           if (S_ISDIR (stbuf.st_mode))
             {
@@ -702,6 +1086,35 @@ _ostree_repo_list_refs_internal (OstreeRepo *self, gboolean cut_prefix,
                 return FALSE;
             }
         }
+
+      /* Packed refs never shadow loose ones, nor conflict with them */
+      if (!aliases_only)
+        {
+          g_autoptr (_OstreePackedRefs) packed = NULL;
+          const gboolean is_dot = strcmp (ref_prefix, ".") == 0;
+          guint start, end;
+
+          if (!load_packed_refs (self, &packed, error))
+            return FALSE;
+
+          const char *packed_rev = is_dot ? NULL : packed_refs_lookup (packed, path);
+          if (packed_rev != NULL && !loose_exists)
+            add_packed_ref_to_set (remote, NULL, ref_prefix, packed_rev, ret_all_refs);
+
+          const char *dir = is_dot ? prefix_path : glnx_strjoina (path, "/");
+          if (!loose_exists || S_ISDIR (stbuf.st_mode))
+            packed_refs_prefix_range (packed, dir, &start, &end);
+          else
+            start = end = 0;
+          for (guint i = start; i < end; i++)
+            {
+              const PackedRef *pref = &g_array_index (packed->refs, PackedRef, i);
+              const char *rest = pref->path + strlen (dir);
+              g_autofree char *name
+                  = cut_prefix ? g_strdup (rest) : g_strconcat (ref_prefix, "/", rest, NULL);
+              add_packed_ref_to_set (remote, NULL, name, pref->checksum, ret_all_refs);
+            }
+        }
     }
   else
     {
@@ -748,6 +1161,18 @@ _ostree_repo_list_refs_internal (OstreeRepo *self, gboolean cut_prefix,
                 return FALSE;
             }
         }
+
+      if (!aliases_only)
+        {
+          g_autoptr (_OstreePackedRefs) packed = NULL;
+
+          if (!load_packed_refs (self, &packed, error))
+            return FALSE;
+
+          add_packed_refs_under (packed, "refs/heads/", FALSE, NULL, ret_all_refs);
+          if (!(flags & OSTREE_REPO_LIST_REFS_EXT_EXCLUDE_REMOTES))
+            add_packed_refs_under (packed, "refs/remotes/", TRUE, NULL, ret_all_refs);
+        }
     }
 
   ot_transfer_out_value (out_all_refs, &ret_all_refs);
@@ -1016,6 +1441,7 @@ _ostree_repo_write_ref (OstreeRepo *self, const char *remote, const OstreeCollec
                         GError **error)
 {
   glnx_autofd int dfd = -1;
+  const char *packed_dir;
 
   g_return_val_if_fail (remote == NULL || ref->collection_id == NULL, FALSE);
   g_return_val_if_fail (!(rev != NULL && alias != NULL), FALSE);
@@ -1033,11 +1459,14 @@ _ostree_repo_write_ref (OstreeRepo *self, const char *remote, const OstreeCollec
     {
       if (!glnx_opendirat (self->repo_dir_fd, "refs/heads", TRUE, &dfd, error))
         return FALSE;
+      packed_dir = "refs/heads/";
     }
   else if (remote == NULL && ref->collection_id != NULL)
     {
       glnx_autofd int refs_mirrors_dfd = -1;
 
+      packed_dir = glnx_strjoina ("refs/mirrors/", ref->collection_id, "/");
+
       /* refs/mirrors might not exist in older repositories, so create it. */
       if (!glnx_shutil_mkdir_p_at_open (self->repo_dir_fd, "refs/mirrors", 0777, &refs_mirrors_dfd,
                                         cancellable, error))
@@ -1059,6 +1488,8 @@ _ostree_repo_write_ref (OstreeRepo *self, const char *remote, const OstreeCollec
     {
       glnx_autofd int refs_remotes_dfd = -1;
 
+      packed_dir = glnx_strjoina ("refs/remotes/", remote, "/");
+
       if (!glnx_opendirat (self->repo_dir_fd, "refs/remotes", TRUE, &refs_remotes_dfd, error))
         return FALSE;
 
@@ -1074,6 +1505,9 @@ _ostree_repo_write_ref (OstreeRepo *self, const char *remote, const OstreeCollec
         return glnx_throw_errno_prefix (error, "Opening remotes/ dir %s", remote);
     }
 
+  const char *packed_path = glnx_strjoina (packed_dir, ref->ref_name);
+  g_autoptr (_OstreePackedRefs) packed = NULL;
+
   if (rev == NULL && alias == NULL)
     {
       if (dfd >= 0)
@@ -1081,15 +1515,41 @@ _ostree_repo_write_ref (OstreeRepo *self, const char *remote, const OstreeCollec
           if (!ot_ensure_unlinked_at (dfd, ref->ref_name, error))
             return FALSE;
         }
+
+      /* Otherwise the packed ref would reappear */
+      if (!delete_packed_ref (self, packed_path, cancellable, error))
+        return FALSE;
     }
   else if (rev != NULL)
     {
+      if (!load_packed_refs (self, &packed, error))
+        return FALSE;
+      if (!check_packed_ref_conflicts (packed, packed_path, error))
+        return FALSE;
+
       if (!write_checksum_file_at (self, dfd, ref->ref_name, rev, cancellable, error))
         return FALSE;
     }
   else if (alias != NULL)
     {
       const char *lastslash = strrchr (ref->ref_name, '/');
+      struct stat stbuf;
+
+      if (!load_packed_refs (self, &packed, error))
+        return FALSE;
+      if (!check_packed_ref_conflicts (packed, packed_path, error))
+        return FALSE;
+
+      /* The alias is a symlink, so its target needs to be a loose ref */
+      if (!glnx_fstatat_allow_noent (dfd, alias, &stbuf, AT_SYMLINK_NOFOLLOW, error))
+        return FALSE;
+      if (errno == ENOENT)
+        {
+          const char *target_rev = packed_refs_lookup (packed, glnx_strjoina (packed_dir, alias));
+          if (target_rev != NULL
+              && !write_checksum_file_at (self, dfd, alias, target_rev, cancellable, error))
+            return FALSE;
+        }
 
       if (lastslash)
         {
@@ -1297,6 +1757,333 @@ ostree_repo_list_collection_refs (OstreeRepo *self, const char *match_collection
         }
     }
 
+  if (!(flags & OSTREE_REPO_LIST_REFS_EXT_ALIASES))
+    {
+      g_autoptr (_OstreePackedRefs) packed = NULL;
+      guint start, end;
+
+      if (!load_packed_refs (self, &packed, error))
+        return FALSE;
+
+      if (main_collection_id != NULL
+          && (match_collection_id == NULL
+              || g_strcmp0 (match_collection_id, main_collection_id) == 0))
+        add_packed_refs_under (packed, "refs/heads/", FALSE, main_collection_id, ret_all_refs);
+
+      if (!(flags & OSTREE_REPO_LIST_REFS_EXT_EXCLUDE_MIRRORS))
+        {
+          packed_refs_prefix_range (packed, "refs/mirrors/", &start, &end);
+          for (guint i = start; i < end; i++)
+            {
+              const PackedRef *pref = &g_array_index (packed->refs, PackedRef, i);
+              const char *name = pref->path + strlen ("refs/mirrors/");
+              const char *slash = strchr (name, '/');
+              if (slash == NULL)
+                continue;
+
+              g_autofree char *collection_id = g_strndup (name, slash - name);
+              if (!ostree_validate_collection_id (collection_id, NULL)
+                  || (match_collection_id != NULL
+                      && g_strcmp0 (match_collection_id, collection_id) != 0))
+                continue;
+
+              add_packed_ref_to_set (NULL, collection_id, slash + 1, pref->checksum,
+                                     ret_all_refs);
+            }
+        }
+
+      if (!(flags & OSTREE_REPO_LIST_REFS_EXT_EXCLUDE_REMOTES))
+        {
+          g_autofree char *remote = NULL;
+          g_autofree char *remote_collection_id = NULL;
+
+          /* Refs are sorted by path, so each remote's refs are adjacent */
+          packed_refs_prefix_range (packed, "refs/remotes/", &start, &end);
+          for (guint i = start; i < end; i++)
+            {
+              const PackedRef *pref = &g_array_index (packed->refs, PackedRef, i);
+              const char *name = pref->path + strlen ("refs/remotes/");
+              const char *slash = strchr (name, '/');
+              if (slash == NULL)
+                continue;
+
+              if (remote == NULL || strncmp (remote, name, slash - name) != 0
+                  || remote[slash - name] != '\0')
+                {
+                  g_clear_pointer (&remote, g_free);
+                  g_clear_pointer (&remote_collection_id, g_free);
+                  remote = g_strndup (name, slash - name);
+                  if (!ostree_repo_get_remote_option (self, remote, "collection-id", NULL,
+                                                      &remote_collection_id, NULL)
+                      || !ostree_validate_collection_id (remote_collection_id, NULL))
+                    g_clear_pointer (&remote_collection_id, g_free);
+                }
+
+              if (remote_collection_id == NULL
+                  || (match_collection_id != NULL
+                      && g_strcmp0 (match_collection_id, remote_collection_id) != 0))
+                continue;
+
+              add_packed_ref_to_set (NULL, remote_collection_id, slash + 1, pref->checksum,
+                                     ret_all_refs);
+            }
+        }
+    }
+
   ot_transfer_out_value (out_all_refs, &ret_all_refs);
   return TRUE;
 }
+
+/* Collects the refs under @path (relative to the repository, ending in `/`)
+ * into @loose as path ↦ checksum, or ↦ %NULL for aliases; the targets of the
+ * aliases into @alias_targets; and the subdirectories into @dirs.  The first
+ * @root_len bytes of @path are the directory which alias targets are relative
+ * to, e.g. `refs/heads/`.
+ */
+static gboolean
+collect_loose_refs (OstreeRepo *self, GString *path, gsize root_len, GHashTable *loose,
+                    GHashTable *alias_targets, GPtrArray *dirs, GCancellable *cancellable,
+                    GError **error)
+{
+  g_auto (GLnxDirFdIterator) dfd_iter = {
+    0,
+  };
+
+  if (!glnx_dirfd_iterator_init_at (self->repo_dir_fd, path->str, FALSE, &dfd_iter, error))
+    return FALSE;
+
+  while (TRUE)
+    {
+      gsize len = path->len;
+      struct dirent *dent = NULL;
+
+      if (!glnx_dirfd_iterator_next_dent_ensure_dtype (&dfd_iter, &dent, cancellable, error))
+        return FALSE;
+      if (dent == NULL)
+        break;
+
+      /* See enumerate_refs_recurse() */
+      if (!_ostree_validate_ref_fragment (dent->d_name, NULL))
+        continue;
+
+      g_string_append (path, dent->d_name);
+
+      if (dent->d_type == DT_DIR)
+        {
+          g_ptr_array_add (dirs, g_strdup (path->str));
+          g_string_append_c (path, '/');
+
+          if (!collect_loose_refs (self, path, root_len, loose, alias_targets, dirs, cancellable,
+                                   error))
+            return FALSE;
+        }
+      else if (dent->d_type == DT_LNK)
+        {
+          g_autofree char *target
+              = glnx_readlinkat_malloc (dfd_iter.fd, dent->d_name, cancellable, error);
+          const char *resolved_target = target;
+          if (!target)
+            return FALSE;
+          while (g_str_has_prefix (resolved_target, "../"))
+            resolved_target += 3;
+
+          g_hash_table_add (alias_targets,
+                            g_strdup_printf ("%.*s%s", (int)root_len, path->str, resolved_target));
+          g_hash_table_insert (loose, g_strdup (path->str), NULL);
+        }
+      else if (dent->d_type == DT_REG)
+        {
+          g_autofree char *contents = glnx_file_get_contents_utf8_at (
+              dfd_iter.fd, dent->d_name, NULL, cancellable, error);
+          if (!contents)
+            return FALSE;
+
+          g_strchomp (contents);
+          if (!ostree_validate_checksum_string (contents, error))
+            return glnx_prefix_error (error, "Ref %s", path->str);
+
+          g_hash_table_insert (loose, g_strdup (path->str), g_steal_pointer (&contents));
+        }
+
+      g_string_truncate (path, len);
+    }
+
+  return TRUE;
+}
+
+/* Whether a packed ref at @path is shadowed by, or conflicts with, a loose one */
+static gboolean
+packed_ref_is_shadowed (GHashTable *loose, GHashTable *loose_dirs, const char *path)
+{
+  if (g_hash_table_contains (loose, path) || g_hash_table_contains (loose_dirs, path))
+    return TRUE;
+
+  g_autofree char *parent = g_strdup (path);
+  char *slash;
+  while ((slash = strrchr (parent, '/')) != NULL)
+    {
+      *slash = '\0';
+      if (g_hash_table_contains (loose, parent))
+        return TRUE;
+    }
+
+  return FALSE;
+}
+
+/**
+ * ostree_repo_pack_refs:
+ * @self: Repo
+ * @cancellable: Cancellable
+ * @error: Error
+ *
+ * Move the refs in `refs/heads`, `refs/remotes` and `refs/mirrors` into the
+ * single file `refs/packed-refs`, which is much cheaper to list and look up
+ * than one file per ref when a repository has many refs.  The new file
+ * replaces the old one atomically before any loose ref is removed, so
+ * concurrent readers always see every ref.
+ *
+ * Refs written afterwards are loose again, and take precedence over packed
+ * ones until the next call.  Aliases, and the refs they point to, are left
+ * loose.
+ *
+ * Note that pulling over HTTP from a repository without a summary file reads
+ * the loose ref files directly, so repositories served that way should keep
+ * their summary up to date (see ostree_repo_regenerate_summary()).
+ *
+ * Since: 2024.11
+ */
+gboolean
+ostree_repo_pack_refs (OstreeRepo *self, GCancellable *cancellable, GError **error)
+{
+  GLNX_AUTO_PREFIX_ERROR ("Packing refs", error);
+
+  g_return_val_if_fail (OSTREE_IS_REPO (self), FALSE);
+
+  g_autoptr (OstreeRepoAutoLock) lock
+      = ostree_repo_auto_lock_push (self, OSTREE_REPO_LOCK_EXCLUSIVE, cancellable, error);
+  if (!lock)
+    return FALSE;
+
+  g_auto (GLnxLockFile) packed_lock = {
+    0,
+  };
+  if (!glnx_make_lock_file (self->repo_dir_fd, PACKED_REFS_LOCK, LOCK_EX, &packed_lock, error))
+    return FALSE;
+
+  g_autoptr (_OstreePackedRefs) packed = NULL;
+  if (!load_packed_refs (self, &packed, error))
+    return FALSE;
+
+  g_autoptr (GPtrArray) roots = g_ptr_array_new_with_free_func (g_free);
+  g_ptr_array_add (roots, g_strdup ("refs/heads/"));
+
+  static const char *const namespace_dirs[] = { "refs/remotes", "refs/mirrors" };
+  for (guint i = 0; i < G_N_ELEMENTS (namespace_dirs); i++)
+    {
+      g_auto (GLnxDirFdIterator) dfd_iter = {
+        0,
+      };
+      gboolean exists;
+
+      if (!ot_dfd_iter_init_allow_noent (self->repo_dir_fd, namespace_dirs[i], &dfd_iter, &exists,
+                                         error))
+        return FALSE;
+
+      while (exists)
+        {
+          struct dirent *dent;
+
+          if (!glnx_dirfd_iterator_next_dent_ensure_dtype (&dfd_iter, &dent, cancellable, error))
+            return FALSE;
+          if (dent == NULL)
+            break;
+
+          if (dent->d_type == DT_DIR)
+            g_ptr_array_add (roots, g_strconcat (namespace_dirs[i], "/", dent->d_name, "/", NULL));
+        }
+    }
+
+  g_autoptr (GHashTable) loose = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+  g_autoptr (GHashTable) alias_targets
+      = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  g_autoptr (GPtrArray) dirs = g_ptr_array_new_with_free_func (g_free);
+
+  for (guint i = 0; i < roots->len; i++)
+    {
+      g_autoptr (GString) path = g_string_new (roots->pdata[i]);
+
+      if (!collect_loose_refs (self, path, path->len, loose, alias_targets, dirs, cancellable,
+                               error))
+        return FALSE;
+    }
+
+  /* Every directory containing a loose ref; a packed ref there would conflict */
+  g_autoptr (GHashTable) loose_dirs = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  GLNX_HASH_TABLE_FOREACH (loose, const char *, path)
+    {
+      g_autofree char *parent = g_strdup (path);
+      char *slash;
+      while ((slash = strrchr (parent, '/')) != NULL)
+        {
+          *slash = '\0';
+          if (!g_hash_table_add (loose_dirs, g_strdup (parent)))
+            break;
+        }
+    }
+
+  g_autoptr (GArray) refs = g_array_new (FALSE, FALSE, sizeof (PackedRef));
+  for (guint i = 0; packed != NULL && i < packed->refs->len; i++)
+    {
+      const PackedRef *pref = &g_array_index (packed->refs, PackedRef, i);
+      if (!packed_ref_is_shadowed (loose, loose_dirs, pref->path))
+        g_array_append_val (refs, *pref);
+    }
+  GLNX_HASH_TABLE_FOREACH_KV (loose, const char *, path, const char *, checksum)
+    {
+      if (checksum == NULL || g_hash_table_contains (alias_targets, path))
+        continue;
+
+      PackedRef pref = { path, checksum };
+      g_array_append_val (refs, pref);
+    }
+  g_array_sort (refs, packed_ref_cmp);
+
+  if (!write_packed_refs (self, refs, cancellable, error))
+    return FALSE;
+
+  /* Immediate ref writes don't take the repository lock, so leave any loose
+   * ref which changed since we read it; it still takes precedence.
+   */
+  GLNX_HASH_TABLE_FOREACH_KV (loose, const char *, path, const char *, checksum)
+    {
+      glnx_autofd int fd = -1;
+
+      if (checksum == NULL || g_hash_table_contains (alias_targets, path))
+        continue;
+
+      if (!ot_openat_ignore_enoent (self->repo_dir_fd, path, &fd, error))
+        return FALSE;
+      if (fd == -1)
+        continue;
+
+      g_autofree char *contents = glnx_fd_readall_utf8 (fd, NULL, cancellable, error);
+      if (!contents)
+        return FALSE;
+      g_strchomp (contents);
+
+      if (strcmp (contents, checksum) == 0
+          && !ot_ensure_unlinked_at (self->repo_dir_fd, path, error))
+        return FALSE;
+    }
+
+  /* Deepest first, so that nested empty directories are all removed */
+  for (guint i = dirs->len; i > 0; i--)
+    {
+      const char *dir = dirs->pdata[i - 1];
+      if (unlinkat (self->repo_dir_fd, dir, AT_REMOVEDIR) < 0 && errno != ENOTEMPTY
+          && errno != EEXIST && errno != ENOENT)
+        return glnx_throw_errno_prefix (error, "rmdir(%s)", dir);
+    }
+
+  return TRUE;
+}
@@ -884,10 +884,59 @@ check_object_world_readable (OstreeRepo *repo, const char *checksum, gboolean *o
   return TRUE;
 }
 
+/* With several delta sources, every new object is tagged with the set of
+ * sources (bit 0 being the primary one) which lack it.  Objects are then
+ * grouped into parts by that set, so that a client updating from any one
+ * of the sources can skip the parts it already has.
+ */
+static guint32
+get_missing_sources_mask (GPtrArray *sources_reachable, GVariant *serialized_key)
+{
+  guint32 mask = 0;
+
+  for (guint i = 0; i < sources_reachable->len; i++)
+    {
+      GHashTable *reachable = sources_reachable->pdata[i];
+      if (!g_hash_table_contains (reachable, serialized_key))
+        mask |= (1U << i);
+    }
+
+  return mask;
+}
+
+/* Whether the content object @checksum can be used as the base for a
+ * rollsum or bsdiff by every source in @mask.
+ */
+static gboolean
+source_object_available (GPtrArray *sources_reachable, guint32 mask, const char *checksum)
+{
+  g_autoptr (GVariant) objname = ostree_object_name_serialize (checksum, OSTREE_OBJECT_TYPE_FILE);
+
+  for (guint i = 0; i < sources_reachable->len; i++)
+    {
+      GHashTable *reachable = sources_reachable->pdata[i];
+      if ((mask & (1U << i)) && !g_hash_table_contains (reachable, objname))
+        return FALSE;
+    }
+
+  return TRUE;
+}
+
+static gint
+compare_masks (gconstpointer a, gconstpointer b)
+{
+  guint32 mask_a = *(const guint32 *)a;
+  guint32 mask_b = *(const guint32 *)b;
+
+  if (mask_a == mask_b)
+    return 0;
+  return mask_a < mask_b ? 1 : -1;
+}
+
 static gboolean
-generate_delta_lowlatency (OstreeRepo *repo, const char *from, const char *to, DeltaOpts opts,
-                           OstreeStaticDeltaBuilder *builder, GCancellable *cancellable,
-                           GError **error)
+generate_delta_lowlatency (OstreeRepo *repo, const char *from, const char *const *extra_froms,
+                           const char *to, DeltaOpts opts, OstreeStaticDeltaBuilder *builder,
+                           GCancellable *cancellable, GError **error)
 {
   GHashTableIter hashiter;
   gpointer key, value;
@@ -897,16 +946,22 @@ generate_delta_lowlatency (OstreeRepo *repo, const char *from, const char *to, D
   g_autoptr (GFile) root_to = NULL;
   g_autoptr (GVariant) to_commit = NULL;
   g_autoptr (GHashTable) to_reachable_objects = NULL;
-  g_autoptr (GHashTable) from_reachable_objects = NULL;
   g_autoptr (GHashTable) new_reachable_metadata = NULL;
   g_autoptr (GHashTable) new_reachable_regfile_content = NULL;
   g_autoptr (GHashTable) new_reachable_symlink_content = NULL;
   g_autoptr (GHashTable) modified_regfile_content = NULL;
   g_autoptr (GHashTable) rollsum_optimized_content_objects = NULL;
   g_autoptr (GHashTable) bsdiff_optimized_content_objects = NULL;
+  g_autoptr (GPtrArray) sources_reachable
+      = g_ptr_array_new_with_free_func ((GDestroyNotify)g_hash_table_unref);
+  g_autoptr (GHashTable) metadata_masks = NULL;
+  g_autoptr (GHashTable) content_masks = NULL;
+  g_autoptr (GArray) masks = g_array_new (FALSE, FALSE, sizeof (guint32));
 
   if (from != NULL)
     {
+      g_autoptr (GHashTable) from_reachable_objects = NULL;
+
       if (!ostree_repo_read_commit (repo, from, &root_from, NULL, cancellable, error))
         return FALSE;
 
@@ -915,6 +970,18 @@ generate_delta_lowlatency (OstreeRepo *repo, const char *from, const char *to, D
 
       if (!ostree_repo_traverse_commit (repo, from, 0, &from_reachable_objects, cancellable, error))
         return FALSE;
+      g_ptr_array_add (sources_reachable, g_steal_pointer (&from_reachable_objects));
+    }
+
+  for (const char *const *iter = extra_froms; iter && *iter; iter++)
+    {
+      g_autoptr (GHashTable) extra_reachable_objects = NULL;
+
+      g_assert (from != NULL);
+      if (!ostree_repo_traverse_commit (repo, *iter, 0, &extra_reachable_objects, cancellable,
+                                        error))
+        return FALSE;
+      g_ptr_array_add (sources_reachable, g_steal_pointer (&extra_reachable_objects));
     }
 
   if (!ostree_repo_read_commit (repo, to, &root_to, NULL, cancellable, error))
@@ -928,6 +995,9 @@ generate_delta_lowlatency (OstreeRepo *repo, const char *from, const char *to, D
   new_reachable_metadata = ostree_repo_traverse_new_reachable ();
   new_reachable_regfile_content = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, g_free);
   new_reachable_symlink_content = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, g_free);
+  metadata_masks = g_hash_table_new_full (ostree_hash_object_name, g_variant_equal,
+                                          (GDestroyNotify)g_variant_unref, NULL);
+  content_masks = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
 
   g_hash_table_iter_init (&hashiter, to_reachable_objects);
   while (g_hash_table_iter_next (&hashiter, &key, &value))
@@ -935,14 +1005,32 @@ generate_delta_lowlatency (OstreeRepo *repo, const char *from, const char *to, D
       GVariant *serialized_key = key;
       const char *checksum;
       OstreeObjectType objtype;
+      guint32 mask;
+      gboolean known_mask = FALSE;
 
-      if (from_reachable_objects && g_hash_table_contains (from_reachable_objects, serialized_key))
-        continue;
+      /* Objects that every source already has don't need to be shipped */
+      if (sources_reachable->len > 0)
+        {
+          mask = get_missing_sources_mask (sources_reachable, serialized_key);
+          if (mask == 0)
+            continue;
+        }
+      else
+        mask = 0;
+
+      for (guint i = 0; i < masks->len && !known_mask; i++)
+        known_mask = g_array_index (masks, guint32, i) == mask;
+      if (!known_mask)
+        g_array_append_val (masks, mask);
 
       ostree_object_name_deserialize (serialized_key, &checksum, &objtype);
 
       if (OSTREE_OBJECT_TYPE_IS_META (objtype))
-        g_hash_table_add (new_reachable_metadata, g_variant_ref (serialized_key));
+        {
+          g_hash_table_add (new_reachable_metadata, g_variant_ref (serialized_key));
+          g_hash_table_insert (metadata_masks, g_variant_ref (serialized_key),
+                               GUINT_TO_POINTER (mask));
+        }
       else
         {
           g_autoptr (GFileInfo) finfo = NULL;
@@ -958,9 +1046,13 @@ generate_delta_lowlatency (OstreeRepo *repo, const char *from, const char *to, D
             g_hash_table_add (new_reachable_symlink_content, g_strdup (checksum));
           else
             g_assert_not_reached ();
+          g_hash_table_insert (content_masks, g_strdup (checksum), GUINT_TO_POINTER (mask));
         }
     }
 
+  /* Objects missing from the most sources go first */
+  g_array_sort (masks, compare_masks);
+
   if (from_commit)
     {
       if (!_ostree_delta_compute_similar_objects (repo, from_commit, to_commit,
@@ -979,6 +1071,8 @@ generate_delta_lowlatency (OstreeRepo *repo, const char *from, const char *to, D
                   g_hash_table_size (new_reachable_metadata),
                   g_hash_table_size (new_reachable_regfile_content),
                   g_hash_table_size (new_reachable_symlink_content));
+      if (sources_reachable->len > 1)
+        g_printerr ("sources: %u object groups: %u\n", sources_reachable->len, masks->len);
     }
 
   /* We already ship the to commit in the superblock, don't ship it twice */
@@ -1001,6 +1095,13 @@ generate_delta_lowlatency (OstreeRepo *repo, const char *from, const char *to, D
       ContentRollsum *rollsum;
       ContentBsdiff *bsdiff;
       gboolean from_world_readable = FALSE;
+      guint32 mask = GPOINTER_TO_UINT (g_hash_table_lookup (content_masks, to_checksum));
+
+      /* The base object must be present for every source this object
+       * will be shipped to, not just the primary one.
+       */
+      if (!source_object_available (sources_reachable, mask, from_checksum))
+        continue;
 
       /* We only want to include in the delta objects that we are sure will
        * be readable by the client when applying the delta, regardless its
@@ -1043,62 +1144,6 @@ generate_delta_lowlatency (OstreeRepo *repo, const char *from, const char *to, D
                   g_hash_table_size (modified_regfile_content));
     }
 
-  current_part = allocate_part (builder, error);
-  if (current_part == NULL)
-    return FALSE;
-
-  /* Pack the metadata first */
-  g_hash_table_iter_init (&hashiter, new_reachable_metadata);
-  while (g_hash_table_iter_next (&hashiter, &key, &value))
-    {
-      GVariant *serialized_key = key;
-      const char *checksum;
-      OstreeObjectType objtype;
-
-      ostree_object_name_deserialize (serialized_key, &checksum, &objtype);
-
-      if (!process_one_object (repo, builder, &current_part, checksum, objtype, cancellable, error))
-        return FALSE;
-    }
-
-  /* Now do rollsummed objects */
-
-  g_hash_table_iter_init (&hashiter, rollsum_optimized_content_objects);
-  while (g_hash_table_iter_next (&hashiter, &key, &value))
-    {
-      const char *checksum = key;
-      ContentRollsum *rollsum = value;
-
-      if (!process_one_rollsum (repo, builder, &current_part, checksum, rollsum, cancellable,
-                                error))
-        return FALSE;
-
-      builder->n_rollsum++;
-    }
-
-  /* Now do bsdiff'ed objects */
-
-  const guint n_bsdiff = g_hash_table_size (bsdiff_optimized_content_objects);
-  if (n_bsdiff > 0)
-    {
-      const guint mod = n_bsdiff / 10;
-      g_hash_table_iter_init (&hashiter, bsdiff_optimized_content_objects);
-      while (g_hash_table_iter_next (&hashiter, &key, &value))
-        {
-          const char *checksum = key;
-          ContentBsdiff *bsdiff = value;
-
-          if (opts & DELTAOPT_FLAG_VERBOSE && (mod == 0 || builder->n_bsdiff % mod == 0))
-            g_printerr ("processing bsdiff: [%u/%u]\n", builder->n_bsdiff, n_bsdiff);
-
-          if (!process_one_bsdiff (repo, builder, &current_part, checksum, bsdiff, cancellable,
-                                   error))
-            return FALSE;
-
-          builder->n_bsdiff++;
-        }
-    }
-
   /* Scan for large objects, so we can fall back to plain HTTP-based
    * fetch.
    */
@@ -1135,31 +1180,118 @@ generate_delta_lowlatency (OstreeRepo *repo, const char *from, const char *to, D
         }
     }
 
-  /* Now non-rollsummed or bsdiff'ed regular file content */
-  g_hash_table_iter_init (&hashiter, new_reachable_regfile_content);
-  while (g_hash_table_iter_next (&hashiter, &key, &value))
+  current_part = allocate_part (builder, error);
+  if (current_part == NULL)
+    return FALSE;
+
+  const guint n_bsdiff = g_hash_table_size (bsdiff_optimized_content_objects);
+  const guint bsdiff_mod = n_bsdiff / 10;
+
+  /* With a single source there is only one group; otherwise each group
+   * starts a new part, so parts never mix objects needed by different
+   * sets of sources.
+   */
+  for (guint i = 0; i < masks->len; i++)
     {
-      const char *checksum = key;
+      const guint32 mask = g_array_index (masks, guint32, i);
 
-      /* Skip content objects we rollsum'd */
-      if (g_hash_table_contains (rollsum_optimized_content_objects, checksum)
-          || g_hash_table_contains (bsdiff_optimized_content_objects, checksum))
-        continue;
+      if (current_part->objects->len > 0)
+        {
+          current_part = allocate_part (builder, error);
+          if (current_part == NULL)
+            return FALSE;
+        }
 
-      if (!process_one_object (repo, builder, &current_part, checksum, OSTREE_OBJECT_TYPE_FILE,
-                               cancellable, error))
-        return FALSE;
-    }
+      /* Pack the metadata first */
+      g_hash_table_iter_init (&hashiter, new_reachable_metadata);
+      while (g_hash_table_iter_next (&hashiter, &key, &value))
+        {
+          GVariant *serialized_key = key;
+          const char *checksum;
+          OstreeObjectType objtype;
 
-  /* Now symlinks */
-  g_hash_table_iter_init (&hashiter, new_reachable_symlink_content);
-  while (g_hash_table_iter_next (&hashiter, &key, &value))
-    {
-      const char *checksum = key;
+          if (GPOINTER_TO_UINT (g_hash_table_lookup (metadata_masks, serialized_key)) != mask)
+            continue;
 
-      if (!process_one_object (repo, builder, &current_part, checksum, OSTREE_OBJECT_TYPE_FILE,
-                               cancellable, error))
-        return FALSE;
+          ostree_object_name_deserialize (serialized_key, &checksum, &objtype);
+
+          if (!process_one_object (repo, builder, &current_part, checksum, objtype, cancellable,
+                                   error))
+            return FALSE;
+        }
+
+      /* Now do rollsummed objects */
+
+      g_hash_table_iter_init (&hashiter, rollsum_optimized_content_objects);
+      while (g_hash_table_iter_next (&hashiter, &key, &value))
+        {
+          const char *checksum = key;
+          ContentRollsum *rollsum = value;
+
+          if (GPOINTER_TO_UINT (g_hash_table_lookup (content_masks, checksum)) != mask)
+            continue;
+
+          if (!process_one_rollsum (repo, builder, &current_part, checksum, rollsum, cancellable,
+                                    error))
+            return FALSE;
+
+          builder->n_rollsum++;
+        }
+
+      /* Now do bsdiff'ed objects */
+
+      g_hash_table_iter_init (&hashiter, bsdiff_optimized_content_objects);
+      while (g_hash_table_iter_next (&hashiter, &key, &value))
+        {
+          const char *checksum = key;
+          ContentBsdiff *bsdiff = value;
+
+          if (GPOINTER_TO_UINT (g_hash_table_lookup (content_masks, checksum)) != mask)
+            continue;
+
+          if (opts & DELTAOPT_FLAG_VERBOSE
+              && (bsdiff_mod == 0 || builder->n_bsdiff % bsdiff_mod == 0))
+            g_printerr ("processing bsdiff: [%u/%u]\n", builder->n_bsdiff, n_bsdiff);
+
+          if (!process_one_bsdiff (repo, builder, &current_part, checksum, bsdiff, cancellable,
+                                   error))
+            return FALSE;
+
+          builder->n_bsdiff++;
+        }
+
+      /* Now non-rollsummed or bsdiff'ed regular file content */
+      g_hash_table_iter_init (&hashiter, new_reachable_regfile_content);
+      while (g_hash_table_iter_next (&hashiter, &key, &value))
+        {
+          const char *checksum = key;
+
+          if (GPOINTER_TO_UINT (g_hash_table_lookup (content_masks, checksum)) != mask)
+            continue;
+
+          /* Skip content objects we rollsum'd */
+          if (g_hash_table_contains (rollsum_optimized_content_objects, checksum)
+              || g_hash_table_contains (bsdiff_optimized_content_objects, checksum))
+            continue;
+
+          if (!process_one_object (repo, builder, &current_part, checksum,
+                                   OSTREE_OBJECT_TYPE_FILE, cancellable, error))
+            return FALSE;
+        }
+
+      /* Now symlinks */
+      g_hash_table_iter_init (&hashiter, new_reachable_symlink_content);
+      while (g_hash_table_iter_next (&hashiter, &key, &value))
+        {
+          const char *checksum = key;
+
+          if (GPOINTER_TO_UINT (g_hash_table_lookup (content_masks, checksum)) != mask)
+            continue;
+
+          if (!process_one_object (repo, builder, &current_part, checksum,
+                                   OSTREE_OBJECT_TYPE_FILE, cancellable, error))
+            return FALSE;
+        }
     }
 
   if (!finish_part (builder, error))
@@ -1217,180 +1349,44 @@ get_fallback_headers (OstreeRepo *self, OstreeStaticDeltaBuilder *builder, GVari
   return TRUE;
 }
 
-/**
- * ostree_repo_static_delta_generate:
- * @self: Repo
- * @opt: High level optimization choice
- * @from: (nullable): ASCII SHA256 checksum of origin, or %NULL
- * @to: ASCII SHA256 checksum of target
- * @metadata: (nullable): Optional metadata
- * @params: (nullable): Parameters, see below
- * @cancellable: Cancellable
- * @error: Error
- *
- * Generate a lookaside "static delta" from @from (%NULL means
- * from-empty) which can generate the objects in @to.  This delta is
- * an optimization over fetching individual objects, and can be
- * conveniently stored and applied offline.
- *
- * The @params argument should be an a{sv}.  The following attributes
- * are known:
- *   - min-fallback-size: u: Minimum uncompressed size in megabytes to use fallback, 0 to disable
- * fallbacks
- *   - max-chunk-size: u: Maximum size in megabytes of a delta part
- *   - max-bsdiff-size: u: Maximum size in megabytes to consider bsdiff compression
- *   for input files
- *   - compression: y: Compression type: 0=none, x=lzma, g=gzip
- *   - bsdiff-enabled: b: Enable bsdiff compression.  Default TRUE.
- *   - inline-parts: b: Put part data in header, to get a single file delta.  Default FALSE.
- *   - verbose: b: Print diagnostic messages.  Default FALSE.
- *   - endianness: b: Deltas use host byte order by default; this option allows choosing
- * (G_BIG_ENDIAN or G_LITTLE_ENDIAN)
- *   - filename: ^ay: Save delta superblock to this filename (bytestring), and parts in the same
- * directory.  Default saves to repository.
- *   - sign-name: ^ay: Signature type to use (bytestring).
- *   - sign-key-ids: ^as: NULL-terminated array of keys used to sign delta superblock.
+/* Write the superblock for the delta @from-@to to @descriptor_name in
+ * @descriptor_dfd, using the parts and fallbacks in @builder.  When
+ * @sources is non-%NULL, it lists all the revisions the parts were
+ * computed against.
  */
-gboolean
-ostree_repo_static_delta_generate (OstreeRepo *self, OstreeStaticDeltaGenerateOpt opt,
-                                   const char *from, const char *to, GVariant *metadata,
-                                   GVariant *params, GCancellable *cancellable, GError **error)
+static gboolean
+write_delta_superblock (OstreeRepo *self, OstreeStaticDeltaBuilder *builder, const char *from,
+                        const char *to, GVariant *to_commit, GVariant *metadata, GVariant *sources,
+                        GVariant *fallback_headers, GVariant *detached, gboolean inline_parts,
+                        guint endianness, const char *opt_sign_name, const char **opt_key_ids,
+                        int descriptor_dfd, const char *descriptor_name, GCancellable *cancellable,
+                        GError **error)
 {
-  OstreeStaticDeltaBuilder builder = {
-    0,
-  };
-  guint i;
-  guint min_fallback_size;
-  guint max_bsdiff_size;
-  guint max_chunk_size;
-  DeltaOpts delta_opts = DELTAOPT_FLAG_NONE;
-  guint64 total_compressed_size = 0;
-  guint64 total_uncompressed_size = 0;
   g_autoptr (GVariantBuilder) part_headers = NULL;
-  g_autoptr (GVariant) to_commit = NULL;
-  const char *opt_filename;
-  g_autofree char *descriptor_name = NULL;
-  glnx_autofd int descriptor_dfd = -1;
-  g_autoptr (GVariant) fallback_headers = NULL;
-  g_autoptr (GVariant) detached = NULL;
-  gboolean inline_parts;
-  guint endianness = G_BYTE_ORDER;
-  g_autoptr (GPtrArray) builder_parts
-      = g_ptr_array_new_with_free_func ((GDestroyNotify)ostree_static_delta_part_builder_unref);
-  g_autoptr (GPtrArray) builder_fallback_objects
-      = g_ptr_array_new_with_free_func ((GDestroyNotify)g_variant_unref);
   g_auto (GLnxTmpfile) descriptor_tmpf = {
     0,
   };
-  const char *opt_sign_name;
-  const char **opt_key_ids;
 
-  if (!g_variant_lookup (params, "min-fallback-size", "u", &min_fallback_size))
-    min_fallback_size = 4;
-  builder.min_fallback_size_bytes = ((guint64)min_fallback_size) * 1000 * 1000;
+  if (!glnx_open_tmpfile_linkable_at (descriptor_dfd, ".", O_RDWR | O_CLOEXEC, &descriptor_tmpf,
+                                      error))
+    return FALSE;
 
-  if (!g_variant_lookup (params, "max-bsdiff-size", "u", &max_bsdiff_size))
-    max_bsdiff_size = 128;
-  builder.max_bsdiff_size_bytes = ((guint64)max_bsdiff_size) * 1000 * 1000;
-  if (!g_variant_lookup (params, "max-chunk-size", "u", &max_chunk_size))
-    max_chunk_size = 32;
-  builder.max_chunk_size_bytes = ((guint64)max_chunk_size) * 1000 * 1000;
+  g_autoptr (OtVariantBuilder) descriptor_builder = ot_variant_builder_new (
+      G_VARIANT_TYPE (OSTREE_STATIC_DELTA_SUPERBLOCK_FORMAT), descriptor_tmpf.fd);
+  g_assert (descriptor_builder != NULL);
 
-  (void)g_variant_lookup (params, "endianness", "u", &endianness);
-  if (!(endianness == G_BIG_ENDIAN || endianness == G_LITTLE_ENDIAN))
-    return glnx_throw (error, "Invalid endianness parameter");
+  /* Open the metadata dict */
+  if (!ot_variant_builder_open (descriptor_builder, G_VARIANT_TYPE ("a{sv}"), error))
+    return FALSE;
 
-  builder.swap_endian = endianness != G_BYTE_ORDER;
-  builder.parts = builder_parts;
-  builder.fallback_objects = builder_fallback_objects;
-
-  {
-    gboolean use_bsdiff;
-    if (!g_variant_lookup (params, "bsdiff-enabled", "b", &use_bsdiff))
-      use_bsdiff = TRUE;
-    if (!use_bsdiff)
-      delta_opts |= DELTAOPT_FLAG_DISABLE_BSDIFF;
-  }
-
-  {
-    gboolean verbose;
-    if (!g_variant_lookup (params, "verbose", "b", &verbose))
-      verbose = FALSE;
-    if (verbose)
-      delta_opts |= DELTAOPT_FLAG_VERBOSE;
-  }
-
-  if (!g_variant_lookup (params, "inline-parts", "b", &inline_parts))
-    inline_parts = FALSE;
-
-  if (!g_variant_lookup (params, "filename", "^&ay", &opt_filename))
-    opt_filename = NULL;
-  else if (opt_filename[0] == '\0')
-    return glnx_throw (error, "Invalid 'filename' parameter");
-
-  if (!g_variant_lookup (params, "sign-name", "^&ay", &opt_sign_name))
-    opt_sign_name = NULL;
-  else if (opt_sign_name[0] == '\0')
-    return glnx_throw (error, "Invalid 'sign-name' parameter");
-
-  if (!g_variant_lookup (params, "sign-key-ids", "^a&s", &opt_key_ids))
-    opt_key_ids = NULL;
-
-  if (!ostree_repo_load_variant (self, OSTREE_OBJECT_TYPE_COMMIT, to, &to_commit, error))
-    return FALSE;
-
-  builder.delta_opts = delta_opts;
-
-  if (opt_filename)
-    {
-      g_autofree char *dnbuf = g_strdup (opt_filename);
-      const char *dn = dirname (dnbuf);
-      descriptor_name = g_strdup (glnx_basename (opt_filename));
-
-      if (!glnx_opendirat (AT_FDCWD, dn, TRUE, &descriptor_dfd, error))
-        return FALSE;
-    }
-  else
-    {
-      g_autofree char *descriptor_relpath
-          = _ostree_get_relative_static_delta_superblock_path (from, to);
-      g_autofree char *dnbuf = g_strdup (descriptor_relpath);
-      const char *dn = dirname (dnbuf);
-
-      if (!glnx_shutil_mkdir_p_at (self->repo_dir_fd, dn, DEFAULT_DIRECTORY_MODE, cancellable,
-                                   error))
-        return FALSE;
-      if (!glnx_opendirat (self->repo_dir_fd, dn, TRUE, &descriptor_dfd, error))
-        return FALSE;
-
-      descriptor_name = g_strdup (basename (descriptor_relpath));
-    }
-  builder.parts_dfd = descriptor_dfd;
-
-  /* Ignore optimization flags */
-  if (!generate_delta_lowlatency (self, from, to, delta_opts, &builder, cancellable, error))
-    return FALSE;
-
-  if (!glnx_open_tmpfile_linkable_at (descriptor_dfd, ".", O_RDWR | O_CLOEXEC, &descriptor_tmpf,
-                                      error))
-    return FALSE;
-
-  g_autoptr (OtVariantBuilder) descriptor_builder = ot_variant_builder_new (
-      G_VARIANT_TYPE (OSTREE_STATIC_DELTA_SUPERBLOCK_FORMAT), descriptor_tmpf.fd);
-  g_assert (descriptor_builder != NULL);
-
-  /* Open the metadata dict */
-  if (!ot_variant_builder_open (descriptor_builder, G_VARIANT_TYPE ("a{sv}"), error))
-    return FALSE;
-
-  /* NOTE: Add user-supplied metadata first.  This is used by at least
-   * flatpak as a way to provide MIME content sniffing, since the
-   * metadata appears first in the file.
-   */
-  if (metadata != NULL)
-    {
-      GVariantIter iter;
-      GVariant *item;
+  /* NOTE: Add user-supplied metadata first.  This is used by at least
+   * flatpak as a way to provide MIME content sniffing, since the
+   * metadata appears first in the file.
+   */
+  if (metadata != NULL)
+    {
+      GVariantIter iter;
+      GVariant *item;
 
       g_variant_iter_init (&iter, metadata);
       while ((item = g_variant_iter_next_value (&iter)))
@@ -1420,10 +1416,17 @@ ostree_repo_static_delta_generate (OstreeRepo *self, OstreeStaticDeltaGenerateOp
       return FALSE;
   }
 
+  if (sources != NULL)
+    {
+      if (!ot_variant_builder_add (descriptor_builder, error, "{sv}", "ostree.delta.sources",
+                                   sources))
+        return FALSE;
+    }
+
   part_headers = g_variant_builder_new (G_VARIANT_TYPE ("a" OSTREE_STATIC_DELTA_META_ENTRY_FORMAT));
-  for (i = 0; i < builder.parts->len; i++)
+  for (guint i = 0; i < builder->parts->len; i++)
     {
-      OstreeStaticDeltaPartBuilder *part_builder = builder.parts->pdata[i];
+      OstreeStaticDeltaPartBuilder *part_builder = builder->parts->pdata[i];
 
       if (inline_parts)
         {
@@ -1441,30 +1444,10 @@ ostree_repo_static_delta_generate (OstreeRepo *self, OstreeStaticDeltaGenerateOp
               || !ot_variant_builder_close (descriptor_builder, error))
             return FALSE;
         }
-      else
-        {
-          g_autofree char *partstr = g_strdup_printf ("%u", i);
-
-          if (fchmod (part_builder->part_tmpf.fd, 0644) < 0)
-            return glnx_throw_errno_prefix (error, "fchmod");
-
-          if (!glnx_link_tmpfile_at (&part_builder->part_tmpf, GLNX_LINK_TMPFILE_REPLACE,
-                                     descriptor_dfd, partstr, error))
-            return FALSE;
-        }
 
       g_variant_builder_add_value (part_headers, part_builder->header);
-
-      total_compressed_size += part_builder->compressed_size;
-      total_uncompressed_size += part_builder->uncompressed_size;
     }
 
-  if (!get_fallback_headers (self, &builder, &fallback_headers, cancellable, error))
-    return FALSE;
-
-  if (!ostree_repo_read_commit_detached_metadata (self, to, &detached, cancellable, error))
-    return FALSE;
-
   if (detached)
     {
       g_autofree char *detached_key
@@ -1502,16 +1485,6 @@ ostree_repo_static_delta_generate (OstreeRepo *self, OstreeStaticDeltaGenerateOp
     g_date_time_unref (now);
   }
 
-  if (delta_opts & DELTAOPT_FLAG_VERBOSE)
-    {
-      g_printerr ("uncompressed=%" G_GUINT64_FORMAT " compressed=%" G_GUINT64_FORMAT
-                  " loose=%" G_GUINT64_FORMAT "\n",
-                  total_uncompressed_size, total_compressed_size, builder.loose_compressed_size);
-      g_printerr ("rollsum=%u objects, %" G_GUINT64_FORMAT " bytes\n", builder.n_rollsum,
-                  builder.rollsum_size);
-      g_printerr ("bsdiff=%u objects\n", builder.n_bsdiff);
-    }
-
   if (opt_sign_name != NULL && opt_key_ids != NULL)
     {
       g_autoptr (GBytes) tmpdata = NULL;
@@ -1597,3 +1570,271 @@ ostree_repo_static_delta_generate (OstreeRepo *self, OstreeStaticDeltaGenerateOp
 
   return TRUE;
 }
+
+/**
+ * ostree_repo_static_delta_generate:
+ * @self: Repo
+ * @opt: High level optimization choice
+ * @from: (nullable): ASCII SHA256 checksum of origin, or %NULL
+ * @to: ASCII SHA256 checksum of target
+ * @metadata: (nullable): Optional metadata
+ * @params: (nullable): Parameters, see below
+ * @cancellable: Cancellable
+ * @error: Error
+ *
+ * Generate a lookaside "static delta" from @from (%NULL means
+ * from-empty) which can generate the objects in @to.  This delta is
+ * an optimization over fetching individual objects, and can be
+ * conveniently stored and applied offline.
+ *
+ * The @params argument should be an a{sv}.  The following attributes
+ * are known:
+ *   - min-fallback-size: u: Minimum uncompressed size in megabytes to use fallback, 0 to disable
+ * fallbacks
+ *   - max-chunk-size: u: Maximum size in megabytes of a delta part
+ *   - max-bsdiff-size: u: Maximum size in megabytes to consider bsdiff compression
+ *   for input files
+ *   - compression: y: Compression type: 0=none, x=lzma, g=gzip
+ *   - bsdiff-enabled: b: Enable bsdiff compression.  Default TRUE.
+ *   - inline-parts: b: Put part data in header, to get a single file delta.  Default FALSE.
+ *   - verbose: b: Print diagnostic messages.  Default FALSE.
+ *   - endianness: b: Deltas use host byte order by default; this option allows choosing
+ * (G_BIG_ENDIAN or G_LITTLE_ENDIAN)
+ *   - filename: ^ay: Save delta superblock to this filename (bytestring), and parts in the same
+ * directory.  Default saves to repository.
+ *   - sign-name: ^ay: Signature type to use (bytestring).
+ *   - sign-key-ids: ^as: NULL-terminated array of keys used to sign delta superblock.
+ *   - extra-from-revisions: ^as: ASCII SHA256 checksums of additional origins.  The delta
+ * parts are computed once for all origins, grouped so that a client skips the parts it
+ * already has, and a superblock is written for each origin.  Not supported with filename.
+ */
+gboolean
+ostree_repo_static_delta_generate (OstreeRepo *self, OstreeStaticDeltaGenerateOpt opt,
+                                   const char *from, const char *to, GVariant *metadata,
+                                   GVariant *params, GCancellable *cancellable, GError **error)
+{
+  OstreeStaticDeltaBuilder builder = {
+    0,
+  };
+  guint i;
+  guint min_fallback_size;
+  guint max_bsdiff_size;
+  guint max_chunk_size;
+  DeltaOpts delta_opts = DELTAOPT_FLAG_NONE;
+  guint64 total_compressed_size = 0;
+  guint64 total_uncompressed_size = 0;
+  g_autoptr (GVariant) to_commit = NULL;
+  const char *opt_filename;
+  g_autofree char *descriptor_name = NULL;
+  glnx_autofd int descriptor_dfd = -1;
+  g_autoptr (GVariant) fallback_headers = NULL;
+  g_autoptr (GVariant) detached = NULL;
+  gboolean inline_parts;
+  guint endianness = G_BYTE_ORDER;
+  g_autoptr (GPtrArray) builder_parts
+      = g_ptr_array_new_with_free_func ((GDestroyNotify)ostree_static_delta_part_builder_unref);
+  g_autoptr (GPtrArray) builder_fallback_objects
+      = g_ptr_array_new_with_free_func ((GDestroyNotify)g_variant_unref);
+  const char *opt_sign_name;
+  const char **opt_key_ids;
+  g_autofree const char **extra_froms = NULL;
+  g_autoptr (GVariant) sources = NULL;
+
+  if (!g_variant_lookup (params, "min-fallback-size", "u", &min_fallback_size))
+    min_fallback_size = 4;
+  builder.min_fallback_size_bytes = ((guint64)min_fallback_size) * 1000 * 1000;
+
+  if (!g_variant_lookup (params, "max-bsdiff-size", "u", &max_bsdiff_size))
+    max_bsdiff_size = 128;
+  builder.max_bsdiff_size_bytes = ((guint64)max_bsdiff_size) * 1000 * 1000;
+  if (!g_variant_lookup (params, "max-chunk-size", "u", &max_chunk_size))
+    max_chunk_size = 32;
+  builder.max_chunk_size_bytes = ((guint64)max_chunk_size) * 1000 * 1000;
+
+  (void)g_variant_lookup (params, "endianness", "u", &endianness);
+  if (!(endianness == G_BIG_ENDIAN || endianness == G_LITTLE_ENDIAN))
+    return glnx_throw (error, "Invalid endianness parameter");
+
+  builder.swap_endian = endianness != G_BYTE_ORDER;
+  builder.parts = builder_parts;
+  builder.fallback_objects = builder_fallback_objects;
+
+  {
+    gboolean use_bsdiff;
+    if (!g_variant_lookup (params, "bsdiff-enabled", "b", &use_bsdiff))
+      use_bsdiff = TRUE;
+    if (!use_bsdiff)
+      delta_opts |= DELTAOPT_FLAG_DISABLE_BSDIFF;
+  }
+
+  {
+    gboolean verbose;
+    if (!g_variant_lookup (params, "verbose", "b", &verbose))
+      verbose = FALSE;
+    if (verbose)
+      delta_opts |= DELTAOPT_FLAG_VERBOSE;
+  }
+
+  if (!g_variant_lookup (params, "inline-parts", "b", &inline_parts))
+    inline_parts = FALSE;
+
+  if (!g_variant_lookup (params, "filename", "^&ay", &opt_filename))
+    opt_filename = NULL;
+  else if (opt_filename[0] == '\0')
+    return glnx_throw (error, "Invalid 'filename' parameter");
+
+  if (!g_variant_lookup (params, "sign-name", "^&ay", &opt_sign_name))
+    opt_sign_name = NULL;
+  else if (opt_sign_name[0] == '\0')
+    return glnx_throw (error, "Invalid 'sign-name' parameter");
+
+  if (!g_variant_lookup (params, "sign-key-ids", "^a&s", &opt_key_ids))
+    opt_key_ids = NULL;
+
+  if (g_variant_lookup (params, "extra-from-revisions", "^a&s", &extra_froms))
+    {
+      const guint n_extra_froms = g_strv_length ((char **)extra_froms);
+
+      if (n_extra_froms == 0)
+        g_clear_pointer (&extra_froms, g_free);
+      else if (from == NULL)
+        return glnx_throw (error, "Extra delta sources require a from revision");
+      else if (opt_filename)
+        return glnx_throw (error, "Extra delta sources cannot be combined with 'filename'");
+      else if (n_extra_froms >= 32)
+        return glnx_throw (error, "Too many extra delta sources (%u)", n_extra_froms);
+
+      for (const char *const *iter = extra_froms; iter && *iter; iter++)
+        {
+          if (!ostree_validate_checksum_string (*iter, error))
+            return FALSE;
+          if (strcmp (*iter, from) == 0 || strcmp (*iter, to) == 0)
+            return glnx_throw (error, "Invalid extra delta source %s", *iter);
+        }
+    }
+
+  if (!ostree_repo_load_variant (self, OSTREE_OBJECT_TYPE_COMMIT, to, &to_commit, error))
+    return FALSE;
+
+  builder.delta_opts = delta_opts;
+
+  if (opt_filename)
+    {
+      g_autofree char *dnbuf = g_strdup (opt_filename);
+      const char *dn = dirname (dnbuf);
+      descriptor_name = g_strdup (glnx_basename (opt_filename));
+
+      if (!glnx_opendirat (AT_FDCWD, dn, TRUE, &descriptor_dfd, error))
+        return FALSE;
+    }
+  else
+    {
+      g_autofree char *descriptor_relpath
+          = _ostree_get_relative_static_delta_superblock_path (from, to);
+      g_autofree char *dnbuf = g_strdup (descriptor_relpath);
+      const char *dn = dirname (dnbuf);
+
+      if (!glnx_shutil_mkdir_p_at (self->repo_dir_fd, dn, DEFAULT_DIRECTORY_MODE, cancellable,
+                                   error))
+        return FALSE;
+      if (!glnx_opendirat (self->repo_dir_fd, dn, TRUE, &descriptor_dfd, error))
+        return FALSE;
+
+      descriptor_name = g_strdup (basename (descriptor_relpath));
+    }
+  builder.parts_dfd = descriptor_dfd;
+
+  /* Ignore optimization flags */
+  if (!generate_delta_lowlatency (self, from, extra_froms, to, delta_opts, &builder, cancellable,
+                                  error))
+    return FALSE;
+
+  if (extra_froms != NULL)
+    {
+      g_autoptr (GVariantBuilder) sources_builder = g_variant_builder_new (G_VARIANT_TYPE ("aay"));
+
+      g_variant_builder_add_value (sources_builder, ostree_checksum_to_bytes_v (from));
+      for (const char *const *iter = extra_froms; *iter; iter++)
+        g_variant_builder_add_value (sources_builder, ostree_checksum_to_bytes_v (*iter));
+      sources = g_variant_ref_sink (g_variant_builder_end (sources_builder));
+    }
+
+  for (i = 0; i < builder.parts->len; i++)
+    {
+      OstreeStaticDeltaPartBuilder *part_builder = builder.parts->pdata[i];
+
+      if (!inline_parts)
+        {
+          g_autofree char *partstr = g_strdup_printf ("%u", i);
+
+          if (fchmod (part_builder->part_tmpf.fd, 0644) < 0)
+            return glnx_throw_errno_prefix (error, "fchmod");
+
+          if (!glnx_link_tmpfile_at (&part_builder->part_tmpf, GLNX_LINK_TMPFILE_REPLACE,
+                                     descriptor_dfd, partstr, error))
+            return FALSE;
+        }
+
+      total_compressed_size += part_builder->compressed_size;
+      total_uncompressed_size += part_builder->uncompressed_size;
+    }
+
+  if (!get_fallback_headers (self, &builder, &fallback_headers, cancellable, error))
+    return FALSE;
+
+  if (!ostree_repo_read_commit_detached_metadata (self, to, &detached, cancellable, error))
+    return FALSE;
+
+  if (delta_opts & DELTAOPT_FLAG_VERBOSE)
+    {
+      g_printerr ("uncompressed=%" G_GUINT64_FORMAT " compressed=%" G_GUINT64_FORMAT
+                  " loose=%" G_GUINT64_FORMAT "\n",
+                  total_uncompressed_size, total_compressed_size, builder.loose_compressed_size);
+      g_printerr ("rollsum=%u objects, %" G_GUINT64_FORMAT " bytes\n", builder.n_rollsum,
+                  builder.rollsum_size);
+      g_printerr ("bsdiff=%u objects\n", builder.n_bsdiff);
+    }
+
+  if (!write_delta_superblock (self, &builder, from, to, to_commit, metadata, sources,
+                               fallback_headers, detached, inline_parts, endianness, opt_sign_name,
+                               opt_key_ids, descriptor_dfd, descriptor_name, cancellable, error))
+    return FALSE;
+
+  /* The other sources get their own superblock, sharing the same parts */
+  for (const char *const *iter = extra_froms; iter && *iter; iter++)
+    {
+      const char *extra_from = *iter;
+      g_autofree char *extra_relpath
+          = _ostree_get_relative_static_delta_superblock_path (extra_from, to);
+      g_autofree char *dnbuf = g_strdup (extra_relpath);
+      const char *dn = dirname (dnbuf);
+      glnx_autofd int extra_dfd = -1;
+
+      if (!glnx_shutil_mkdir_p_at (self->repo_dir_fd, dn, DEFAULT_DIRECTORY_MODE, cancellable,
+                                   error))
+        return FALSE;
+      if (!glnx_opendirat (self->repo_dir_fd, dn, TRUE, &extra_dfd, error))
+        return FALSE;
+
+      if (!inline_parts)
+        {
+          for (i = 0; i < builder.parts->len; i++)
+            {
+              g_autofree char *partstr = g_strdup_printf ("%u", i);
+
+              if (!ot_ensure_unlinked_at (extra_dfd, partstr, error))
+                return FALSE;
+              if (linkat (descriptor_dfd, partstr, extra_dfd, partstr, 0) < 0)
+                return glnx_throw_errno_prefix (error, "linkat(%s)", partstr);
+            }
+        }
+
+      if (!write_delta_superblock (self, &builder, extra_from, to, to_commit, metadata, sources,
+                                   fallback_headers, detached, inline_parts, endianness,
+                                   opt_sign_name, opt_key_ids, extra_dfd,
+                                   glnx_basename (extra_relpath), cancellable, error))
+        return FALSE;
+    }
+
+  return TRUE;
+}
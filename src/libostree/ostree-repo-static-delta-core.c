@@ -371,30 +371,127 @@ _ostree_repo_static_delta_verify_signature (OstreeRepo *self, int fd, OstreeSign
   return ostree_sign_data_verify (sign, signed_data, signatures, out_success_message, error);
 }
 
-/**
- * ostree_repo_static_delta_execute_offline_with_signature:
- * @self: Repo
- * @dir_or_file: Path to a directory containing static delta data, or directly to the superblock
- * @sign: Signature engine used to check superblock
- * @skip_validation: If %TRUE, assume data integrity
- * @cancellable: Cancellable
- * @error: Error
- *
- * Given a directory representing an already-downloaded static delta
- * on disk, apply it, generating a new commit.
- * If sign is passed, the static delta signature is verified.
- * If sign-verify-deltas configuration option is set and static delta is signed,
- * signature verification will be mandatory before apply the static delta.
- * The directory must be named with the form "FROM-TO", where both are
- * checksums, and it must contain a file named "superblock", along with at least
- * one part.
- *
- * Since: 2020.7
- */
-gboolean
-ostree_repo_static_delta_execute_offline_with_signature (OstreeRepo *self, GFile *dir_or_file,
-                                                         OstreeSign *sign, gboolean skip_validation,
-                                                         GCancellable *cancellable, GError **error)
+static gboolean
+execute_offline_part (OstreeRepo *self, int dfd, GVariant *metadata, const char *from_checksum,
+                      const char *to_checksum, guint i, GVariant *header, gboolean skip_validation,
+                      GCancellable *cancellable, GError **error)
+{
+  guint32 version;
+  guint64 size;
+  guint64 usize;
+  char checksum[OSTREE_SHA256_STRING_LEN + 1];
+  g_autoptr (GVariant) csum_v = NULL;
+  g_autoptr (GVariant) objects = NULL;
+  g_autoptr (GVariant) part = NULL;
+  OstreeStaticDeltaOpenFlags delta_open_flags
+      = skip_validation ? OSTREE_STATIC_DELTA_OPEN_FLAGS_SKIP_CHECKSUM : 0;
+  g_variant_get (header, "(u@aytt@ay)", &version, &csum_v, &size, &usize, &objects);
+
+  if (version > OSTREE_DELTAPART_VERSION)
+    return glnx_throw (error, "Delta part has too new version %u", version);
+
+  gboolean have_all;
+  if (!_ostree_repo_static_delta_part_have_all_objects (self, objects, &have_all, cancellable,
+                                                        error))
+    return FALSE;
+
+  /* If we already have these objects, don't bother executing the
+   * static delta.
+   */
+  if (have_all)
+    return TRUE;
+
+  const guchar *csum = ostree_checksum_bytes_peek_validate (csum_v, error);
+  if (!csum)
+    return FALSE;
+  ostree_checksum_inplace_from_bytes (csum, checksum);
+
+  g_autofree char *deltapart_path
+      = _ostree_get_relative_static_delta_part_path (from_checksum, to_checksum, i);
+
+  g_autoptr (GInputStream) part_in = NULL;
+  g_autoptr (GVariant) inline_part_data
+      = g_variant_lookup_value (metadata, deltapart_path, G_VARIANT_TYPE ("(yay)"));
+  if (inline_part_data)
+    {
+      g_autoptr (GBytes) inline_part_bytes = g_variant_get_data_as_bytes (inline_part_data);
+      part_in = g_memory_input_stream_new_from_bytes (inline_part_bytes);
+
+      /* For inline parts, we don't checksum, because it's
+       * included with the metadata, so we're not trying to
+       * protect against MITM or such.  Non-security related
+       * checksums should be done at the underlying storage layer.
+       */
+      delta_open_flags |= OSTREE_STATIC_DELTA_OPEN_FLAGS_SKIP_CHECKSUM;
+
+      if (!_ostree_static_delta_part_open (part_in, inline_part_bytes, delta_open_flags, NULL,
+                                           &part, cancellable, error))
+        return FALSE;
+    }
+  else
+    {
+      char relpath[16];
+      g_snprintf (relpath, sizeof (relpath), "%u", i);
+      glnx_autofd int part_fd = openat (dfd, relpath, O_RDONLY | O_CLOEXEC);
+      if (part_fd < 0)
+        return glnx_throw_errno_prefix (error, "Opening deltapart '%s'", relpath);
+
+      part_in = g_unix_input_stream_new (part_fd, FALSE);
+
+      if (!_ostree_static_delta_part_open (part_in, NULL, delta_open_flags, checksum, &part,
+                                           cancellable, error))
+        return FALSE;
+    }
+
+  if (!_ostree_static_delta_part_execute (self, objects, part, skip_validation, NULL, cancellable,
+                                          error))
+    return glnx_prefix_error (error, "Executing delta part %i", i);
+
+  return TRUE;
+}
+
+typedef struct
+{
+  OstreeRepo *repo;
+  int dfd;
+  GVariant *metadata;
+  GVariant *headers;
+  const char *from_checksum;
+  const char *to_checksum;
+  gboolean skip_validation;
+  GCancellable *cancellable;
+  gint failed; /* atomic */
+  GMutex lock; /* protects error */
+  GError *error;
+} OfflinePartsApply;
+
+static void
+execute_offline_part_thread (gpointer data, gpointer user_data)
+{
+  OfflinePartsApply *apply = user_data;
+  const guint i = GPOINTER_TO_UINT (data) - 1;
+  g_autoptr (GError) local_error = NULL;
+
+  /* Once one part failed, don't bother with the remaining ones */
+  if (g_atomic_int_get (&apply->failed))
+    return;
+
+  g_autoptr (GVariant) header = g_variant_get_child_value (apply->headers, i);
+  if (!execute_offline_part (apply->repo, apply->dfd, apply->metadata, apply->from_checksum,
+                             apply->to_checksum, i, header, apply->skip_validation,
+                             apply->cancellable, &local_error))
+    {
+      g_mutex_lock (&apply->lock);
+      if (apply->error == NULL)
+        apply->error = g_steal_pointer (&local_error);
+      g_mutex_unlock (&apply->lock);
+      g_atomic_int_set (&apply->failed, TRUE);
+    }
+}
+
+static gboolean
+execute_offline (OstreeRepo *self, GFile *dir_or_file, OstreeSign *sign, gboolean skip_validation,
+                 guint n_jobs, GCancellable *cancellable, GError **error)
 {
   g_autofree char *basename = NULL;
   g_autoptr (GVariant) meta = NULL;
@@ -534,83 +631,128 @@ ostree_repo_static_delta_execute_offline_with_signature (OstreeRepo *self, GFile
 
   g_autoptr (GVariant) headers = g_variant_get_child_value (meta, 6);
   const guint n = g_variant_n_children (headers);
-  for (guint i = 0; i < n; i++)
+  if (n_jobs <= 1 || n <= 1)
     {
-      guint32 version;
-      guint64 size;
-      guint64 usize;
-      char checksum[OSTREE_SHA256_STRING_LEN + 1];
-      g_autoptr (GVariant) csum_v = NULL;
-      g_autoptr (GVariant) objects = NULL;
-      g_autoptr (GVariant) part = NULL;
-      OstreeStaticDeltaOpenFlags delta_open_flags
-          = skip_validation ? OSTREE_STATIC_DELTA_OPEN_FLAGS_SKIP_CHECKSUM : 0;
-      g_autoptr (GVariant) header = g_variant_get_child_value (headers, i);
-      g_variant_get (header, "(u@aytt@ay)", &version, &csum_v, &size, &usize, &objects);
-
-      if (version > OSTREE_DELTAPART_VERSION)
-        return glnx_throw (error, "Delta part has too new version %u", version);
-
-      gboolean have_all;
-      if (!_ostree_repo_static_delta_part_have_all_objects (self, objects, &have_all, cancellable,
-                                                            error))
-        return FALSE;
+      for (guint i = 0; i < n; i++)
+        {
+          g_autoptr (GVariant) header = g_variant_get_child_value (headers, i);
+          if (!execute_offline_part (self, dfd, metadata, from_checksum, to_checksum, i, header,
+                                     skip_validation, cancellable, error))
+            return FALSE;
+        }
+    }
+  else
+    {
+      OfflinePartsApply apply = {
+        .repo = self,
+        .dfd = dfd,
+        .metadata = metadata,
+        .headers = headers,
+        .from_checksum = from_checksum,
+        .to_checksum = to_checksum,
+        .skip_validation = skip_validation,
+        .cancellable = cancellable,
+      };
 
-      /* If we already have these objects, don't bother executing the
-       * static delta.
+      /* Each worker holds at most one decompressed part in memory, so the
+       * memory use is bounded by the number of jobs.
        */
-      if (have_all)
-        continue;
-
-      const guchar *csum = ostree_checksum_bytes_peek_validate (csum_v, error);
-      if (!csum)
-        return FALSE;
-      ostree_checksum_inplace_from_bytes (csum, checksum);
-
-      g_autofree char *deltapart_path
-          = _ostree_get_relative_static_delta_part_path (from_checksum, to_checksum, i);
-
-      g_autoptr (GInputStream) part_in = NULL;
-      g_autoptr (GVariant) inline_part_data
-          = g_variant_lookup_value (metadata, deltapart_path, G_VARIANT_TYPE ("(yay)"));
-      if (inline_part_data)
+      g_mutex_init (&apply.lock);
+      GThreadPool *pool
+          = g_thread_pool_new (execute_offline_part_thread, &apply, MIN (n_jobs, n), TRUE, error);
+      if (pool == NULL)
         {
-          g_autoptr (GBytes) inline_part_bytes = g_variant_get_data_as_bytes (inline_part_data);
-          part_in = g_memory_input_stream_new_from_bytes (inline_part_bytes);
-
-          /* For inline parts, we don't checksum, because it's
-           * included with the metadata, so we're not trying to
-           * protect against MITM or such.  Non-security related
-           * checksums should be done at the underlying storage layer.
-           */
-          delta_open_flags |= OSTREE_STATIC_DELTA_OPEN_FLAGS_SKIP_CHECKSUM;
-
-          if (!_ostree_static_delta_part_open (part_in, inline_part_bytes, delta_open_flags, NULL,
-                                               &part, cancellable, error))
-            return FALSE;
+          g_mutex_clear (&apply.lock);
+          return FALSE;
         }
-      else
+      for (guint i = 0; i < n; i++)
         {
-          g_autofree char *relpath = g_strdup_printf ("%u", i); /* TODO avoid malloc here */
-          glnx_autofd int part_fd = openat (dfd, relpath, O_RDONLY | O_CLOEXEC);
-          if (part_fd < 0)
-            return glnx_throw_errno_prefix (error, "Opening deltapart '%s'", relpath);
-
-          part_in = g_unix_input_stream_new (part_fd, FALSE);
-
-          if (!_ostree_static_delta_part_open (part_in, NULL, delta_open_flags, checksum, &part,
-                                               cancellable, error))
-            return FALSE;
+          if (!g_thread_pool_push (pool, GUINT_TO_POINTER (i + 1), error))
+            {
+              g_atomic_int_set (&apply.failed, TRUE);
+              break;
+            }
         }
+      g_thread_pool_free (pool, FALSE, TRUE);
+      g_mutex_clear (&apply.lock);
 
-      if (!_ostree_static_delta_part_execute (self, objects, part, skip_validation, NULL,
-                                              cancellable, error))
-        return glnx_prefix_error (error, "Executing delta part %i", i);
+      if (apply.error != NULL)
+        {
+          g_clear_error (error);
+          g_propagate_error (error, g_steal_pointer (&apply.error));
+          return FALSE;
+        }
+      else if (g_atomic_int_get (&apply.failed))
+        return FALSE;
     }
 
   return TRUE;
 }
 
+/**
+ * ostree_repo_static_delta_execute_offline_with_signature:
+ * @self: Repo
+ * @dir_or_file: Path to a directory containing static delta data, or directly to the superblock
+ * @sign: Signature engine used to check superblock
+ * @skip_validation: If %TRUE, assume data integrity
+ * @cancellable: Cancellable
+ * @error: Error
+ *
+ * Given a directory representing an already-downloaded static delta
+ * on disk, apply it, generating a new commit.
+ * If sign is passed, the static delta signature is verified.
+ * If sign-verify-deltas configuration option is set and static delta is signed,
+ * signature verification will be mandatory before apply the static delta.
+ * The directory must be named with the form "FROM-TO", where both are
+ * checksums, and it must contain a file named "superblock", along with at least
+ * one part.
+ *
+ * Since: 2020.7
+ */
+gboolean
+ostree_repo_static_delta_execute_offline_with_signature (OstreeRepo *self, GFile *dir_or_file,
+                                                         OstreeSign *sign, gboolean skip_validation,
+                                                         GCancellable *cancellable, GError **error)
+{
+  return execute_offline (self, dir_or_file, sign, skip_validation, 1, cancellable, error);
+}
+
+/**
+ * ostree_repo_static_delta_execute_offline_with_options:
+ * @self: Repo
+ * @dir_or_file: Path to a directory containing static delta data, or directly to the superblock
+ * @sign: (nullable): Signature engine used to check superblock
+ * @options: (nullable): GVariant of type a{sv}, see below
+ * @cancellable: Cancellable
+ * @error: Error
+ *
+ * Like ostree_repo_static_delta_execute_offline_with_signature(), but
+ * takes its parameters as a GVariant.  The following options are known:
+ *   - skip-validation: b: If %TRUE, assume data integrity.  Default FALSE.
+ *   - n-jobs: u: Number of delta parts to decompress and execute
+ *   concurrently; 0 means one per CPU.  Default 1.
+ *
+ * Since: 2024.11
+ */
+gboolean
+ostree_repo_static_delta_execute_offline_with_options (OstreeRepo *self, GFile *dir_or_file,
+                                                       OstreeSign *sign, GVariant *options,
+                                                       GCancellable *cancellable, GError **error)
+{
+  gboolean skip_validation = FALSE;
+  guint n_jobs = 1;
+
+  if (options != NULL)
+    {
+      (void)g_variant_lookup (options, "skip-validation", "b", &skip_validation);
+      (void)g_variant_lookup (options, "n-jobs", "u", &n_jobs);
+    }
+  if (n_jobs == 0)
+    n_jobs = g_get_num_processors ();
+
+  return execute_offline (self, dir_or_file, sign, skip_validation, n_jobs, cancellable, error);
+}
+
 /**
  * ostree_repo_static_delta_execute_offline:
  * @self: Repo
@@ -1014,6 +1156,26 @@ _ostree_repo_static_delta_dump (OstreeRepo *self, const char *delta_id, GCancell
   g_autofree char *to_commit = ostree_checksum_from_bytes_v (to_commit_v);
   g_print ("To: %s\n", to_commit);
 
+  {
+    g_autoptr (GVariant) delta_meta = g_variant_get_child_value (delta_superblock, 0);
+    g_autoptr (GVariant) sources
+        = g_variant_lookup_value (delta_meta, "ostree.delta.sources", G_VARIANT_TYPE ("aay"));
+
+    if (sources != NULL)
+      {
+        const guint n_sources = g_variant_n_children (sources);
+
+        for (guint i = 0; i < n_sources; i++)
+          {
+            g_autoptr (GVariant) source_v = g_variant_get_child_value (sources, i);
+            if (!ostree_checksum_bytes_peek_validate (source_v, error))
+              return FALSE;
+            g_autofree char *source = ostree_checksum_from_bytes_v (source_v);
+            g_print ("Source: %s\n", source);
+          }
+      }
+  }
+
   gboolean swap_endian = FALSE;
   OstreeDeltaEndianness endianness;
   {
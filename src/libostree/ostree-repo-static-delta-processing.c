@@ -61,7 +61,7 @@ typedef struct
   char checksum[OSTREE_SHA256_STRING_LEN + 1];
   OstreeRepoBareContent content_out;
   char *read_source_object;
-  int read_source_fd;
+  GMappedFile *read_source_mfile;
   gboolean have_obj;
   guint32 uid;
   guint32 gid;
@@ -71,6 +71,7 @@ typedef struct
   const guint8 *output_target;
   const guint8 *input_target_csum;
 
+  GVariant *payload;
   const guint8 *payload_data;
   guint64 payload_size;
 } StaticDeltaExecutionState;
@@ -97,12 +98,6 @@ OPPROTO (close)
 OPPROTO (bspatch)
 #undef OPPROTO
 
-static void
-static_delta_execution_state_init (StaticDeltaExecutionState *state)
-{
-  state->read_source_fd = -1;
-}
-
 static gboolean
 read_varuint64 (StaticDeltaExecutionState *state, guint64 *out_value, GError **error)
 {
@@ -178,8 +173,6 @@ _ostree_static_delta_part_execute (OstreeRepo *repo, GVariant *objects, GVariant
   StaticDeltaExecutionState *state = &statedata;
   guint n_executed = 0;
 
-  static_delta_execution_state_init (&statedata);
-
   state->repo = repo;
   state->async_error = error;
   state->stats_only = stats_only;
@@ -202,6 +195,7 @@ _ostree_static_delta_part_execute (OstreeRepo *repo, GVariant *objects, GVariant
   state->mode_dict = mode_dict;
   state->xattr_dict = xattr_dict;
 
+  state->payload = payload;
   state->payload_data = g_variant_get_data (payload);
   state->payload_size = g_variant_get_size (payload);
 
@@ -266,6 +260,8 @@ _ostree_static_delta_part_execute (OstreeRepo *repo, GVariant *objects, GVariant
   ret = TRUE;
 out:
   _ostree_repo_bare_content_cleanup (&state->content_out);
+  g_clear_pointer (&state->read_source_mfile, g_mapped_file_unref);
+  g_clear_pointer (&state->read_source_object, g_free);
   return ret;
 }
 
@@ -409,12 +405,20 @@ dispatch_bspatch (OstreeRepo *repo, StaticDeltaExecutionState *state, GCancellab
 
   if (!state->have_obj)
     {
-      g_autoptr (GMappedFile) input_mfile
-          = g_mapped_file_new_from_fd (state->read_source_fd, FALSE, error);
-      if (!input_mfile)
-        return FALSE;
+      if (state->read_source_mfile == NULL)
+        return glnx_throw (error, "bspatch without a read source");
 
-      g_autofree guchar *buf = g_malloc0 (state->content_size);
+      /* Patch straight into the mapped output object if possible, rather
+       * than a heap buffer of the full object size.
+       */
+      guint8 *target = NULL;
+      g_autofree guchar *buf = NULL;
+      if (state->content_size > 0
+          && !_ostree_repo_bare_content_map (repo, &state->content_out, &target, error))
+        return FALSE;
+      const gboolean mapped = target != NULL;
+      if (!mapped)
+        target = buf = g_malloc (state->content_size);
 
       struct bzpatch_opaque_s opaque;
       opaque.state = state;
@@ -423,13 +427,18 @@ dispatch_bspatch (OstreeRepo *repo, StaticDeltaExecutionState *state, GCancellab
       struct bspatch_stream stream;
       stream.read = bspatch_read;
       stream.opaque = &opaque;
-      if (bspatch ((const guint8 *)g_mapped_file_get_contents (input_mfile),
-                   g_mapped_file_get_length (input_mfile), buf, state->content_size, &stream)
-          < 0)
+      int r = bspatch ((const guint8 *)g_mapped_file_get_contents (state->read_source_mfile),
+                       g_mapped_file_get_length (state->read_source_mfile), target,
+                       state->content_size, &stream);
+
+      if (mapped && !_ostree_repo_bare_content_unmap (repo, &state->content_out, target, error))
+        return FALSE;
+      if (r < 0)
         return glnx_throw (error, "bsdiff patch failed");
 
-      if (!_ostree_repo_bare_content_write (repo, &state->content_out, buf, state->content_size,
-                                            cancellable, error))
+      if (!mapped
+          && !_ostree_repo_bare_content_write (repo, &state->content_out, buf, state->content_size,
+                                               cancellable, error))
         return FALSE;
     }
 
@@ -464,13 +473,14 @@ dispatch_open_splice_and_close (OstreeRepo *repo, StaticDeltaExecutionState *sta
           goto out;
         }
 
-      /* Unfortunately we need a copy because GVariant wants pointer-alignment
-       * and we didn't guarantee that in static deltas. We can do so in the
-       * future.
+      /* We didn't guarantee alignment in static deltas, but GVariant copies
+       * the object itself if it isn't suitably aligned in the payload.
        */
-      g_autoptr (GBytes) metadata_copy = g_bytes_new (state->payload_data + offset, length);
+      g_autoptr (GBytes) metadata_bytes = g_bytes_new_with_free_func (
+          state->payload_data + offset, length, (GDestroyNotify)g_variant_unref,
+          g_variant_ref (state->payload));
       metadata = g_variant_new_from_bytes (ostree_metadata_variant_type (state->output_objtype),
-                                           metadata_copy, FALSE);
+                                           metadata_bytes, FALSE);
 
       {
         g_autofree guchar *actual_csum = NULL;
@@ -627,30 +637,22 @@ dispatch_write (OstreeRepo *repo, StaticDeltaExecutionState *state, GCancellable
 
   if (!state->have_obj)
     {
-      if (state->read_source_fd != -1)
+      if (state->read_source_mfile != NULL)
         {
-          while (content_size > 0)
-            {
-              char buf[4096];
-              gssize bytes_read;
-
-              do
-                bytes_read = pread (state->read_source_fd, buf, MIN (sizeof (buf), content_size),
-                                    content_offset);
-              while (G_UNLIKELY (bytes_read == -1 && errno == EINTR));
-              if (bytes_read == -1)
-                return glnx_throw_errno_prefix (error, "read");
-              if (G_UNLIKELY (bytes_read == 0))
-                return glnx_throw (error, "Unexpected EOF reading object %s",
-                                   state->read_source_object);
-
-              if (!_ostree_repo_bare_content_write (repo, &state->content_out, (guint8 *)buf,
-                                                    bytes_read, cancellable, error))
-                return FALSE;
-
-              content_size -= bytes_read;
-              content_offset += bytes_read;
-            }
+          /* Write straight from the mapped source object */
+          const guint8 *source_data
+              = (const guint8 *)g_mapped_file_get_contents (state->read_source_mfile);
+          const guint64 source_size = g_mapped_file_get_length (state->read_source_mfile);
+
+          if (G_UNLIKELY (content_offset + content_size < content_offset
+                          || content_offset + content_size > source_size))
+            return glnx_throw (error, "Unexpected EOF reading object %s",
+                               state->read_source_object);
+
+          if (!_ostree_repo_bare_content_write (repo, &state->content_out,
+                                                source_data + content_offset, content_size,
+                                                cancellable, error))
+            return FALSE;
         }
       else
         {
@@ -674,7 +676,7 @@ dispatch_set_read_source (OstreeRepo *repo, StaticDeltaExecutionState *state,
   GLNX_AUTO_PREFIX_ERROR ("opcode set-read-source", error);
   guint64 source_offset;
 
-  glnx_close_fd (&state->read_source_fd);
+  g_clear_pointer (&state->read_source_mfile, g_mapped_file_unref);
 
   if (!read_varuint64 (state, &source_offset, error))
     return FALSE;
@@ -687,8 +689,14 @@ dispatch_set_read_source (OstreeRepo *repo, StaticDeltaExecutionState *state,
   g_free (state->read_source_object);
   state->read_source_object = ostree_checksum_from_bytes (state->payload_data + source_offset);
 
-  if (!_ostree_repo_load_file_bare (repo, state->read_source_object, &state->read_source_fd, NULL,
-                                    NULL, NULL, cancellable, error))
+  glnx_autofd int fd = -1;
+  if (!_ostree_repo_load_file_bare (repo, state->read_source_object, &fd, NULL, NULL, NULL,
+                                    cancellable, error))
+    return FALSE;
+
+  /* The source is only read from, and possibly several times; map it once */
+  state->read_source_mfile = g_mapped_file_new_from_fd (fd, FALSE, error);
+  if (!state->read_source_mfile)
     return FALSE;
 
   return TRUE;
@@ -703,7 +711,7 @@ dispatch_unset_read_source (OstreeRepo *repo, StaticDeltaExecutionState *state,
   if (state->stats_only)
     return TRUE; /* Early return */
 
-  glnx_close_fd (&state->read_source_fd);
+  g_clear_pointer (&state->read_source_mfile, g_mapped_file_unref);
   g_clear_pointer (&state->read_source_object, g_free);
 
   return TRUE;
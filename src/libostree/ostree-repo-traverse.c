@@ -22,6 +22,7 @@
 #include "config.h"
 
 #include "libglnx.h"
+#include "ostree-repo-private.h"
 #include "ostree.h"
 #include "otutil.h"
 
@@ -348,11 +349,6 @@ ostree_repo_traverse_parents_get_commits (GHashTable *parents, GVariant *object)
   return g_strdupv (tmpbuf);
 }
 
-static gboolean traverse_dirtree (OstreeRepo *repo, const char *checksum, GVariant *parent_key,
-                                  GHashTable *inout_reachable, GHashTable *inout_parents,
-                                  gboolean ignore_missing_dirs, GCancellable *cancellable,
-                                  GError **error);
-
 static void
 add_parent_ref (GHashTable *inout_parents, GVariant *key, GVariant *parent_key)
 {
@@ -398,96 +394,463 @@ add_parent_ref (GHashTable *inout_parents, GVariant *key, GVariant *parent_key)
     }
 }
 
+/* An OstreeRepoReachableSet is an open-addressed hash set of binary object
+ * names, so entries need no allocations of their own.  It is sharded by the
+ * first byte of the checksum, each shard having its own lock, so that the
+ * workers of a parallel traversal rarely contend for one.
+ */
+typedef struct
+{
+  guint8 csum[OSTREE_SHA256_DIGEST_LEN];
+  guint8 objtype; /* 0 for an empty slot */
+} ReachableEntry;
+
+G_STATIC_ASSERT (sizeof (ReachableEntry) == _OSTREE_REACHABLE_SET_ENTRY_SIZE);
+
+typedef struct
+{
+  GMutex lock;
+  ReachableEntry *entries;
+  gsize n_entries;
+  gsize n_slots; /* 0 or a power of two */
+} ReachableShard;
+
+struct OstreeRepoReachableSet
+{
+  gint ref_count;
+  ReachableShard shards[256];
+};
+
+static gsize
+reachable_entry_hash (const guint8 *csum, guint8 objtype)
+{
+  guint64 h;
+  /* The checksum is already uniformly distributed; byte 0 picked the shard */
+  memcpy (&h, csum + 1, sizeof (h));
+  return (gsize)(h ^ objtype);
+}
+
+/* Returns the slot holding the entry, or the empty slot where it would go */
+static ReachableEntry *
+reachable_shard_find (ReachableShard *shard, const guint8 *csum, guint8 objtype)
+{
+  const gsize mask = shard->n_slots - 1;
+  for (gsize i = reachable_entry_hash (csum, objtype) & mask;; i = (i + 1) & mask)
+    {
+      ReachableEntry *entry = &shard->entries[i];
+      if (entry->objtype == 0
+          || (entry->objtype == objtype && memcmp (entry->csum, csum, sizeof (entry->csum)) == 0))
+        return entry;
+    }
+}
+
+static void
+reachable_shard_grow (ReachableShard *shard)
+{
+  ReachableEntry *old_entries = shard->entries;
+  const gsize old_n_slots = shard->n_slots;
+
+  shard->n_slots = MAX (old_n_slots * 2, 64);
+  shard->entries = g_new0 (ReachableEntry, shard->n_slots);
+  for (gsize i = 0; i < old_n_slots; i++)
+    {
+      if (old_entries[i].objtype != 0)
+        *reachable_shard_find (shard, old_entries[i].csum, old_entries[i].objtype)
+            = old_entries[i];
+    }
+  g_free (old_entries);
+}
+
+G_DEFINE_BOXED_TYPE (OstreeRepoReachableSet, ostree_repo_reachable_set,
+                     ostree_repo_reachable_set_ref, ostree_repo_reachable_set_unref);
+
+/**
+ * ostree_repo_reachable_set_new:
+ *
+ * Create a set of object names, like ostree_repo_traverse_new_reachable(),
+ * which stores each object in a few dozen bytes.  Sets may be added to
+ * from several threads at once.
+ *
+ * Returns: (transfer full): A new empty set
+ * Since: 2024.11
+ */
+OstreeRepoReachableSet *
+ostree_repo_reachable_set_new (void)
+{
+  OstreeRepoReachableSet *set = g_new0 (OstreeRepoReachableSet, 1);
+  set->ref_count = 1;
+  for (guint i = 0; i < G_N_ELEMENTS (set->shards); i++)
+    g_mutex_init (&set->shards[i].lock);
+  return set;
+}
+
+/**
+ * ostree_repo_reachable_set_ref:
+ * @set: A set
+ *
+ * Returns: (transfer full): @set, with an additional reference
+ * Since: 2024.11
+ */
+OstreeRepoReachableSet *
+ostree_repo_reachable_set_ref (OstreeRepoReachableSet *set)
+{
+  g_atomic_int_inc (&set->ref_count);
+  return set;
+}
+
+/**
+ * ostree_repo_reachable_set_unref:
+ * @set: (transfer full): A set
+ *
+ * Drop a reference to @set, freeing it if it was the last one.
+ *
+ * Since: 2024.11
+ */
+void
+ostree_repo_reachable_set_unref (OstreeRepoReachableSet *set)
+{
+  if (!g_atomic_int_dec_and_test (&set->ref_count))
+    return;
+
+  for (guint i = 0; i < G_N_ELEMENTS (set->shards); i++)
+    {
+      g_free (set->shards[i].entries);
+      g_mutex_clear (&set->shards[i].lock);
+    }
+  g_free (set);
+}
+
+/* Like ostree_repo_reachable_set_add(), for a binary checksum */
 static gboolean
-traverse_iter (OstreeRepo *repo, OstreeRepoCommitTraverseIter *iter, GVariant *parent_key,
-               GHashTable *inout_reachable, GHashTable *inout_parents, gboolean ignore_missing_dirs,
-               GCancellable *cancellable, GError **error)
+reachable_set_add_bytes (OstreeRepoReachableSet *set, const guint8 *csum, OstreeObjectType objtype)
 {
-  while (TRUE)
+  ReachableShard *shard = &set->shards[csum[0]];
+  gboolean added = FALSE;
+
+  g_mutex_lock (&shard->lock);
+  if ((shard->n_entries + 1) * 4 > shard->n_slots * 3)
+    reachable_shard_grow (shard);
+  ReachableEntry *entry = reachable_shard_find (shard, csum, objtype);
+  if (entry->objtype == 0)
     {
-      g_autoptr (GVariant) key = NULL;
-      g_autoptr (GError) local_error = NULL;
-      OstreeRepoCommitIterResult iterres
-          = ostree_repo_commit_traverse_iter_next (iter, cancellable, &local_error);
+      memcpy (entry->csum, csum, sizeof (entry->csum));
+      entry->objtype = objtype;
+      shard->n_entries++;
+      added = TRUE;
+    }
+  g_mutex_unlock (&shard->lock);
+  return added;
+}
 
-      if (iterres == OSTREE_REPO_COMMIT_ITER_RESULT_ERROR)
+/* Like ostree_repo_reachable_set_contains(), for a binary checksum */
+static gboolean
+reachable_set_contains_bytes (OstreeRepoReachableSet *set, const guint8 *csum,
+                              OstreeObjectType objtype)
+{
+  ReachableShard *shard = &set->shards[csum[0]];
+  gboolean found = FALSE;
+
+  g_mutex_lock (&shard->lock);
+  if (shard->n_slots > 0)
+    found = reachable_shard_find (shard, csum, objtype)->objtype != 0;
+  g_mutex_unlock (&shard->lock);
+  return found;
+}
+
+/**
+ * ostree_repo_reachable_set_add:
+ * @set: A set
+ * @checksum: ASCII SHA256 checksum
+ * @objtype: Object type
+ *
+ * Add an object to @set.
+ *
+ * Returns: %TRUE if the object was not in @set before
+ * Since: 2024.11
+ */
+gboolean
+ostree_repo_reachable_set_add (OstreeRepoReachableSet *set, const char *checksum,
+                               OstreeObjectType objtype)
+{
+  guint8 csum[OSTREE_SHA256_DIGEST_LEN];
+  ostree_checksum_inplace_to_bytes (checksum, csum);
+  return reachable_set_add_bytes (set, csum, objtype);
+}
+
+/**
+ * ostree_repo_reachable_set_contains:
+ * @set: A set
+ * @checksum: ASCII SHA256 checksum
+ * @objtype: Object type
+ *
+ * Returns: %TRUE if the object is in @set
+ * Since: 2024.11
+ */
+gboolean
+ostree_repo_reachable_set_contains (OstreeRepoReachableSet *set, const char *checksum,
+                                    OstreeObjectType objtype)
+{
+  guint8 csum[OSTREE_SHA256_DIGEST_LEN];
+  ostree_checksum_inplace_to_bytes (checksum, csum);
+  return reachable_set_contains_bytes (set, csum, objtype);
+}
+
+/**
+ * ostree_repo_reachable_set_get_size:
+ * @set: A set
+ *
+ * Returns: The number of objects in @set
+ * Since: 2024.11
+ */
+guint
+ostree_repo_reachable_set_get_size (OstreeRepoReachableSet *set)
+{
+  gsize n = 0;
+  for (guint i = 0; i < G_N_ELEMENTS (set->shards); i++)
+    {
+      g_mutex_lock (&set->shards[i].lock);
+      n += set->shards[i].n_entries;
+      g_mutex_unlock (&set->shards[i].lock);
+    }
+  return (guint)n;
+}
+
+/**
+ * ostree_repo_reachable_set_foreach:
+ * @set: A set
+ * @func: (scope call): Function called for each object
+ * @user_data: Data for @func
+ *
+ * Call @func for each object in @set, in no particular order.  @set must
+ * not be modified while this runs.
+ *
+ * Since: 2024.11
+ */
+void
+ostree_repo_reachable_set_foreach (OstreeRepoReachableSet *set, OstreeRepoReachableSetFunc func,
+                                   gpointer user_data)
+{
+  for (guint i = 0; i < G_N_ELEMENTS (set->shards); i++)
+    {
+      ReachableShard *shard = &set->shards[i];
+      for (gsize j = 0; j < shard->n_slots; j++)
         {
-          /* There is only one kind of not-found error, which is
-             failing to load the dirmeta itself, if so, we ignore that
-             (and the whole subtree) if told to. */
-          if (ignore_missing_dirs
-              && g_error_matches (local_error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND))
-            {
-              g_debug ("Ignoring not-found dirmeta");
-              return TRUE; /* Note early return */
-            }
+          const ReachableEntry *entry = &shard->entries[j];
+          if (entry->objtype == 0)
+            continue;
 
-          g_propagate_error (error, g_steal_pointer (&local_error));
-          return FALSE;
+          char checksum[OSTREE_SHA256_STRING_LEN + 1];
+          ostree_checksum_inplace_from_bytes (entry->csum, checksum);
+          func (checksum, entry->objtype, user_data);
         }
-      else if (iterres == OSTREE_REPO_COMMIT_ITER_RESULT_END)
-        break;
-      else if (iterres == OSTREE_REPO_COMMIT_ITER_RESULT_FILE)
+    }
+}
+
+/* Append the entries of @set to @buf, as _OSTREE_REACHABLE_SET_ENTRY_SIZE byte
+ * binary checksum and object type pairs.
+ */
+void
+_ostree_repo_reachable_set_serialize (OstreeRepoReachableSet *set, GByteArray *buf)
+{
+  for (guint i = 0; i < G_N_ELEMENTS (set->shards); i++)
+    {
+      ReachableShard *shard = &set->shards[i];
+      g_mutex_lock (&shard->lock);
+      for (gsize j = 0; j < shard->n_slots; j++)
         {
-          char *name;
-          char *checksum;
+          if (shard->entries[j].objtype != 0)
+            g_byte_array_append (buf, (guint8 *)&shard->entries[j], sizeof (ReachableEntry));
+        }
+      g_mutex_unlock (&shard->lock);
+    }
+}
 
-          ostree_repo_commit_traverse_iter_get_file (iter, &name, &checksum);
+/* The reverse of _ostree_repo_reachable_set_serialize() */
+gboolean
+_ostree_repo_reachable_set_add_serialized (OstreeRepoReachableSet *set, const guint8 *data,
+                                           gsize len, GError **error)
+{
+  if (len % sizeof (ReachableEntry) != 0)
+    return glnx_throw (error, "Invalid reachable set length %" G_GSIZE_FORMAT, len);
 
-          g_debug ("Found file object %s", checksum);
-          key = g_variant_ref_sink (
-              ostree_object_name_serialize (checksum, OSTREE_OBJECT_TYPE_FILE));
-          add_parent_ref (inout_parents, key, parent_key);
-          g_hash_table_add (inout_reachable, g_steal_pointer (&key));
-        }
-      else if (iterres == OSTREE_REPO_COMMIT_ITER_RESULT_DIR)
-        {
-          char *name;
-          char *content_checksum;
-          char *meta_checksum;
+  for (gsize i = 0; i < len; i += sizeof (ReachableEntry))
+    {
+      const ReachableEntry *entry = (const ReachableEntry *)(data + i);
+      if (!ostree_validate_structureof_objtype (entry->objtype, error))
+        return FALSE;
+      reachable_set_add_bytes (set, entry->csum, entry->objtype);
+    }
+  return TRUE;
+}
 
-          ostree_repo_commit_traverse_iter_get_dir (iter, &name, &content_checksum, &meta_checksum);
+/* State of a traversal, whose dirtrees are loaded and walked by a pool of
+ * worker threads.  Objects found are added to @found; with the #GHashTable
+ * API that's a temporary set, and @reachable is only read while the
+ * workers run.
+ */
+typedef struct
+{
+  OstreeRepo *repo;
+  OstreeRepoReachableSet *found;
+  GHashTable *reachable;
+  GHashTable *parents;
+  GMutex parents_lock;
+  GThreadPool *pool;
+  GMutex lock; /* Protects n_pending and error */
+  GCond cond;
+  guint n_pending;
+  GError *error;
+  gint stop;
+  GCancellable *cancellable;
+} TraverseWorkers;
+
+typedef struct
+{
+  char checksum[OSTREE_SHA256_STRING_LEN + 1];
+  GVariant *key; /* Object name of the dirtree */
+  gboolean ignore_missing_dirs;
+} TraverseTask;
 
-          g_debug ("Found dirtree object %s", content_checksum);
-          g_debug ("Found dirmeta object %s", meta_checksum);
-          key = g_variant_ref_sink (
-              ostree_object_name_serialize (meta_checksum, OSTREE_OBJECT_TYPE_DIR_META));
-          add_parent_ref (inout_parents, key, parent_key);
-          g_hash_table_add (inout_reachable, g_steal_pointer (&key));
+static void traverse_task_thread (gpointer data, gpointer user_data);
 
-          key = g_variant_ref_sink (
-              ostree_object_name_serialize (content_checksum, OSTREE_OBJECT_TYPE_DIR_TREE));
-          add_parent_ref (inout_parents, key, parent_key);
-          if (!g_hash_table_lookup (inout_reachable, key))
-            {
-              if (!traverse_dirtree (repo, content_checksum, key, inout_reachable, inout_parents,
-                                     ignore_missing_dirs, cancellable, error))
-                return FALSE;
+static void
+traverse_workers_init (TraverseWorkers *workers, OstreeRepo *repo, OstreeRepoReachableSet *found,
+                       GHashTable *reachable, GHashTable *parents, GCancellable *cancellable)
+{
+  memset (workers, 0, sizeof (*workers));
+  workers->repo = repo;
+  workers->found = found;
+  workers->reachable = reachable;
+  workers->parents = parents;
+  workers->cancellable = cancellable;
+  g_mutex_init (&workers->parents_lock);
+  g_mutex_init (&workers->lock);
+  g_cond_init (&workers->cond);
+}
 
-              g_hash_table_add (inout_reachable, g_steal_pointer (&key));
-            }
-        }
-      else
-        g_assert_not_reached ();
+/* Wait for the queued dirtrees and return the first error */
+static gboolean
+traverse_workers_finish (TraverseWorkers *workers, GError **error)
+{
+  g_mutex_lock (&workers->lock);
+  while (workers->n_pending > 0)
+    g_cond_wait (&workers->cond, &workers->lock);
+  g_mutex_unlock (&workers->lock);
+
+  if (workers->pool != NULL)
+    g_thread_pool_free (workers->pool, FALSE, TRUE);
+
+  g_mutex_clear (&workers->parents_lock);
+  g_mutex_clear (&workers->lock);
+  g_cond_clear (&workers->cond);
+
+  if (workers->error != NULL)
+    {
+      g_propagate_error (error, g_steal_pointer (&workers->error));
+      return FALSE;
+    }
+  return TRUE;
+}
+
+/* Returns %TRUE if the object wasn't found before */
+static gboolean
+traverse_mark (TraverseWorkers *workers, const char *checksum, OstreeObjectType objtype)
+{
+  return ostree_repo_reachable_set_add (workers->found, checksum, objtype);
+}
+
+static gboolean
+traverse_contains (TraverseWorkers *workers, const char *checksum, OstreeObjectType objtype,
+                   GVariant *key)
+{
+  if (workers->reachable != NULL && g_hash_table_contains (workers->reachable, key))
+    return TRUE;
+  return ostree_repo_reachable_set_contains (workers->found, checksum, objtype);
+}
+
+static void
+traverse_add_parent_ref (TraverseWorkers *workers, GVariant *key, GVariant *parent_key)
+{
+  if (workers->parents == NULL)
+    return;
+
+  g_mutex_lock (&workers->parents_lock);
+  add_parent_ref (workers->parents, key, parent_key);
+  g_mutex_unlock (&workers->parents_lock);
+}
+
+/* Record a directory found in @parent_key, and queue its dirtree to be
+ * traversed if it wasn't seen before.
+ */
+static gboolean
+traverse_found_dir (TraverseWorkers *workers, const char *content_checksum,
+                    const char *meta_checksum, GVariant *parent_key, gboolean ignore_missing_dirs,
+                    GError **error)
+{
+  g_debug ("Found dirtree object %s", content_checksum);
+  g_debug ("Found dirmeta object %s", meta_checksum);
+
+  if (workers->parents != NULL)
+    {
+      g_autoptr (GVariant) meta_key = g_variant_ref_sink (
+          ostree_object_name_serialize (meta_checksum, OSTREE_OBJECT_TYPE_DIR_META));
+      traverse_add_parent_ref (workers, meta_key, parent_key);
+    }
+  (void)traverse_mark (workers, meta_checksum, OSTREE_OBJECT_TYPE_DIR_META);
+
+  g_autoptr (GVariant) key = g_variant_ref_sink (
+      ostree_object_name_serialize (content_checksum, OSTREE_OBJECT_TYPE_DIR_TREE));
+  traverse_add_parent_ref (workers, key, parent_key);
+  if ((workers->reachable != NULL && g_hash_table_contains (workers->reachable, key))
+      || !traverse_mark (workers, content_checksum, OSTREE_OBJECT_TYPE_DIR_TREE))
+    return TRUE;
+
+  if (workers->pool == NULL)
+    {
+      workers->pool = g_thread_pool_new (traverse_task_thread, workers, g_get_num_processors (),
+                                         FALSE, error);
+      if (workers->pool == NULL)
+        return FALSE;
     }
 
+  TraverseTask *task = g_new0 (TraverseTask, 1);
+  memcpy (task->checksum, content_checksum, sizeof (task->checksum));
+  task->key = g_steal_pointer (&key);
+  task->ignore_missing_dirs = ignore_missing_dirs;
+
+  g_mutex_lock (&workers->lock);
+  workers->n_pending++;
+  g_mutex_unlock (&workers->lock);
+  if (!g_thread_pool_push (workers->pool, task, error))
+    {
+      g_variant_unref (task->key);
+      g_free (task);
+      g_mutex_lock (&workers->lock);
+      if (--workers->n_pending == 0)
+        g_cond_signal (&workers->cond);
+      g_mutex_unlock (&workers->lock);
+      return FALSE;
+    }
   return TRUE;
 }
 
 static gboolean
-traverse_dirtree (OstreeRepo *repo, const char *checksum, GVariant *parent_key,
-                  GHashTable *inout_reachable, GHashTable *inout_parents,
-                  gboolean ignore_missing_dirs, GCancellable *cancellable, GError **error)
+traverse_task_run (TraverseWorkers *workers, TraverseTask *task, GError **error)
 {
+  OstreeRepo *repo = workers->repo;
   g_autoptr (GError) local_error = NULL;
 
+  if (g_cancellable_set_error_if_cancelled (workers->cancellable, error))
+    return FALSE;
+
   g_autoptr (GVariant) dirtree = NULL;
-  if (!ostree_repo_load_variant (repo, OSTREE_OBJECT_TYPE_DIR_TREE, checksum, &dirtree,
+  if (!ostree_repo_load_variant (repo, OSTREE_OBJECT_TYPE_DIR_TREE, task->checksum, &dirtree,
                                  &local_error))
     {
-      if (ignore_missing_dirs && g_error_matches (local_error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND))
+      if (task->ignore_missing_dirs
+          && g_error_matches (local_error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND))
         {
-          g_debug ("Ignoring not-found dirmeta %s", checksum);
+          g_debug ("Ignoring not-found dirtree %s", task->checksum);
           return TRUE; /* Early return */
         }
 
@@ -495,7 +858,7 @@ traverse_dirtree (OstreeRepo *repo, const char *checksum, GVariant *parent_key,
       return FALSE;
     }
 
-  g_debug ("Traversing dirtree %s", checksum);
+  g_debug ("Traversing dirtree %s", task->checksum);
   ostree_cleanup_repo_commit_traverse_iter OstreeRepoCommitTraverseIter iter = {
     0,
   };
@@ -503,39 +866,77 @@ traverse_dirtree (OstreeRepo *repo, const char *checksum, GVariant *parent_key,
                                                       OSTREE_REPO_COMMIT_TRAVERSE_FLAG_NONE, error))
     return FALSE;
 
-  if (!traverse_iter (repo, &iter, parent_key, inout_reachable, inout_parents, ignore_missing_dirs,
-                      cancellable, error))
-    return FALSE;
+  while (TRUE)
+    {
+      OstreeRepoCommitIterResult iterres
+          = ostree_repo_commit_traverse_iter_next (&iter, workers->cancellable, error);
+
+      if (iterres == OSTREE_REPO_COMMIT_ITER_RESULT_ERROR)
+        return FALSE;
+      else if (iterres == OSTREE_REPO_COMMIT_ITER_RESULT_END)
+        break;
+      else if (iterres == OSTREE_REPO_COMMIT_ITER_RESULT_FILE)
+        {
+          char *name;
+          char *checksum;
+
+          ostree_repo_commit_traverse_iter_get_file (&iter, &name, &checksum);
+
+          g_debug ("Found file object %s", checksum);
+          if (workers->parents != NULL)
+            {
+              g_autoptr (GVariant) key = g_variant_ref_sink (
+                  ostree_object_name_serialize (checksum, OSTREE_OBJECT_TYPE_FILE));
+              traverse_add_parent_ref (workers, key, task->key);
+            }
+          (void)traverse_mark (workers, checksum, OSTREE_OBJECT_TYPE_FILE);
+        }
+      else if (iterres == OSTREE_REPO_COMMIT_ITER_RESULT_DIR)
+        {
+          char *name;
+          char *content_checksum;
+          char *meta_checksum;
+
+          ostree_repo_commit_traverse_iter_get_dir (&iter, &name, &content_checksum,
+                                                    &meta_checksum);
+          if (!traverse_found_dir (workers, content_checksum, meta_checksum, task->key,
+                                   task->ignore_missing_dirs, error))
+            return FALSE;
+        }
+      else
+        g_assert_not_reached ();
+    }
 
   return TRUE;
 }
 
-/**
- * ostree_repo_traverse_commit_with_flags: (skip)
- * @repo: Repo
- * @flags: change traversal behaviour according to these flags
- * @commit_checksum: ASCII SHA256 checksum
- * @maxdepth: Traverse this many parent commits, -1 for unlimited
- * @inout_reachable: Set of reachable objects
- * @inout_parents: Map from object to parent object
- * @cancellable: Cancellable
- * @error: Error
- *
- * Update the set @inout_reachable containing all objects reachable
- * from @commit_checksum, traversing @maxdepth parent commits.
- *
- * Additionally this constructs a mapping from each object to the parents
- * of the object, which can be used to track which commits an object
- * belongs to.
- *
- * Since: 2018.5
- */
-gboolean
-ostree_repo_traverse_commit_with_flags (OstreeRepo *repo, OstreeRepoCommitTraverseFlags flags,
-                                        const char *commit_checksum, int maxdepth,
-                                        GHashTable *inout_reachable, GHashTable *inout_parents,
-                                        GCancellable *cancellable, GError **error)
+static void
+traverse_task_thread (gpointer data, gpointer user_data)
+{
+  TraverseTask *task = data;
+  TraverseWorkers *workers = user_data;
+  g_autoptr (GError) local_error = NULL;
+
+  if (!g_atomic_int_get (&workers->stop) && !traverse_task_run (workers, task, &local_error))
+    g_atomic_int_set (&workers->stop, TRUE);
+
+  g_variant_unref (task->key);
+  g_free (task);
+
+  g_mutex_lock (&workers->lock);
+  if (local_error != NULL && workers->error == NULL)
+    workers->error = g_steal_pointer (&local_error);
+  if (--workers->n_pending == 0)
+    g_cond_signal (&workers->cond);
+  g_mutex_unlock (&workers->lock);
+}
+
+/* Walk the history of @commit_checksum, queueing the root of each commit */
+static gboolean
+traverse_commit_history (TraverseWorkers *workers, OstreeRepoCommitTraverseFlags flags,
+                         const char *commit_checksum, int maxdepth, GError **error)
 {
+  OstreeRepo *repo = workers->repo;
   g_autofree char *tmp_checksum = NULL;
   gboolean commit_only = flags & OSTREE_REPO_COMMIT_TRAVERSE_FLAG_COMMIT_ONLY;
 
@@ -544,7 +945,7 @@ ostree_repo_traverse_commit_with_flags (OstreeRepo *repo, OstreeRepoCommitTraver
       g_autoptr (GVariant) key = g_variant_ref_sink (
           ostree_object_name_serialize (commit_checksum, OSTREE_OBJECT_TYPE_COMMIT));
 
-      if (g_hash_table_contains (inout_reachable, key))
+      if (traverse_contains (workers, commit_checksum, OSTREE_OBJECT_TYPE_COMMIT, key))
         break;
 
       g_autoptr (GVariant) commit = NULL;
@@ -567,21 +968,31 @@ ostree_repo_traverse_commit_with_flags (OstreeRepo *repo, OstreeRepoCommitTraver
       if ((commitstate & OSTREE_REPO_COMMIT_STATE_PARTIAL) != 0)
         ignore_missing_dirs = TRUE;
 
-      g_hash_table_add (inout_reachable, g_variant_ref (key));
+      (void)traverse_mark (workers, commit_checksum, OSTREE_OBJECT_TYPE_COMMIT);
 
       /* Save time by skipping traversal of non-commit objects */
       if (!commit_only)
         {
+          char content_checksum[OSTREE_SHA256_STRING_LEN + 1];
+          char meta_checksum[OSTREE_SHA256_STRING_LEN + 1];
+
           g_debug ("Traversing commit %s", commit_checksum);
-          ostree_cleanup_repo_commit_traverse_iter OstreeRepoCommitTraverseIter iter = {
-            0,
-          };
-          if (!ostree_repo_commit_traverse_iter_init_commit (
-                  &iter, repo, commit, OSTREE_REPO_COMMIT_TRAVERSE_FLAG_NONE, error))
+          g_autoptr (GVariant) content_csum_bytes = NULL;
+          g_variant_get_child (commit, 6, "@ay", &content_csum_bytes);
+          const guchar *csum = ostree_checksum_bytes_peek_validate (content_csum_bytes, error);
+          if (!csum)
+            return FALSE;
+          ostree_checksum_inplace_from_bytes (csum, content_checksum);
+
+          g_autoptr (GVariant) meta_csum_bytes = NULL;
+          g_variant_get_child (commit, 7, "@ay", &meta_csum_bytes);
+          csum = ostree_checksum_bytes_peek_validate (meta_csum_bytes, error);
+          if (!csum)
             return FALSE;
+          ostree_checksum_inplace_from_bytes (csum, meta_checksum);
 
-          if (!traverse_iter (repo, &iter, key, inout_reachable, inout_parents, ignore_missing_dirs,
-                              cancellable, error))
+          if (!traverse_found_dir (workers, content_checksum, meta_checksum, key,
+                                   ignore_missing_dirs, error))
             return FALSE;
         }
 
@@ -605,6 +1016,138 @@ ostree_repo_traverse_commit_with_flags (OstreeRepo *repo, OstreeRepoCommitTraver
   return TRUE;
 }
 
+static gboolean
+traverse_commits (OstreeRepo *repo, OstreeRepoCommitTraverseFlags flags,
+                  const char *const *commit_checksums, int maxdepth, OstreeRepoReachableSet *found,
+                  GHashTable *reachable, GHashTable *parents, GCancellable *cancellable,
+                  GError **error)
+{
+  TraverseWorkers workers;
+  g_autoptr (GError) local_error = NULL;
+
+  traverse_workers_init (&workers, repo, found, reachable, parents, cancellable);
+
+  for (const char *const *iter = commit_checksums;
+       *iter != NULL && !g_atomic_int_get (&workers.stop); iter++)
+    {
+      if (!traverse_commit_history (&workers, flags, *iter, maxdepth, &local_error))
+        {
+          g_atomic_int_set (&workers.stop, TRUE);
+          break;
+        }
+    }
+
+  /* Prefer the error from the workers; they were probably told to stop by it */
+  if (!traverse_workers_finish (&workers, error))
+    return FALSE;
+  if (local_error != NULL)
+    {
+      g_propagate_error (error, g_steal_pointer (&local_error));
+      return FALSE;
+    }
+  return TRUE;
+}
+
+/**
+ * ostree_repo_traverse_commits_to_set:
+ * @repo: Repo
+ * @flags: change traversal behaviour according to these flags
+ * @commit_checksums: (array zero-terminated=1): ASCII SHA256 checksums
+ * @maxdepth: Traverse this many parent commits, -1 for unlimited
+ * @inout_reachable: Set of reachable objects
+ * @cancellable: Cancellable
+ * @error: Error
+ *
+ * Add all objects reachable from each of @commit_checksums to
+ * @inout_reachable, traversing @maxdepth parent commits.  The directory
+ * trees are loaded and walked by a pool of threads, and each one is only
+ * traversed once even if it is shared between several commits; those
+ * already in @inout_reachable are not traversed again.
+ *
+ * Since: 2024.11
+ */
+gboolean
+ostree_repo_traverse_commits_to_set (OstreeRepo *repo, OstreeRepoCommitTraverseFlags flags,
+                                     const char *const *commit_checksums, int maxdepth,
+                                     OstreeRepoReachableSet *inout_reachable,
+                                     GCancellable *cancellable, GError **error)
+{
+  return traverse_commits (repo, flags, commit_checksums, maxdepth, inout_reachable, NULL, NULL,
+                           cancellable, error);
+}
+
+static void
+add_to_reachable_table (const char *checksum, OstreeObjectType objtype, gpointer user_data)
+{
+  GHashTable *reachable = user_data;
+  g_hash_table_add (reachable,
+                    g_variant_ref_sink (ostree_object_name_serialize (checksum, objtype)));
+}
+
+/**
+ * ostree_repo_traverse_commits_with_flags: (skip)
+ * @repo: Repo
+ * @flags: change traversal behaviour according to these flags
+ * @commit_checksums: (array zero-terminated=1): ASCII SHA256 checksums
+ * @maxdepth: Traverse this many parent commits, -1 for unlimited
+ * @inout_reachable: Set of reachable objects
+ * @inout_parents: (nullable): Map from object to parent object
+ * @cancellable: Cancellable
+ * @error: Error
+ *
+ * Like ostree_repo_traverse_commit_with_flags(), but for each of
+ * @commit_checksums, in parallel as ostree_repo_traverse_commits_to_set()
+ * does.
+ *
+ * Since: 2024.11
+ */
+gboolean
+ostree_repo_traverse_commits_with_flags (OstreeRepo *repo, OstreeRepoCommitTraverseFlags flags,
+                                         const char *const *commit_checksums, int maxdepth,
+                                         GHashTable *inout_reachable, GHashTable *inout_parents,
+                                         GCancellable *cancellable, GError **error)
+{
+  g_autoptr (OstreeRepoReachableSet) found = ostree_repo_reachable_set_new ();
+  if (!traverse_commits (repo, flags, commit_checksums, maxdepth, found, inout_reachable,
+                         inout_parents, cancellable, error))
+    return FALSE;
+
+  ostree_repo_reachable_set_foreach (found, add_to_reachable_table, inout_reachable);
+  return TRUE;
+}
+
+/**
+ * ostree_repo_traverse_commit_with_flags: (skip)
+ * @repo: Repo
+ * @flags: change traversal behaviour according to these flags
+ * @commit_checksum: ASCII SHA256 checksum
+ * @maxdepth: Traverse this many parent commits, -1 for unlimited
+ * @inout_reachable: Set of reachable objects
+ * @inout_parents: Map from object to parent object
+ * @cancellable: Cancellable
+ * @error: Error
+ *
+ * Update the set @inout_reachable containing all objects reachable
+ * from @commit_checksum, traversing @maxdepth parent commits.
+ *
+ * Additionally this constructs a mapping from each object to the parents
+ * of the object, which can be used to track which commits an object
+ * belongs to.
+ *
+ * Since: 2018.5
+ */
+gboolean
+ostree_repo_traverse_commit_with_flags (OstreeRepo *repo, OstreeRepoCommitTraverseFlags flags,
+                                        const char *commit_checksum, int maxdepth,
+                                        GHashTable *inout_reachable, GHashTable *inout_parents,
+                                        GCancellable *cancellable, GError **error)
+{
+  const char *commit_checksums[] = { commit_checksum, NULL };
+  return ostree_repo_traverse_commits_with_flags (repo, flags, commit_checksums, maxdepth,
+                                                  inout_reachable, inout_parents, cancellable,
+                                                  error);
+}
+
 /**
  * ostree_repo_traverse_commit_union_with_parents: (skip)
  * @repo: Repo
@@ -245,3 +245,163 @@ _ostree_ensure_fsverity (OstreeRepo *self, gboolean allow_enoent, int dirfd, con
 
   return TRUE;
 }
+
+/* Enabling fs-verity reads back the whole file to build the Merkle tree,
+ * so it's done on worker threads for bulk operations and for objects staged
+ * in a transaction.
+ */
+struct _OstreeFsverityWorkers
+{
+  OstreeRepo *repo;
+  GThreadPool *pool;
+  GMutex lock; /* protects error */
+  GError *error;
+  gint stop; /* atomic; set on error or if fs-verity isn't supported */
+};
+
+typedef struct
+{
+  int dirfd;
+  char *path;
+} FsverityJob;
+
+static void
+fsverity_job_thread (gpointer data, gpointer user_data)
+{
+  FsverityJob *job = data;
+  _OstreeFsverityWorkers *workers = user_data;
+  OstreeRepo *self = workers->repo;
+  g_autoptr (GError) local_error = NULL;
+
+  if (!g_atomic_int_get (&workers->stop))
+    {
+      gboolean supported;
+      if (!_ostree_ensure_fsverity (self, FALSE, job->dirfd, job->path, &supported,
+                                    &local_error))
+        {
+          g_mutex_lock (&workers->lock);
+          if (workers->error == NULL)
+            workers->error = g_steal_pointer (&local_error);
+          g_mutex_unlock (&workers->lock);
+          g_atomic_int_set (&workers->stop, TRUE);
+        }
+      else
+        {
+          /* If not supported, skip the rest; see also _ostree_tmpf_fsverity() */
+          if (!supported)
+            g_atomic_int_set (&workers->stop, TRUE);
+          g_mutex_lock (&self->txn_lock);
+          self->fs_verity_supported = supported ? _OSTREE_FEATURE_YES : _OSTREE_FEATURE_NO;
+          g_mutex_unlock (&self->txn_lock);
+        }
+    }
+
+  g_free (job->path);
+  g_free (job);
+}
+
+_OstreeFsverityWorkers *
+_ostree_fsverity_workers_new (OstreeRepo *self, GError **error)
+{
+  g_autofree _OstreeFsverityWorkers *workers = g_new0 (_OstreeFsverityWorkers, 1);
+  workers->repo = self;
+  workers->pool
+      = g_thread_pool_new (fsverity_job_thread, workers, g_get_num_processors (), TRUE, error);
+  if (workers->pool == NULL)
+    return NULL;
+  g_mutex_init (&workers->lock);
+  return g_steal_pointer (&workers);
+}
+
+/* Queue enabling fs-verity on @path in @dirfd, which must stay open until
+ * _ostree_fsverity_workers_finish().
+ */
+gboolean
+_ostree_fsverity_workers_push (_OstreeFsverityWorkers *workers, int dirfd, const char *path,
+                               GError **error)
+{
+  FsverityJob *job = g_new0 (FsverityJob, 1);
+  job->dirfd = dirfd;
+  job->path = g_strdup (path);
+  if (!g_thread_pool_push (workers->pool, job, error))
+    {
+      g_free (job->path);
+      g_free (job);
+      return FALSE;
+    }
+  return TRUE;
+}
+
+/* Wait for all queued files and free @workers, returning the first error */
+gboolean
+_ostree_fsverity_workers_finish (_OstreeFsverityWorkers *workers, GError **error)
+{
+  g_thread_pool_free (workers->pool, FALSE, TRUE);
+  g_mutex_clear (&workers->lock);
+  g_autoptr (GError) local_error = g_steal_pointer (&workers->error);
+  g_free (workers);
+
+  if (local_error != NULL)
+    {
+      g_propagate_error (error, g_steal_pointer (&local_error));
+      return FALSE;
+    }
+  return TRUE;
+}
+
+/* Like _ostree_tmpf_fsverity(), but for an object which was just staged as
+ * @path in @dirfd by the current transaction; fs-verity is enabled in the
+ * background, and _ostree_repo_fsverity_wait() must be called before the
+ * staged objects are moved into place.
+ */
+gboolean
+_ostree_repo_fsverity_defer (OstreeRepo *self, int dirfd, const char *path, GError **error)
+{
+#ifdef HAVE_LINUX_FSVERITY_H
+  g_mutex_lock (&self->txn_lock);
+  _OstreeFeatureSupport fsverity_wanted = self->fs_verity_wanted;
+  _OstreeFeatureSupport fsverity_supported = self->fs_verity_supported;
+  g_mutex_unlock (&self->txn_lock);
+
+  switch (fsverity_wanted)
+    {
+    case _OSTREE_FEATURE_YES:
+      if (fsverity_supported == _OSTREE_FEATURE_NO)
+        return glnx_throw (error, "fsverity required but filesystem does not support it");
+      break;
+    case _OSTREE_FEATURE_MAYBE:
+      /* Don't queue any more objects once we know it's not supported */
+      if (fsverity_supported == _OSTREE_FEATURE_NO)
+        return TRUE;
+      break;
+    case _OSTREE_FEATURE_NO:
+      return TRUE;
+    }
+
+  g_mutex_lock (&self->txn_lock);
+  if (self->fsverity_workers == NULL)
+    self->fsverity_workers = _ostree_fsverity_workers_new (self, error);
+  _OstreeFsverityWorkers *workers = self->fsverity_workers;
+  g_mutex_unlock (&self->txn_lock);
+  if (workers == NULL)
+    return FALSE;
+
+  return _ostree_fsverity_workers_push (workers, dirfd, path, error);
+#else
+  g_assert_cmpint (self->fs_verity_wanted, !=, _OSTREE_FEATURE_YES);
+  return TRUE;
+#endif
+}
+
+/* Wait for the objects queued by _ostree_repo_fsverity_defer() */
+gboolean
+_ostree_repo_fsverity_wait (OstreeRepo *self, GError **error)
+{
+  g_mutex_lock (&self->txn_lock);
+  _OstreeFsverityWorkers *workers = g_steal_pointer (&self->fsverity_workers);
+  g_mutex_unlock (&self->txn_lock);
+
+  if (workers == NULL)
+    return TRUE;
+  return _ostree_fsverity_workers_finish (workers, error);
+}
@@ -416,6 +416,7 @@ pop_repo_lock (OstreeRepo *self, OstreeRepoLockType lock_type, gboolean blocking
       g_debug ("Unlocking repo");
       if (!do_repo_unlock (self->lock.fd, flags))
         return glnx_throw_errno_prefix (error, "Unlocking repo failed");
+      _ostree_repo_object_index_invalidate (self);
     }
   else if (info.state == next_state)
     {
@@ -1145,12 +1146,14 @@ ostree_repo_finalize (GObject *object)
   g_clear_object (&self->repodir_fdrel);
   g_clear_object (&self->repodir);
   glnx_close_fd (&self->repo_dir_fd);
+  (void)_ostree_repo_fsverity_wait (self, NULL);
   glnx_tmpdir_unset (&self->commit_stagedir);
   glnx_release_lock_file (&self->commit_stagedir_lock);
   glnx_close_fd (&self->tmp_dir_fd);
   glnx_close_fd (&self->cache_dir_fd);
   glnx_close_fd (&self->objects_dir_fd);
   glnx_close_fd (&self->uncompressed_objects_dir_fd);
+  glnx_close_fd (&self->link_anchors_dir_fd);
   g_clear_object (&self->sysroot_dir);
   g_weak_ref_clear (&self->sysroot);
   g_free (self->remotes_config_dir);
@@ -1159,13 +1162,18 @@ ostree_repo_finalize (GObject *object)
     g_hash_table_destroy (self->loose_object_devino_hash);
   if (self->updated_uncompressed_dirs)
     g_hash_table_destroy (self->updated_uncompressed_dirs);
+  g_clear_pointer (&self->uncompressed_cache_pending, g_hash_table_unref);
   if (self->config)
     g_key_file_free (self->config);
   g_clear_pointer (&self->txn.refs, g_hash_table_destroy);
   g_clear_pointer (&self->txn.collection_refs, g_hash_table_destroy);
   g_clear_error (&self->writable_error);
   g_clear_pointer (&self->object_sizes, g_hash_table_unref);
-  g_clear_pointer (&self->dirmeta_cache, g_hash_table_unref);
+#ifdef HAVE_COMPOSEFS
+  g_clear_pointer (&self->composefs_dir_cache, _ostree_composefs_dir_cache_free);
+#endif
+  g_clear_pointer (&self->packed_refs, _ostree_packed_refs_unref);
+  g_clear_pointer (&self->object_index, _ostree_object_index_free);
   g_mutex_clear (&self->cache_lock);
   g_mutex_clear (&self->txn_lock);
   g_free (self->collection_id);
@@ -1305,6 +1313,7 @@ ostree_repo_init (OstreeRepo *self)
   const GDebugKey test_error_keys[] = {
     { "pre-commit", OSTREE_REPO_TEST_ERROR_PRE_COMMIT },
     { "invalid-cache", OSTREE_REPO_TEST_ERROR_INVALID_CACHE },
+    { "emlink", OSTREE_REPO_TEST_ERROR_EMLINK },
   };
 
 #ifndef OSTREE_DISABLE_GPGME
@@ -1322,6 +1331,7 @@ ostree_repo_init (OstreeRepo *self)
                                                  test_error_keys, G_N_ELEMENTS (test_error_keys));
 
   g_mutex_init (&self->lock.mutex);
+  self->object_index = _ostree_object_index_new ();
   g_mutex_init (&self->cache_lock);
   g_mutex_init (&self->txn_lock);
 
@@ -1336,6 +1346,7 @@ ostree_repo_init (OstreeRepo *self)
   self->tmp_dir_fd = -1;
   self->objects_dir_fd = -1;
   self->uncompressed_objects_dir_fd = -1;
+  self->link_anchors_dir_fd = -1;
   self->lock.fd = -1;
   self->sysroot_kind = OSTREE_REPO_SYSROOT_KIND_UNKNOWN;
 }
@@ -2941,8 +2952,7 @@ min_free_space_calculate_reserved_bytes (OstreeRepo *self, guint64 *bytes, GErro
 }
 
 static gboolean
-min_free_space_size_validate_and_convert (OstreeRepo *self, const char *min_free_space_size_str,
-                                          GError **error)
+size_mb_validate_and_convert (const char *size_str, guint64 *out_size_mb, GError **error)
 {
   static GRegex *regex;
   static gsize regex_initialized;
@@ -2954,10 +2964,10 @@ min_free_space_size_validate_and_convert (OstreeRepo *self, const char *min_free
     }
 
   g_autoptr (GMatchInfo) match = NULL;
-  if (!g_regex_match (regex, min_free_space_size_str, 0, &match))
+  if (!g_regex_match (regex, size_str, 0, &match))
     return glnx_throw (error, "It should be of the format '123MB', '123GB' or '123TB'");
 
-  g_autofree char *size_str = g_match_info_fetch (match, 1);
+  g_autofree char *number_str = g_match_info_fetch (match, 1);
   g_autofree char *unit = g_match_info_fetch (match, 2);
   guint shifts;
 
@@ -2976,11 +2986,11 @@ min_free_space_size_validate_and_convert (OstreeRepo *self, const char *min_free
       g_assert_not_reached ();
     }
 
-  guint64 min_free_space = g_ascii_strtoull (size_str, NULL, 10);
-  if (shifts > 0 && g_bit_nth_lsf (min_free_space, 63 - shifts) != -1)
+  guint64 size = g_ascii_strtoull (number_str, NULL, 10);
+  if (shifts > 0 && g_bit_nth_lsf (size, 63 - shifts) != -1)
     return glnx_throw (error, "Value was too high");
 
-  self->min_free_space_mb = min_free_space << shifts;
+  *out_size_mb = size << shifts;
 
   return TRUE;
 }
@@ -3035,6 +3045,19 @@ reload_core_config (OstreeRepo *self, GCancellable *cancellable, GError **error)
       if (!ot_keyfile_get_boolean_with_default (self->config, "core", "enable-uncompressed-cache",
                                                 TRUE, &self->enable_uncompressed_cache, error))
         return FALSE;
+
+      g_autofree char *max_size_str = NULL;
+      if (!ot_keyfile_get_value_with_default (self->config, "core", "uncompressed-cache-max-size",
+                                              NULL, &max_size_str, error))
+        return FALSE;
+
+      guint64 max_size_mb = 0;
+      if (max_size_str && !size_mb_validate_and_convert (max_size_str, &max_size_mb, error))
+        return glnx_prefix_error (error, "Invalid uncompressed-cache-max-size '%s'", max_size_str);
+      if (max_size_mb > G_MAXUINT64 >> 20)
+        return glnx_throw (error, "Invalid uncompressed-cache-max-size '%s': Value was too high",
+                           max_size_str);
+      self->uncompressed_cache_max_size = max_size_mb << 20;
     }
   else
     self->enable_uncompressed_cache = FALSE;
@@ -3121,7 +3144,7 @@ reload_core_config (OstreeRepo *self, GCancellable *cancellable, GError **error)
           return FALSE;
 
         /* Validate the string and convert the size to MBs */
-        if (!min_free_space_size_validate_and_convert (self, min_free_space_size_str, error))
+        if (!size_mb_validate_and_convert (min_free_space_size_str, &self->min_free_space_mb, error))
           return glnx_prefix_error (error, "Invalid min-free-space-size '%s'",
                                     min_free_space_size_str);
       }
@@ -3209,6 +3232,20 @@ reload_core_config (OstreeRepo *self, GCancellable *cancellable, GError **error)
     self->payload_link_threshold = g_ascii_strtoull (payload_threshold, NULL, 10);
   }
 
+  if (!ot_keyfile_get_boolean_with_default (self->config, "core", "object-index", FALSE,
+                                            &self->enable_object_index, error))
+    return FALSE;
+
+  {
+    g_autofree char *prune_full_interval = NULL;
+
+    if (!ot_keyfile_get_value_with_default (self->config, "core", "prune-full-interval", "10",
+                                            &prune_full_interval, error))
+      return FALSE;
+
+    self->prune_full_interval = g_ascii_strtoull (prune_full_interval, NULL, 10);
+  }
+
   {
     g_auto (GStrv) configured_finders = NULL;
     g_autoptr (GError) local_error = NULL;
@@ -3350,6 +3387,10 @@ reload_sysroot_config (OstreeRepo *self, GCancellable *cancellable, GError **err
                                             &self->enable_bootprefix, error))
     return FALSE;
 
+  if (!ot_keyfile_get_boolean_with_default (self->config, "sysroot", "boot-prefetch", FALSE,
+                                            &self->enable_boot_prefetch, error))
+    return FALSE;
+
   return TRUE;
 }
 
@@ -3719,13 +3760,51 @@ ostree_repo_get_parent (OstreeRepo *self)
   return self->parent_repo;
 }
 
+typedef struct
+{
+  GVariant *dummy_value;
+  GHashTable *objects;
+  const char *commit_starting_with;
+} ListLooseObjectsData;
+
+static void
+list_loose_object (const char *checksum, OstreeObjectType objtype, gpointer user_data)
+{
+  ListLooseObjectsData *data = user_data;
+
+  if (!G_IN_SET (objtype, OSTREE_OBJECT_TYPE_FILE, OSTREE_OBJECT_TYPE_DIR_TREE,
+                 OSTREE_OBJECT_TYPE_DIR_META, OSTREE_OBJECT_TYPE_COMMIT,
+                 OSTREE_OBJECT_TYPE_PAYLOAD_LINK))
+    return;
+
+  /* if we passed in a "starting with" argument, then
+     we only want to return .commit objects with a checksum
+     that matches the commit_starting_with argument */
+  if (data->commit_starting_with)
+    {
+      /* object is not a commit, do not add to array */
+      if (objtype != OSTREE_OBJECT_TYPE_COMMIT)
+        return;
+
+      /* commit checksum does not match "starting with", do not add to array */
+      if (!g_str_has_prefix (checksum, data->commit_starting_with))
+        return;
+    }
+
+  GVariant *key = ostree_object_name_serialize (checksum, objtype);
+
+  /* transfer ownership */
+  if (data->dummy_value)
+    g_hash_table_replace (data->objects, g_variant_ref_sink (key),
+                          g_variant_ref (data->dummy_value));
+  else
+    g_hash_table_add (data->objects, g_variant_ref_sink (key));
+}
+
 static gboolean
-list_loose_objects_at (OstreeRepo *self, GVariant *dummy_value, GHashTable *inout_objects, int dfd,
-                       const char *prefix, const char *commit_starting_with,
+list_loose_objects_at (OstreeRepo *self, ListLooseObjectsData *data, int dfd, const char *prefix,
                        GCancellable *cancellable, GError **error)
 {
-  GVariant *key;
-
   g_auto (GLnxDirFdIterator) dfd_iter = {
     0,
   };
@@ -3777,27 +3856,7 @@ list_loose_objects_at (OstreeRepo *self, GVariant *dummy_value, GHashTable *inou
       memcpy (buf + 2, name, 62);
       buf[sizeof (buf) - 1] = '\0';
 
-      /* if we passed in a "starting with" argument, then
-         we only want to return .commit objects with a checksum
-         that matches the commit_starting_with argument */
-      if (commit_starting_with)
-        {
-          /* object is not a commit, do not add to array */
-          if (objtype != OSTREE_OBJECT_TYPE_COMMIT)
-            continue;
-
-          /* commit checksum does not match "starting with", do not add to array */
-          if (!g_str_has_prefix (buf, commit_starting_with))
-            continue;
-        }
-
-      key = ostree_object_name_serialize (buf, objtype);
-
-      /* transfer ownership */
-      if (dummy_value)
-        g_hash_table_replace (inout_objects, g_variant_ref_sink (key), g_variant_ref (dummy_value));
-      else
-        g_hash_table_add (inout_objects, g_variant_ref_sink (key));
+      list_loose_object (buf, objtype, data);
     }
 
   return TRUE;
@@ -3808,21 +3867,316 @@ list_loose_objects (OstreeRepo *self, GVariant *dummy_value, GHashTable *inout_o
                     const char *commit_starting_with, GCancellable *cancellable, GError **error)
 {
   static const gchar hexchars[] = "0123456789abcdef";
+  ListLooseObjectsData data = { dummy_value, inout_objects, commit_starting_with };
 
   for (guint c = 0; c < 256; c++)
     {
+      /* Skip reading the directory if the object index covers it */
+      if (_ostree_repo_object_index_foreach_prefix (self, c, list_loose_object, &data))
+        continue;
+
       char buf[3];
       buf[0] = hexchars[c >> 4];
       buf[1] = hexchars[c & 0xF];
       buf[2] = '\0';
-      if (!list_loose_objects_at (self, dummy_value, inout_objects, self->objects_dir_fd, buf,
-                                  commit_starting_with, cancellable, error))
+      if (!list_loose_objects_at (self, &data, self->objects_dir_fd, buf, cancellable, error))
         return FALSE;
     }
 
   return TRUE;
 }
 
+/* Process-wide LRU cache of parsed commit, dirtree and dirmeta objects,
+ * enabled with ostree_repo_set_metadata_cache_max_size().  Entries are keyed
+ * by the device and inode of the repository as well as the object, since
+ * load_metadata_internal() also tells callers whether a repository has an
+ * object.  Objects only go in once they're out of the staging directory, and
+ * ostree_repo_delete_object() drops them again.
+ *
+ * While an OstreeRepoMemoryCacheRef is held, dirmeta objects are cached
+ * even if the cache wasn't enabled, up to METADATA_CACHE_SCOPED_MAX_SIZE,
+ * since checkouts look up the same few of them over and over.
+ */
+#define METADATA_CACHE_SCOPED_MAX_SIZE (16 * 1024 * 1024)
+
+typedef struct
+{
+  dev_t device;
+  ino_t inode;
+  OstreeObjectType objtype;
+  char checksum[OSTREE_SHA256_STRING_LEN + 1];
+  GVariant *variant;
+  guint64 size;
+  GList link; /* In metadata_cache_lru */
+} MetadataCacheEntry;
+
+static GMutex metadata_cache_lock;
+static GHashTable *metadata_cache;               /* MetadataCacheEntry set */
+static GQueue metadata_cache_lru = G_QUEUE_INIT; /* Most recently used first */
+static guint64 metadata_cache_max_size;
+static guint metadata_cache_scopes; /* Number of OstreeRepoMemoryCacheRef held */
+static guint64 metadata_cache_size;
+static guint64 metadata_cache_hits;
+static guint64 metadata_cache_misses;
+static guint64 metadata_cache_evictions;
+
+static guint
+metadata_cache_entry_hash (gconstpointer v)
+{
+  const MetadataCacheEntry *entry = v;
+  return g_str_hash (entry->checksum) ^ (guint)entry->objtype ^ (guint)entry->inode;
+}
+
+static gboolean
+metadata_cache_entry_equal (gconstpointer a, gconstpointer b)
+{
+  const MetadataCacheEntry *entry_a = a;
+  const MetadataCacheEntry *entry_b = b;
+  return entry_a->device == entry_b->device && entry_a->inode == entry_b->inode
+         && entry_a->objtype == entry_b->objtype
+         && strcmp (entry_a->checksum, entry_b->checksum) == 0;
+}
+
+static void
+metadata_cache_entry_free (MetadataCacheEntry *entry)
+{
+  g_variant_unref (entry->variant);
+  g_free (entry);
+}
+
+static gboolean
+metadata_cache_is_cachable (OstreeObjectType objtype)
+{
+  return objtype == OSTREE_OBJECT_TYPE_COMMIT || objtype == OSTREE_OBJECT_TYPE_DIR_TREE
+         || objtype == OSTREE_OBJECT_TYPE_DIR_META;
+}
+
+static void
+metadata_cache_init_key (MetadataCacheEntry *key, OstreeRepo *self, OstreeObjectType objtype,
+                         const char *sha256)
+{
+  key->device = self->device;
+  key->inode = self->inode;
+  key->objtype = objtype;
+  memcpy (key->checksum, sha256, OSTREE_SHA256_STRING_LEN + 1);
+}
+
+/* Must be called with metadata_cache_lock held */
+static guint64
+metadata_cache_get_max_size (void)
+{
+  if (metadata_cache_max_size > 0)
+    return metadata_cache_max_size;
+  return metadata_cache_scopes > 0 ? METADATA_CACHE_SCOPED_MAX_SIZE : 0;
+}
+
+/* Must be called with metadata_cache_lock held */
+static void
+metadata_cache_remove_entry (MetadataCacheEntry *entry)
+{
+  g_queue_unlink (&metadata_cache_lru, &entry->link);
+  metadata_cache_size -= entry->size;
+  g_hash_table_remove (metadata_cache, entry);
+}
+
+/* Must be called with metadata_cache_lock held */
+static void
+metadata_cache_shrink (guint64 max_size)
+{
+  while (metadata_cache_size > max_size)
+    {
+      GList *tail = metadata_cache_lru.tail;
+      g_assert (tail);
+      metadata_cache_remove_entry (tail->data);
+      metadata_cache_evictions++;
+    }
+}
+
+/* Create, shrink or free the cache for its current maximum size.  Must be
+ * called with metadata_cache_lock held.
+ */
+static void
+metadata_cache_resize (void)
+{
+  const guint64 max_size = metadata_cache_get_max_size ();
+  if (max_size == 0)
+    {
+      g_queue_init (&metadata_cache_lru);
+      metadata_cache_size = 0;
+      GHashTable *cache = metadata_cache;
+      g_atomic_pointer_set (&metadata_cache, NULL);
+      g_clear_pointer (&cache, g_hash_table_unref);
+    }
+  else
+    {
+      if (metadata_cache == NULL)
+        g_atomic_pointer_set (&metadata_cache,
+                              g_hash_table_new_full (metadata_cache_entry_hash,
+                                                     metadata_cache_entry_equal,
+                                                     (GDestroyNotify)metadata_cache_entry_free,
+                                                     NULL));
+      metadata_cache_shrink (max_size);
+    }
+}
+
+static GVariant *
+metadata_cache_lookup (OstreeRepo *self, OstreeObjectType objtype, const char *sha256)
+{
+  /* Avoid taking the lock if the cache is disabled */
+  if (g_atomic_pointer_get (&metadata_cache) == NULL)
+    return NULL;
+
+  MetadataCacheEntry key;
+  metadata_cache_init_key (&key, self, objtype, sha256);
+
+  g_autoptr (GMutexLocker) locker = g_mutex_locker_new (&metadata_cache_lock);
+  if (metadata_cache == NULL
+      || (metadata_cache_max_size == 0 && objtype != OSTREE_OBJECT_TYPE_DIR_META))
+    return NULL;
+
+  MetadataCacheEntry *entry = g_hash_table_lookup (metadata_cache, &key);
+  if (entry == NULL)
+    {
+      metadata_cache_misses++;
+      return NULL;
+    }
+
+  metadata_cache_hits++;
+  g_queue_unlink (&metadata_cache_lru, &entry->link);
+  g_queue_push_head_link (&metadata_cache_lru, &entry->link);
+  return g_variant_ref (entry->variant);
+}
+
+static void
+metadata_cache_insert (OstreeRepo *self, OstreeObjectType objtype, const char *sha256,
+                       GVariant *variant)
+{
+  if (g_atomic_pointer_get (&metadata_cache) == NULL)
+    return;
+
+  g_autoptr (GMutexLocker) locker = g_mutex_locker_new (&metadata_cache_lock);
+  if (metadata_cache == NULL)
+    return;
+  /* Only cache dirmeta objects for an OstreeRepoMemoryCacheRef */
+  if (metadata_cache_max_size == 0 && objtype != OSTREE_OBJECT_TYPE_DIR_META)
+    return;
+
+  const guint64 max_size = metadata_cache_get_max_size ();
+  g_autofree MetadataCacheEntry *entry = g_new0 (MetadataCacheEntry, 1);
+  metadata_cache_init_key (entry, self, objtype, sha256);
+  entry->size = g_variant_get_size (variant) + sizeof (MetadataCacheEntry);
+  if (entry->size > max_size || g_hash_table_contains (metadata_cache, entry))
+    return;
+
+  metadata_cache_shrink (max_size - entry->size);
+
+  entry->variant = g_variant_ref (variant);
+  entry->link.data = entry;
+  g_queue_push_head_link (&metadata_cache_lru, &entry->link);
+  metadata_cache_size += entry->size;
+  g_hash_table_add (metadata_cache, g_steal_pointer (&entry));
+}
+
+static void
+metadata_cache_invalidate (OstreeRepo *self, OstreeObjectType objtype, const char *sha256)
+{
+  if (g_atomic_pointer_get (&metadata_cache) == NULL)
+    return;
+
+  MetadataCacheEntry key;
+  metadata_cache_init_key (&key, self, objtype, sha256);
+
+  g_autoptr (GMutexLocker) locker = g_mutex_locker_new (&metadata_cache_lock);
+  if (metadata_cache == NULL)
+    return;
+
+  MetadataCacheEntry *entry = g_hash_table_lookup (metadata_cache, &key);
+  if (entry)
+    metadata_cache_remove_entry (entry);
+}
+
+/**
+ * ostree_repo_set_metadata_cache_max_size:
+ * @max_size: Maximum size of the cache in bytes, or 0 to disable it
+ *
+ * Enable a process-wide cache of parsed commit, dirtree and dirmeta objects,
+ * shared between all #OstreeRepo instances, which holds at most @max_size
+ * bytes of metadata and evicts the least recently used objects first.  This
+ * is useful for long-running processes which repeatedly walk the same
+ * trees.
+ *
+ * The cache is disabled by default.  Objects deleted by another process may
+ * still be returned from the cache.
+ *
+ * Since: 2024.11
+ */
+void
+ostree_repo_set_metadata_cache_max_size (guint64 max_size)
+{
+  g_autoptr (GMutexLocker) locker = g_mutex_locker_new (&metadata_cache_lock);
+
+  metadata_cache_max_size = max_size;
+  metadata_cache_resize ();
+}
+
+/**
+ * ostree_repo_get_metadata_cache_stats:
+ *
+ * Get statistics about the cache enabled with
+ * ostree_repo_set_metadata_cache_max_size(), as a dictionary with these
+ * keys, all of type `t`:
+ *
+ *   - hits: Number of objects loaded from the cache
+ *   - misses: Number of objects which had to be loaded from disk
+ *   - evictions: Number of objects evicted from the cache
+ *   - size: Current size of the cache in bytes
+ *   - max-size: Maximum size of the cache in bytes
+ *
+ * Returns: (transfer full): A #GVariant of type `a{sv}`
+ * Since: 2024.11
+ */
+GVariant *
+ostree_repo_get_metadata_cache_stats (void)
+{
+  g_auto (GVariantDict) dict;
+  g_variant_dict_init (&dict, NULL);
+
+  g_mutex_lock (&metadata_cache_lock);
+  g_variant_dict_insert (&dict, "hits", "t", metadata_cache_hits);
+  g_variant_dict_insert (&dict, "misses", "t", metadata_cache_misses);
+  g_variant_dict_insert (&dict, "evictions", "t", metadata_cache_evictions);
+  g_variant_dict_insert (&dict, "size", "t", metadata_cache_size);
+  g_variant_dict_insert (&dict, "max-size", "t", metadata_cache_max_size);
+  g_mutex_unlock (&metadata_cache_lock);
+
+  return g_variant_ref_sink (g_variant_dict_end (&dict));
+}
+
+/* Set @out_state according to the commitpartial marker of commit @sha256 */
+static gboolean
+load_commit_state (OstreeRepo *self, const char *sha256, OstreeRepoCommitState *out_state,
+                   GError **error)
+{
+  g_autofree char *commitpartial_path = _ostree_get_commitpartial_path (sha256);
+  *out_state = 0;
+
+  glnx_autofd int commitpartial_fd = -1;
+  if (!ot_openat_ignore_enoent (self->repo_dir_fd, commitpartial_path, &commitpartial_fd, error))
+    return FALSE;
+  if (commitpartial_fd != -1)
+    {
+      *out_state |= OSTREE_REPO_COMMIT_STATE_PARTIAL;
+      char reason;
+      if (read (commitpartial_fd, &reason, 1) == 1)
+        {
+          if (reason == 'f')
+            *out_state |= OSTREE_REPO_COMMIT_STATE_FSCK_PARTIAL;
+        }
+    }
+
+  return TRUE;
+}
+
 static gboolean
 load_metadata_internal (OstreeRepo *self, OstreeObjectType objtype, const char *sha256,
                         gboolean error_if_not_found, GVariant **out_variant,
@@ -3841,24 +4195,19 @@ load_metadata_internal (OstreeRepo *self, OstreeObjectType objtype, const char *
   if (out_variant)
     *out_variant = NULL;
 
-  /* Special caching for dirmeta objects, since they're commonly referenced many
-   * times.
-   */
-  const gboolean is_dirmeta_cachable
-      = (objtype == OSTREE_OBJECT_TYPE_DIR_META && out_variant && !out_stream);
-  if (is_dirmeta_cachable)
-    {
-      GMutex *lock = &self->cache_lock;
-      g_mutex_lock (lock);
-      GVariant *cache_hit = NULL;
-      /* Look it up, if we have a cache */
-      if (self->dirmeta_cache)
-        cache_hit = g_hash_table_lookup (self->dirmeta_cache, sha256);
-      if (cache_hit)
-        *out_variant = g_variant_ref (cache_hit);
-      g_mutex_unlock (lock);
+  /* Use the process-wide cache, if enabled */
+  const gboolean is_metadata_cachable
+      = (metadata_cache_is_cachable (objtype) && out_variant && !out_stream && !out_size);
+  if (is_metadata_cachable)
+    {
+      g_autoptr (GVariant) cache_hit = metadata_cache_lookup (self, objtype, sha256);
       if (cache_hit)
-        return TRUE;
+        {
+          if (out_state && !load_commit_state (self, sha256, out_state, error))
+            return FALSE;
+          *out_variant = g_steal_pointer (&cache_hit);
+          return TRUE;
+        }
     }
 
   _ostree_loose_path (loose_path_buf, sha256, objtype, self->mode);
@@ -3866,10 +4215,12 @@ load_metadata_internal (OstreeRepo *self, OstreeObjectType objtype, const char *
   if (!ot_openat_ignore_enoent (self->objects_dir_fd, loose_path_buf, &fd, error))
     return FALSE;
 
+  gboolean is_staged = FALSE;
   if (fd < 0 && self->commit_stagedir.initialized)
     {
       if (!ot_openat_ignore_enoent (self->commit_stagedir.fd, loose_path_buf, &fd, error))
         return FALSE;
+      is_staged = (fd != -1);
     }
 
   if (fd != -1)
@@ -3883,16 +4234,9 @@ load_metadata_internal (OstreeRepo *self, OstreeObjectType objtype, const char *
                                    &ret_variant, error))
             return FALSE;
 
-          /* Now, let's put it in the cache */
-          if (is_dirmeta_cachable)
-            {
-              GMutex *lock = &self->cache_lock;
-              g_mutex_lock (lock);
-              if (self->dirmeta_cache)
-                g_hash_table_replace (self->dirmeta_cache, g_strdup (sha256),
-                                      g_variant_ref (ret_variant));
-              g_mutex_unlock (lock);
-            }
+          /* Staged objects may yet go away if the transaction is aborted */
+          if (is_metadata_cachable && !is_staged)
+            metadata_cache_insert (self, objtype, sha256, ret_variant);
         }
       else if (out_stream)
         {
@@ -3905,26 +4249,8 @@ load_metadata_internal (OstreeRepo *self, OstreeObjectType objtype, const char *
       if (out_size)
         *out_size = stbuf.st_size;
 
-      if (out_state)
-        {
-          g_autofree char *commitpartial_path = _ostree_get_commitpartial_path (sha256);
-          *out_state = 0;
-
-          glnx_autofd int commitpartial_fd = -1;
-          if (!ot_openat_ignore_enoent (self->repo_dir_fd, commitpartial_path, &commitpartial_fd,
-                                        error))
-            return FALSE;
-          if (commitpartial_fd != -1)
-            {
-              *out_state |= OSTREE_REPO_COMMIT_STATE_PARTIAL;
-              char reason;
-              if (read (commitpartial_fd, &reason, 1) == 1)
-                {
-                  if (reason == 'f')
-                    *out_state |= OSTREE_REPO_COMMIT_STATE_FSCK_PARTIAL;
-                }
-            }
-        }
+      if (out_state && !load_commit_state (self, sha256, out_state, error))
+        return FALSE;
     }
   else if (self->parent_repo)
     {
@@ -4289,6 +4615,15 @@ gboolean
 _ostree_repo_has_loose_object (OstreeRepo *self, const char *checksum, OstreeObjectType objtype,
                                gboolean *out_is_stored, GCancellable *cancellable, GError **error)
 {
+  /* Objects which made it out of the staging directory don't need a stat() */
+  const _OstreeObjectIndexResult indexed
+      = _ostree_repo_object_index_lookup (self, checksum, objtype, NULL);
+  if (indexed == _OSTREE_OBJECT_INDEX_PRESENT)
+    {
+      *out_is_stored = TRUE;
+      return TRUE;
+    }
+
   char loose_path_buf[_OSTREE_LOOSE_PATH_MAX];
   _ostree_loose_path (loose_path_buf, checksum, objtype, self->mode);
 
@@ -4297,6 +4632,8 @@ _ostree_repo_has_loose_object (OstreeRepo *self, const char *checksum, OstreeObj
   int dfd_searches[] = { -1, self->objects_dir_fd };
   if (self->commit_stagedir.initialized)
     dfd_searches[0] = self->commit_stagedir.fd;
+  if (indexed == _OSTREE_OBJECT_INDEX_ABSENT)
+    dfd_searches[1] = -1;
   for (guint i = 0; i < G_N_ELEMENTS (dfd_searches); i++)
     {
       int dfd = dfd_searches[i];
@@ -4386,11 +4723,15 @@ ostree_repo_delete_object (OstreeRepo *self, OstreeObjectType objtype, const cha
 
       if (!ot_ensure_unlinked_at (self->objects_dir_fd, meta_loose, error))
         return FALSE;
+      _ostree_repo_object_index_note_removed (self, self->objects_dir_fd, sha256,
+                                              OSTREE_OBJECT_TYPE_COMMIT_META);
     }
 
   if (!glnx_unlinkat (self->objects_dir_fd, loose_path, 0, error))
     return glnx_prefix_error (error, "Deleting object %s.%s", sha256,
                               ostree_object_type_to_string (objtype));
+  _ostree_repo_object_index_note_removed (self, self->objects_dir_fd, sha256, objtype);
+  metadata_cache_invalidate (self, objtype, sha256);
 
   /* If the repository is configured to use tombstone commits, create one when deleting a commit.
    */
@@ -4557,13 +4898,25 @@ ostree_repo_query_object_storage_size (OstreeRepo *self, OstreeObjectType objtyp
                                        const char *sha256, guint64 *out_size,
                                        GCancellable *cancellable, GError **error)
 {
+  const _OstreeObjectIndexResult indexed
+      = _ostree_repo_object_index_lookup (self, sha256, objtype, out_size);
+  /* Note early return */
+  if (indexed == _OSTREE_OBJECT_INDEX_PRESENT)
+    return TRUE;
+
   char loose_path[_OSTREE_LOOSE_PATH_MAX];
   _ostree_loose_path (loose_path, sha256, objtype, self->mode);
   int res;
 
   struct stat stbuf;
-  res = TEMP_FAILURE_RETRY (
-      fstatat (self->objects_dir_fd, loose_path, &stbuf, AT_SYMLINK_NOFOLLOW));
+  if (indexed == _OSTREE_OBJECT_INDEX_ABSENT)
+    {
+      res = -1;
+      errno = ENOENT;
+    }
+  else
+    res = TEMP_FAILURE_RETRY (
+        fstatat (self->objects_dir_fd, loose_path, &stbuf, AT_SYMLINK_NOFOLLOW));
   if (res < 0 && errno == ENOENT && self->commit_stagedir.initialized)
     res = TEMP_FAILURE_RETRY (
         fstatat (self->commit_stagedir.fd, loose_path, &stbuf, AT_SYMLINK_NOFOLLOW));
@@ -6400,27 +6753,21 @@ void
 _ostree_repo_memory_cache_ref_init (OstreeRepoMemoryCacheRef *state, OstreeRepo *repo)
 {
   state->repo = g_object_ref (repo);
-  GMutex *lock = &repo->cache_lock;
-  g_mutex_lock (lock);
-  repo->dirmeta_cache_refcount++;
-  if (repo->dirmeta_cache == NULL)
-    repo->dirmeta_cache
-        = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, (GDestroyNotify)g_variant_unref);
-  g_mutex_unlock (lock);
+  g_autoptr (GMutexLocker) locker = g_mutex_locker_new (&metadata_cache_lock);
+  metadata_cache_scopes++;
+  metadata_cache_resize ();
 }
 
 /* See ostree-repo-private.h for more information about this */
 void
 _ostree_repo_memory_cache_ref_destroy (OstreeRepoMemoryCacheRef *state)
 {
-  OstreeRepo *repo = state->repo;
-  GMutex *lock = &repo->cache_lock;
-  g_mutex_lock (lock);
-  repo->dirmeta_cache_refcount--;
-  if (repo->dirmeta_cache_refcount == 0)
-    g_clear_pointer (&repo->dirmeta_cache, g_hash_table_unref);
-  g_mutex_unlock (lock);
-  g_object_unref (repo);
+  g_mutex_lock (&metadata_cache_lock);
+  g_assert_cmpuint (metadata_cache_scopes, >, 0);
+  metadata_cache_scopes--;
+  metadata_cache_resize ();
+  g_mutex_unlock (&metadata_cache_lock);
+  g_clear_object (&state->repo);
 }
 
 /**
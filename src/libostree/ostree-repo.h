@@ -424,6 +424,9 @@ gboolean ostree_repo_list_refs_ext (OstreeRepo *self, const char *refspec_prefix
                                     GHashTable **out_all_refs, OstreeRepoListRefsExtFlags flags,
                                     GCancellable *cancellable, GError **error);
 
+_OSTREE_PUBLIC
+gboolean ostree_repo_pack_refs (OstreeRepo *self, GCancellable *cancellable, GError **error);
+
 _OSTREE_PUBLIC
 gboolean ostree_repo_remote_list_refs (OstreeRepo *self, const char *remote_name,
                                        GHashTable **out_all_refs, GCancellable *cancellable,
@@ -793,6 +796,17 @@ typedef OstreeRepoCheckoutFilterResult (*OstreeRepoCheckoutFilter) (OstreeRepo *
  * options.  This is used by ostree_repo_checkout_at() which
  * supercedes previous separate enumeration usage in
  * ostree_repo_checkout_tree() and ostree_repo_checkout_tree_at().
+ *
+ * If `n_threads` is greater than 1, files are checked out by that many
+ * worker threads while directories are created and finalized in order
+ * on the calling thread.  This is ignored when `filter` or `sepolicy`
+ * is set, or `process_whiteouts` is enabled.
+ *
+ * If `update_from` is set to a commit checksum, the destination must be an
+ * existing checkout of that commit (with the same `subpath`), which is
+ * updated in place by applying only the differences between the two
+ * commits; subtrees with identical contents are skipped without being
+ * traversed.  This can't be combined with `process_whiteouts`.
  */
 typedef struct
 {
@@ -814,8 +828,10 @@ typedef struct
 
   OstreeRepoDevInoCache *devino_to_csum_cache;
 
-  int unused_ints[6];
-  gpointer unused_ptrs[3];
+  int n_threads; /* Since: 2024.11 */
+  int unused_ints[5];
+  const char *update_from; /* Since: 2024.11 */
+  gpointer unused_ptrs[2];
   OstreeRepoCheckoutFilter filter; /* Since: 2018.2 */
   gpointer filter_user_data;       /* Since: 2018.2 */
   OstreeSePolicy *sepolicy;        /* Since: 2017.6 */
@@ -840,6 +856,12 @@ gboolean ostree_repo_checkout_at (OstreeRepo *self, OstreeRepoCheckoutAtOptions
                                   int destination_dfd, const char *destination_path,
                                   const char *commit, GCancellable *cancellable, GError **error);
 
+_OSTREE_PUBLIC
+gboolean ostree_repo_checkout_layers_at (OstreeRepo *self, OstreeRepoCheckoutAtOptions *options,
+                                         int destination_dfd, const char *destination_path,
+                                         const char *const *commits, const char *const *subpaths,
+                                         GCancellable *cancellable, GError **error);
+
 _OSTREE_PUBLIC
 gboolean ostree_repo_checkout_composefs (OstreeRepo *self, GVariant *options, int destination_dfd,
                                          const char *destination_path, const char *checksum,
@@ -848,6 +870,18 @@ gboolean ostree_repo_checkout_composefs (OstreeRepo *self, GVariant *options, in
 _OSTREE_PUBLIC
 gboolean ostree_repo_checkout_gc (OstreeRepo *self, GCancellable *cancellable, GError **error);
 
+_OSTREE_PUBLIC
+GVariant *ostree_repo_get_uncompressed_cache_stats (OstreeRepo *self);
+
+_OSTREE_PUBLIC
+GVariant *ostree_repo_get_checkout_stats (OstreeRepo *self);
+
+_OSTREE_PUBLIC
+void ostree_repo_set_metadata_cache_max_size (guint64 max_size);
+
+_OSTREE_PUBLIC
+GVariant *ostree_repo_get_metadata_cache_stats (void);
+
 _OSTREE_PUBLIC
 gboolean ostree_repo_read_commit (OstreeRepo *self, const char *ref, GFile **out_root,
                                   char **out_commit, GCancellable *cancellable, GError **error);
@@ -946,6 +980,12 @@ ostree_repo_static_delta_execute_offline_with_signature (OstreeRepo *self, GFile
                                                          OstreeSign *sign, gboolean skip_validation,
                                                          GCancellable *cancellable, GError **error);
 
+_OSTREE_PUBLIC
+gboolean
+ostree_repo_static_delta_execute_offline_with_options (OstreeRepo *self, GFile *dir_or_file,
+                                                       OstreeSign *sign, GVariant *options,
+                                                       GCancellable *cancellable, GError **error);
+
 _OSTREE_PUBLIC
 gboolean ostree_repo_static_delta_execute_offline (OstreeRepo *self, GFile *dir_or_file,
                                                    gboolean skip_validation,
@@ -990,6 +1030,56 @@ gboolean ostree_repo_traverse_commit_with_flags (OstreeRepo *repo,
                                                  GHashTable *inout_parents,
                                                  GCancellable *cancellable, GError **error);
 
+_OSTREE_PUBLIC
+gboolean ostree_repo_traverse_commits_with_flags (OstreeRepo *repo,
+                                                  OstreeRepoCommitTraverseFlags flags,
+                                                  const char *const *commit_checksums,
+                                                  int maxdepth, GHashTable *inout_reachable,
+                                                  GHashTable *inout_parents,
+                                                  GCancellable *cancellable, GError **error);
+
+_OSTREE_PUBLIC
+GType ostree_repo_reachable_set_get_type (void);
+_OSTREE_PUBLIC
+OstreeRepoReachableSet *ostree_repo_reachable_set_new (void);
+_OSTREE_PUBLIC
+OstreeRepoReachableSet *ostree_repo_reachable_set_ref (OstreeRepoReachableSet *set);
+_OSTREE_PUBLIC
+void ostree_repo_reachable_set_unref (OstreeRepoReachableSet *set);
+
+_OSTREE_PUBLIC
+gboolean ostree_repo_reachable_set_add (OstreeRepoReachableSet *set, const char *checksum,
+                                        OstreeObjectType objtype);
+
+_OSTREE_PUBLIC
+gboolean ostree_repo_reachable_set_contains (OstreeRepoReachableSet *set, const char *checksum,
+                                             OstreeObjectType objtype);
+
+_OSTREE_PUBLIC
+guint ostree_repo_reachable_set_get_size (OstreeRepoReachableSet *set);
+
+/**
+ * OstreeRepoReachableSetFunc:
+ * @checksum: ASCII SHA256 checksum
+ * @objtype: Object type
+ * @user_data: User data
+ *
+ * Since: 2024.11
+ */
+typedef void (*OstreeRepoReachableSetFunc) (const char *checksum, OstreeObjectType objtype,
+                                            gpointer user_data);
+
+_OSTREE_PUBLIC
+void ostree_repo_reachable_set_foreach (OstreeRepoReachableSet *set,
+                                        OstreeRepoReachableSetFunc func, gpointer user_data);
+
+_OSTREE_PUBLIC
+gboolean ostree_repo_traverse_commits_to_set (OstreeRepo *repo,
+                                              OstreeRepoCommitTraverseFlags flags,
+                                              const char *const *commit_checksums, int maxdepth,
+                                              OstreeRepoReachableSet *inout_reachable,
+                                              GCancellable *cancellable, GError **error);
+
 struct _OstreeRepoCommitTraverseIter
 {
   gboolean initialized;
@@ -1050,6 +1140,8 @@ void ostree_repo_commit_traverse_iter_cleanup (void *p);
  * @OSTREE_REPO_PRUNE_FLAGS_REFS_ONLY: Do not traverse individual commit objects, only follow refs
  * for reachability calculations
  * @OSTREE_REPO_PRUNE_FLAGS_COMMIT_ONLY: Only traverse commit objects.  (Since 2022.2)
+ * @OSTREE_REPO_PRUNE_FLAGS_INCREMENTAL: Start from the objects found reachable by the last
+ * incremental prune, see ostree_repo_prune().  (Since 2024.11)
  */
 typedef enum
 {
@@ -1057,6 +1149,7 @@ typedef enum
   OSTREE_REPO_PRUNE_FLAGS_NO_PRUNE = (1 << 0),
   OSTREE_REPO_PRUNE_FLAGS_REFS_ONLY = (1 << 1),
   OSTREE_REPO_PRUNE_FLAGS_COMMIT_ONLY = (1 << 2),
+  OSTREE_REPO_PRUNE_FLAGS_INCREMENTAL = (1 << 3),
 } OstreeRepoPruneFlags;
 
 _OSTREE_PUBLIC
@@ -1079,7 +1172,9 @@ struct _OstreeRepoPruneOptions
 
   gboolean unused_bools[6];
   int unused_ints[6];
-  gpointer unused_ptrs[7];
+  OstreeRepoReachableSet *reachable_set; /* Since: 2024.11 */
+  OstreeAsyncProgress *progress;         /* Since: 2024.11 */
+  gpointer unused_ptrs[5];
 };
 
 typedef struct _OstreeRepoPruneOptions OstreeRepoPruneOptions;
@@ -1088,6 +1183,11 @@ _OSTREE_PUBLIC
 gboolean ostree_repo_traverse_reachable_refs (OstreeRepo *self, guint depth, GHashTable *reachable,
                                               GCancellable *cancellable, GError **error);
 
+_OSTREE_PUBLIC
+gboolean ostree_repo_traverse_reachable_refs_to_set (OstreeRepo *self, guint depth,
+                                                     OstreeRepoReachableSet *reachable,
+                                                     GCancellable *cancellable, GError **error);
+
 _OSTREE_PUBLIC
 gboolean ostree_repo_prune_from_reachable (OstreeRepo *self, OstreeRepoPruneOptions *options,
                                            gint *out_objects_total, gint *out_objects_pruned,
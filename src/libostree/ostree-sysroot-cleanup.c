@@ -449,7 +449,8 @@ generate_deployment_refs (OstreeSysroot *self, OstreeRepo *repo, int bootversion
  * Prune the system repository.  This is a thin wrapper
  * around ostree_repo_prune_from_reachable(); the primary
  * addition is that this function automatically gathers
- * all deployed commits into the reachable set.
+ * all deployed commits into the reachable set, which is the
+ * `reachable_set` member of @options if set, and `reachable` otherwise.
  *
  * You generally want to at least set the `OSTREE_REPO_PRUNE_FLAGS_REFS_ONLY`
  * flag in @options.  A commit traversal depth of `0` is assumed.
@@ -482,7 +483,14 @@ ostree_sysroot_cleanup_prune_repo (OstreeSysroot *sysroot, OstreeRepoPruneOption
    * what we've always done for the system repo, but perhaps down
    * the line we could add a depth flag to the repo config or something?
    */
-  if (!ostree_repo_traverse_reachable_refs (repo, depth, options->reachable, cancellable, error))
+  if (options->reachable_set)
+    {
+      if (!ostree_repo_traverse_reachable_refs_to_set (repo, depth, options->reachable_set,
+                                                       cancellable, error))
+        return FALSE;
+    }
+  else if (!ostree_repo_traverse_reachable_refs (repo, depth, options->reachable, cancellable,
+                                                 error))
     return FALSE;
 
   /* Since ostree was created we've been generating "deployment refs" in
@@ -495,8 +503,16 @@ ostree_sysroot_cleanup_prune_repo (OstreeSysroot *sysroot, OstreeRepoPruneOption
   for (guint i = 0; i < sysroot->deployments->len; i++)
     {
       const char *checksum = ostree_deployment_get_csum (sysroot->deployments->pdata[i]);
-      if (!ostree_repo_traverse_commit_union (repo, checksum, depth, options->reachable,
-                                              cancellable, error))
+      if (options->reachable_set)
+        {
+          const char *commits[] = { checksum, NULL };
+          if (!ostree_repo_traverse_commits_to_set (repo, OSTREE_REPO_COMMIT_TRAVERSE_FLAG_NONE,
+                                                    commits, depth, options->reachable_set,
+                                                    cancellable, error))
+            return FALSE;
+        }
+      else if (!ostree_repo_traverse_commit_union (repo, checksum, depth, options->reachable,
+                                                   cancellable, error))
         return FALSE;
     }
 
@@ -606,6 +622,11 @@ ostree_sysroot_update_post_copy (OstreeSysroot *self, GCancellable *cancellable,
   if (objects == NULL)
     return FALSE;
 
+  /* This reads back every object, so spread it over worker threads */
+  _OstreeFsverityWorkers *workers = _ostree_fsverity_workers_new (repo, error);
+  if (workers == NULL)
+    return FALSE;
+  gboolean pushed = TRUE;
   GLNX_HASH_TABLE_FOREACH (objects, GVariant *, key)
     {
       const char *checksum;
@@ -616,14 +637,18 @@ ostree_sysroot_update_post_copy (OstreeSysroot *self, GCancellable *cancellable,
       char loose_path_buf[_OSTREE_LOOSE_PATH_MAX];
       _ostree_loose_path (loose_path_buf, checksum, objtype, repo->mode);
 
-      gboolean supported;
-      if (!_ostree_ensure_fsverity (repo, FALSE, repo->objects_dir_fd, loose_path_buf, &supported,
-                                    error))
-        return FALSE;
-
-      if (!supported)
-        break; /* If not supported, skip rest */
+      /* The workers skip the rest if fs-verity isn't supported */
+      pushed = _ostree_fsverity_workers_push (workers, repo->objects_dir_fd, loose_path_buf, error);
+      if (!pushed)
+        break;
+    }
+  if (!pushed)
+    {
+      (void)_ostree_fsverity_workers_finish (workers, NULL);
+      return FALSE;
     }
+  if (!_ostree_fsverity_workers_finish (workers, error))
+    return FALSE;
 
   g_autoptr (GPtrArray) all_deployment_dirs = NULL;
   if (!list_all_deployment_directories (self, &all_deployment_dirs, cancellable, error))
@@ -600,6 +600,192 @@ merge_configuration_from (OstreeSysroot *sysroot, OstreeDeployment *merge_deploy
   return TRUE;
 }
 
+/* Upper bound on the number of objects in a boot prefetch list */
+#define BOOT_PREFETCH_MAX_OBJECTS 16384
+
+/* Add the checksums of the files in @dirtree_checksum to @objects; only
+ * shared libraries if @libs_only, and recursing into subdirectories if
+ * @recurse.
+ */
+static gboolean
+collect_boot_prefetch_objects (OstreeRepo *repo, const char *dirtree_checksum, gboolean recurse,
+                               gboolean libs_only, GHashTable *objects, GCancellable *cancellable,
+                               GError **error)
+{
+  g_autoptr (GVariant) dirtree = NULL;
+  if (!ostree_repo_load_variant (repo, OSTREE_OBJECT_TYPE_DIR_TREE, dirtree_checksum, &dirtree,
+                                 error))
+    return FALSE;
+
+  g_autoptr (GVariant) files = g_variant_get_child_value (dirtree, 0);
+  const guint n_files = g_variant_n_children (files);
+  for (guint i = 0; i < n_files; i++)
+    {
+      const char *name;
+      g_autoptr (GVariant) csum_v = NULL;
+      g_variant_get_child (files, i, "(&s@ay)", &name, &csum_v);
+      if (libs_only && strstr (name, ".so") == NULL)
+        continue;
+      g_hash_table_add (objects, ostree_checksum_from_bytes_v (csum_v));
+    }
+
+  if (!recurse)
+    return TRUE;
+
+  g_autoptr (GVariant) dirs = g_variant_get_child_value (dirtree, 1);
+  const guint n_dirs = g_variant_n_children (dirs);
+  for (guint i = 0; i < n_dirs; i++)
+    {
+      g_autoptr (GVariant) tree_csum_v = NULL;
+      g_variant_get_child (dirs, i, "(&s@ay@ay)", NULL, &tree_csum_v, NULL);
+      char subdirtree_checksum[OSTREE_SHA256_STRING_LEN + 1];
+      _ostree_checksum_inplace_from_bytes_v (tree_csum_v, subdirtree_checksum);
+      if (!collect_boot_prefetch_objects (repo, subdirtree_checksum, recurse, libs_only, objects,
+                                          cancellable, error))
+        return FALSE;
+    }
+
+  return TRUE;
+}
+
+/* Find the dirtree of @path in the tree of @root_dirtree_checksum; sets
+ * @out_checksum to %NULL if it doesn't exist.
+ */
+static gboolean
+lookup_dirtree_path (OstreeRepo *repo, const char *root_dirtree_checksum, const char *path,
+                     char **out_checksum, GError **error)
+{
+  g_autofree char *checksum = g_strdup (root_dirtree_checksum);
+  g_auto (GStrv) components = g_strsplit (path, "/", -1);
+  for (char **iter = components; *iter && checksum; iter++)
+    {
+      g_autoptr (GVariant) dirtree = NULL;
+      if (!ostree_repo_load_variant (repo, OSTREE_OBJECT_TYPE_DIR_TREE, checksum, &dirtree, error))
+        return FALSE;
+      g_clear_pointer (&checksum, g_free);
+
+      g_autoptr (GVariant) dirs = g_variant_get_child_value (dirtree, 1);
+      const guint n_dirs = g_variant_n_children (dirs);
+      for (guint i = 0; i < n_dirs; i++)
+        {
+          const char *name;
+          g_autoptr (GVariant) tree_csum_v = NULL;
+          g_variant_get_child (dirs, i, "(&s@ay@ay)", &name, &tree_csum_v, NULL);
+          if (g_str_equal (name, *iter))
+            {
+              checksum = ostree_checksum_from_bytes_v (tree_csum_v);
+              break;
+            }
+        }
+    }
+
+  *out_checksum = g_steal_pointer (&checksum);
+  return TRUE;
+}
+
+typedef struct
+{
+  ino_t ino;
+  char *path;
+} BootPrefetchEntry;
+
+static int
+compare_boot_prefetch_entries (gconstpointer a, gconstpointer b)
+{
+  const BootPrefetchEntry *entry_a = a;
+  const BootPrefetchEntry *entry_b = b;
+  if (entry_a->ino < entry_b->ino)
+    return -1;
+  return entry_a->ino > entry_b->ino;
+}
+
+static void
+boot_prefetch_entry_clear (gpointer data)
+{
+  BootPrefetchEntry *entry = data;
+  g_free (entry->path);
+}
+
+/* Write OSTREE_BOOT_PREFETCH_NAME into the deployment, listing the objects
+ * of @revision likely to be read early in boot, which ostree-prepare-root
+ * reads ahead.  The list is ordered by inode number, which approximates the
+ * on-disk layout.
+ */
+static gboolean
+write_boot_prefetch_list (OstreeRepo *repo, const char *revision, int deployment_dfd,
+                          GCancellable *cancellable, GError **error)
+{
+  GLNX_AUTO_PREFIX_ERROR ("Writing boot prefetch list", error);
+  static const struct
+  {
+    const char *path;
+    gboolean recurse;
+    gboolean libs_only;
+  } prefetch_dirs[] = {
+    { "usr/lib/systemd", TRUE, FALSE },
+    { "usr/lib64", FALSE, TRUE },
+    { "usr/lib", FALSE, TRUE },
+  };
+
+  g_autoptr (GVariant) commit = NULL;
+  if (!ostree_repo_load_commit (repo, revision, &commit, NULL, error))
+    return FALSE;
+  g_autoptr (GVariant) root_csum_v = g_variant_get_child_value (commit, 6);
+  g_autofree char *root_checksum = ostree_checksum_from_bytes_v (root_csum_v);
+
+  g_autoptr (GHashTable) objects = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  for (guint i = 0; i < G_N_ELEMENTS (prefetch_dirs); i++)
+    {
+      g_autofree char *dirtree_checksum = NULL;
+      if (!lookup_dirtree_path (repo, root_checksum, prefetch_dirs[i].path, &dirtree_checksum,
+                                error))
+        return FALSE;
+      if (dirtree_checksum == NULL)
+        continue;
+      if (!collect_boot_prefetch_objects (repo, dirtree_checksum, prefetch_dirs[i].recurse,
+                                          prefetch_dirs[i].libs_only, objects, cancellable, error))
+        return FALSE;
+    }
+
+  g_autoptr (GArray) entries = g_array_new (FALSE, FALSE, sizeof (BootPrefetchEntry));
+  g_array_set_clear_func (entries, boot_prefetch_entry_clear);
+  GLNX_HASH_TABLE_FOREACH (objects, const char *, checksum)
+    {
+      if (entries->len == BOOT_PREFETCH_MAX_OBJECTS)
+        break;
+
+      char loose_path[_OSTREE_LOOSE_PATH_MAX];
+      _ostree_loose_path (loose_path, checksum, OSTREE_OBJECT_TYPE_FILE, repo->mode);
+      struct stat stbuf;
+      if (fstatat (repo->objects_dir_fd, loose_path, &stbuf, AT_SYMLINK_NOFOLLOW) < 0)
+        {
+          if (errno == ENOENT)
+            continue;
+          return glnx_throw_errno_prefix (error, "fstatat(%s)", loose_path);
+        }
+      /* Nothing to read ahead for symlinks and empty files */
+      if (!S_ISREG (stbuf.st_mode) || stbuf.st_size == 0)
+        continue;
+
+      BootPrefetchEntry entry = { stbuf.st_ino, g_strdup (loose_path) };
+      g_array_append_val (entries, entry);
+    }
+  g_array_sort (entries, compare_boot_prefetch_entries);
+
+  g_autoptr (GString) buf = g_string_new ("");
+  for (guint i = 0; i < entries->len; i++)
+    {
+      const BootPrefetchEntry *entry = &g_array_index (entries, BootPrefetchEntry, i);
+      g_string_append (buf, OSTREE_BOOT_PREFETCH_OBJECTS_PREFIX);
+      g_string_append (buf, entry->path);
+      g_string_append_c (buf, '\n');
+    }
+
+  return glnx_file_replace_contents_at (deployment_dfd, OSTREE_BOOT_PREFETCH_NAME,
+                                        (guint8 *)buf->str, buf->len, GLNX_FILE_REPLACE_NODATASYNC,
+                                        cancellable, error);
+}
+
 /* Look up @revision in the repository, and check it out in
  * /ostree/deploy/OS/deploy/${treecsum}.${deployserial}.
  * A dfd for the result is returned in @out_deployment_dfd.
@@ -628,7 +814,8 @@ checkout_deployment_tree (OstreeSysroot *sysroot, OstreeRepo *repo, OstreeDeploy
     return FALSE;
 
   /* Generate hardlink farm, then opendir it */
-  OstreeRepoCheckoutAtOptions checkout_opts = { .process_passthrough_whiteouts = TRUE };
+  OstreeRepoCheckoutAtOptions checkout_opts
+      = { .process_passthrough_whiteouts = TRUE, .n_threads = g_get_num_processors () };
 
   guint64 checkout_start_time = g_get_monotonic_time ();
   if (!ostree_repo_checkout_at (repo, &checkout_opts, osdeploy_dfd, checkout_target_name, csum,
@@ -696,6 +883,10 @@ checkout_deployment_tree (OstreeSysroot *sysroot, OstreeRepo *repo, OstreeDeploy
     g_debug ("not using composefs");
 #endif
 
+  if (repo->enable_boot_prefetch
+      && !write_boot_prefetch_list (repo, csum, ret_deployment_dfd, cancellable, error))
+    return FALSE;
+
   *checkout_elapsed = (checkout_end_time - checkout_start_time);
   *composefs_elapsed = (composefs_end_time - composefs_start_time);
   if (out_deployment_dfd)
@@ -81,6 +81,10 @@ ComposefsConfig *otcore_load_composefs_config (const char *cmdline, GKeyFile *co
 
 // The name of the composefs metadata root
 #define OSTREE_COMPOSEFS_NAME ".ostree.cfs"
+// Written at deploy time if sysroot.boot-prefetch is set: repository object paths
+// (relative to the physical root) which ostree-prepare-root reads ahead
+#define OSTREE_BOOT_PREFETCH_NAME ".ostree.prefetch"
+#define OSTREE_BOOT_PREFETCH_OBJECTS_PREFIX "ostree/repo/objects/"
 // The temporary directory used for the EROFS mount; it's in the .private directory
 // to help ensure that at least unprivileged code can't transiently see the underlying
 // EROFS mount if we somehow leaked it (but it *should* be unmounted always).
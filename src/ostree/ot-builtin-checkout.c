@@ -49,6 +49,9 @@ static gboolean opt_bareuseronly_dirs;
 static char *opt_skiplist_file;
 static char *opt_selinux_policy;
 static char *opt_selinux_prefix;
+static int opt_threads;
+static char *opt_update_from;
+static char **opt_layers;
 
 static gboolean
 parse_fsync_cb (const char *option_name, const char *value, gpointer data, GError **error)
@@ -109,6 +112,13 @@ static GOptionEntry options[] = {
     "PATH" },
   { "selinux-prefix", 0, 0, G_OPTION_ARG_STRING, &opt_selinux_prefix,
     "When setting SELinux labels, prefix all paths by PREFIX", "PREFIX" },
+  { "threads", 0, 0, G_OPTION_ARG_INT, &opt_threads, "Check out files using N threads", "N" },
+  { "update-from", 0, 0, G_OPTION_ARG_STRING, &opt_update_from,
+    "Update DESTINATION, an existing checkout of OLD, in place", "OLD" },
+  { "layer", 0, 0, G_OPTION_ARG_STRING_ARRAY, &opt_layers,
+    "Check out the union of COMMIT and LAYER, with LAYER replacing files from COMMIT (may be used "
+    "multiple times)",
+    "LAYER" },
   { "composefs", 0, 0, G_OPTION_ARG_NONE, &opt_composefs, "Only create a composefs blob", NULL },
   { "composefs-noverity", 0, 0, G_OPTION_ARG_NONE, &opt_composefs_noverity,
     "Only create a composefs blob, and disable fsverity", NULL },
@@ -145,7 +155,8 @@ process_one_checkout (OstreeRepo *repo, const char *resolved_commit, const char
                              || opt_union_add || opt_force_copy || opt_force_copy_zerosized
                              || opt_bareuseronly_dirs || opt_union_identical || opt_skiplist_file
                              || opt_selinux_policy || opt_selinux_prefix
-                             || opt_process_passthrough_whiteouts;
+                             || opt_process_passthrough_whiteouts || opt_threads > 1
+                             || opt_update_from || opt_layers;
 
   /* If we're doing composefs, then this is it */
   if (opt_composefs || opt_composefs_noverity)
@@ -200,7 +211,7 @@ process_one_checkout (OstreeRepo *repo, const char *resolved_commit, const char
         checkout_options.process_whiteouts = TRUE;
       if (opt_process_passthrough_whiteouts)
         checkout_options.process_passthrough_whiteouts = TRUE;
-      if (subpath)
+      if (subpath && !opt_layers)
         checkout_options.subpath = subpath;
 
       g_autoptr (OstreeSePolicy) policy = NULL;
@@ -231,9 +242,43 @@ process_one_checkout (OstreeRepo *repo, const char *resolved_commit, const char
       checkout_options.force_copy = opt_force_copy;
       checkout_options.force_copy_zerosized = opt_force_copy_zerosized;
       checkout_options.bareuseronly_dirs = opt_bareuseronly_dirs;
+      checkout_options.n_threads = opt_threads;
+
+      g_autofree char *resolved_update_from = NULL;
+      if (opt_update_from)
+        {
+          if (!ostree_repo_resolve_rev (repo, opt_update_from, FALSE, &resolved_update_from,
+                                        error))
+            return FALSE;
+          checkout_options.update_from = resolved_update_from;
+        }
 
-      if (!ostree_repo_checkout_at (repo, &checkout_options, AT_FDCWD, destination, resolved_commit,
-                                    cancellable, error))
+      if (opt_layers)
+        {
+          /* The subpath applies to each layer */
+          g_autoptr (GPtrArray) commits = g_ptr_array_new_with_free_func (g_free);
+          g_autoptr (GPtrArray) subpaths = g_ptr_array_new ();
+          g_ptr_array_add (commits, g_strdup (resolved_commit));
+          for (char **iter = opt_layers; *iter; iter++)
+            {
+              char *resolved_layer = NULL;
+              if (!ostree_repo_resolve_rev (repo, *iter, FALSE, &resolved_layer, error))
+                return FALSE;
+              g_ptr_array_add (commits, resolved_layer);
+            }
+          for (guint i = 0; i < commits->len; i++)
+            g_ptr_array_add (subpaths, (char *)(subpath ?: "/"));
+          g_ptr_array_add (commits, NULL);
+          g_ptr_array_add (subpaths, NULL);
+
+          if (!ostree_repo_checkout_layers_at (repo, &checkout_options, AT_FDCWD, destination,
+                                               (const char *const *)commits->pdata,
+                                               (const char *const *)subpaths->pdata, cancellable,
+                                               error))
+            return FALSE;
+        }
+      else if (!ostree_repo_checkout_at (repo, &checkout_options, AT_FDCWD, destination,
+                                         resolved_commit, cancellable, error))
         return FALSE;
     }
   else
@@ -355,6 +400,13 @@ ostree_builtin_checkout (int argc, char **argv, OstreeCommandInvocation *invocat
   if (opt_disable_fsync)
     ostree_repo_set_disable_fsync (repo, TRUE);
 
+  if (opt_threads < 0)
+    return glnx_throw (error, "--threads must be non-negative");
+  if (opt_update_from && opt_whiteouts)
+    return glnx_throw (error, "Cannot specify both --update-from and --whiteouts");
+  if (opt_update_from && opt_layers)
+    return glnx_throw (error, "Cannot specify both --update-from and --layer");
+
   if (argc < 2)
     {
       g_autofree char *help = g_option_context_get_help (context, TRUE, NULL);
@@ -27,12 +27,21 @@
 #include "ot-builtins.h"
 #include "otutil.h"
 
+#ifdef HAVE_LINUX_FSVERITY_H
+#include <linux/fsverity.h>
+#include <sys/ioctl.h>
+#endif
+
 static gboolean opt_quiet;
 static gboolean opt_delete;
 static gboolean opt_all;
 static gboolean opt_add_tombstones;
 static gboolean opt_verify_bindings;
 static gboolean opt_verify_back_refs;
+static int opt_jobs = 1;
+static gboolean opt_incremental;
+static double opt_sample;
+static gboolean opt_use_verity;
 
 /* ATTENTION:
  * Please remember to update the bash-completion script (bash/ostree) and
@@ -49,15 +58,25 @@ static GOptionEntry options[]
           NULL },
         { "verify-back-refs", 0, 0, G_OPTION_ARG_NONE, &opt_verify_back_refs,
           "Verify back-references (implies --verify-bindings)", NULL },
+        { "jobs", 'j', 0, G_OPTION_ARG_INT, &opt_jobs,
+          "Number of objects to verify in parallel, 0 for one per CPU (default: 1)", "N" },
+        { "incremental", 0, 0, G_OPTION_ARG_NONE, &opt_incremental,
+          "Skip objects unchanged since they were verified by a previous incremental fsck",
+          NULL },
+        { "sample", 0, 0, G_OPTION_ARG_DOUBLE, &opt_sample,
+          "Still verify this percentage of unchanged objects (default: 0)", "PERCENT" },
+        { "use-verity", 0, 0, G_OPTION_ARG_NONE, &opt_use_verity,
+          "Skip objects whose fs-verity digest is unchanged since they were verified", NULL },
         { NULL } };
 
+/* Handle @fsck_error (transfer full) from ostree_repo_fsck_object(), if set */
 static gboolean
-fsck_one_object (OstreeRepo *repo, const char *checksum, OstreeObjectType objtype,
-                 GHashTable *object_parents, GVariant *key, gboolean *out_found_corruption,
-                 GCancellable *cancellable, GError **error)
+fsck_object_result (OstreeRepo *repo, const char *checksum, OstreeObjectType objtype,
+                    GHashTable *object_parents, GVariant *key, GError *fsck_error,
+                    gboolean *out_found_corruption, GCancellable *cancellable, GError **error)
 {
-  g_autoptr (GError) temp_error = NULL;
-  if (!ostree_repo_fsck_object (repo, objtype, checksum, cancellable, &temp_error))
+  g_autoptr (GError) temp_error = fsck_error;
+  if (temp_error != NULL)
     {
       gboolean object_missing = FALSE;
       g_auto (GStrv) parent_commits = NULL;
@@ -134,6 +153,271 @@ fsck_one_object (OstreeRepo *repo, const char *checksum, OstreeObjectType objtyp
   return TRUE;
 }
 
+static gboolean
+fsck_one_object (OstreeRepo *repo, const char *checksum, OstreeObjectType objtype,
+                 GHashTable *object_parents, GVariant *key, gboolean *out_found_corruption,
+                 GCancellable *cancellable, GError **error)
+{
+  GError *temp_error = NULL;
+  (void)ostree_repo_fsck_object (repo, objtype, checksum, cancellable, &temp_error);
+  return fsck_object_result (repo, checksum, objtype, object_parents, key, temp_error,
+                             out_found_corruption, cancellable, error);
+}
+
+/* The ledger of objects verified by --incremental records the inode, ctime and
+ * size each object had when it was verified; objects are immutable, so if
+ * these haven't changed there is no need to checksum it again.  With
+ * --use-verity it also records the fs-verity digest, if the object has one.
+ * It is a sorted array of little-endian records, searched in place.
+ */
+#define FSCK_LEDGER_PATH "state/fsck-ledger"
+#define FSCK_LEDGER_MAGIC "OSTFSCK1"
+
+typedef struct
+{
+  char magic[8];
+  guint64 n_records;
+} FsckLedgerHeader;
+
+typedef struct
+{
+  guint8 csum[OSTREE_SHA256_DIGEST_LEN];
+  guint8 objtype;
+  guint8 padding[3];
+  guint32 ctime_nsec;
+  guint64 ino;
+  guint64 ctime_sec;
+  guint64 size;
+  guint8 verity[OSTREE_SHA256_DIGEST_LEN]; /* All zero if none */
+} FsckLedgerRecord;
+
+G_STATIC_ASSERT (sizeof (FsckLedgerHeader) == 16);
+G_STATIC_ASSERT (sizeof (FsckLedgerRecord) == 96);
+
+static int
+compare_ledger_records (gconstpointer a, gconstpointer b)
+{
+  const FsckLedgerRecord *rec_a = a;
+  const FsckLedgerRecord *rec_b = b;
+  int r = memcmp (rec_a->csum, rec_b->csum, sizeof (rec_a->csum));
+  if (r == 0)
+    r = (int)rec_a->objtype - (int)rec_b->objtype;
+  return r;
+}
+
+/* Copy the fs-verity digest of @fd to @digest, if it has one */
+static void
+fsck_measure_verity (int fd, guint8 *digest)
+{
+#ifdef HAVE_LINUX_FSVERITY_H
+  char buf[sizeof (struct fsverity_digest) + OSTREE_SHA256_DIGEST_LEN];
+  struct fsverity_digest *d = (struct fsverity_digest *)&buf;
+  d->digest_size = OSTREE_SHA256_DIGEST_LEN;
+
+  if (ioctl (fd, FS_IOC_MEASURE_VERITY, d) == 0 && d->digest_size == OSTREE_SHA256_DIGEST_LEN
+      && d->digest_algorithm == FS_VERITY_HASH_ALG_SHA256)
+    memcpy (digest, d->digest, OSTREE_SHA256_DIGEST_LEN);
+#endif
+}
+
+/* Fill in @rec for the object as it is now on disk; returns %FALSE if it
+ * can't be stat'ed, in which case it always needs verifying.
+ */
+static gboolean
+fsck_ledger_record_init (OstreeRepo *repo, const char *checksum, OstreeObjectType objtype,
+                         FsckLedgerRecord *rec)
+{
+  const int dfd = ostree_repo_get_dfd (repo);
+  g_autofree char *path = ostree_get_relative_object_path (
+      checksum, objtype, ostree_repo_get_mode (repo) == OSTREE_REPO_MODE_ARCHIVE);
+  glnx_autofd int fd = -1;
+  struct stat stbuf;
+
+  memset (rec, 0, sizeof (*rec));
+  ostree_checksum_inplace_to_bytes (checksum, rec->csum);
+  rec->objtype = objtype;
+  /* Symbolic links, which fail to open here, can't have fs-verity enabled */
+  if (opt_use_verity)
+    fd = openat (dfd, path, O_RDONLY | O_NOCTTY | O_NOFOLLOW | O_CLOEXEC);
+  if (fd != -1)
+    {
+      if (fstat (fd, &stbuf) != 0)
+        return FALSE;
+      fsck_measure_verity (fd, rec->verity);
+    }
+  else if (fstatat (dfd, path, &stbuf, AT_SYMLINK_NOFOLLOW) != 0)
+    return FALSE;
+  rec->ctime_nsec = GUINT32_TO_LE ((guint32)stbuf.st_ctim.tv_nsec);
+  rec->ino = GUINT64_TO_LE ((guint64)stbuf.st_ino);
+  rec->ctime_sec = GUINT64_TO_LE ((guint64)stbuf.st_ctim.tv_sec);
+  rec->size = GUINT64_TO_LE ((guint64)stbuf.st_size);
+  return TRUE;
+}
+
+/* Set @out_ledger to the previous run's records, or %NULL if there is no
+ * usable ledger.
+ */
+static gboolean
+fsck_ledger_load (OstreeRepo *repo, GBytes **out_ledger, GError **error)
+{
+  glnx_autofd int fd = -1;
+  *out_ledger = NULL;
+  if (!ot_openat_ignore_enoent (ostree_repo_get_dfd (repo), FSCK_LEDGER_PATH, &fd, error))
+    return FALSE;
+  if (fd == -1)
+    return TRUE;
+
+  g_autoptr (GBytes) contents = glnx_fd_readall_bytes (fd, NULL, error);
+  if (!contents)
+    return FALSE;
+
+  gsize len;
+  const guint8 *buf = g_bytes_get_data (contents, &len);
+  FsckLedgerHeader header = {
+    { 0 },
+  };
+  if (len >= sizeof (header))
+    memcpy (&header, buf, sizeof (header));
+  if (memcmp (header.magic, FSCK_LEDGER_MAGIC, sizeof (header.magic)) != 0
+      || (len - sizeof (header)) % sizeof (FsckLedgerRecord) != 0
+      || GUINT64_FROM_LE (header.n_records) != (len - sizeof (header)) / sizeof (FsckLedgerRecord))
+    {
+      g_printerr ("Ignoring invalid %s\n", FSCK_LEDGER_PATH);
+      return TRUE;
+    }
+
+  *out_ledger = g_bytes_new_from_bytes (contents, sizeof (header), len - sizeof (header));
+  return TRUE;
+}
+
+/* Check whether the object in @rec is unchanged since a previous run verified
+ * it, and if so update @rec to what should be recorded for it now.
+ */
+static gboolean
+fsck_ledger_unchanged (GBytes *ledger, FsckLedgerRecord *rec)
+{
+  static const guint8 no_verity[OSTREE_SHA256_DIGEST_LEN] = { 0 };
+  gsize len;
+  const FsckLedgerRecord *records = g_bytes_get_data (ledger, &len);
+  const FsckLedgerRecord *found = bsearch (rec, records, len / sizeof (FsckLedgerRecord),
+                                           sizeof (FsckLedgerRecord), compare_ledger_records);
+  if (found == NULL)
+    return FALSE;
+
+  /* The kernel checks the content against the fs-verity digest whenever it
+   * is read, so if that is the same, so is the content.
+   */
+  if (memcmp (rec->verity, no_verity, sizeof (no_verity)) != 0
+      && memcmp (rec->verity, found->verity, sizeof (rec->verity)) == 0)
+    return TRUE;
+
+  if (opt_incremental && memcmp (rec, found, G_STRUCT_OFFSET (FsckLedgerRecord, verity)) == 0)
+    {
+      /* Keep the digest, if it was measured by an earlier run */
+      memcpy (rec->verity, found->verity, sizeof (rec->verity));
+      return TRUE;
+    }
+
+  return FALSE;
+}
+
+static gboolean
+fsck_ledger_write (OstreeRepo *repo, GArray *records, GCancellable *cancellable, GError **error)
+{
+  FsckLedgerHeader header = {
+    FSCK_LEDGER_MAGIC,
+    GUINT64_TO_LE (records->len),
+  };
+  g_autoptr (GByteArray) buf = g_byte_array_sized_new (
+      sizeof (header) + records->len * sizeof (FsckLedgerRecord));
+
+  g_array_sort (records, compare_ledger_records);
+  g_byte_array_append (buf, (guint8 *)&header, sizeof (header));
+  g_byte_array_append (buf, (guint8 *)records->data, records->len * sizeof (FsckLedgerRecord));
+
+  if (!glnx_shutil_mkdir_p_at (ostree_repo_get_dfd (repo), "state", 0777, cancellable, error))
+    return FALSE;
+  return glnx_file_replace_contents_at (ostree_repo_get_dfd (repo), FSCK_LEDGER_PATH, buf->data,
+                                        buf->len, GLNX_FILE_REPLACE_NODATASYNC, cancellable,
+                                        error);
+}
+
+/* Objects are checksummed by worker threads, but the results are handled in
+ * order by the main thread, so that the output, --delete and stopping on the
+ * first error all behave as if the objects were checked one by one.
+ */
+typedef struct
+{
+  OstreeRepo *repo;
+  GPtrArray *objects; /* Sorted serialized object names */
+  GError **errors;
+  gboolean *done;
+  GMutex lock;
+  GCond cond;
+  gint next;
+  gint stop_at; /* Objects from this index on aren't needed */
+  GCancellable *cancellable;
+} FsckJobs;
+
+static void
+fsck_jobs_stop_at (FsckJobs *jobs, gint i)
+{
+  gint old;
+  do
+    {
+      old = g_atomic_int_get (&jobs->stop_at);
+      if (old <= i)
+        return;
+    }
+  while (!g_atomic_int_compare_and_exchange (&jobs->stop_at, old, i));
+}
+
+static void
+fsck_job_thread (gpointer data, gpointer user_data)
+{
+  FsckJobs *jobs = user_data;
+
+  while (TRUE)
+    {
+      const gint i = g_atomic_int_add (&jobs->next, 1);
+      if (i >= g_atomic_int_get (&jobs->stop_at))
+        break;
+
+      const char *checksum;
+      OstreeObjectType objtype;
+      ostree_object_name_deserialize (jobs->objects->pdata[i], &checksum, &objtype);
+
+      GError *local_error = NULL;
+      if (!ostree_repo_fsck_object (jobs->repo, objtype, checksum, jobs->cancellable, &local_error)
+          && !opt_delete && !opt_all
+          && !g_error_matches (local_error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND))
+        {
+          /* The main thread will stop at this object at the latest */
+          fsck_jobs_stop_at (jobs, i + 1);
+        }
+
+      g_mutex_lock (&jobs->lock);
+      jobs->errors[i] = local_error;
+      jobs->done[i] = TRUE;
+      g_cond_broadcast (&jobs->cond);
+      g_mutex_unlock (&jobs->lock);
+    }
+}
+
+static int
+compare_object_names (gconstpointer a, gconstpointer b)
+{
+  const char *checksum_a, *checksum_b;
+  OstreeObjectType objtype_a, objtype_b;
+
+  ostree_object_name_deserialize (*(GVariant **)a, &checksum_a, &objtype_a);
+  ostree_object_name_deserialize (*(GVariant **)b, &checksum_b, &objtype_b);
+  int r = strcmp (checksum_a, checksum_b);
+  if (r == 0)
+    r = (int)objtype_a - (int)objtype_b;
+  return r;
+}
+
 static gboolean
 fsck_reachable_objects_from_commits (OstreeRepo *repo, GHashTable *commits,
                                      gboolean *out_found_corruption, GCancellable *cancellable,
@@ -142,12 +426,9 @@ fsck_reachable_objects_from_commits (OstreeRepo *repo, GHashTable *commits,
   g_autoptr (GHashTable) reachable_objects = ostree_repo_traverse_new_reachable ();
   g_autoptr (GHashTable) object_parents = ostree_repo_traverse_new_parents ();
 
-  GHashTableIter hash_iter;
-  gpointer key, value;
-  g_hash_table_iter_init (&hash_iter, commits);
-  while (g_hash_table_iter_next (&hash_iter, &key, &value))
+  g_autoptr (GPtrArray) commit_checksums = g_ptr_array_new ();
+  GLNX_HASH_TABLE_FOREACH (commits, GVariant *, serialized_key)
     {
-      GVariant *serialized_key = key;
       const char *checksum;
       OstreeObjectType objtype;
 
@@ -155,9 +436,82 @@ fsck_reachable_objects_from_commits (OstreeRepo *repo, GHashTable *commits,
 
       g_assert (objtype == OSTREE_OBJECT_TYPE_COMMIT);
 
-      if (!ostree_repo_traverse_commit_union_with_parents (repo, checksum, 0, reachable_objects,
-                                                           object_parents, cancellable, error))
+      g_ptr_array_add (commit_checksums, (char *)checksum);
+    }
+  g_ptr_array_add (commit_checksums, NULL);
+
+  if (!ostree_repo_traverse_commits_with_flags (
+          repo, OSTREE_REPO_COMMIT_TRAVERSE_FLAG_NONE, (const char *const *)commit_checksums->pdata,
+          0, reachable_objects, object_parents, cancellable, error))
+    return FALSE;
+
+  g_autoptr (GPtrArray) objects = g_ptr_array_sized_new (g_hash_table_size (reachable_objects));
+  GLNX_HASH_TABLE_FOREACH (reachable_objects, GVariant *, serialized_key)
+    g_ptr_array_add (objects, serialized_key);
+  /* In checksum order, which is also roughly the order on disk */
+  g_ptr_array_sort (objects, compare_object_names);
+
+  /* With --incremental or --use-verity, objects that are unchanged since they
+   * were last verified are skipped, apart from a random sample.  The records of the
+   * objects that are checked are kept in @pending (indexed like @objects),
+   * and those that pass are added to @verified to form the new ledger.
+   */
+  g_autoptr (GArray) verified = NULL;
+  g_autoptr (GArray) pending = NULL;
+  if (opt_incremental || opt_use_verity)
+    {
+      g_autoptr (GBytes) ledger = NULL;
+      if (!fsck_ledger_load (repo, &ledger, error))
         return FALSE;
+
+      verified = g_array_new (FALSE, FALSE, sizeof (FsckLedgerRecord));
+      pending = g_array_sized_new (FALSE, FALSE, sizeof (FsckLedgerRecord), objects->len);
+      guint n_checked = 0;
+      for (guint i = 0; i < objects->len; i++)
+        {
+          const char *checksum;
+          OstreeObjectType objtype;
+          FsckLedgerRecord rec;
+
+          ostree_object_name_deserialize (objects->pdata[i], &checksum, &objtype);
+          if (!fsck_ledger_record_init (repo, checksum, objtype, &rec))
+            rec.objtype = 0; /* Not recorded even if it passes */
+          else if (ledger != NULL && fsck_ledger_unchanged (ledger, &rec)
+                   && g_random_double_range (0, 100) >= opt_sample)
+            {
+              g_array_append_val (verified, rec);
+              continue;
+            }
+
+          objects->pdata[n_checked++] = objects->pdata[i];
+          g_array_append_val (pending, rec);
+        }
+
+      if (!opt_quiet && verified->len > 0)
+        g_print ("Skipping %u objects verified by a previous fsck\n", verified->len);
+      g_ptr_array_set_size (objects, n_checked);
+    }
+
+  const guint count = objects->len;
+  const guint n_jobs = opt_jobs > 0 ? (guint)opt_jobs : g_get_num_processors ();
+  FsckJobs jobs = {
+    .repo = repo,
+    .objects = objects,
+    .errors = g_new0 (GError *, count),
+    .done = g_new0 (gboolean, count),
+    .stop_at = count,
+    .cancellable = cancellable,
+  };
+  g_mutex_init (&jobs.lock);
+  g_cond_init (&jobs.cond);
+
+  GThreadPool *pool = g_thread_pool_new (fsck_job_thread, &jobs, MIN (n_jobs, MAX (count, 1)),
+                                         TRUE, error);
+  gboolean ret = pool != NULL;
+  if (pool != NULL)
+    {
+      for (guint j = 0; j < MIN (n_jobs, count); j++)
+        g_thread_pool_push (pool, GUINT_TO_POINTER (j + 1), NULL);
     }
 
   g_auto (GLnxConsoleRef) console = {
@@ -165,26 +519,50 @@ fsck_reachable_objects_from_commits (OstreeRepo *repo, GHashTable *commits,
   };
   glnx_console_lock (&console);
 
-  const guint count = g_hash_table_size (reachable_objects);
-  guint i = 0;
-  g_hash_table_iter_init (&hash_iter, reachable_objects);
-  while (g_hash_table_iter_next (&hash_iter, &key, &value))
+  for (guint i = 0; ret && i < count; i++)
     {
-      GVariant *serialized_key = key;
+      g_mutex_lock (&jobs.lock);
+      while (!jobs.done[i])
+        g_cond_wait (&jobs.cond, &jobs.lock);
+      GError *fsck_error = g_steal_pointer (&jobs.errors[i]);
+      g_mutex_unlock (&jobs.lock);
+
+      GVariant *serialized_key = objects->pdata[i];
       const char *checksum;
       OstreeObjectType objtype;
 
       ostree_object_name_deserialize (serialized_key, &checksum, &objtype);
 
-      if (!fsck_one_object (repo, checksum, objtype, object_parents, serialized_key,
-                            out_found_corruption, cancellable, error))
-        return FALSE;
+      if (pending != NULL && fsck_error == NULL)
+        {
+          const FsckLedgerRecord *rec = &g_array_index (pending, FsckLedgerRecord, i);
+          if (rec->objtype != 0)
+            g_array_append_vals (verified, rec, 1);
+        }
 
-      i++;
-      glnx_console_progress_n_items ("fsck objects", i, count);
+      if (!fsck_object_result (repo, checksum, objtype, object_parents, serialized_key,
+                               fsck_error, out_found_corruption, cancellable, error))
+        ret = FALSE;
+
+      glnx_console_progress_n_items ("fsck objects", i + 1, count);
     }
 
-  return TRUE;
+  if (pool != NULL)
+    {
+      fsck_jobs_stop_at (&jobs, 0);
+      g_thread_pool_free (pool, FALSE, TRUE);
+    }
+  for (guint i = 0; i < count; i++)
+    g_clear_error (&jobs.errors[i]);
+  g_free (jobs.errors);
+  g_free (jobs.done);
+  g_mutex_clear (&jobs.lock);
+  g_cond_clear (&jobs.cond);
+
+  if (ret && verified != NULL && !fsck_ledger_write (repo, verified, cancellable, error))
+    return FALSE;
+
+  return ret;
 }
 
 /* Check that a given commit object is valid for the ref it was looked up via.
@@ -308,6 +686,15 @@ ostree_builtin_fsck (int argc, char **argv, OstreeCommandInvocation *invocation,
                                     error))
     return FALSE;
 
+  if (opt_jobs < 0)
+    return glnx_throw (error, "Invalid number of jobs: %d", opt_jobs);
+  if (opt_sample < 0 || opt_sample > 100)
+    return glnx_throw (error, "Invalid sample percentage: %g", opt_sample);
+#ifndef HAVE_LINUX_FSVERITY_H
+  if (opt_use_verity)
+    return glnx_throw (error, "--use-verity requires fs-verity support");
+#endif
+
   if (!opt_quiet)
     g_print ("Validating refs...\n");
 
@@ -36,6 +36,8 @@ static char *opt_keep_younger_than;
 static char **opt_retain_branch_depth;
 static char **opt_only_branches;
 static gboolean opt_commit_only;
+static gboolean opt_incremental;
+static char *opt_retention;
 
 /* ATTENTION:
  * Please remember to update the bash-completion script (bash/ostree) and
@@ -61,6 +63,10 @@ static GOptionEntry options[] = {
     "Only prune BRANCH (may be specified multiple times)", "BRANCH" },
   { "commit-only", 0, 0, G_OPTION_ARG_NONE, &opt_commit_only,
     "Only traverse and delete commit objects.", NULL },
+  { "incremental", 0, 0, G_OPTION_ARG_NONE, &opt_incremental,
+    "Only traverse commits added since the last incremental prune", NULL },
+  { "retention", 0, 0, G_OPTION_ARG_STRING, &opt_retention,
+    "Keep the commits selected by RULES, e.g. 7d,30d/1d,1y/1w", "RULES" },
   { NULL }
 };
 
@@ -107,7 +113,8 @@ delete_commit (OstreeRepo *repo, const char *commit_to_delete, GCancellable *can
 
 static gboolean
 traverse_keep_younger_than (OstreeRepo *repo, const char *checksum, struct timespec *ts,
-                            GHashTable *reachable, GCancellable *cancellable, GError **error)
+                            OstreeRepoReachableSet *reachable, GCancellable *cancellable,
+                            GError **error)
 {
   g_autofree char *next_checksum = g_strdup (checksum);
   OstreeRepoCommitTraverseFlags traverse_flags = OSTREE_REPO_COMMIT_TRAVERSE_FLAG_NONE;
@@ -117,8 +124,9 @@ traverse_keep_younger_than (OstreeRepo *repo, const char *checksum, struct times
   /* This is the first commit in our loop, which has a ref pointing to it. We
    * don't want to auto-prune it.
    */
-  if (!ostree_repo_traverse_commit_with_flags (repo, traverse_flags, checksum, 0, reachable, NULL,
-                                               cancellable, error))
+  const char *commits[] = { checksum, NULL };
+  if (!ostree_repo_traverse_commits_to_set (repo, traverse_flags, commits, 0, reachable,
+                                            cancellable, error))
     return FALSE;
 
   while (TRUE)
@@ -135,8 +143,9 @@ traverse_keep_younger_than (OstreeRepo *repo, const char *checksum, struct times
       if (commit_timestamp >= ts->tv_sec)
         {
           /* It's newer, traverse it */
-          if (!ostree_repo_traverse_commit_with_flags (repo, traverse_flags, next_checksum, 0,
-                                                       reachable, NULL, cancellable, error))
+          commits[0] = next_checksum;
+          if (!ostree_repo_traverse_commits_to_set (repo, traverse_flags, commits, 0, reachable,
+                                                    cancellable, error))
             return FALSE;
 
           g_free (next_checksum);
@@ -153,6 +162,153 @@ traverse_keep_younger_than (OstreeRepo *repo, const char *checksum, struct times
   return TRUE;
 }
 
+/* A --retention rule, which keeps one commit per @interval seconds, or all of
+ * them if that is 0, among those younger than @age seconds.
+ */
+typedef struct
+{
+  guint64 age;
+  guint64 interval;
+} RetentionRule;
+
+static gboolean
+parse_duration (const char *str, guint64 *out_seconds, GError **error)
+{
+  char *endptr;
+  guint64 n = g_ascii_strtoull (str, &endptr, 10);
+  guint64 unit;
+
+  if (endptr == str)
+    return glnx_throw (error, "Invalid duration '%s'", str);
+  switch (*endptr)
+    {
+    case 'h':
+      unit = 60 * 60;
+      break;
+    case 'd':
+      unit = 24 * 60 * 60;
+      break;
+    case 'w':
+      unit = 7 * 24 * 60 * 60;
+      break;
+    case 'y':
+      unit = 365 * 24 * 60 * 60;
+      break;
+    default:
+      return glnx_throw (error, "Invalid duration '%s', must end in h, d, w or y", str);
+    }
+  if (endptr[1] != '\0')
+    return glnx_throw (error, "Invalid duration '%s'", str);
+
+  *out_seconds = n * unit;
+  return TRUE;
+}
+
+/* Parse a comma separated list of AGE or AGE/INTERVAL rules */
+static GArray *
+parse_retention (const char *spec, GError **error)
+{
+  g_autoptr (GArray) rules = g_array_new (FALSE, FALSE, sizeof (RetentionRule));
+  g_auto (GStrv) parts = g_strsplit (spec, ",", -1);
+
+  for (char **iter = parts; *iter; iter++)
+    {
+      RetentionRule rule = {
+        0,
+      };
+      const char *slash = strchr (*iter, '/');
+      g_autofree char *age = slash ? g_strndup (*iter, slash - *iter) : g_strdup (*iter);
+
+      if (!parse_duration (age, &rule.age, error))
+        return NULL;
+      if (slash)
+        {
+          if (!parse_duration (slash + 1, &rule.interval, error))
+            return NULL;
+          if (rule.interval == 0)
+            return glnx_null_throw (error, "Invalid retention rule '%s'", *iter);
+        }
+      g_array_append_val (rules, rule);
+    }
+
+  if (rules->len == 0)
+    return glnx_null_throw (error, "No retention rules in '%s'", spec);
+  return g_steal_pointer (&rules);
+}
+
+/* Add the commits of the history of @checksum to keep according to @rules
+ * to @retained.  The history is walked from the newest commit, so the one
+ * kept for an interval is the newest in it; intervals are aligned to the
+ * epoch, so e.g. days are UTC days.
+ */
+static gboolean
+collect_retained_commits (OstreeRepo *repo, const char *checksum, GArray *rules, guint64 now,
+                          GPtrArray *retained, GCancellable *cancellable, GError **error)
+{
+  g_autofree guint64 *last_intervals = g_new (guint64, rules->len);
+  guint64 max_age = 0;
+  for (guint i = 0; i < rules->len; i++)
+    {
+      last_intervals[i] = G_MAXUINT64;
+      max_age = MAX (max_age, g_array_index (rules, RetentionRule, i).age);
+    }
+
+  /* This is the first commit in our loop, which has a ref pointing to it. We
+   * don't want to auto-prune it.
+   */
+  g_ptr_array_add (retained, g_strdup (checksum));
+
+  g_autofree char *next_checksum = g_strdup (checksum);
+  while (next_checksum != NULL)
+    {
+      g_autoptr (GVariant) commit = NULL;
+      if (!ostree_repo_load_variant_if_exists (repo, OSTREE_OBJECT_TYPE_COMMIT, next_checksum,
+                                               &commit, error))
+        return FALSE;
+      if (!commit)
+        break; /* This commit was pruned, so we're done */
+
+      const guint64 timestamp = ostree_commit_get_timestamp (commit);
+      const guint64 age = now > timestamp ? now - timestamp : 0;
+      if (age >= max_age)
+        break; /* Older than any rule, we're done */
+
+      gboolean keep = FALSE;
+      for (guint i = 0; i < rules->len; i++)
+        {
+          const RetentionRule *rule = &g_array_index (rules, RetentionRule, i);
+          if (age >= rule->age)
+            continue;
+          if (rule->interval == 0)
+            keep = TRUE;
+          else if (timestamp / rule->interval != last_intervals[i])
+            {
+              last_intervals[i] = timestamp / rule->interval;
+              keep = TRUE;
+            }
+        }
+
+      if (keep && strcmp (next_checksum, checksum) != 0)
+        g_ptr_array_add (retained, g_strdup (next_checksum));
+
+      g_free (next_checksum);
+      next_checksum = ostree_commit_get_parent (commit);
+    }
+
+  return TRUE;
+}
+
+static void
+prune_console_progress_changed (OstreeAsyncProgress *progress, gpointer user_data)
+{
+  guint total_objects;
+  guint swept_objects;
+
+  ostree_async_progress_get (progress, "total-objects", "u", &total_objects, "swept-objects", "u",
+                             &swept_objects, NULL);
+  glnx_console_progress_n_items ("Pruning objects", swept_objects, total_objects);
+}
+
 gboolean
 ostree_builtin_prune (int argc, char **argv, OstreeCommandInvocation *invocation,
                       GCancellable *cancellable, GError **error)
@@ -203,6 +359,16 @@ ostree_builtin_prune (int argc, char **argv, OstreeCommandInvocation *invocation
     pruneflags |= OSTREE_REPO_PRUNE_FLAGS_NO_PRUNE;
   if (opt_commit_only)
     pruneflags |= OSTREE_REPO_PRUNE_FLAGS_COMMIT_ONLY;
+  if (opt_incremental)
+    pruneflags |= OSTREE_REPO_PRUNE_FLAGS_INCREMENTAL;
+
+  /* Incremental pruning is only implemented by ostree_repo_prune() */
+  if (opt_incremental
+      && (opt_retain_branch_depth || opt_keep_younger_than || opt_only_branches || opt_retention))
+    return glnx_throw (error, "--incremental cannot be used with --keep-younger-than, "
+                              "--retain-branch-depth, --only-branch or --retention");
+  if (opt_retention && opt_keep_younger_than)
+    return glnx_throw (error, "--retention cannot be used with --keep-younger-than");
 
   /* If no newer more complex options are specified, drop down to the original
    * prune API - both to avoid code duplication, and to keep it run from the
@@ -211,7 +377,7 @@ ostree_builtin_prune (int argc, char **argv, OstreeCommandInvocation *invocation
   gint n_objects_total;
   gint n_objects_pruned;
   guint64 objsize_total;
-  if (!(opt_retain_branch_depth || opt_keep_younger_than || opt_only_branches))
+  if (!(opt_retain_branch_depth || opt_keep_younger_than || opt_only_branches || opt_retention))
     {
       if (!ostree_repo_prune (repo, pruneflags, opt_depth, &n_objects_total, &n_objects_pruned,
                               &objsize_total, cancellable, error))
@@ -229,12 +395,15 @@ ostree_builtin_prune (int argc, char **argv, OstreeCommandInvocation *invocation
         return FALSE;
 
       g_autoptr (GHashTable) all_refs = NULL;
-      g_autoptr (GHashTable) reachable = ostree_repo_traverse_new_reachable ();
+      g_autoptr (OstreeRepoReachableSet) reachable = ostree_repo_reachable_set_new ();
       g_autoptr (GHashTable) retain_branch_depth
           = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
       struct timespec keep_younger_than_ts = {
         0,
       };
+      g_autoptr (GArray) retention = NULL;
+      g_autoptr (GPtrArray) retained = g_ptr_array_new_with_free_func (g_free);
+      const guint64 now = g_get_real_time () / G_USEC_PER_SEC;
       GHashTableIter hash_iter;
       gpointer key, value;
 
@@ -246,6 +415,12 @@ ostree_builtin_prune (int argc, char **argv, OstreeCommandInvocation *invocation
           if (!parse_datetime (&keep_younger_than_ts, opt_keep_younger_than, NULL))
             return glnx_throw (error, "Could not parse '%s'", opt_keep_younger_than);
         }
+      if (opt_retention)
+        {
+          retention = parse_retention (opt_retention, error);
+          if (!retention)
+            return FALSE;
+        }
 
       /* Process --retain-branch-depth */
       for (char **iter = opt_retain_branch_depth; iter && *iter; iter++)
@@ -344,22 +519,54 @@ ostree_builtin_prune (int argc, char **argv, OstreeCommandInvocation *invocation
                */
               continue; /* Note again, we're skipping the below bit */
             }
+          else if (retention)
+            {
+              /* The retained commits of all refs are traversed together below */
+              if (!collect_retained_commits (repo, checksum, retention, now, retained,
+                                             cancellable, error))
+                return FALSE;
+              continue;
+            }
           else
             depth = opt_depth; /* No --retain-branch-depth for this branch, use
                                   the global default */
 
           g_debug ("Finding objects to keep for commit %s", checksum);
-          if (!ostree_repo_traverse_commit_with_flags (repo, traverse_flags, checksum, depth,
-                                                       reachable, NULL, cancellable, error))
+          const char *commits[] = { checksum, NULL };
+          if (!ostree_repo_traverse_commits_to_set (repo, traverse_flags, commits, depth,
+                                                    reachable, cancellable, error))
+            return FALSE;
+        }
+
+      if (retained->len > 0)
+        {
+          g_debug ("Retaining %u commits", retained->len);
+          g_ptr_array_add (retained, NULL);
+          if (!ostree_repo_traverse_commits_to_set (repo, traverse_flags,
+                                                    (const char *const *)retained->pdata, 0,
+                                                    reachable, cancellable, error))
             return FALSE;
         }
 
       /* We've gathered the reachable set; start the prune ✀ */
       {
-        OstreeRepoPruneOptions opts = { pruneflags, reachable };
+        g_auto (GLnxConsoleRef) console = {
+          0,
+        };
+        g_autoptr (OstreeAsyncProgress) progress = NULL;
+        glnx_console_lock (&console);
+        if (console.is_tty)
+          progress = ostree_async_progress_new_and_connect (prune_console_progress_changed, NULL);
+
+        OstreeRepoPruneOptions opts = { pruneflags, NULL };
+        opts.reachable_set = reachable;
+        opts.progress = progress;
         if (!ostree_repo_prune_from_reachable (repo, &opts, &n_objects_total, &n_objects_pruned,
                                                &objsize_total, cancellable, error))
           return FALSE;
+
+        if (progress)
+          ostree_async_progress_finish (progress);
       }
     }
 
@@ -31,6 +31,7 @@ static gboolean opt_alias;
 static char *opt_create;
 static gboolean opt_collections;
 static gboolean opt_force;
+static gboolean opt_pack;
 
 /* ATTENTION:
  * Please remember to update the bash-completion script (bash/ostree) and
@@ -49,6 +50,7 @@ static GOptionEntry options[] = {
   { "collections", 'c', 0, G_OPTION_ARG_NONE, &opt_collections,
     "Enable listing collection IDs for refs", NULL },
   { "force", 0, 0, G_OPTION_ARG_NONE, &opt_force, "Overwrite existing refs when creating", NULL },
+  { "pack", 0, 0, G_OPTION_ARG_NONE, &opt_pack, "Move all refs into the packed-refs file", NULL },
   { NULL }
 };
 
@@ -323,7 +325,19 @@ ostree_builtin_refs (int argc, char **argv, OstreeCommandInvocation *invocation,
                                     error))
     goto out;
 
-  if (argc >= 2)
+  if (opt_pack)
+    {
+      if (argc >= 2 || opt_create || opt_delete)
+        {
+          g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                       "--pack cannot be combined with a PREFIX, --create or --delete");
+          goto out;
+        }
+
+      if (!ostree_repo_pack_refs (repo, cancellable, error))
+        goto out;
+    }
+  else if (argc >= 2)
     {
       if (opt_create && argc > 2)
         {
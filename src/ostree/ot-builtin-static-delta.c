@@ -25,6 +25,7 @@
 #include "otutil.h"
 
 static char *opt_from_rev;
+static char **opt_extra_from_revs;
 static char *opt_to_rev;
 static char *opt_min_fallback_size;
 static char *opt_max_bsdiff_size;
@@ -40,6 +41,7 @@ static char **opt_key_ids;
 static char *opt_sign_name;
 static char *opt_keysfilename;
 static char *opt_keysdir;
+static int opt_jobs = 1;
 
 #define BUILTINPROTO(name) \
   static gboolean ot_static_delta_builtin_##name (int argc, char **argv, \
@@ -81,6 +83,8 @@ static OstreeCommand static_delta_subcommands[] = {
 
 static GOptionEntry generate_options[] = {
   { "from", 0, 0, G_OPTION_ARG_STRING, &opt_from_rev, "Create delta from revision REV", "REV" },
+  { "extra-from", 0, 0, G_OPTION_ARG_STRING_ARRAY, &opt_extra_from_revs,
+    "Also support applying the delta from revision REV (can be specified multiple times)", "REV" },
   { "empty", 0, 0, G_OPTION_ARG_NONE, &opt_empty, "Create delta from scratch", NULL },
   { "inline", 0, 0, G_OPTION_ARG_NONE, &opt_inline, "Inline delta parts into main delta", NULL },
   { "to", 0, 0, G_OPTION_ARG_STRING, &opt_to_rev, "Create delta to revision REV", "REV" },
@@ -111,6 +115,8 @@ static GOptionEntry generate_options[] = {
 };
 
 static GOptionEntry apply_offline_options[] = {
+  { "jobs", 'j', 0, G_OPTION_ARG_INT, &opt_jobs,
+    "Number of delta parts to apply in parallel, 0 for one per CPU (default: 1)", "N" },
   { "sign-type", 0, 0, G_OPTION_ARG_STRING, &opt_sign_name,
     "Signature type to use (defaults to 'ed25519')", "NAME" },
 #if defined(HAVE_ED25519)
@@ -310,6 +316,7 @@ ot_static_delta_builtin_generate (int argc, char **argv, OstreeCommandInvocation
       g_autofree char *from_resolved = NULL;
       g_autofree char *to_resolved = NULL;
       g_autofree char *from_parent_str = NULL;
+      g_autoptr (GPtrArray) extra_froms = g_ptr_array_new_with_free_func (g_free);
       g_autoptr (GVariantBuilder) parambuilder = NULL;
       int endianness;
 
@@ -411,6 +418,22 @@ ot_static_delta_builtin_generate (int argc, char **argv, OstreeCommandInvocation
       if (opt_filename)
         g_variant_builder_add (parambuilder, "{sv}", "filename",
                                g_variant_new_bytestring (opt_filename));
+      if (opt_extra_from_revs)
+        {
+          if (opt_empty)
+            return glnx_throw (error, "Cannot specify both --empty and --extra-from=REV");
+
+          for (char **iter = opt_extra_from_revs; *iter; iter++)
+            {
+              char *extra_resolved = NULL;
+              if (!ostree_repo_resolve_rev (repo, *iter, FALSE, &extra_resolved, error))
+                return FALSE;
+              g_ptr_array_add (extra_froms, extra_resolved);
+            }
+          g_variant_builder_add (
+              parambuilder, "{sv}", "extra-from-revisions",
+              g_variant_new_strv ((const char *const *)extra_froms->pdata, extra_froms->len));
+        }
 
       g_variant_builder_add (parambuilder, "{sv}", "verbose", g_variant_new_boolean (TRUE));
       if (opt_endianness || opt_swap_endianness)
@@ -475,6 +498,8 @@ ot_static_delta_builtin_generate (int argc, char **argv, OstreeCommandInvocation
 
       g_print ("Generating static delta:\n");
       g_print ("  From: %s\n", from_resolved ? from_resolved : "empty");
+      for (guint i = 0; i < extra_froms->len; i++)
+        g_print ("  Also from: %s\n", (char *)extra_froms->pdata[i]);
       g_print ("  To:   %s\n", to_resolved);
       {
         g_autoptr (GVariant) params = g_variant_ref_sink (g_variant_builder_end (parambuilder));
@@ -512,6 +537,9 @@ ot_static_delta_builtin_apply_offline (int argc, char **argv, OstreeCommandInvoc
       return FALSE;
     }
 
+  if (opt_jobs < 0)
+    return glnx_throw (error, "Invalid number of jobs: %d", opt_jobs);
+
 #if defined(HAVE_ED25519)
   /* Initialize crypto system */
   opt_sign_name = opt_sign_name ?: OSTREE_SIGN_NAME_ED25519;
@@ -567,8 +595,12 @@ ot_static_delta_builtin_apply_offline (int argc, char **argv, OstreeCommandInvoc
   if (!ostree_repo_prepare_transaction (repo, NULL, cancellable, error))
     return FALSE;
 
-  if (!ostree_repo_static_delta_execute_offline_with_signature (repo, path, sign, FALSE,
-                                                                cancellable, error))
+  g_autoptr (GVariantBuilder) options_builder = g_variant_builder_new (G_VARIANT_TYPE ("a{sv}"));
+  g_variant_builder_add (options_builder, "{sv}", "n-jobs", g_variant_new_uint32 (opt_jobs));
+  g_autoptr (GVariant) options = g_variant_ref_sink (g_variant_builder_end (options_builder));
+
+  if (!ostree_repo_static_delta_execute_offline_with_options (repo, path, sign, options,
+                                                              cancellable, error))
     return FALSE;
 
   if (!ostree_repo_commit_transaction (repo, NULL, cancellable, error))
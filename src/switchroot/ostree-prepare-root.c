@@ -97,6 +97,56 @@
 
 #include "ostree-mount-util.h"
 
+/* Read ahead the repository objects listed in the deployment's prefetch list
+ * (see write_boot_prefetch_list() in ostree-sysroot-deploy.c).  This is done
+ * in a child process so it doesn't delay the boot; the readahead is best
+ * effort and the child may be killed at switch-root.
+ */
+static void
+prefetch_boot_objects (const char *root_mountpoint)
+{
+  FILE *list = fopen (OSTREE_BOOT_PREFETCH_NAME, "re");
+  if (list == NULL)
+    {
+      if (errno != ENOENT)
+        warn ("opening %s", OSTREE_BOOT_PREFETCH_NAME);
+      return;
+    }
+
+  pid_t pid = fork ();
+  if (pid != 0)
+    {
+      if (pid < 0)
+        warn ("fork");
+      fclose (list);
+      return;
+    }
+
+  int sysroot_fd = open (root_mountpoint, O_DIRECTORY | O_RDONLY | O_CLOEXEC);
+  if (sysroot_fd < 0)
+    _exit (EXIT_FAILURE);
+
+  char *line = NULL;
+  size_t len = 0;
+  ssize_t n;
+  while ((n = getline (&line, &len, list)) > 0)
+    {
+      if (line[n - 1] == '\n')
+        line[n - 1] = '\0';
+      /* Only ever look at objects */
+      if (!g_str_has_prefix (line, OSTREE_BOOT_PREFETCH_OBJECTS_PREFIX) || strstr (line, ".."))
+        continue;
+
+      int fd = openat (sysroot_fd, line, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+      if (fd < 0)
+        continue;
+      (void)posix_fadvise (fd, 0, 0, POSIX_FADV_WILLNEED);
+      close (fd);
+    }
+
+  _exit (EXIT_SUCCESS);
+}
+
 static bool
 sysroot_is_configured_ro (const char *sysroot)
 {
@@ -355,6 +405,8 @@ main (int argc, char *argv[])
   if (chdir (deploy_path) < 0)
     err (EXIT_FAILURE, "failed to chdir to deploy_path");
 
+  prefetch_boot_objects (root_mountpoint);
+
   GVariantBuilder metadata_builder;
   g_variant_builder_init (&metadata_builder, G_VARIANT_TYPE ("a{sv}"));
 
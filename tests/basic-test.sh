@@ -19,7 +19,7 @@
 
 set -euo pipefail
 
-echo "1..$((90 + ${extra_basic_tests:-0}))"
+echo "1..$((94 + ${extra_basic_tests:-0}))"
 
 CHECKOUT_U_ARG=""
 CHECKOUT_H_ARGS="-H"
@@ -92,6 +92,54 @@ done
 
 echo "ok checkout -C"
 
+rm checkout-test2 checkout-test2-threads -rf
+$OSTREE checkout test2 checkout-test2
+$OSTREE checkout --threads=4 test2 checkout-test2-threads
+validate_checkout_basic checkout-test2-threads
+(cd checkout-test2 && find . -printf '%p %y %m %T@\n' | sort) > checkout-serial.txt
+(cd checkout-test2-threads && find . -printf '%p %y %m %T@\n' | sort) > checkout-threads.txt
+diff -u checkout-serial.txt checkout-threads.txt
+rm checkout-test2-threads -rf
+if $OSTREE checkout --threads=-1 test2 checkout-test2-threads 2>err.txt; then
+    assert_not_reached "checkout --threads=-1 worked?"
+fi
+assert_file_has_content err.txt "--threads must be non-negative"
+
+echo "ok checkout --threads"
+
+rm update-files checkout-update checkout-update-fresh -rf
+mkdir -p update-files/unchanged/sub update-files/changed update-files/removed-dir
+echo same > update-files/unchanged/sub/file
+echo old > update-files/changed/file
+echo removed > update-files/changed/removed-file
+echo removed > update-files/removed-dir/file
+echo file > update-files/becomes-dir
+$OSTREE commit ${COMMIT_ARGS} -b update-test --tree=dir=update-files
+oldrev=$($OSTREE rev-parse update-test)
+echo new > update-files/changed/file
+echo added > update-files/changed/added-file
+rm update-files/changed/removed-file update-files/removed-dir update-files/becomes-dir -rf
+mkdir update-files/becomes-dir update-files/added-dir
+echo dir > update-files/becomes-dir/file
+echo added > update-files/added-dir/file
+$OSTREE commit ${COMMIT_ARGS} -b update-test --tree=dir=update-files
+$OSTREE checkout ${CHECKOUT_U_ARG} ${oldrev} checkout-update
+$OSTREE checkout ${CHECKOUT_U_ARG} --update-from=${oldrev} update-test checkout-update
+$OSTREE checkout ${CHECKOUT_U_ARG} update-test checkout-update-fresh
+(cd checkout-update && find . -printf '%p %y %m %T@\n' | sort) > checkout-update.txt
+(cd checkout-update-fresh && find . -printf '%p %y %m %T@\n' | sort) > checkout-fresh.txt
+diff -u checkout-fresh.txt checkout-update.txt
+diff -r checkout-update-fresh checkout-update
+assert_file_has_content checkout-update/changed/file new
+assert_not_has_file checkout-update/changed/removed-file
+assert_not_has_dir checkout-update/removed-dir
+if $OSTREE checkout --update-from=${oldrev} update-test nonexistent-checkout 2>err.txt; then
+    assert_not_reached "checkout --update-from into a missing directory worked?"
+fi
+rm update-files checkout-update checkout-update-fresh -rf
+
+echo "ok checkout --update-from"
+
 $OSTREE rev-parse test2
 $OSTREE rev-parse 'test2^'
 $OSTREE rev-parse 'test2^^' 2>/dev/null && fatal "rev-parse test2^^ unexpectedly succeeded!"
@@ -1102,6 +1150,43 @@ if ! is_bare_user_only_repo repo; then
 fi
 echo "ok disable cache checkout"
 
+cd ${test_tmpdir}
+rm cache-files cache-checkout -rf
+mkdir cache-files
+for f in a b c; do
+    dd if=/dev/urandom of=cache-files/$f bs=1k count=400 2>/dev/null
+done
+${CMD_PREFIX} ostree --repo=repo2 commit -b cache-test --tree=dir=cache-files
+${CMD_PREFIX} ostree --repo=repo2 config set core.uncompressed-cache-max-size 1MB
+${CMD_PREFIX} ostree --repo=repo2 checkout -U cache-test cache-checkout
+for f in a b c; do
+    cmp cache-files/$f cache-checkout/$f
+done
+assert_has_file repo2/uncompressed-objects-cache/index
+count_cached() {
+    n=0
+    for f in a b c; do
+        csum=$(ostree_file_path_to_checksum repo2 cache-test /$f)
+        if test -f repo2/uncompressed-objects-cache/${csum:0:2}/${csum:2}.file; then
+            n=$((n + 1))
+        fi
+    done
+    echo ${n}
+}
+# Objects used by a checkout don't count towards the budget
+assert_streq "$(count_cached)" 3
+# Once unused, the least recently used one is evicted by the next checkout
+rm cache-checkout -rf
+${CMD_PREFIX} ostree --repo=repo2 checkout -U test2 cache-checkout
+assert_streq "$(count_cached)" 2
+${CMD_PREFIX} ostree --repo=repo2 config unset core.uncompressed-cache-max-size
+# Unbounded checkouts don't index the objects they add
+rm cache-checkout -rf
+${CMD_PREFIX} ostree --repo=repo2 checkout -U cache-test cache-checkout
+assert_not_has_file repo2/uncompressed-objects-cache/index
+rm cache-files cache-checkout -rf
+echo "ok uncompressed cache max size"
+
 cd ${test_tmpdir}
 rm checkout-test2 -rf
 $OSTREE checkout test2 checkout-test2
@@ -1185,9 +1270,25 @@ if touch overlay/baz/.wh.cow && touch overlay/.wh.deeper && touch overlay/baz/an
     assert_has_file overlay-co/anewdir/blah
     assert_has_file overlay-co/anewfile
     echo "ok whiteouts disabled"
+
+    # A layered checkout should match checking out each layer in turn
+    rm overlay-co overlay-seq -rf
+    for branch in test2 overlay overlay-dir-convert; do
+        $OSTREE --repo=repo checkout --union --whiteouts ${branch} overlay-seq
+    done
+    $OSTREE --repo=repo checkout --whiteouts --layer=overlay --layer=overlay-dir-convert test2 overlay-co
+    (cd overlay-seq && find . | sort) > overlay-seq.txt
+    (cd overlay-co && find . | sort) > overlay-co.txt
+    diff -u overlay-seq.txt overlay-co.txt
+    assert_file_has_content overlay-co/baz 'baz to file'
+    test -L overlay-co/anewdir
+    assert_not_has_file overlay-co/.wh.deeper
+    rm overlay-co overlay-seq overlay-seq.txt overlay-co.txt -rf
+    echo "ok layered checkout"
 else
     echo "ok # SKIP whiteouts do not work, are you using aufs?"
     echo "ok # SKIP whiteouts do not work, are you using aufs?"
+    echo "ok # SKIP whiteouts do not work, are you using aufs?"
 fi
 
 cd ${test_tmpdir}
@@ -0,0 +1,49 @@
+#!/bin/bash
+#
+# Copyright (C) 2024 Red Hat, Inc.
+#
+# SPDX-License-Identifier: LGPL-2.0+
+#
+# This library is free software; you can redistribute it and/or
+# modify it under the terms of the GNU Lesser General Public
+# License as published by the Free Software Foundation; either
+# version 2 of the License, or (at your option) any later version.
+#
+# This library is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+# Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public
+# License along with this library. If not, see <https://www.gnu.org/licenses/>.
+
+set -euo pipefail
+
+. $(dirname $0)/libtest.sh
+
+cd ${test_tmpdir}
+echo probe > probe
+if ! fsverity enable probe 2>err.txt; then
+    skip "no fsverity support: $(cat err.txt)"
+fi
+
+echo '1..2'
+
+mkdir d
+for i in $(seq 100); do echo ${i} > d/${i}; done
+
+# fs-verity is enabled on objects by worker threads while the transaction is
+# committed; every object must have it once the commit is done.
+for mode in maybe yes; do
+    $CMD_PREFIX ostree --repo=repo-${mode} init --mode=bare-user-only
+    $CMD_PREFIX ostree --repo=repo-${mode} config set ex-integrity.fsverity ${mode}
+    $CMD_PREFIX ostree --repo=repo-${mode} commit -b main --tree=dir=d
+    find repo-${mode}/objects -type f > objects.txt
+    assert_streq "$(wc -l < objects.txt)" 103
+    while read obj; do
+        if ! fsverity measure ${obj} > /dev/null; then
+            fatal "fs-verity not enabled on ${obj}"
+        fi
+    done < objects.txt
+    echo "ok commit with fsverity ${mode}"
+done
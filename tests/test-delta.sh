@@ -26,7 +26,7 @@ skip_without_user_xattrs
 bindatafiles="bash true ostree"
 morebindatafiles="false ls"
 
-echo '1..14'
+echo '1..19'
 
 mkdir repo
 ostree_repo_init repo --mode=archive
@@ -217,6 +217,33 @@ ${CMD_PREFIX} ostree --repo=repo2 ls ${newrev} >/dev/null
 
 echo 'ok apply offline'
 
+rm repo2 -rf
+ostree_repo_init repo2 --mode=bare-user
+${CMD_PREFIX} ostree --repo=repo2 pull-local repo ${origrev}
+${CMD_PREFIX} ostree --repo=repo2 static-delta apply-offline --jobs=4 repo/deltas/${deltaprefix}/${deltadir}
+${CMD_PREFIX} ostree --repo=repo2 fsck
+${CMD_PREFIX} ostree --repo=repo2 ls ${newrev} >/dev/null
+if ${CMD_PREFIX} ostree --repo=repo2 static-delta apply-offline --jobs=-1 repo/deltas/${deltaprefix}/${deltadir} 2>err.txt; then
+    assert_not_reached "apply-offline --jobs=-1 unexpectedly succeeded"
+fi
+assert_file_has_content err.txt "Invalid number of jobs"
+
+echo 'ok apply offline parallel'
+
+${CMD_PREFIX} ostree --repo=repo static-delta generate --max-bsdiff-size=10000 --from=${origrev} --to=${newrev} 2>&1 | grep "bsdiff=[1-9]"
+rm repo2 -rf
+ostree_repo_init repo2 --mode=bare-user
+${CMD_PREFIX} ostree --repo=repo2 pull-local repo ${origrev}
+${CMD_PREFIX} ostree --repo=repo2 static-delta apply-offline repo/deltas/${deltaprefix}/${deltadir}
+${CMD_PREFIX} ostree --repo=repo2 fsck
+rm co-bsdiff -rf
+${CMD_PREFIX} ostree --repo=repo2 checkout -U ${newrev} co-bsdiff
+for bin in ${bindatafiles}; do
+    cmp co-bsdiff/${bin} files/${bin}
+done
+
+echo 'ok apply offline bsdiff'
+
 rm -rf repo/deltas/${deltaprefix}/${deltadir}/*
 ${CMD_PREFIX} ostree --repo=repo static-delta generate --from=${origrev} --to=${newrev} --inline
 assert_not_has_file repo/deltas/${deltaprefix}/${deltadir}/0
@@ -324,3 +351,105 @@ fi
 assert_file_has_content err.txt "Invalid rev GARBAGE"
 
 echo 'ok handle bad delta name'
+
+# The server only has deltas between consecutive commits, and the client
+# is two commits behind; it should apply both deltas in sequence.
+rm -rf repo/deltas repo/delta-indexes
+permuteDirectory 1 files
+${CMD_PREFIX} ostree --repo=repo commit -b test -s test --tree=dir=files
+hop1rev=$(${CMD_PREFIX} ostree --repo=repo rev-parse test)
+permuteDirectory 1 files
+${CMD_PREFIX} ostree --repo=repo commit -b test -s test --tree=dir=files
+hop2rev=$(${CMD_PREFIX} ostree --repo=repo rev-parse test)
+${CMD_PREFIX} ostree --repo=repo static-delta generate --from=${samerev} --to=${hop1rev}
+${CMD_PREFIX} ostree --repo=repo static-delta generate --from=${hop1rev} --to=${hop2rev}
+
+for indexed in false true; do
+    ${CMD_PREFIX} ostree --repo=repo config set core.no-deltas-in-summary ${indexed}
+    ${CMD_PREFIX} ostree --repo=repo static-delta reindex
+    ${CMD_PREFIX} ostree --repo=repo summary -u
+
+    rm -rf repo2
+    mkdir repo2 && ostree_repo_init repo2 --mode=bare-user
+    ${CMD_PREFIX} ostree --repo=repo2 pull-local --disable-static-deltas repo ${samerev}
+    ${CMD_PREFIX} ostree --repo=repo2 refs --create=test ${samerev}
+    ${CMD_PREFIX} ostree --repo=repo2 pull-local --require-static-deltas repo test
+    ${CMD_PREFIX} ostree --repo=repo2 fsck
+    assert_streq "$(${CMD_PREFIX} ostree --repo=repo2 rev-parse test)" "${hop2rev}"
+    ${CMD_PREFIX} ostree --repo=repo2 ls ${hop1rev} >/dev/null
+
+    # The target has no ostree.sizes metadata to tell whether the chain is
+    # worth it, so unless deltas are required, objects are pulled as before
+    rm -rf repo2
+    mkdir repo2 && ostree_repo_init repo2 --mode=bare-user
+    ${CMD_PREFIX} ostree --repo=repo2 pull-local --disable-static-deltas repo ${samerev}
+    ${CMD_PREFIX} ostree --repo=repo2 refs --create=test ${samerev}
+    ${CMD_PREFIX} ostree --repo=repo2 pull-local repo test | tee pullstats.txt
+    assert_not_file_has_content pullstats.txt 'delta parts'
+    ${CMD_PREFIX} ostree --repo=repo2 fsck
+    assert_streq "$(${CMD_PREFIX} ostree --repo=repo2 rev-parse test)" "${hop2rev}"
+done
+${CMD_PREFIX} ostree --repo=repo config set core.no-deltas-in-summary false
+
+# If a hop of the chain is missing, the error names the pull that was asked
+# for rather than the hop
+${CMD_PREFIX} ostree --repo=repo static-delta delete ${hop1rev}-${hop2rev}
+rm -rf repo2
+mkdir repo2 && ostree_repo_init repo2 --mode=bare-user
+${CMD_PREFIX} ostree --repo=repo2 pull-local --disable-static-deltas repo ${samerev}
+${CMD_PREFIX} ostree --repo=repo2 refs --create=test ${samerev}
+if ${CMD_PREFIX} ostree --repo=repo2 pull-local --require-static-deltas repo test 2>err.txt; then
+    assert_not_reached "pull with a missing delta in the chain unexpectedly succeeded"
+fi
+assert_file_has_content err.txt "Static deltas required, but none found for ${samerev} to ${hop2rev}"
+
+echo 'ok pull chain of deltas'
+
+# One delta generation covering two source revisions
+rm -rf repo/deltas repo/delta-indexes
+permuteDirectory 1 files
+${CMD_PREFIX} ostree --repo=repo commit -b test -s test --tree=dir=files
+multirev=$(${CMD_PREFIX} ostree --repo=repo rev-parse test)
+${CMD_PREFIX} ostree --repo=repo static-delta generate --from=${hop2rev} --extra-from=test^^ --to=${multirev} > generate.txt
+assert_file_has_content generate.txt "Also from: ${hop1rev}"
+${CMD_PREFIX} ostree --repo=repo static-delta list > delta-list.txt
+assert_file_has_content delta-list.txt "^${hop2rev}-${multirev}$"
+assert_file_has_content delta-list.txt "^${hop1rev}-${multirev}$"
+${CMD_PREFIX} ostree --repo=repo static-delta show ${hop1rev}-${multirev} > show.txt
+assert_file_has_content show.txt "Source: ${hop2rev}"
+assert_file_has_content show.txt "Source: ${hop1rev}"
+${CMD_PREFIX} ostree --repo=repo summary -u
+
+for fromrev in ${hop1rev} ${hop2rev}; do
+    rm -rf repo2
+    mkdir repo2 && ostree_repo_init repo2 --mode=bare-user
+    ${CMD_PREFIX} ostree --repo=repo2 pull-local --disable-static-deltas repo ${fromrev}
+    ${CMD_PREFIX} ostree --repo=repo2 refs --create=test ${fromrev}
+    ${CMD_PREFIX} ostree --repo=repo2 pull-local --require-static-deltas repo test
+    ${CMD_PREFIX} ostree --repo=repo2 fsck
+    assert_streq "$(${CMD_PREFIX} ostree --repo=repo2 rev-parse test)" "${multirev}"
+done
+
+echo 'ok generate and pull multi-source delta'
+
+# Partial pulls only fetch what they need from a delta
+rm -rf repo/deltas repo/delta-indexes
+mkdir -p files/subdir
+cp $(which false) files/subdir
+${CMD_PREFIX} ostree --repo=repo commit -b test -s test --tree=dir=files
+subdirrev=$(${CMD_PREFIX} ostree --repo=repo rev-parse test)
+${CMD_PREFIX} ostree --repo=repo static-delta generate --empty --to=${subdirrev}
+${CMD_PREFIX} ostree --repo=repo summary -u
+
+rm -rf repo2 subdir-checkout
+mkdir repo2 && ostree_repo_init repo2 --mode=bare-user
+${CMD_PREFIX} ostree --repo=repo2 remote add --set=gpg-verify=false origin file://$(pwd)/repo
+${CMD_PREFIX} ostree --repo=repo2 pull --commit-metadata-only --require-static-deltas origin test
+assert_streq "$(${CMD_PREFIX} ostree --repo=repo2 rev-parse origin:test)" "${subdirrev}"
+${CMD_PREFIX} ostree --repo=repo2 pull --subpath=/subdir --require-static-deltas origin test
+${CMD_PREFIX} ostree --repo=repo2 checkout --subpath=/subdir origin:test subdir-checkout
+cmp files/subdir/false subdir-checkout/false
+${CMD_PREFIX} ostree --repo=repo2 pull --require-static-deltas origin test
+${CMD_PREFIX} ostree --repo=repo2 fsck
+
+echo 'ok partial pulls with delta'
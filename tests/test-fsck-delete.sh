@@ -21,7 +21,7 @@ set -euo pipefail
 
 . $(dirname $0)/libtest.sh
 
-echo '1..6'
+echo '1..9'
 
 cd ${test_tmpdir}
 
@@ -79,3 +79,59 @@ fi
 assert_file_has_content fsck "^Validating refs\.\.\.$"
 assert_file_empty fsck-error
 echo "ok 6 fsck-good"
+
+# Same again, with objects verified in parallel
+file=`find ./f2 |grep objects |grep \\.file |tail -1 `
+rm $file
+echo whoops > $file
+if ${CMD_PREFIX} ostree fsck --jobs=4 --repo=./f2 > fsck 2> fsck-error; then
+  assert_not_reached "fsck did not fail"
+fi
+assert_file_has_content fsck-error "^error: In commits"
+if ${CMD_PREFIX} ostree fsck -j 0 --delete --repo=./f2 > fsck 2> fsck-error; then
+  assert_not_reached "fsck did not fail"
+fi
+assert_file_has_content fsck-error "^In commits"
+${CMD_PREFIX} ostree --repo=./f2 pull-local ./f1 > /dev/null
+${CMD_PREFIX} ostree fsck --jobs=0 --repo=./f2 > fsck 2> fsck-error
+assert_file_empty fsck-error
+if ${CMD_PREFIX} ostree fsck --jobs=-1 --repo=./f2 2> fsck-error; then
+  assert_not_reached "fsck --jobs=-1 succeeded"
+fi
+assert_file_has_content fsck-error "Invalid number of jobs"
+echo "ok 7 fsck-jobs"
+
+# Incremental fsck only verifies objects that changed since the last run
+${CMD_PREFIX} ostree fsck --incremental --repo=./f2 > fsck
+assert_not_file_has_content fsck "^Skipping"
+test -f ./f2/state/fsck-ledger
+${CMD_PREFIX} ostree fsck --incremental --repo=./f2 > fsck
+assert_file_has_content fsck "^Skipping [1-9][0-9]* objects verified by a previous fsck"
+file=`find ./f2 |grep objects |grep \\.file |tail -1 `
+rm $file
+echo whoops > $file
+if ${CMD_PREFIX} ostree fsck --incremental --repo=./f2 > fsck 2> fsck-error; then
+  assert_not_reached "fsck did not fail"
+fi
+assert_file_has_content fsck-error "^error: In commits"
+${CMD_PREFIX} ostree fsck --delete --repo=./f2 > /dev/null 2>&1 || true
+${CMD_PREFIX} ostree --repo=./f2 pull-local ./f1 > /dev/null
+${CMD_PREFIX} ostree fsck --incremental --sample=100 --repo=./f2 > fsck
+assert_not_file_has_content fsck "^Skipping"
+echo "ok 8 fsck-incremental"
+
+# Objects with fs-verity are skipped while their digest is unchanged
+rm -f ./f2/state/fsck-ledger
+file=`find ./f2 |grep objects |grep \\.file |tail -1 `
+if ! ${CMD_PREFIX} ostree fsck --use-verity --repo=./f2 > fsck 2> err.txt; then
+  echo "ok 9 fsck-use-verity # SKIP $(cat err.txt)"
+elif ! fsverity enable $file 2> err.txt; then
+  echo "ok 9 fsck-use-verity # SKIP no fsverity support: $(cat err.txt)"
+else
+  ${CMD_PREFIX} ostree fsck --use-verity --repo=./f2 > fsck
+  assert_not_file_has_content fsck "^Skipping"
+  chmod a+r $file
+  ${CMD_PREFIX} ostree fsck --use-verity --repo=./f2 > fsck
+  assert_file_has_content fsck "^Skipping 1 objects verified by a previous fsck"
+  echo "ok 9 fsck-use-verity"
+fi
@@ -0,0 +1,114 @@
+#!/bin/bash
+#
+# Copyright (C) 2024 Red Hat, Inc.
+#
+# SPDX-License-Identifier: LGPL-2.0+
+#
+# This library is free software; you can redistribute it and/or
+# modify it under the terms of the GNU Lesser General Public
+# License as published by the Free Software Foundation; either
+# version 2 of the License, or (at your option) any later version.
+#
+# This library is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+# Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public
+# License along with this library. If not, see <https://www.gnu.org/licenses/>.
+
+set -euox pipefail
+
+. $(dirname $0)/libtest.sh
+
+# Every operation is done in both a repository using the index and one
+# which doesn't, and must give the same results in both.
+for r in repo repo-noindex; do
+    $CMD_PREFIX ostree --repo=${r} init --mode=archive
+done
+$CMD_PREFIX ostree config --repo=repo set core.object-index true
+$CMD_PREFIX ostree config --repo=repo-noindex set core.object-index false
+
+both() {
+    $CMD_PREFIX ostree --repo=repo "$@" > index.txt
+    $CMD_PREFIX ostree --repo=repo-noindex "$@" > noindex.txt
+    diff -u noindex.txt index.txt
+}
+
+# Commits skip the objects ostree_repo_has_object() says are present
+commit() {
+    both commit --table-output --timestamp="2024-01-01 00:00:00 +0000" "$@"
+}
+
+mkdir -p d/sub
+for i in $(seq 20); do echo ${i} > d/sub/${i}; done
+commit --tree=dir=d -b main
+both prune --refs-only
+assert_has_file repo/objects.index
+assert_has_file repo/objects.journal
+assert_not_has_file repo-noindex/objects.index
+tap_ok index written by prune
+
+# Objects written by later transactions are journaled
+for i in $(seq 20); do echo ${i}.2 > d/sub/${i}; done
+commit --tree=dir=d -b other
+assert_file_has_content index.txt "Content Written: 20$"
+both prune --refs-only --no-prune
+assert_file_has_content index.txt "No unreachable objects"
+both fsck
+# Committing the same content again finds every object
+commit --tree=dir=d -b other
+assert_file_has_content index.txt "Content Written: 0$"
+tap_ok commit journaled
+
+both refs --delete other
+both prune --refs-only
+assert_file_has_content index.txt "Deleted [1-9][0-9]* objects"
+both fsck
+both prune --refs-only --no-prune
+assert_file_has_content index.txt "No unreachable objects"
+tap_ok prune with index
+
+# Objects added or removed behind the index's back, including in
+# directories it considers clean, are still seen
+# Pick content whose object goes in a directory that already exists
+for i in $(seq 1000); do
+    echo outofband ${i} > d/sub/outofband
+    csum=$($CMD_PREFIX ostree checksum d/sub/outofband)
+    if test -d repo/objects/${csum:0:2}; then break; fi
+done
+prefix=${csum:0:2}
+obj=${prefix}/${csum:2}.filez
+assert_has_dir repo/objects/${prefix}
+$CMD_PREFIX ostree --repo=repo-outofband init --mode=archive
+$CMD_PREFIX ostree --repo=repo-outofband commit --tree=dir=d -b main
+assert_has_file repo-outofband/objects/${obj}
+assert_not_has_file repo/objects/${obj}
+for r in repo repo-noindex; do
+    cp repo-outofband/objects/${obj} ${r}/objects/${obj}
+done
+commit --tree=dir=d -b main
+assert_file_has_content index.txt "Content Written: 0$"
+both fsck
+both prune --refs-only
+
+fake=${prefix}/$(printf 'f%.0s' $(seq 62)).filez
+for r in repo repo-noindex; do
+    cp ${r}/objects/${obj} ${r}/objects/${fake}
+done
+both prune --refs-only --no-prune
+assert_file_has_content index.txt "Would delete: 1 objects"
+both prune --refs-only
+assert_file_has_content index.txt "Deleted 1 objects"
+both fsck
+
+both refs --delete main
+for r in repo repo-noindex; do
+    rm ${r}/objects/${obj}
+done
+both prune --refs-only
+both prune --refs-only --no-prune
+assert_file_has_content index.txt "Total objects: 0$"
+tap_ok index falls back to objects/
+
+tap_end
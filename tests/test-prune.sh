@@ -299,6 +299,30 @@ fi
 assert_file_has_content err.txt "Refspec.*BACON.*not found"
 tap_ok --only-branch=BACON
 
+# Test --retention, with commits in known days and weeks
+reinitialize_datesnap_repo
+now=$(date +%s)
+week=$(( (now - 100 * 86400) / 604800 * 604800 ))
+day=$(( (now - 10 * 86400) / 86400 * 86400 ))
+commits=()
+for ts in $((now - 500 * 86400)) $((week + 10)) $((week + 20)) $((day + 10)) $((day + 20)) \
+          $((now - 7200)) $((now - 3600)); do
+    commits+=($(${CMD_PREFIX} ostree --repo=repo commit --branch=retention -m test tree --timestamp="@$ts"))
+done
+assert_repo_has_n_commits repo 23
+if ${CMD_PREFIX} ostree --repo=repo prune --retention=7x 2>err.txt; then
+    fatal "pruned with an invalid --retention"
+fi
+assert_file_has_content err.txt "must end in h, d, w or y"
+# This keeps the two recent ones, the newest of the day and the newest of the week
+${CMD_PREFIX} ostree --repo=repo prune --only-branch=retention --retention=7d,30d/1d,1y/1w
+assert_repo_has_n_commits repo 20
+for i in 2 4 5 6; do
+    ${CMD_PREFIX} ostree --repo=repo show ${commits[$i]} > /dev/null
+done
+$OSTREE fsck
+tap_ok --retention
+
 # We will use the same principle as datesnap repo
 # to create a snapshot to test --commit-only
 rm -rf commit-only-test-repo
@@ -375,4 +399,58 @@ for i in {1..10}; do
 done
 tap_ok commit and prune together
 
+rm -rf repo
+ostree_repo_init repo --mode=archive
+echo 1 > tree/incremental
+${CMD_PREFIX} ostree --repo=repo commit --branch=a -m a tree
+echo 2 > tree/incremental
+${CMD_PREFIX} ostree --repo=repo commit --branch=b -m b tree
+${CMD_PREFIX} ostree --repo=repo prune --refs-only --incremental
+assert_has_file repo/state/prune-reachable
+incremental_obj_count=$(find repo/objects -name '*.*' | wc -l)
+# Objects of b were reachable at the last prune, so they're kept until a full one
+${CMD_PREFIX} ostree --repo=repo refs --delete b
+${CMD_PREFIX} ostree --repo=repo prune --refs-only --incremental | tee prune.txt
+assert_file_has_content prune.txt "No unreachable objects"
+# But new unreachable objects are deleted
+echo 3 > tree/incremental
+${CMD_PREFIX} ostree --repo=repo commit --orphan -m c tree
+${CMD_PREFIX} ostree --repo=repo prune --refs-only --incremental
+assert_streq "$(find repo/objects -name '*.*' | wc -l)" "${incremental_obj_count}"
+${CMD_PREFIX} ostree --repo=repo config set core.prune-full-interval 0
+${CMD_PREFIX} ostree --repo=repo prune --refs-only --incremental
+assert_repo_has_n_commits repo 1
+if ${CMD_PREFIX} ostree --repo=repo prune --incremental --only-branch=a 2>err.txt; then
+    fatal "pruned incrementally with --only-branch"
+fi
+assert_file_has_content err.txt "--incremental cannot be used"
+tap_ok --incremental
+
+# Enough objects to be spread over most of the objects/XX directories, which
+# are swept in parallel
+rm -rf repo tree
+ostree_repo_init repo --mode=archive
+mkdir -p tree/keep
+echo keep > tree/keep/file
+${CMD_PREFIX} ostree --repo=repo commit --branch=keep -m keep tree
+mkdir tree/many
+for i in $(seq 1000); do echo ${i} > tree/many/${i}; done
+${CMD_PREFIX} ostree --repo=repo commit --branch=many -m many tree
+n_dirs=$(find repo/objects -mindepth 1 -maxdepth 1 -type d | wc -l)
+if test ${n_dirs} -lt 200; then
+    fatal "only ${n_dirs} object directories"
+fi
+n_objects_orig=$(find repo/objects -name '*.*' | wc -l)
+${CMD_PREFIX} ostree --repo=repo refs --delete many
+${CMD_PREFIX} ostree --repo=repo prune --refs-only | tee prune.txt
+n_objects=$(find repo/objects -name '*.*' | wc -l)
+n_pruned=$((n_objects_orig - n_objects))
+# The commit, the two dirtrees containing many/ and its files
+assert_streq "${n_pruned}" 1003
+assert_file_has_content prune.txt "Total objects: ${n_objects_orig}"
+assert_file_has_content prune.txt "Deleted ${n_pruned} objects"
+assert_repo_has_n_commits repo 1
+${CMD_PREFIX} ostree --repo=repo fsck
+tap_ok prune objects spread over many directories
+
 tap_end
@@ -23,7 +23,7 @@ set -euo pipefail
 
 setup_fake_remote_repo1 "archive"
 
-echo '1..7'
+echo '1..8'
 
 cd ${test_tmpdir}
 mkdir repo
@@ -228,3 +228,39 @@ if ${CMD_PREFIX} ostree --repo=repo refs -A --create foobar nonexistent 2>err.tx
 fi
 assert_file_has_content_literal err.txt 'Cannot create alias to non-existent ref'
 echo "ok ref no broken alias"
+
+rm -rf repo2
+ostree_repo_init repo2
+${CMD_PREFIX} ostree --repo=repo2 commit --branch=packed/a -m test -s test tree
+${CMD_PREFIX} ostree --repo=repo2 commit --branch=packed/b -m test -s test tree
+${CMD_PREFIX} ostree --repo=repo2 commit --branch=origin:remote1 -m test -s test tree
+a_rev=$(${CMD_PREFIX} ostree --repo=repo2 rev-parse packed/a)
+${CMD_PREFIX} ostree --repo=repo2 refs --revision > refs-loose.txt
+${CMD_PREFIX} ostree --repo=repo2 refs --pack
+assert_not_has_dir repo2/refs/heads/packed
+assert_not_has_file repo2/refs/remotes/origin/remote1
+assert_file_has_content repo2/refs/packed-refs "^${a_rev} refs/heads/packed/a$"
+${CMD_PREFIX} ostree --repo=repo2 refs --revision > refs-packed.txt
+assert_files_equal refs-loose.txt refs-packed.txt
+${CMD_PREFIX} ostree --repo=repo2 refs packed | wc -l > refscount.packed
+assert_file_has_content refscount.packed "^2$"
+assert_ref repo2 packed/a ${a_rev}
+${CMD_PREFIX} ostree --repo=repo2 rev-parse origin:remote1 >/dev/null
+${CMD_PREFIX} ostree --repo=repo2 rev-parse remote1 >/dev/null
+# Loose refs take precedence over packed ones
+${CMD_PREFIX} ostree --repo=repo2 commit --branch=packed/a -m test2 -s test2 tree
+new_a_rev=$(${CMD_PREFIX} ostree --repo=repo2 rev-parse packed/a)
+assert_not_streq "${new_a_rev}" "${a_rev}"
+if ${CMD_PREFIX} ostree --repo=repo2 refs packed/a --create=packed/b/c 2>err.txt; then
+    fatal "Created ref under packed ref?"
+fi
+assert_file_has_content err.txt 'Conflict'
+${CMD_PREFIX} ostree --repo=repo2 refs --delete packed/b
+assert_not_file_has_content repo2/refs/packed-refs 'packed/b'
+if ${CMD_PREFIX} ostree --repo=repo2 rev-parse packed/b 2>/dev/null; then
+    fatal "Deleted packed ref still exists"
+fi
+${CMD_PREFIX} ostree --repo=repo2 refs --pack
+assert_file_has_content repo2/refs/packed-refs "^${new_a_rev} refs/heads/packed/a$"
+assert_not_has_file repo2/refs/heads/packed/a
+echo "ok packed refs"
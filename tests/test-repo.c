@@ -258,6 +258,61 @@ test_write_regfile_api (Fixture *fixture, gconstpointer test_data)
                    "23a2e97d21d960ac7a4e39a8721b1baff7b213e00e5e5641334f50506012fcff");
 }
 
+/* Test that the process-wide metadata cache is shared between #OstreeRepo
+ * instances for the same repository, and dropped when objects are deleted. */
+static void
+test_metadata_cache (Fixture *fixture, gconstpointer test_data)
+{
+  g_autoptr (GError) error = NULL;
+  g_autoptr (OstreeRepo) repo = ostree_repo_create_at (
+      fixture->tmpdir.fd, ".", OSTREE_REPO_MODE_ARCHIVE, NULL, NULL, &error);
+  g_assert_no_error (error);
+
+  g_autoptr (GVariant) dirmeta = g_variant_ref_sink (
+      g_variant_new ("(uuu@a(ayay))", 0, 0, GUINT32_TO_BE (S_IFDIR | 0755),
+                     g_variant_new_array (G_VARIANT_TYPE ("(ayay)"), NULL, 0)));
+  g_autofree guchar *csum = NULL;
+  ostree_repo_write_metadata (repo, OSTREE_OBJECT_TYPE_DIR_META, NULL, dirmeta, &csum, NULL,
+                             &error);
+  g_assert_no_error (error);
+  g_autofree char *checksum = ostree_checksum_from_bytes (csum);
+
+  ostree_repo_set_metadata_cache_max_size (1024 * 1024);
+
+  g_autoptr (OstreeRepo) repo2 = ostree_repo_open_at (fixture->tmpdir.fd, ".", NULL, &error);
+  g_assert_no_error (error);
+
+  g_autoptr (GVariant) stats = ostree_repo_get_metadata_cache_stats ();
+  guint64 hits_before = 0;
+  g_assert (g_variant_lookup (stats, "hits", "t", &hits_before));
+
+  for (guint i = 0; i < 2; i++)
+    {
+      g_autoptr (GVariant) loaded = NULL;
+      ostree_repo_load_variant (i == 0 ? repo : repo2, OSTREE_OBJECT_TYPE_DIR_META, checksum,
+                                &loaded, &error);
+      g_assert_no_error (error);
+      g_assert (g_variant_equal (loaded, dirmeta));
+    }
+
+  g_clear_pointer (&stats, g_variant_unref);
+  stats = ostree_repo_get_metadata_cache_stats ();
+  guint64 hits = 0, size = 0;
+  g_assert (g_variant_lookup (stats, "hits", "t", &hits));
+  g_assert (g_variant_lookup (stats, "size", "t", &size));
+  g_assert_cmpuint (hits, ==, hits_before + 1);
+  g_assert_cmpuint (size, >, 0);
+
+  ostree_repo_delete_object (repo, OSTREE_OBJECT_TYPE_DIR_META, checksum, NULL, &error);
+  g_assert_no_error (error);
+  g_autoptr (GVariant) loaded = NULL;
+  g_assert (!ostree_repo_load_variant (repo, OSTREE_OBJECT_TYPE_DIR_META, checksum, &loaded,
+                                      &error));
+  g_assert_error (error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND);
+
+  ostree_repo_set_metadata_cache_max_size (0);
+}
+
 /* Just a sanity check of the C autolocking API */
 static void
 test_repo_autolock (Fixture *fixture, gconstpointer test_data)
@@ -541,6 +596,543 @@ test_repo_lock_multi_thread (Fixture *fixture, gconstpointer test_data)
   g_thread_join (thread2);
 }
 
+static void
+count_reachable_commits (const char *checksum, OstreeObjectType objtype, gpointer user_data)
+{
+  guint *n_commits = user_data;
+  if (objtype == OSTREE_OBJECT_TYPE_COMMIT)
+    (*n_commits)++;
+}
+
+/* Check the compact reachable set against enough objects to force every
+ * shard to grow a few times.
+ */
+static void
+test_repo_reachable_set (Fixture *fixture, gconstpointer test_data)
+{
+  g_autoptr (OstreeRepoReachableSet) set = ostree_repo_reachable_set_new ();
+  const guint n_objects = 10000;
+
+  g_assert_cmpuint (ostree_repo_reachable_set_get_size (set), ==, 0);
+
+  for (guint i = 0; i < n_objects; i++)
+    {
+      g_autofree char *data = g_strdup_printf ("%u", i);
+      g_autofree char *checksum = g_compute_checksum_for_string (G_CHECKSUM_SHA256, data, -1);
+      g_assert_true (ostree_repo_reachable_set_add (set, checksum, OSTREE_OBJECT_TYPE_COMMIT));
+      g_assert_false (ostree_repo_reachable_set_add (set, checksum, OSTREE_OBJECT_TYPE_COMMIT));
+      g_assert_false (
+          ostree_repo_reachable_set_contains (set, checksum, OSTREE_OBJECT_TYPE_DIR_TREE));
+    }
+  g_assert_cmpuint (ostree_repo_reachable_set_get_size (set), ==, n_objects);
+
+  for (guint i = 0; i < n_objects; i++)
+    {
+      g_autofree char *data = g_strdup_printf ("%u", i);
+      g_autofree char *checksum = g_compute_checksum_for_string (G_CHECKSUM_SHA256, data, -1);
+      g_assert_true (ostree_repo_reachable_set_contains (set, checksum, OSTREE_OBJECT_TYPE_COMMIT));
+    }
+
+  guint n_commits = 0;
+  ostree_repo_reachable_set_foreach (set, count_reachable_commits, &n_commits);
+  g_assert_cmpuint (n_commits, ==, n_objects);
+}
+
+/* Fill @mtree with @n_files distinct files and, while @depth is non-zero,
+ * two subdirectories filled the same way. */
+static void
+fill_test_tree (OstreeRepo *repo, OstreeMutableTree *mtree, const char *dirmeta_checksum,
+                const char *prefix, guint depth, guint n_files)
+{
+  g_autoptr (GError) error = NULL;
+
+  ostree_mutable_tree_set_metadata_checksum (mtree, dirmeta_checksum);
+  for (guint i = 0; i < n_files; i++)
+    {
+      g_autofree char *name = g_strdup_printf ("file%u", i);
+      g_autofree char *contents = g_strdup_printf ("%s/%s\n", prefix, name);
+      g_autofree char *checksum = ostree_repo_write_regfile_inline (
+          repo, NULL, 0, 0, S_IFREG | 0644, NULL, (const guint8 *)contents, strlen (contents),
+          NULL, &error);
+      g_assert_no_error (error);
+      ostree_mutable_tree_replace_file (mtree, name, checksum, &error);
+      g_assert_no_error (error);
+    }
+
+  if (depth == 0)
+    return;
+
+  for (guint i = 0; i < 2; i++)
+    {
+      g_autofree char *name = g_strdup_printf ("dir%u", i);
+      g_autofree char *subprefix = g_strdup_printf ("%s/%s", prefix, name);
+      g_autoptr (OstreeMutableTree) subdir = NULL;
+      ostree_mutable_tree_ensure_dir (mtree, name, &subdir, &error);
+      g_assert_no_error (error);
+      fill_test_tree (repo, subdir, dirmeta_checksum, subprefix, depth - 1, n_files);
+    }
+}
+
+/* Write a commit of a tree generated by fill_test_tree(), returning its
+ * checksum. */
+static char *
+write_test_commit (OstreeRepo *repo, guint depth, guint n_files)
+{
+  g_autoptr (GError) error = NULL;
+
+  ostree_repo_prepare_transaction (repo, NULL, NULL, &error);
+  g_assert_no_error (error);
+
+  g_autoptr (GVariant) dirmeta = g_variant_ref_sink (
+      g_variant_new ("(uuu@a(ayay))", 0, 0, GUINT32_TO_BE (S_IFDIR | 0755),
+                     g_variant_new_array (G_VARIANT_TYPE ("(ayay)"), NULL, 0)));
+  g_autofree guchar *csum = NULL;
+  ostree_repo_write_metadata (repo, OSTREE_OBJECT_TYPE_DIR_META, NULL, dirmeta, &csum, NULL,
+                             &error);
+  g_assert_no_error (error);
+  g_autofree char *dirmeta_checksum = ostree_checksum_from_bytes (csum);
+
+  g_autoptr (OstreeMutableTree) mtree = ostree_mutable_tree_new ();
+  fill_test_tree (repo, mtree, dirmeta_checksum, "", depth, n_files);
+
+  g_autoptr (GFile) root = NULL;
+  ostree_repo_write_mtree (repo, mtree, &root, NULL, &error);
+  g_assert_no_error (error);
+  g_autofree char *checksum = NULL;
+  ostree_repo_write_commit (repo, NULL, "Test", NULL, NULL, OSTREE_REPO_FILE (root), &checksum,
+                            NULL, &error);
+  g_assert_no_error (error);
+
+  ostree_repo_commit_transaction (repo, NULL, NULL, &error);
+  g_assert_no_error (error);
+
+  return g_steal_pointer (&checksum);
+}
+
+/* Write a child commit of @parent which only adds a file to dir1,
+ * returning its checksum. */
+static char *
+write_test_child_commit (OstreeRepo *repo, const char *parent)
+{
+  g_autoptr (GError) error = NULL;
+
+  ostree_repo_prepare_transaction (repo, NULL, NULL, &error);
+  g_assert_no_error (error);
+
+  g_autoptr (OstreeMutableTree) mtree = ostree_mutable_tree_new_from_commit (repo, parent, &error);
+  g_assert_no_error (error);
+  g_autofree char *file_checksum = NULL;
+  ostree_mutable_tree_lookup (mtree, "file0", &file_checksum, NULL, &error);
+  g_assert_no_error (error);
+  g_autoptr (OstreeMutableTree) subdir = NULL;
+  ostree_mutable_tree_lookup (mtree, "dir1", NULL, &subdir, &error);
+  g_assert_no_error (error);
+  ostree_mutable_tree_replace_file (subdir, "new", file_checksum, &error);
+  g_assert_no_error (error);
+
+  g_autoptr (GFile) root = NULL;
+  ostree_repo_write_mtree (repo, mtree, &root, NULL, &error);
+  g_assert_no_error (error);
+  g_autofree char *checksum = NULL;
+  ostree_repo_write_commit (repo, parent, "Test", NULL, NULL, OSTREE_REPO_FILE (root), &checksum,
+                            NULL, &error);
+  g_assert_no_error (error);
+
+  ostree_repo_commit_transaction (repo, NULL, NULL, &error);
+  g_assert_no_error (error);
+
+  return g_steal_pointer (&checksum);
+}
+
+static void
+add_reachable (GHashTable *reachable, const char *checksum, OstreeObjectType objtype)
+{
+  g_hash_table_add (reachable,
+                    g_variant_ref_sink (ostree_object_name_serialize (checksum, objtype)));
+}
+
+/* Add the objects yielded by @iter to @reachable, recursing into each
+ * directory in turn on the calling thread. */
+static void
+traverse_iter_serial (OstreeRepo *repo, OstreeRepoCommitTraverseIter *iter,
+                      GHashTable *reachable)
+{
+  g_autoptr (GError) error = NULL;
+
+  while (TRUE)
+    {
+      OstreeRepoCommitIterResult res = ostree_repo_commit_traverse_iter_next (iter, NULL, &error);
+      g_assert_no_error (error);
+      if (res == OSTREE_REPO_COMMIT_ITER_RESULT_END)
+        break;
+      else if (res == OSTREE_REPO_COMMIT_ITER_RESULT_FILE)
+        {
+          char *name;
+          char *checksum;
+          ostree_repo_commit_traverse_iter_get_file (iter, &name, &checksum);
+          add_reachable (reachable, checksum, OSTREE_OBJECT_TYPE_FILE);
+        }
+      else if (res == OSTREE_REPO_COMMIT_ITER_RESULT_DIR)
+        {
+          char *name;
+          char *content_checksum;
+          char *meta_checksum;
+          ostree_repo_commit_traverse_iter_get_dir (iter, &name, &content_checksum,
+                                                    &meta_checksum);
+          add_reachable (reachable, meta_checksum, OSTREE_OBJECT_TYPE_DIR_META);
+          add_reachable (reachable, content_checksum, OSTREE_OBJECT_TYPE_DIR_TREE);
+
+          g_autoptr (GVariant) dirtree = NULL;
+          ostree_repo_load_variant (repo, OSTREE_OBJECT_TYPE_DIR_TREE, content_checksum,
+                                    &dirtree, &error);
+          g_assert_no_error (error);
+          ostree_cleanup_repo_commit_traverse_iter OstreeRepoCommitTraverseIter subiter = {
+            0,
+          };
+          ostree_repo_commit_traverse_iter_init_dirtree (
+              &subiter, repo, dirtree, OSTREE_REPO_COMMIT_TRAVERSE_FLAG_NONE, &error);
+          g_assert_no_error (error);
+          traverse_iter_serial (repo, &subiter, reachable);
+        }
+    }
+}
+
+/* Return the objects reachable from @checksum and its parents, walking
+ * one object at a time as a reference for the parallel traversal. */
+static GHashTable *
+traverse_commit_serial (OstreeRepo *repo, const char *checksum)
+{
+  g_autoptr (GError) error = NULL;
+  g_autoptr (GHashTable) reachable = ostree_repo_traverse_new_reachable ();
+  g_autofree char *next = g_strdup (checksum);
+
+  while (next != NULL)
+    {
+      g_autofree char *current = g_steal_pointer (&next);
+      g_autoptr (GVariant) commit = NULL;
+      ostree_repo_load_variant (repo, OSTREE_OBJECT_TYPE_COMMIT, current, &commit, &error);
+      g_assert_no_error (error);
+      add_reachable (reachable, current, OSTREE_OBJECT_TYPE_COMMIT);
+
+      ostree_cleanup_repo_commit_traverse_iter OstreeRepoCommitTraverseIter iter = {
+        0,
+      };
+      ostree_repo_commit_traverse_iter_init_commit (&iter, repo, commit,
+                                                    OSTREE_REPO_COMMIT_TRAVERSE_FLAG_NONE, &error);
+      g_assert_no_error (error);
+      traverse_iter_serial (repo, &iter, reachable);
+
+      next = ostree_commit_get_parent (commit);
+    }
+
+  return g_steal_pointer (&reachable);
+}
+
+/* Count the files in the subdirectories of @path, which is laid out like
+ * an objects directory. */
+static guint
+count_object_files (int dfd, const char *path)
+{
+  g_autoptr (GError) error = NULL;
+  g_auto (GLnxDirFdIterator) dfd_iter = {
+    0,
+  };
+  guint n_files = 0;
+
+  glnx_dirfd_iterator_init_at (dfd, path, FALSE, &dfd_iter, &error);
+  g_assert_no_error (error);
+  while (TRUE)
+    {
+      struct dirent *dent;
+      glnx_dirfd_iterator_next_dent_ensure_dtype (&dfd_iter, &dent, NULL, &error);
+      g_assert_no_error (error);
+      if (dent == NULL)
+        break;
+      if (dent->d_type != DT_DIR)
+        continue;
+
+      g_auto (GLnxDirFdIterator) child_dfd_iter = {
+        0,
+      };
+      glnx_dirfd_iterator_init_at (dfd_iter.fd, dent->d_name, FALSE, &child_dfd_iter, &error);
+      g_assert_no_error (error);
+      while (TRUE)
+        {
+          struct dirent *child_dent;
+          glnx_dirfd_iterator_next_dent (&child_dfd_iter, &child_dent, NULL, &error);
+          g_assert_no_error (error);
+          if (child_dent == NULL)
+            break;
+          n_files++;
+        }
+    }
+
+  return n_files;
+}
+
+/* Test that objects at the filesystem's limit on hardlinks are linked into
+ * checkouts through link anchors, and that unused anchors are deleted. */
+static void
+test_checkout_link_anchors (Fixture *fixture, gconstpointer test_data)
+{
+  g_autoptr (GError) error = NULL;
+  const guint n_files = 4;
+
+  /* Make every hardlink to an object fail with EMLINK */
+  g_setenv ("OSTREE_REPO_TEST_ERROR", "emlink", TRUE);
+  g_autoptr (OstreeRepo) repo = ostree_repo_create_at (
+      fixture->tmpdir.fd, "repo", OSTREE_REPO_MODE_BARE_USER_ONLY, NULL, NULL, &error);
+  g_unsetenv ("OSTREE_REPO_TEST_ERROR");
+  g_assert_no_error (error);
+
+  g_autofree char *commit = write_test_commit (repo, 0, n_files);
+
+  OstreeRepoCheckoutAtOptions opts = {
+    0,
+  };
+  opts.mode = OSTREE_REPO_CHECKOUT_MODE_USER;
+  opts.no_copy_fallback = TRUE;
+  ostree_repo_checkout_at (repo, &opts, fixture->tmpdir.fd, "checkout0", commit, NULL, &error);
+  g_assert_no_error (error);
+  ostree_repo_checkout_at (repo, &opts, fixture->tmpdir.fd, "checkout1", commit, NULL, &error);
+  g_assert_no_error (error);
+
+  g_autoptr (GVariant) stats = ostree_repo_get_checkout_stats (repo);
+  guint64 n_anchored = 0, n_created = 0;
+  g_assert (g_variant_lookup (stats, "hardlinks-anchored", "t", &n_anchored));
+  g_assert (g_variant_lookup (stats, "link-anchors-created", "t", &n_created));
+  g_assert_cmpuint (n_anchored, ==, 2 * n_files);
+  g_assert_cmpuint (n_created, ==, n_files);
+  g_assert_cmpuint (count_object_files (fixture->tmpdir.fd, "repo/link-anchors"), ==, n_files);
+
+  /* Both checkouts share the anchor, not the object */
+  struct stat stbuf;
+  glnx_fstatat (fixture->tmpdir.fd, "checkout0/file0", &stbuf, AT_SYMLINK_NOFOLLOW, &error);
+  g_assert_no_error (error);
+  g_assert_cmpuint (stbuf.st_nlink, ==, 3);
+
+  /* Anchors are only deleted once no checkout uses them */
+  glnx_shutil_rm_rf_at (fixture->tmpdir.fd, "checkout0", NULL, &error);
+  g_assert_no_error (error);
+  ostree_repo_checkout_gc (repo, NULL, &error);
+  g_assert_no_error (error);
+  g_assert_cmpuint (count_object_files (fixture->tmpdir.fd, "repo/link-anchors"), ==, n_files);
+
+  glnx_shutil_rm_rf_at (fixture->tmpdir.fd, "checkout1", NULL, &error);
+  g_assert_no_error (error);
+  ostree_repo_checkout_gc (repo, NULL, &error);
+  g_assert_no_error (error);
+  g_assert_cmpuint (count_object_files (fixture->tmpdir.fd, "repo/link-anchors"), ==, 0);
+}
+
+/* Look up the counter @key in the checkout statistics of @repo. */
+static guint64
+get_checkout_stat (OstreeRepo *repo, const char *key)
+{
+  g_autoptr (GVariant) stats = ostree_repo_get_checkout_stats (repo);
+  guint64 value = 0;
+  g_assert (g_variant_lookup (stats, key, "t", &value));
+  return value;
+}
+
+/* Test that files which can't be hardlinked are counted as cloned or
+ * copied, depending on whether the filesystem supports reflinks. */
+static void
+test_checkout_copy_stats (Fixture *fixture, gconstpointer test_data)
+{
+  g_autoptr (GError) error = NULL;
+  const guint n_files = 8;
+
+  g_autoptr (OstreeRepo) repo = ostree_repo_create_at (
+      fixture->tmpdir.fd, "repo", OSTREE_REPO_MODE_BARE_USER_ONLY, NULL, NULL, &error);
+  g_assert_no_error (error);
+  g_autofree char *commit = write_test_commit (repo, 1, n_files);
+  const guint n_commit_files = 3 * n_files;
+
+  /* Object data is read from a file descriptor, so FICLONE is tried first */
+  OstreeRepoCheckoutAtOptions opts = {
+    0,
+  };
+  opts.mode = OSTREE_REPO_CHECKOUT_MODE_USER;
+  opts.force_copy = TRUE;
+  ostree_repo_checkout_at (repo, &opts, fixture->tmpdir.fd, "checkout0", commit, NULL, &error);
+  g_assert_no_error (error);
+  g_assert_cmpuint (get_checkout_stat (repo, "files-cloned")
+                        + get_checkout_stat (repo, "files-copied"),
+                    ==, n_commit_files);
+  g_assert_cmpuint (get_checkout_stat (repo, "hardlinks-anchored"), ==, 0);
+
+  /* Archive objects have to be decompressed, so they're always copied */
+  g_autoptr (OstreeRepo) archive_repo = ostree_repo_create_at (
+      fixture->tmpdir.fd, "archive-repo", OSTREE_REPO_MODE_ARCHIVE, NULL, NULL, &error);
+  g_assert_no_error (error);
+  g_autofree char *archive_commit = write_test_commit (archive_repo, 1, n_files);
+  ostree_repo_checkout_at (archive_repo, &opts, fixture->tmpdir.fd, "checkout1", archive_commit,
+                           NULL, &error);
+  g_assert_no_error (error);
+  ostree_repo_checkout_at (archive_repo, &opts, fixture->tmpdir.fd, "checkout2", archive_commit,
+                           NULL, &error);
+  g_assert_no_error (error);
+  g_assert_cmpuint (get_checkout_stat (archive_repo, "files-cloned"), ==, 0);
+  g_assert_cmpuint (get_checkout_stat (archive_repo, "files-copied"), ==, 2 * n_commit_files);
+}
+
+/* Assert that @set holds exactly the objects in @expected. */
+static void
+assert_reachable_set_equal (OstreeRepoReachableSet *set, GHashTable *expected)
+{
+  g_assert_cmpuint (ostree_repo_reachable_set_get_size (set), ==, g_hash_table_size (expected));
+  GLNX_HASH_TABLE_FOREACH (expected, GVariant *, object)
+    {
+      const char *checksum;
+      OstreeObjectType objtype;
+      ostree_object_name_deserialize (object, &checksum, &objtype);
+      g_assert_true (ostree_repo_reachable_set_contains (set, checksum, objtype));
+    }
+}
+
+/* Test that the parallel traversal finds the same objects as a serial walk
+ * of a commit with several levels of directories and a parent. */
+static void
+test_traverse_parallel (Fixture *fixture, gconstpointer test_data)
+{
+  g_autoptr (GError) error = NULL;
+  g_autoptr (OstreeRepo) repo = ostree_repo_create_at (
+      fixture->tmpdir.fd, "repo", OSTREE_REPO_MODE_ARCHIVE, NULL, NULL, &error);
+  g_assert_no_error (error);
+
+  g_autofree char *parent = write_test_commit (repo, 4, 3);
+  g_autofree char *commit = write_test_child_commit (repo, parent);
+  g_autoptr (GHashTable) expected = traverse_commit_serial (repo, commit);
+
+  g_autoptr (GHashTable) reachable = NULL;
+  ostree_repo_traverse_commit (repo, commit, -1, &reachable, NULL, &error);
+  g_assert_no_error (error);
+  g_assert_cmpuint (g_hash_table_size (reachable), ==, g_hash_table_size (expected));
+  GLNX_HASH_TABLE_FOREACH (expected, GVariant *, object)
+    g_assert_true (g_hash_table_contains (reachable, object));
+
+  const char *commits[] = { commit, NULL };
+  g_autoptr (OstreeRepoReachableSet) set = ostree_repo_reachable_set_new ();
+  ostree_repo_traverse_commits_to_set (repo, OSTREE_REPO_COMMIT_TRAVERSE_FLAG_NONE, commits, -1,
+                                       set, NULL, &error);
+  g_assert_no_error (error);
+  assert_reachable_set_equal (set, expected);
+
+  /* Without history only the child is traversed; adding the parent's
+   * objects afterwards must give the same set. */
+  const char *parents[] = { parent, NULL };
+  g_autoptr (OstreeRepoReachableSet) partial_set = ostree_repo_reachable_set_new ();
+  ostree_repo_traverse_commits_to_set (repo, OSTREE_REPO_COMMIT_TRAVERSE_FLAG_NONE, commits, 0,
+                                       partial_set, NULL, &error);
+  g_assert_no_error (error);
+  g_assert_false (
+      ostree_repo_reachable_set_contains (partial_set, parent, OSTREE_OBJECT_TYPE_COMMIT));
+  ostree_repo_traverse_commits_to_set (repo, OSTREE_REPO_COMMIT_TRAVERSE_FLAG_NONE, parents, -1,
+                                       partial_set, NULL, &error);
+  g_assert_no_error (error);
+  assert_reachable_set_equal (partial_set, expected);
+}
+
+/* Test that a missing dirtree fails the traversal, unless the commit is
+ * partial and missing directories are expected. */
+static void
+test_traverse_missing_dirtree (Fixture *fixture, gconstpointer test_data)
+{
+  g_autoptr (GError) error = NULL;
+  g_autoptr (OstreeRepo) repo = ostree_repo_create_at (
+      fixture->tmpdir.fd, "repo", OSTREE_REPO_MODE_ARCHIVE, NULL, NULL, &error);
+  g_assert_no_error (error);
+
+  g_autofree char *commit = write_test_commit (repo, 3, 2);
+  g_autoptr (GHashTable) expected = traverse_commit_serial (repo, commit);
+
+  g_autoptr (GFile) root = NULL;
+  ostree_repo_read_commit (repo, commit, &root, NULL, NULL, &error);
+  g_assert_no_error (error);
+  g_autoptr (GFile) subdir = g_file_resolve_relative_path (root, "dir0/dir1");
+  ostree_repo_file_ensure_resolved (OSTREE_REPO_FILE (subdir), &error);
+  g_assert_no_error (error);
+  const char *subdir_checksum
+      = ostree_repo_file_tree_get_contents_checksum (OSTREE_REPO_FILE (subdir));
+  ostree_repo_delete_object (repo, OSTREE_OBJECT_TYPE_DIR_TREE, subdir_checksum, NULL, &error);
+  g_assert_no_error (error);
+
+  const char *commits[] = { commit, NULL };
+  g_autoptr (OstreeRepoReachableSet) set = ostree_repo_reachable_set_new ();
+  g_assert_false (ostree_repo_traverse_commits_to_set (
+      repo, OSTREE_REPO_COMMIT_TRAVERSE_FLAG_NONE, commits, -1, set, NULL, &error));
+  g_assert_error (error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND);
+  g_clear_error (&error);
+
+  g_autoptr (GHashTable) reachable = NULL;
+  g_assert_false (ostree_repo_traverse_commit (repo, commit, -1, &reachable, NULL, &error));
+  g_assert_error (error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND);
+  g_clear_error (&error);
+
+  ostree_repo_mark_commit_partial (repo, commit, TRUE, &error);
+  g_assert_no_error (error);
+  g_autoptr (OstreeRepoReachableSet) partial_set = ostree_repo_reachable_set_new ();
+  ostree_repo_traverse_commits_to_set (repo, OSTREE_REPO_COMMIT_TRAVERSE_FLAG_NONE, commits, -1,
+                                       partial_set, NULL, &error);
+  g_assert_no_error (error);
+  /* The files under the missing directory can't have been found */
+  g_assert_cmpuint (ostree_repo_reachable_set_get_size (partial_set), <,
+                    g_hash_table_size (expected));
+  g_assert_true (
+      ostree_repo_reachable_set_contains (partial_set, commit, OSTREE_OBJECT_TYPE_COMMIT));
+}
+
+#ifdef HAVE_COMPOSEFS
+/* Generate a composefs image of @commit, returning the checksum of the image */
+static char *
+composefs_image_checksum (OstreeRepo *repo, int dfd, const char *commit, gboolean reuse_dirs)
+{
+  g_autoptr (GError) error = NULL;
+  g_auto (GVariantBuilder) builder = G_VARIANT_BUILDER_INIT (G_VARIANT_TYPE_VARDICT);
+  g_variant_builder_add (&builder, "{sv}", "verity", g_variant_new_uint32 (2));
+  g_variant_builder_add (&builder, "{sv}", "reuse-dirs", g_variant_new_boolean (reuse_dirs));
+  g_autoptr (GVariant) options = g_variant_ref_sink (g_variant_builder_end (&builder));
+
+  ostree_repo_checkout_composefs (repo, options, dfd, "image.cfs", commit, NULL, &error);
+  g_assert_no_error (error);
+
+  glnx_autofd int fd = -1;
+  glnx_openat_rdonly (dfd, "image.cfs", TRUE, &fd, &error);
+  g_assert_no_error (error);
+  g_autoptr (GBytes) contents = glnx_fd_readall_bytes (fd, NULL, &error);
+  g_assert_no_error (error);
+  return g_compute_checksum_for_bytes (G_CHECKSUM_SHA256, contents);
+}
+
+/* Test that composefs images generated by copying the unchanged directories
+ * of the previous image are the same as those generated from scratch. */
+static void
+test_checkout_composefs_reuse_dirs (Fixture *fixture, gconstpointer test_data)
+{
+  g_autoptr (GError) error = NULL;
+  g_autoptr (OstreeRepo) repo = ostree_repo_create_at (
+      fixture->tmpdir.fd, "repo", OSTREE_REPO_MODE_ARCHIVE, NULL, NULL, &error);
+  g_assert_no_error (error);
+
+  g_autofree char *commit1 = write_test_commit (repo, 3, 2);
+  g_autofree char *commit2 = write_test_child_commit (repo, commit1);
+
+  /* A checkout without reuse-dirs drops the cache, so do those first */
+  const char *commits[] = { commit1, commit2, commit1 };
+  g_autoptr (GPtrArray) expected = g_ptr_array_new_with_free_func (g_free);
+  for (guint i = 0; i < G_N_ELEMENTS (commits); i++)
+    g_ptr_array_add (expected,
+                     composefs_image_checksum (repo, fixture->tmpdir.fd, commits[i], FALSE));
+  for (guint i = 0; i < G_N_ELEMENTS (commits); i++)
+    {
+      g_autofree char *actual
+          = composefs_image_checksum (repo, fixture->tmpdir.fd, commits[i], TRUE);
+      g_assert_cmpstr (actual, ==, expected->pdata[i]);
+    }
+}
+#endif
+
 int
 main (int argc, char **argv)
 {
@@ -553,7 +1145,20 @@ main (int argc, char **argv)
   g_test_add ("/repo/get_min_free_space", Fixture, NULL, setup, test_repo_get_min_free_space,
               teardown);
   g_test_add ("/repo/write_regfile_api", Fixture, NULL, setup, test_write_regfile_api, teardown);
+  g_test_add ("/repo/metadata_cache", Fixture, NULL, setup, test_metadata_cache, teardown);
   g_test_add ("/repo/autolock", Fixture, NULL, setup, test_repo_autolock, teardown);
+  g_test_add ("/repo/reachable_set", Fixture, NULL, setup, test_repo_reachable_set, teardown);
+  g_test_add ("/repo/checkout/copy_stats", Fixture, NULL, setup, test_checkout_copy_stats,
+              teardown);
+  g_test_add ("/repo/traverse/parallel", Fixture, NULL, setup, test_traverse_parallel, teardown);
+  g_test_add ("/repo/traverse/missing_dirtree", Fixture, NULL, setup,
+              test_traverse_missing_dirtree, teardown);
+  g_test_add ("/repo/checkout/link_anchors", Fixture, NULL, setup, test_checkout_link_anchors,
+              teardown);
+#ifdef HAVE_COMPOSEFS
+  g_test_add ("/repo/checkout/composefs_reuse_dirs", Fixture, NULL, setup,
+              test_checkout_composefs_reuse_dirs, teardown);
+#endif
   g_test_add ("/repo/lock/single", Fixture, NULL, lock_setup, test_repo_lock_single, teardown);
   g_test_add ("/repo/lock/unlock-never-locked", Fixture, NULL, lock_setup,
               test_repo_lock_unlock_never_locked, teardown);